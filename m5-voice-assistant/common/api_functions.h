@@ -1,7 +1,8 @@
 #ifndef API_FUNCTIONS_H
 #define API_FUNCTIONS_H
 
-// Pure declarations only - no includes to avoid conflicts
+// Pure declarations only - no includes to avoid conflicts. Defined in
+// assistant.h, the camera functions in the board's camera.h and image_upload.h
 // MP3DecoderHelix types used in main .ino file
 
 // External references
@@ -11,18 +12,9 @@ extern int actualRecordedSamples;
 extern bool isLargeDevice;
 extern String systemPrompt;
 
-// TTS audio output buffer and state
-extern int16_t* ttsOutputBuffer;
-extern size_t ttsOutputSize;
-extern size_t ttsOutputIndex;
-extern int ttsSampleRate;
-extern int ttsChannels;
-
-// Last played TTS for replay
-extern int16_t* lastTtsBuffer;
-extern size_t lastTtsLength;
-extern int lastTtsSampleRate;
-extern int lastTtsChannels;
+// Last played TTS (MP3) for replay
+extern uint8_t* lastTtsMp3;
+extern size_t lastTtsMp3Length;
 
 // Current TTS voice
 extern bool useTtsVoice1;
@@ -0,0 +1,1051 @@
+#ifndef ASSISTANT_H
+#define ASSISTANT_H
+
+// Dependencies: interaction.h, api_functions.h and everything they need (the
+// board's camera.h and image_upload.h where there is a camera) must be
+// included before this file
+//
+// The question flow shared by every board: speech out (speakText, replay),
+// transcription, the OpenWebUI chat calls and the LLM requests. The sketches
+// keep only their own I/O - setup(), loop(), buttons or touch, and how
+// interaction events are drawn. Board differences come from device_config.h:
+//   TTS_SPEAKER          speaker object (CoreS3.Speaker on the CoreS3)
+//   VISION_INLINE_IMAGE  photo questions send the JPEG as base64 in the LLM
+//                        request and save it to the chat with a files entry
+//                        (CoreS3); otherwise they reference the uploaded file
+
+// Text-to-Speech - speak the response on Core2/CoreS3
+void speakText(const String &text) {
+  if (!USE_TTS || !isLargeDevice) {
+    Serial.println("TTS disabled or not a large device");
+    return;
+  }
+
+  // Sentences already streamed to the TTS pipeline - speak the rest and wait
+  if (ttsPipelineActive()) {
+    ttsPipelineFinish(text);
+    return;
+  }
+  
+  Serial.println("\n========== TEXT-TO-SPEECH ==========");
+  Serial.printf("Speaking: %s\n", text.c_str());
+  
+  // Build JSON request - OpenWebUI always returns MP3 regardless of format
+  const char* currentVoice = useTtsVoice1 ? TTS_VOICE_1 : TTS_VOICE_2;
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"model\":").quoted(TTS_MODEL)
+     .add(",\"input\":").quoted(text)
+     .add(",\"voice\":").quoted(currentVoice).add('}');
+  });
+  if (!built) {
+    Serial.println("ERROR: No memory for the TTS request");
+    return;
+  }
+  
+  String ttsUrl = String(OWUI_BASE_URL) + "/api/v1/audio/speech";
+  Serial.printf("TTS URL: %s\n", ttsUrl.c_str());
+  
+  HTTPClient &http = httpPoolBegin(ttsUrl);
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.addHeader("Content-Type", "application/json");
+  http.setTimeout(30000);
+  
+  Serial.println("Requesting TTS...");
+  int httpCode = httpPoolSend(http, "POST", body.c_str(), body.length());
+  Serial.printf("HTTP response code: %d\n", httpCode);
+  
+  if (httpCode == 200) {
+    int contentLength = http.getSize();
+    Serial.printf("MP3 size: %d bytes\n", contentLength);
+    
+    // Reinitialize speaker for each playback
+    mp3StreamClearReplay();
+    TTS_SPEAKER.end();
+    delay(50);
+    TTS_SPEAKER.begin();
+    TTS_SPEAKER.setVolume(200);
+    
+    // Decode and play while downloading - the player returns http to the pool
+    unsigned long playStart = millis();
+    if (mp3StreamStart(http, contentLength, true)) {
+      mp3StreamWait();
+      Serial.printf("TTS playback complete (%lums)\n", millis() - playStart);
+    } else {
+      Serial.println("ERROR: Could not start MP3 stream");
+    }
+    
+    // Release speaker
+    TTS_SPEAKER.end();
+  } else {
+    Serial.println("ERROR: TTS request failed");
+    Serial.println(http.getString());
+    httpPoolEnd(http);
+  }
+  
+  Serial.println("=====================================\n");
+}
+
+// Replay last TTS audio (called on button C press)
+void replayTts() {
+  if (!lastTtsMp3 || lastTtsMp3Length == 0) {
+    Serial.println("No TTS audio to replay");
+    return;
+  }
+  
+  Serial.println("\n========== REPLAY TTS ==========");
+  Serial.printf("Replaying %d bytes of MP3\n", lastTtsMp3Length);
+  
+  // Initialize speaker
+  TTS_SPEAKER.end();
+  delay(50);
+  TTS_SPEAKER.begin();
+  TTS_SPEAKER.setVolume(200);
+  
+  if (mp3StreamStartBuffer(lastTtsMp3, lastTtsMp3Length)) {
+    mp3StreamWait();
+  }
+  
+  TTS_SPEAKER.end();
+  Serial.println("Replay complete");
+  Serial.println("=================================\n");
+}
+
+// Utility functions
+String generateUUID() {
+  String uuid = "";
+  const char* hex = "0123456789abcdef";
+  
+  for (int i = 0; i < 36; i++) {
+    if (i == 8 || i == 13 || i == 18 || i == 23) {
+      uuid += '-';
+    } else if (i == 14) {
+      uuid += '4';
+    } else if (i == 19) {
+      uuid += hex[(esp_random() & 0x3) | 0x8];
+    } else {
+      uuid += hex[esp_random() & 0xF];
+    }
+  }
+  
+  return uuid;
+}
+
+unsigned long getUnixTimestamp() {
+  time_t now;
+  time(&now);
+  return (unsigned long)now;
+}
+
+unsigned long long getUnixTimestampMs() {
+  return (unsigned long long)getUnixTimestamp() * 1000;
+}
+
+// Display and audio functions now in display.h and audio.h
+
+String transcribeAudio() {
+  Serial.println("\n========== TRANSCRIBING ==========");
+
+  // Encoded while recording (audio_codec.h)
+  int audioDataSize = audioCodecBytes;
+  uint8_t wavHeader[AUDIO_CODEC_HEADER_MAX];
+  int wavHeaderSize = audioCodecHeader(wavHeader, audioDataSize);
+
+  String boundary = "----ESP32Boundary";
+
+  // Both OpenAI and OpenWebUI return {"text": "..."} - parsed as the response arrives
+  JsonStream json;
+  String result;
+  json.capture("text", result);
+  bool haveResponse = false;
+
+  // Audio already uploaded while recording - just collect the result
+  if (sttStreamActive) {
+    Serial.println("Using streamed upload");
+    String streamed = sttStreamFinish();
+    if (streamed.length() > 0) {
+      json.write((const uint8_t *)streamed.c_str(), streamed.length());
+      haveResponse = true;
+    } else {
+      Serial.println("Falling back to buffered upload");
+    }
+  }
+
+  if (haveResponse) {
+    // Streamed upload succeeded
+  } else if (USE_OWUI_STT) {
+    // Use OpenWebUI's transcription endpoint via HTTPClient
+    Serial.println("Using OpenWebUI STT endpoint");
+    
+    String sttUrl = String(OWUI_BASE_URL) + "/api/v1/audio/transcriptions";
+    Serial.printf("STT URL: %s\n", sttUrl.c_str());
+    
+    HTTPClient &http = httpPoolBegin(sttUrl);
+    http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+    http.setTimeout(60000);
+    
+    // Multipart body streams straight from the encoded audio - no full-body copy
+    MultipartStream body(boundary.c_str());
+    body.addFile("file", "audio.wav", "audio/wav",
+                 audioCodecData(), audioDataSize, wavHeader, wavHeaderSize);
+    
+    int contentLength = body.contentLength();
+    Serial.printf("Content length: %d bytes (audio: %d bytes %s)\n", contentLength, audioDataSize, audioCodecName());
+    
+    http.addHeader("Content-Type", body.contentType());
+    
+    Serial.println("Sending audio to OpenWebUI...");
+    int httpCode = httpPoolSend(http, "POST", body);
+    
+    Serial.printf("HTTP response code: %d\n", httpCode);
+    
+    if (httpCode == 200) {
+      jsonStreamHttp(http, json);
+    } else {
+      Serial.println("ERROR: STT request failed");
+      Serial.println(http.getString());
+      httpPoolEnd(http);
+      return "STT failed";
+    }
+    httpPoolEnd(http);
+    
+  } else {
+    // Use OpenAI Whisper endpoint via raw socket (original implementation)
+    Serial.println("Using OpenAI Whisper endpoint");
+    
+    TlsClient client;
+    client.setInsecure();
+    client.setTimeout(60);
+
+    Serial.printf("Connecting to %s:%d...\n", STT_HOST, STT_PORT);
+    if (!client.connect(STT_HOST, STT_PORT)) {
+      Serial.println("ERROR: Connection failed!");
+      return "Connection failed";
+    }
+    Serial.println("Connected");
+
+    MultipartStream body(boundary.c_str());
+    body.addFile("file", "audio.wav", "audio/wav",
+                 audioCodecData(), audioDataSize, wavHeader, wavHeaderSize);
+    body.addField("model", STT_MODEL);
+
+    int contentLength = body.contentLength();
+    Serial.printf("Content length: %d bytes (audio: %d bytes %s)\n", contentLength,
+                  audioDataSize, audioCodecName());
+
+    Serial.println("Sending request headers...");
+    client.print(String("POST ") + STT_PATH + " HTTP/1.1\r\n");
+    client.print(String("Host: ") + STT_HOST + "\r\n");
+    client.print("Authorization: Bearer " + String(STT_API_KEY) + "\r\n");
+    client.print("Content-Type: " + body.contentType() + "\r\n");
+    client.print("Content-Length: " + String(contentLength) + "\r\n");
+    client.print("Connection: close\r\n\r\n");
+
+    // Send in chunks to avoid watchdog and network buffer issues
+    Serial.println("Sending audio data...");
+    if (!body.writeTo(client)) {
+      return "Connection lost";
+    }
+
+    Serial.println("Request sent, waiting for response...");
+
+    unsigned long timeout = millis();
+    while (!client.available()) {
+      if (millis() - timeout > 60000) {
+        Serial.println("ERROR: Timeout waiting for response!");
+        client.stop();
+        return "Timeout";
+      }
+      delay(100);
+    }
+
+    Serial.println("Response received, reading headers...");
+    bool chunked = false;
+    while (client.connected()) {
+      String line = client.readStringUntil('\n');
+      Serial.println("  " + line);
+      if (line == "\r")
+        break;
+      line.toLowerCase();
+      if (line.startsWith("transfer-encoding:") && line.indexOf("chunked") >= 0) chunked = true;
+    }
+
+    jsonStreamRead(client, json, chunked, 60000);
+    client.stop();
+  }
+
+  if (!json.done()) {
+    Serial.println("ERROR: Parse error!");
+    return "Parse error";
+  }
+  if (result.length() == 0) {
+    Serial.println("ERROR: No 'text' field in response!");
+    return "No transcription";
+  }
+
+  Serial.println("Transcription: " + result);
+  Serial.println("==================================\n");
+
+  return result;
+}
+
+String createChatSession(const String &title) {
+  Serial.println("\n========== CREATE CHAT SESSION ==========");
+  
+  // OpenWebUI /api/v1/chats/new body format with history and timestamp
+  unsigned long long timestamp = getUnixTimestampMs(); // Milliseconds for chat creation
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"chat\":{\"title\":").quoted(title)
+     .add(",\"models\":[").quoted(LLM_MODEL)
+     .add("],\"timestamp\":").num((unsigned long)timestamp)
+     .add(",\"history\":{\"messages\":{},\"currentId\":null}}}");
+  });
+  if (!built) {
+    Serial.println("ERROR: No memory for the request body");
+    return "";
+  }
+  
+  String url = String(OWUI_BASE_URL) + "/api/v1/chats/new";
+  Serial.printf("Creating chat at: %s\n", url.c_str());
+  
+  HTTPClient &http = httpPoolBegin(url);
+  http.addHeader("Content-Type", "application/json");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.setTimeout(30000);
+  
+  strLogBody("Request body", body);
+  int httpCode = httpPoolSend(http, "POST", body.c_str(), body.length());
+  Serial.printf("HTTP response code: %d\n", httpCode);
+  
+  if (httpCode < 200 || httpCode >= 300) {
+    Serial.println("ERROR: Non-2xx response code");
+    Serial.println(http.getString());
+    httpPoolEnd(http);
+    return "";
+  }
+  
+  // Parse chat ID from response as it arrives
+  JsonStream json;
+  String chatId, altId;
+  long version = 0;
+  json.capture("id", chatId);
+  json.capture("chat_id", altId);
+  json.capture("chatId", altId);
+  json.onEvent(chatVersionField, &version);
+  jsonStreamHttp(http, json);
+  httpPoolEnd(http);
+  Serial.printf("Response length: %d bytes\n", json.bytesParsed());
+  
+  if (chatId.length() == 0 && altId.length() > 0) {
+    Serial.println("Found alternative ID field");
+    chatId = altId;
+  }
+  if (chatId.length() == 0) {
+    Serial.println("ERROR: Could not find any ID field in response!");
+    return "";
+  }
+  
+  Serial.println("Chat ID: " + chatId);
+  Serial.printf("Chat ID length: %d\n", chatId.length());
+  
+  // New chat: the local tree starts empty at the version the server returned
+  chatTreeReset(chatId, version);
+  Serial.println("=========================================\n");
+  
+  return chatId;
+}
+
+// Step 3: Update chat with user message
+bool updateChatWithUserMessage(const String &chatId, const String &userMsgId, const String &userContent) {
+  Serial.println("\n========== UPDATE CHAT WITH USER MESSAGE ==========");
+  
+  String url = String(OWUI_BASE_URL) + "/api/v1/chats/" + chatId;
+  
+  // Queued saves of the previous turn are replaced by this write
+  chatPersistSupersede(chatId);
+  
+  // Local chat tree; only refetched if the chat changed on the server
+  int syncCode = chatTreeSync(chatId, true);
+  
+  if (syncCode == 401 || syncCode == 404) {
+    Serial.println("Chat session no longer exists (deleted or invalid)");
+    Serial.println("===================================================\n");
+    chatTreeInvalidate();
+    currentChatId = "";
+    return false;
+  }
+  
+  if (syncCode != 200) {
+    Serial.printf("ERROR: Failed to fetch chat (HTTP %d)\n", syncCode);
+    Serial.println("===================================================\n");
+    return false;
+  }
+  
+  String previousMsgId = chatTree.currentId;
+  
+  Serial.printf("Previous message ID: %s\n", previousMsgId.length() > 0 ? previousMsgId.c_str() : "none (new chat)");
+  Serial.printf("Existing messages length: %d\n", chatTree.messages.length());
+  
+  // Link the new message under the previous one
+  unsigned long timestamp = getUnixTimestamp();
+  chatTreeAdd(userMsgId, previousMsgId, "user", userContent,
+              "\"timestamp\":" + String(timestamp) + ","
+              "\"models\":[\"" + String(LLM_MODEL) + "\"]");
+  
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"chat\":{\"title\":\"M5 Voice Assistant\",\"history\":");
+    chatTreeHistoryJson(b);
+    b.add(",\"messages\":[{\"id\":").quoted(userMsgId)
+     .add(",\"role\":\"user\",\"content\":").quoted(userContent)
+     .add("}]}}");
+  });
+  if (!built) {
+    Serial.println("ERROR: No memory for the request body");
+    Serial.println("===================================================\n");
+    return false;
+  }
+  
+  Serial.printf("Updating chat at: %s\n", url.c_str());
+  
+  HTTPClient &http = httpPoolBegin(url);
+  http.addHeader("Content-Type", "application/json");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.setTimeout(30000);
+  
+  Serial.println("Updating with user message...");
+  int httpCode = httpPoolSend(http, "POST", body.c_str(), body.length());
+  Serial.printf("HTTP response code: %d\n", httpCode);
+  
+  if (httpCode >= 200 && httpCode < 300) {
+    chatTreeNoteWrite(http);
+    httpPoolEnd(http);
+    Serial.println("User message saved successfully");
+    Serial.println("===================================================\n");
+    return true;
+  }
+  
+  // The local message stays in the tree and goes out with the next write
+  String resp = http.getString();
+  httpPoolEnd(http);
+  
+  if (httpCode == 401 || httpCode == 404) {
+    Serial.println("Chat session no longer exists (deleted or invalid)");
+    Serial.println("===================================================\n");
+    chatTreeInvalidate();
+    currentChatId = "";
+    return false;
+  } else {
+    Serial.println("Error saving user message:");
+    Serial.println(resp);
+    Serial.println("===================================================\n");
+    return false;
+  }
+}
+
+// Step 5: Call completed handler
+bool chatCompleted(const String &chatId, const String &sessionId, const String &userMsgId, 
+                   const String &userContent, const String &assistantMsgId, const String &assistantContent) {
+  Serial.println("\n========== CHAT COMPLETED ==========");
+  
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"model\":").quoted(LLM_MODEL)
+     .add(",\"messages\":[{\"id\":").quoted(userMsgId)
+     .add(",\"role\":\"user\",\"content\":").quoted(userContent)
+     .add("},{\"id\":").quoted(assistantMsgId)
+     .add(",\"role\":\"assistant\",\"content\":").quoted(assistantContent)
+     .add("}],\"chat_id\":").quoted(chatId)
+     .add(",\"session_id\":").quoted(sessionId)
+     .add(",\"id\":").quoted(assistantMsgId).add('}');
+  });
+  
+  // Sent by the persistence worker while the answer is shown
+  bool queued = built && chatPersistPost(CHAT_PERSIST_COMPLETED, chatId, body.c_str(), body.length());
+  Serial.println(queued ? "Completed handler queued" : "Error calling completed");
+  Serial.println("====================================\n");
+  return queued;
+}
+
+// Step 6: Update chat with full conversation history
+bool saveChatHistory(const String &chatId, const String &userMsgId, const String &userContent, 
+                     const String &assistantMsgId, const String &assistantContent) {
+  Serial.println("\n========== SAVING CHAT HISTORY ==========");
+  
+  // Local chat tree, which already holds the user message
+  int syncCode = chatTreeSync(chatId, false);
+  
+  if (syncCode != 200) {
+    Serial.printf("ERROR: Failed to fetch chat (HTTP %d)\n", syncCode);
+    Serial.println("=========================================\n");
+    return false;
+  }
+  
+  Serial.printf("Existing messages length: %d\n", chatTree.messages.length());
+  
+  unsigned long timestamp = getUnixTimestamp();
+  
+  // Image questions don't store the user message up front
+  if (!chatTreeHas(userMsgId)) {
+    chatTreeAdd(userMsgId, chatTree.currentId, "user", userContent,
+                "\"timestamp\":" + String(timestamp) + ","
+                "\"models\":[\"" + String(LLM_MODEL) + "\"]");
+  }
+  if (!chatTreeHas(assistantMsgId)) {
+    chatTreeAdd(assistantMsgId, userMsgId, "assistant", assistantContent,
+                "\"model\":\"" + String(LLM_MODEL) + "\","
+                "\"timestamp\":" + String(timestamp) + ","
+                "\"done\":true");
+  }
+  
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"chat\":{\"title\":\"M5 Voice Assistant\",\"history\":");
+    chatTreeHistoryJson(b);
+    b.add(",\"messages\":[{\"id\":").quoted(userMsgId)
+     .add(",\"role\":\"user\",\"content\":").quoted(userContent)
+     .add("},{\"id\":").quoted(assistantMsgId)
+     .add(",\"role\":\"assistant\",\"content\":").quoted(assistantContent)
+     .add("}]}}");
+  });
+  
+  // One combined save per turn, sent by the persistence worker
+  bool queued = built && chatPersistPost(CHAT_PERSIST_SAVE, chatId, body.c_str(), body.length());
+  Serial.println(queued ? "Chat history save queued" : "Error saving chat history");
+  Serial.println("=========================================\n");
+  return queued;
+}
+
+#if VISION_INLINE_IMAGE
+// Save chat history with image file reference for OWUI display
+bool saveChatHistoryWithImage(const String &chatId, const String &userMsgId, const String &userContent, 
+                              const String &assistantMsgId, const String &assistantContent, const String &fileId) {
+  Serial.println("\n========== SAVING CHAT HISTORY WITH IMAGE ==========");
+  
+  unsigned long timestamp = getUnixTimestamp();
+  
+  // Build image URL for markdown display
+  String imageUrl = String(OWUI_BASE_URL) + "/api/v1/files/" + fileId + "/content";
+  
+  // Local chat tree (camera questions start a fresh chat)
+  int syncCode = chatTreeSync(chatId, false);
+  if (syncCode != 200) {
+    Serial.printf("ERROR: Failed to fetch chat (HTTP %d)\n", syncCode);
+    Serial.println("=============================================\n");
+    return false;
+  }
+  
+  // User message shows the image as markdown
+  String userWithImage = userContent + "\n\n![image](" + imageUrl + ")";
+  
+  // Files array for the user message
+  auto filesArray = [&](StrBuilder &b) {
+    b.add("[{\"id\":").quoted(fileId)
+     .add(",\"type\":\"image\",\"name\":").quoted(lastUploadedFileName)
+     .add(",\"status\":\"uploaded\",\"size\":").num(lastUploadedFileSize)
+     .add(",\"file\":{\"id\":").quoted(fileId)
+     .add(",\"path\":").quoted(lastUploadedFilePath)
+     .add(",\"meta\":{\"content_type\":\"image/jpeg\",\"name\":").quoted(lastUploadedFileName)
+     .add(",\"size\":").num(lastUploadedFileSize)
+     .add("}}}]");
+  };
+  
+  if (!chatTreeHas(userMsgId)) {
+    chatTreeAdd(userMsgId, chatTree.currentId, "user", userWithImage, strBuildString([&](StrBuilder &b) {
+      b.add("\"files\":");
+      filesArray(b);
+      b.add(",\"timestamp\":").num(timestamp);
+    }));
+  }
+  if (!chatTreeHas(assistantMsgId)) {
+    chatTreeAdd(assistantMsgId, userMsgId, "assistant", assistantContent,
+                "\"model\":\"" + String(LLM_MODEL) + "\","
+                "\"timestamp\":" + String(timestamp) + ","
+                "\"done\":true");
+  }
+  
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"chat\":{\"title\":\"M5 Camera\",\"history\":");
+    chatTreeHistoryJson(b);
+    b.add(",\"messages\":[{\"id\":").quoted(userMsgId)
+     .add(",\"role\":\"user\",\"content\":").quoted(userWithImage)
+     .add(",\"files\":");
+    filesArray(b);
+    b.add("},{\"id\":").quoted(assistantMsgId)
+     .add(",\"role\":\"assistant\",\"content\":").quoted(assistantContent)
+     .add("}]}}");
+  });
+  
+  // Sent by the persistence worker while the answer is shown
+  bool queued = built && chatPersistPost(CHAT_PERSIST_SAVE, chatId, body.c_str(), body.length());
+  Serial.println(queued ? "Chat history with image queued" : "Error saving chat history with image");
+  Serial.println("=============================================\n");
+  return queued;
+}
+#endif // VISION_INLINE_IMAGE
+
+// Partial answer while the LLM is still generating, redrawn as tokens arrive
+String streamingAnswer = "";
+unsigned long lastStreamDraw = 0;
+
+void onAnswerDelta(const String &delta) {
+  streamingAnswer += delta;
+  ttsPipelineFeed(delta); // Complete sentences start synthesizing right away
+  if (millis() - lastStreamDraw < 300) return; // Full-screen redraws are slow
+  lastStreamDraw = millis();
+  interactionShowText(streamingAnswer); // Drawn by loop()
+}
+
+String askGPT(const String &question) {
+  Serial.println("\n========== ASKING LLM ==========");
+  Serial.println("Question: " + question);
+  streamingAnswer = "";
+  if (USE_TTS && isLargeDevice) {
+    ttsPipelineBegin(); // speakText() finishes it once the answer is complete
+  }
+
+  // Session, message IDs and LLM connection are usually set up while recording
+  chatPrefetchWait();
+
+  // Step 1: Create or reuse chat session for OpenWebUI (if the prefetch couldn't)
+  if (USE_OWUI_SESSIONS && currentChatId.length() == 0) {
+    currentChatId = createChatSession("M5 Voice Assistant");
+    currentSessionId = generateUUID(); // Generate session ID once per chat
+    if (currentChatId.length() == 0) {
+      Serial.println("ERROR: Failed to create chat session!");
+      return "Session error";
+    }
+  }
+
+  // Step 2: Generate message IDs for OpenWebUI
+  String userMsgId = "";
+  String assistantMsgId = "";
+  if (USE_OWUI_SESSIONS) {
+    chatPrefetchTakeIds(userMsgId, assistantMsgId);
+    Serial.println("User message ID: " + userMsgId);
+    Serial.println("Assistant message ID: " + assistantMsgId);
+    
+    // Step 3: Update chat with user message before completion
+    if (!updateChatWithUserMessage(currentChatId, userMsgId, question)) {
+      // Check if chat was deleted (currentChatId cleared by updateChatWithUserMessage)
+      if (currentChatId.length() == 0) {
+        Serial.println("Chat was deleted, creating new session and retrying...");
+        currentChatId = createChatSession("M5 Voice Assistant");
+        currentSessionId = generateUUID();
+        if (currentChatId.length() > 0) {
+          // Retry with new session
+          if (!updateChatWithUserMessage(currentChatId, userMsgId, question)) {
+            Serial.println("ERROR: Failed to update chat even after recreating!");
+            return "Update error";
+          }
+        } else {
+          Serial.println("ERROR: Failed to recreate chat session!");
+          return "Session error";
+        }
+      } else {
+        Serial.println("ERROR: Failed to update chat with user message!");
+        return "Update error";
+      }
+    }
+  }
+
+  // Messages array with the conversation history for context: newest turns of
+  // the local chat tree (including the user message saved by
+  // updateChatWithUserMessage) plus a summary of older ones; system prompt
+  // added to the last user message. Written straight into the body below.
+  ChatContextWindow window = {0, 0, ""};
+  if (USE_OWUI_SESSIONS) {
+    window = chatContextWindow();
+    Serial.printf("Built context from %d history messages\n", chatTree.count);
+  }
+
+  String url;
+  if (USE_OWUI_SESSIONS) {
+    url = String(OWUI_BASE_URL) + "/api/v1/chat/completions";
+  } else {
+    url = LLM_URL;
+  }
+  
+  // Open the event socket first - OpenWebUI sends completion events to the
+  // session_id, which has to be the socket id
+  bool socketReady = false;
+  if (USE_OWUI_SESSIONS) {
+    socketReady = owuiSocketConnect();
+    if (socketReady) {
+      currentSessionId = owuiSocketSid;
+    }
+  }
+  
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    if (LLM_USE_RESPONSES_API) {
+      // OpenAI Responses API format
+      b.add("{\"model\":").quoted(LLM_MODEL).add(',');
+      if (ENABLE_LLM_STREAMING) b.add("\"stream\":true,");
+      b.add("\"input\":[{\"role\":\"user\",\"content\":[{\"type\":\"input_text\",\"text\":\"")
+       .json(question).json(systemPrompt).add("\"}]}]}");
+    } else if (USE_OWUI_SESSIONS) {
+      // Step 4: OpenWebUI with chat session tracking and full context
+      b.add("{\"model\":").quoted(LLM_MODEL)
+       .add(",\"messages\":[");
+      chatContextWrite(b, window, systemPrompt);
+      b.add("],\"chat_id\":").quoted(currentChatId)
+       .add(",\"id\":").quoted(assistantMsgId)
+       .add(",\"session_id\":").quoted(currentSessionId)
+       .add(",\"stream\":true}");
+    } else {
+      // Standard Chat Completions API format
+      b.add("{\"model\":").quoted(LLM_MODEL).add(',');
+      if (ENABLE_LLM_STREAMING) b.add("\"stream\":true,");
+      b.add("\"messages\":[{\"role\":\"user\",\"content\":\"")
+       .json(question).json(systemPrompt).add("\"}]}");
+    }
+  });
+  if (!built) {
+    Serial.println("ERROR: No memory for the request body");
+    owuiSocketClose();
+    return "Memory error";
+  }
+
+  Serial.printf("Connecting to LLM at %s...\n", url.c_str());
+  HTTPClient &http = httpPoolBegin(url);
+  http.addHeader("Content-Type", "application/json");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.setTimeout(90000);
+  if (ENABLE_LLM_STREAMING && !USE_OWUI_SESSIONS) {
+    http.useHTTP10(true); // No chunked encoding, so SSE lines can be read straight off the socket
+  }
+
+  Serial.println("Sending request...");
+  strLogBody("Body", body);
+
+  int httpCode = httpPoolSend(http, "POST", body.c_str(), body.length());
+  Serial.printf("HTTP response code: %d\n", httpCode);
+
+  if (httpCode != 200) {
+    String error = http.getString();
+    Serial.println("Error response: " + error);
+    httpPoolEnd(http);
+    owuiSocketClose();
+    return "HTTP " + String(httpCode);
+  }
+
+  // Handle async completion for OpenWebUI (uses WebSocket, not HTTP streaming)
+  String result = "";
+  if (USE_OWUI_SESSIONS) {
+    String resp = http.getString();
+    httpPoolEnd(http);
+    
+    Serial.println("Task initiated:");
+    Serial.println(resp);
+    
+    if (socketReady) {
+      Serial.println("Waiting for completion events on socket...");
+      owuiSocketWatch(currentChatId, assistantMsgId, onAnswerDelta);
+      if (owuiSocketWait(result, 60000) <= 0) {
+        Serial.println("Socket stream incomplete, falling back to polling");
+        result = "";
+      }
+      owuiSocketClose();
+    }
+    
+    // No socket: poll chat history until assistant response appears
+    if (result.length() == 0) {
+      Serial.println("Polling chat history for completion...");
+    }
+    
+    String fetchUrl = String(OWUI_BASE_URL) + "/api/v1/chats/" + currentChatId;
+    String contentPath = "chat.history.messages." + assistantMsgId + ".content";
+    unsigned long pollStart = millis();
+    int pollAttempt = 0;
+    
+    while (result.length() == 0 && millis() - pollStart < 60000 && !interactionCancelRequested) { // 60 second timeout
+      pollAttempt++;
+      if (!interactionWait(1000)) break; // Poll every 1 second
+      
+      Serial.printf("[POLL #%d] Fetching chat history...\n", pollAttempt);
+      
+      HTTPClient &fetchHttp = httpPoolBegin(fetchUrl);
+      fetchHttp.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+      
+      int fetchCode = httpPoolSend(fetchHttp, "GET");
+      if (fetchCode != 200) {
+        httpPoolEnd(fetchHttp);
+        Serial.printf("Fetch failed: HTTP %d\n", fetchCode);
+        continue;
+      }
+      
+      // Assistant message content, picked out while the chat JSON streams in
+      JsonStream json;
+      json.capture(contentPath.c_str(), result);
+      jsonStreamHttp(fetchHttp, json);
+      httpPoolEnd(fetchHttp);
+      
+      if (result.length() == 0) {
+        Serial.println("Assistant message not ready yet...");
+        continue;
+      }
+      
+      Serial.printf("Found assistant message after %d polls\n", pollAttempt);
+      Serial.printf("Retrieved response length: %d\n", result.length());
+      Serial.printf("First 50 chars: %.50s\n", result.c_str());
+      
+      // Check if this is an echo of the user's question (without system prompt suffix)
+      // Extract just the question part (before " Answer in")
+      String questionOnly = question;
+      int answerIdx = question.indexOf(" Answer in");
+      if (answerIdx > 0) {
+        questionOnly = question.substring(0, answerIdx);
+      }
+      
+      if (result == questionOnly || result == question) {
+        Serial.println("WARNING: Got echo of question, waiting for real response...");
+        result = ""; // Keep polling
+      }
+    }
+    
+    if (result.length() == 0) {
+      Serial.printf("ERROR: No response after %d polls\n", pollAttempt);
+      return "Timeout";
+    }
+  } else if (ENABLE_LLM_STREAMING) {
+    // Streamed response (SSE) for OpenAI APIs - tokens are shown as they arrive
+    int status = sseReadCompletion(http, LLM_USE_RESPONSES_API, onAnswerDelta, result, 90000);
+    httpPoolEnd(http);
+
+    if (result.length() == 0) {
+      Serial.println("ERROR: No text in streamed response!");
+      return status < 0 ? "Stream error" : "No content";
+    }
+  } else {
+    // Non-streaming response for OpenAI APIs - answer text picked out as it arrives
+    JsonStream json;
+    if (LLM_USE_RESPONSES_API) {
+      json.capture("output.*.content.*.text", result); // Parts of type output_text
+    } else {
+      json.capture("choices.0.message.content", result);
+    }
+    jsonStreamHttp(http, json);
+    httpPoolEnd(http);
+    
+    Serial.printf("LLM response: %d bytes\n", json.bytesParsed());
+    
+    if (result.length() == 0) {
+      Serial.println(LLM_USE_RESPONSES_API ? "ERROR: No 'output_text' in response!" : "ERROR: No 'content' in response!");
+      return json.done() ? (LLM_USE_RESPONSES_API ? "No output" : "No content") : "Parse error";
+    }
+  }
+
+  Serial.println("Extracted answer: " + result);
+  Serial.println("=================================\n");
+
+  // Steps 5 & 6: Call completed handler and save full chat history for OpenWebUI
+  if (USE_OWUI_SESSIONS && currentChatId.length() > 0 && userMsgId.length() > 0) {
+    // Step 5: Call completed handler
+    chatCompleted(currentChatId, currentSessionId, userMsgId, question, assistantMsgId, result);
+    
+    // Step 6: Save full conversation history
+    saveChatHistory(currentChatId, userMsgId, question, assistantMsgId, result);
+    
+    // Fold turns leaving the context window into the summary (background)
+    chatSummaryUpdate();
+  }
+  
+  return result;
+}
+
+String askGPTWithImage(const String &question, const String &fileId) {
+  Serial.println("\n========== ASKING LLM WITH IMAGE ==========");
+  Serial.println("Question: " + question);
+  streamingAnswer = "";
+  Serial.println("File ID: " + fileId);
+
+  if (fileId.length() == 0) {
+    Serial.println("ERROR: No file ID provided, falling back to text-only");
+    return askGPT(question); // Begins the TTS pipeline itself
+  }
+
+  if (USE_TTS && isLargeDevice) {
+    ttsPipelineBegin(); // speakText() finishes it once the answer is complete
+  }
+
+  // Session, message IDs and LLM connection are usually set up while recording
+  chatPrefetchWait();
+
+  // Step 1: Create or reuse chat session for OpenWebUI (if the prefetch couldn't)
+  if (USE_OWUI_SESSIONS && currentChatId.length() == 0) {
+    currentChatId = createChatSession("M5 Voice Assistant");
+    currentSessionId = generateUUID();
+    if (currentChatId.length() == 0) {
+      Serial.println("ERROR: Failed to create chat session!");
+      return "Session error";
+    }
+  }
+
+  // Step 2: Generate message IDs for OpenWebUI
+  String userMsgId = "";
+  String assistantMsgId = "";
+  if (USE_OWUI_SESSIONS) {
+    chatPrefetchTakeIds(userMsgId, assistantMsgId);
+    Serial.println("User message ID: " + userMsgId);
+    Serial.println("Assistant message ID: " + assistantMsgId);
+  }
+
+  String url = String(OWUI_BASE_URL) + "/api/v1/chat/completions";
+  
+  // Open the event socket first - OpenWebUI sends completion events to the
+  // session_id, which has to be the socket id
+  bool socketReady = false;
+  if (USE_OWUI_SESSIONS) {
+    socketReady = owuiSocketConnect();
+    if (socketReady) {
+      currentSessionId = owuiSocketSid;
+    }
+  }
+  
+  #if VISION_INLINE_IMAGE
+  // OpenAI vision format with the base64 image - more universally supported
+  // than file attachments. The JPEG is encoded straight into the body.
+  bool withImage = lastCapturedImage && lastCapturedImageSize > 0;
+  #endif
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    #if VISION_INLINE_IMAGE
+    b.add("{\"model\":").quoted(LLM_MODEL).add(",\"messages\":[{\"role\":\"user\",\"content\":");
+    if (withImage) {
+      // Content is an array with text and image_url
+      b.add("[{\"type\":\"text\",\"text\":\"").json(question).json(systemPrompt)
+       .add("\"},{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:image/jpeg;base64,")
+       .base64(lastCapturedImage, lastCapturedImageSize)
+       .add("\"}}]");
+    } else {
+      // Fallback to text-only if no image data
+      b.add('"').json(question).json(systemPrompt).add('"');
+    }
+    b.add("}],\"chat_id\":").quoted(currentChatId)
+    #else
+    // Message with the image file reference - OpenWebUI format for images in
+    // messages uses the files array
+    b.add("{\"model\":").quoted(LLM_MODEL)
+     .add(",\"messages\":[{\"role\":\"user\",\"content\":\"").json(question).json(systemPrompt)
+     .add("\",\"files\":[{\"type\":\"file\",\"id\":").quoted(fileId)
+     .add("}]}],\"chat_id\":").quoted(currentChatId)
+    #endif
+     .add(",\"id\":").quoted(assistantMsgId)
+     .add(",\"session_id\":").quoted(currentSessionId)
+     .add(",\"stream\":true}");
+  });
+  if (!built) {
+    Serial.println("ERROR: No memory for the request body");
+    owuiSocketClose();
+    return "Memory error";
+  }
+  #if VISION_INLINE_IMAGE
+  if (withImage) {
+    Serial.printf("Base64 encoded image: %d chars\n", (int)((lastCapturedImageSize + 2) / 3 * 4));
+  }
+  #endif
+
+  Serial.printf("Connecting to LLM at %s...\n", url.c_str());
+  HTTPClient &http = httpPoolBegin(url);
+  http.addHeader("Content-Type", "application/json");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.setTimeout(90000);
+
+  Serial.println("Sending request with image...");
+  strLogBody("Body", body);
+
+  int httpCode = httpPoolSend(http, "POST", body.c_str(), body.length());
+  Serial.printf("HTTP response code: %d\n", httpCode);
+
+  if (httpCode != 200) {
+    String error = http.getString();
+    Serial.println("Error response: " + error);
+    httpPoolEnd(http);
+    owuiSocketClose();
+    return "HTTP " + String(httpCode);
+  }
+
+  String result = "";
+  String resp = http.getString();
+  httpPoolEnd(http);
+  
+  Serial.println("Task initiated:");
+  Serial.println(resp);
+  
+  if (socketReady) {
+    Serial.println("Waiting for completion events on socket...");
+    owuiSocketWatch(currentChatId, assistantMsgId, onAnswerDelta);
+    if (owuiSocketWait(result, 90000) <= 0) {
+      Serial.println("Socket stream incomplete, falling back to polling");
+      result = "";
+    }
+    owuiSocketClose();
+  }
+  
+  // No socket: poll chat history until assistant response appears
+  if (result.length() == 0) {
+    Serial.println("Polling chat history for completion...");
+  }
+  
+  String fetchUrl = String(OWUI_BASE_URL) + "/api/v1/chats/" + currentChatId;
+  String contentPath = "chat.history.messages." + assistantMsgId + ".content";
+  unsigned long pollStart = millis();
+  int pollAttempt = 0;
+  
+  while (result.length() == 0 && millis() - pollStart < 90000 && !interactionCancelRequested) { // 90 second timeout for image processing
+    pollAttempt++;
+    if (!interactionWait(1500)) break; // Poll every 1.5 seconds (image processing takes longer)
+    
+    Serial.printf("[POLL #%d] Fetching chat history...\n", pollAttempt);
+    
+    HTTPClient &fetchHttp = httpPoolBegin(fetchUrl);
+    fetchHttp.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+    
+    int fetchCode = httpPoolSend(fetchHttp, "GET");
+    if (fetchCode != 200) {
+      httpPoolEnd(fetchHttp);
+      Serial.printf("Fetch failed: HTTP %d\n", fetchCode);
+      continue;
+    }
+    
+    // Assistant message content, picked out while the chat JSON streams in
+    JsonStream json;
+    json.capture(contentPath.c_str(), result);
+    jsonStreamHttp(fetchHttp, json);
+    httpPoolEnd(fetchHttp);
+    
+    if (result.length() == 0) {
+      Serial.println("Assistant message not ready yet...");
+      continue;
+    }
+    
+    Serial.printf("Found assistant message after %d polls\n", pollAttempt);
+    Serial.printf("Retrieved response length: %d\n", result.length());
+  }
+  
+  if (result.length() == 0) {
+    Serial.printf("ERROR: No response after %d polls\n", pollAttempt);
+    return "Timeout";
+  }
+
+  Serial.println("Extracted answer: " + result);
+  Serial.println("===========================================\n");
+
+  // Call completed handler and save chat history
+  if (USE_OWUI_SESSIONS && currentChatId.length() > 0 && userMsgId.length() > 0) {
+    chatCompleted(currentChatId, currentSessionId, userMsgId, question, assistantMsgId, result);
+    #if VISION_INLINE_IMAGE
+    // Save with image file reference so it shows in OWUI
+    saveChatHistoryWithImage(currentChatId, userMsgId, question, assistantMsgId, result, fileId);
+    #else
+    saveChatHistory(currentChatId, userMsgId, question, assistantMsgId, result);
+    #endif
+  }
+  
+  return result;
+}
+
+#endif // ASSISTANT_H
@@ -1,7 +1,7 @@
 #ifndef AUDIO_H
 #define AUDIO_H
 
-// Dependencies: M5Unified.h and m5go_leds.h must be included before this file
+// Dependencies: M5Unified.h, m5go_leds.h, mic_capture.h, vad.h, dsp_kernels.h and mic_preprocess.h must be included before this file
 
 // External references
 extern int SAMPLE_RATE;
@@ -12,10 +12,12 @@ extern int actualRecordedSamples;
 extern const int VAD_SILENCE_THRESHOLD;
 extern const float VAD_SILENCE_DURATION;
 extern const bool VAD_ENABLED;
+extern const VadEngine *vadEngine;
 
 // Real-time audio display state
 extern volatile bool isRecording;
 extern volatile int currentRmsLevel;
+extern volatile bool currentVadSpeech;
 extern volatile int recordingSecondsLeft;
 extern TaskHandle_t displayTaskHandle;
 extern bool audioLevelInitialized;
@@ -29,39 +31,54 @@ extern bool hasM5GOBottom2;
 // Display task
 extern void displayTask(void *parameter);
 
+// Upload encoding while recording, without the silence (audio_codec.h, audio_trim.h)
+extern void audioCodecBegin();
+extern int audioCodecFinish(int recordedSamples);
+extern int audioTrimPush(const Vad &vad, int heard);
+extern int audioTrimFinish(const Vad &vad, int recorded);
+
+// Streaming STT upload (stt_stream.h)
+extern void sttStreamBegin();
+extern void sttStreamPush(int bytesReady);
+extern void sttStreamEndOfAudio();
+
+// Set when the user cancels the interaction (interaction.h)
+extern volatile bool interactionCancelRequested;
+
+// Chat set-up while recording (chat_prefetch.h)
+extern void chatPrefetchBegin();
+extern void chatPrefetchWarm();
+
 bool recordAudio() {
   Serial.println("\n========== RECORDING ==========");
 
-  if (!audioBuffer) {
-    Serial.printf("Allocating buffer: %d samples, %d bytes\n", RECORD_SAMPLES,
-                  RECORD_SAMPLES * sizeof(int16_t));
-    audioBuffer = (int16_t *)malloc(RECORD_SAMPLES * sizeof(int16_t));
-    if (!audioBuffer) {
-      Serial.println("ERROR: Failed to allocate audio buffer!");
-      return false;
-    }
-    Serial.println("Buffer allocated OK");
-  } else {
-    Serial.println("Using existing buffer");
+  // The armed mic already holds the last moments before the press; the
+  // recording continues right behind them in the same buffer (mic_capture.h)
+  int preRoll = micCaptureStart();
+  if (preRoll < 0) {
+    Serial.println("ERROR: Failed to start mic!");
+    return false;
   }
+  Serial.printf("Pre-roll: %d samples (%dms)\n", preRoll, preRoll * 1000 / SAMPLE_RATE);
 
-  Serial.println("Starting mic...");
-  M5.Mic.begin();
-
-  // Use smaller chunks for more responsive display (250ms chunks = 4 updates/sec)
-  const int CHUNK_MS = 250;
-  const int SAMPLES_PER_CHUNK = SAMPLE_RATE * CHUNK_MS / 1000;
-  const int CHUNKS_PER_SECOND = 1000 / CHUNK_MS;
-  
-  int totalSamplesRecorded = 0;
-  int silentChunks = 0;
-  int silenceChunkThreshold = (int)(VAD_SILENCE_DURATION * CHUNKS_PER_SECOND);
+  int totalSamplesRecorded = preRoll;
+  int silenceMsThreshold = (int)(VAD_SILENCE_DURATION * 1000);
+  int nextLogSecond = 0;
   bool stoppedEarly = false;
   
+  // Every block is cleaned up (DC, high-pass, AGC) before anything reads it
+  micPreprocessBegin();
+  micPreprocess(audioBuffer, totalSamplesRecorded);
+  
+  // Stats for the whole recording, built up block by block
+  DspStats stats, block;
+  dspStats(stats, audioBuffer, totalSamplesRecorded);
+  
   // Start display task for real-time updates
   isRecording = true;
   recordingSecondsLeft = RECORD_SECONDS;
   currentRmsLevel = 0;
+  currentVadSpeech = false;
   audioLevelInitialized = false;
   
   // Initialize M5GO LEDs for recording
@@ -74,135 +91,124 @@ bool recordAudio() {
     xTaskCreatePinnedToCore(displayTask, "displayTask", 4096, NULL, 1, &displayTaskHandle, 0);
   }
   
-  int totalChunks = RECORD_SECONDS * CHUNKS_PER_SECOND;
-  Serial.printf("Recording %d chunks of %dms each...\n", totalChunks, CHUNK_MS);
+  // Pre-roll gives the VAD's noise floor a head start (and may hold the first word)
+  Vad vad;
+  vadBegin(vad, *vadEngine, SAMPLE_RATE, VAD_SILENCE_THRESHOLD);
+  int vadPos = vadFeed(vad, audioBuffer, 0, totalSamplesRecorded);
+  
+  // Open the transcription connection now so the upload overlaps with speech;
+  // blocks are encoded for the upload once the VAD has heard them
+  audioCodecBegin();
+  sttStreamBegin();
+  sttStreamPush(audioTrimPush(vad, vadPos));
   
-  for (int chunk = 0; chunk < totalChunks; chunk++) {
+  // Chat session, message IDs and LLM connection don't need the transcript
+  chatPrefetchBegin();
+  
+  Serial.printf("Recording up to %d samples in %dms blocks...\n", RECORD_SAMPLES, MIC_CAPTURE_BLOCK_MS);
+  
+  while (totalSamplesRecorded - preRoll < RECORD_SAMPLES) {
+    if (interactionCancelRequested) {
+      Serial.println("Recording cancelled");
+      stoppedEarly = true;
+      break;
+    }
     int offset = totalSamplesRecorded;
     
-    // Record one chunk
-    M5.Mic.record(&audioBuffer[offset], SAMPLES_PER_CHUNK, SAMPLE_RATE);
-    while (M5.Mic.isRecording()) {
-      delay(1);
+    // Whatever landed since the last pass (one block or more)
+    totalSamplesRecorded = micCaptureWait(offset, 1000);
+    if (totalSamplesRecorded == offset) {
+      Serial.println("Mic stalled - stopping");
+      stoppedEarly = true;
+      break;
     }
+    int newSamples = totalSamplesRecorded - offset;
     
-    totalSamplesRecorded += SAMPLES_PER_CHUNK;
+    micPreprocess(audioBuffer + offset, newSamples);
     
-    // Calculate RMS for this chunk (skip first 2 chunks to ignore button click)
-    if (chunk >= 2) {
-      int64_t sum = 0;
-      for (int i = 0; i < SAMPLES_PER_CHUNK; i++) {
-        int16_t sample = audioBuffer[offset + i];
-        sum += (int64_t)sample * sample;
-      }
-      currentRmsLevel = (int)sqrt(sum / SAMPLES_PER_CHUNK);
-      
-      // Update M5GO LEDs based on audio level
-      if (hasM5GOBottom2) {
-        int activeLeds = map(constrain(currentRmsLevel, 0, 3000), 0, 3000, 0, M5GO_NUM_LEDS);
-        if (currentRmsLevel >= VAD_SILENCE_THRESHOLD) {
-          setM5GOLEDsPattern(activeLeds, CRGB::Green);
-        } else {
-          setM5GOLEDsPattern(2, CRGB::Blue);
-        }
+    // Level of the new samples - pre-roll means the first ones are speech too
+    dspStats(block, audioBuffer + offset, newSamples);
+    dspMerge(stats, block);
+    currentRmsLevel = dspRms(block);
+    
+    // VAD frames are shorter than a block; a partial frame waits for the next one
+    vadPos = vadFeed(vad, audioBuffer, vadPos, totalSamplesRecorded);
+    currentVadSpeech = vad.speech;
+    sttStreamPush(audioTrimPush(vad, vadPos));
+    
+    // Update M5GO LEDs based on audio level
+    if (hasM5GOBottom2) {
+      int activeLeds = map(constrain(currentRmsLevel, 0, 3000), 0, 3000, 0, M5GO_NUM_LEDS);
+      if (vad.speech) {
+        setM5GOLEDsPattern(activeLeds, CRGB::Green);
+      } else {
+        setM5GOLEDsPattern(2, CRGB::Blue);
       }
     }
     
     // Update countdown
-    recordingSecondsLeft = RECORD_SECONDS - (chunk / CHUNKS_PER_SECOND);
+    int recordedMs = (int)((int64_t)(totalSamplesRecorded - preRoll) * 1000 / SAMPLE_RATE);
+    recordingSecondsLeft = RECORD_SECONDS - recordedMs / 1000;
     
     // Log every second
-    if (chunk % CHUNKS_PER_SECOND == 0) {
-      Serial.printf("Recording: %ds, RMS: %d\n", chunk / CHUNKS_PER_SECOND + 1, currentRmsLevel);
+    if (recordedMs >= nextLogSecond * 1000) {
+      Serial.printf("Recording: %ds, RMS: %d\n", nextLogSecond + 1, currentRmsLevel);
+      nextLogSecond++;
     }
     
-    // VAD check after first second
-    if (VAD_ENABLED && chunk >= CHUNKS_PER_SECOND) {
-      if (currentRmsLevel < VAD_SILENCE_THRESHOLD) {
-        silentChunks++;
-        
-        if (silentChunks >= silenceChunkThreshold) {
-          Serial.println("Silence threshold - stopping");
-          stoppedEarly = true;
-          break;
-        }
-      } else {
-        silentChunks = 0;
+    // VAD check after first second. Before anyone spoke, silence counts from
+    // there as it always did; after that, from the last speech-like frame.
+    if (VAD_ENABLED && recordedMs >= 1000) {
+      int silentMs = vad.lastSpeechFrame >= 0 ? vadSilenceMs(vad) : recordedMs - 1000;
+      if (silentMs >= silenceMsThreshold) {
+        Serial.println("Silence threshold - stopping");
+        stoppedEarly = true;
+        break;
       }
     }
   }
 
-  // Stop recording
+  // Stop recording (the block still on the mic lands first)
+  int landed = totalSamplesRecorded;
+  totalSamplesRecorded = micCaptureStop();
+  micPreprocess(audioBuffer + landed, totalSamplesRecorded - landed);
+  dspStats(block, audioBuffer + landed, totalSamplesRecorded - landed);
+  dspMerge(stats, block);
   isRecording = false;
-  M5.Mic.end();
+  currentVadSpeech = false;
+  vadFeed(vad, audioBuffer, vadPos, totalSamplesRecorded);
+  
+  // Upload only the speech (plus margins) - actualRecordedSamples is its length
+  actualRecordedSamples = audioTrimFinish(vad, totalSamplesRecorded);
+  sttStreamPush(audioCodecFinish(totalSamplesRecorded));
+  sttStreamEndOfAudio();
+  chatPrefetchWarm();
   
   // Clear M5GO LEDs
   clearM5GOLEDs();
   
-  // Update actual recorded samples for transcription
-  actualRecordedSamples = totalSamplesRecorded;
-  
   if (stoppedEarly) {
     Serial.printf("Recording stopped early after %d samples (%.1fs)\n", 
                   totalSamplesRecorded, (float)totalSamplesRecorded / SAMPLE_RATE);
   } else {
     Serial.println("Recording complete");
   }
+  
+  // Where the VAD heard speech and how long it waited after it
+  if (vad.firstSpeechFrame >= 0) {
+    Serial.printf("[VAD] %s: speech %d-%dms, %d/%d frames, stopped %dms after, floor %d\n",
+                  vad.engine->name, vad.firstSpeechFrame * VAD_FRAME_MS, (vad.lastSpeechFrame + 1) * VAD_FRAME_MS,
+                  vad.speechFrames, vad.frames, vadSilenceMs(vad), (int)sqrtf(vad.noiseFloor));
+  } else {
+    Serial.printf("[VAD] %s: no speech in %d frames, floor %d\n", vad.engine->name, vad.frames, (int)sqrtf(vad.noiseFloor));
+  }
 
   // Audio stats
-  int16_t minVal = 32767, maxVal = -32768;
-  int64_t sum = 0;
-  for (int i = 0; i < actualRecordedSamples; i++) {
-    if (audioBuffer[i] < minVal)
-      minVal = audioBuffer[i];
-    if (audioBuffer[i] > maxVal)
-      maxVal = audioBuffer[i];
-    sum += abs(audioBuffer[i]);
-  }
-  Serial.printf("Audio stats: min=%d, max=%d, avg=%lld\n", minVal, maxVal,
-                sum / actualRecordedSamples);
+  Serial.printf("Audio stats: min=%d, max=%d, avg=%d, rms=%d\n", stats.minVal, stats.maxVal,
+                dspAbsMean(stats), dspRms(stats));
   Serial.println("================================\n");
 
   return true;
 }
 
-void createWavHeader(uint8_t *header, int dataSize) {
-  int fileSize = dataSize + 36;
-  int byteRate = SAMPLE_RATE * 1 * 16 / 8;
-  int blockAlign = 1 * 16 / 8;
-
-  memcpy(header, "RIFF", 4);
-  header[4] = fileSize & 0xFF;
-  header[5] = (fileSize >> 8) & 0xFF;
-  header[6] = (fileSize >> 16) & 0xFF;
-  header[7] = (fileSize >> 24) & 0xFF;
-  memcpy(header + 8, "WAVE", 4);
-  memcpy(header + 12, "fmt ", 4);
-  header[16] = 16;
-  header[17] = 0;
-  header[18] = 0;
-  header[19] = 0;
-  header[20] = 1;
-  header[21] = 0;
-  header[22] = 1;
-  header[23] = 0;
-  header[24] = SAMPLE_RATE & 0xFF;
-  header[25] = (SAMPLE_RATE >> 8) & 0xFF;
-  header[26] = (SAMPLE_RATE >> 16) & 0xFF;
-  header[27] = (SAMPLE_RATE >> 24) & 0xFF;
-  header[28] = byteRate & 0xFF;
-  header[29] = (byteRate >> 8) & 0xFF;
-  header[30] = (byteRate >> 16) & 0xFF;
-  header[31] = (byteRate >> 24) & 0xFF;
-  header[32] = blockAlign;
-  header[33] = 0;
-  header[34] = 16;
-  header[35] = 0;
-  memcpy(header + 36, "data", 4);
-  header[40] = dataSize & 0xFF;
-  header[41] = (dataSize >> 8) & 0xFF;
-  header[42] = (dataSize >> 16) & 0xFF;
-  header[43] = (dataSize >> 24) & 0xFF;
-}
-
 #endif // AUDIO_H
@@ -0,0 +1,309 @@
+#ifndef AUDIO_CODEC_H
+#define AUDIO_CODEC_H
+
+// Dependencies: device_config.h and audio.h must be included before this file
+//
+// Upload codecs for the STT request. recordAudio() encodes each mic block as
+// it lands, so the compressed upload is complete when the user stops talking.
+// The streaming uploader sends the encoded bytes as they appear and the
+// buffered upload sends them in one go. audioBuffer stays PCM for the VAD
+// and the level meter. Ranges of audioBuffer are appended one after the
+// other, so silence can be left out (audio_trim.h); PCM16 sends audioBuffer
+// itself and only takes one contiguous range.
+//
+//   UPLOAD_PCM16      16-bit PCM as recorded (no extra buffer)
+//   UPLOAD_MULAW      G.711 mu-law, 8 bits per sample (2:1)
+//   UPLOAD_IMA_ADPCM  IMA ADPCM, 4 bits per sample in 256-byte blocks (~4:1)
+//
+// All three are WAV files that ffmpeg decodes, so both Whisper and OpenWebUI
+// accept them as they are.
+//
+// Usage:
+//   audioCodecBegin();                       // before sttStreamBegin()
+//   int bytes = audioCodecAppend(from, to);  // encoded bytes ready so far
+//   bytes = audioCodecFinish(recorded);      // encodes the rest, logs the cost
+//   audioCodecHeader(header, bytes);         // WAV header, -1 = length unknown
+//   audioCodecData();                        // the encoded bytes
+
+enum UploadCodec {
+  UPLOAD_PCM16,
+  UPLOAD_MULAW,
+  UPLOAD_IMA_ADPCM,
+};
+
+#define AUDIO_CODEC_HEADER_MAX 60          // Largest WAV header (ADPCM: fmt extension + fact chunk)
+#define IMA_ADPCM_BLOCK_BYTES 256          // Block size ffmpeg and most players expect for mono
+#define IMA_ADPCM_BLOCK_SAMPLES ((IMA_ADPCM_BLOCK_BYTES - 4) * 2 + 1)
+
+// External references (defined in the main .ino)
+extern int SAMPLE_RATE;
+extern int RECORD_SAMPLES;
+extern int PRE_ROLL_SAMPLES;
+extern int16_t *audioBuffer;
+
+static uint8_t *audioCodecBuffer = nullptr;     // Encoded audio, audio arena (PCM16 sends audioBuffer itself)
+static UploadCodec audioCodecActive = UPLOAD_PCM16;
+volatile int audioCodecBytes = 0;               // Encoded bytes ready to send
+int audioCodecSamples = 0;                      // Samples appended so far (the upload's length)
+static int audioCodecFirst = -1;                // PCM16: where the range starts in audioBuffer
+static unsigned long audioCodecMicros = 0;      // Time spent encoding this recording
+static int audioCodecAdpcmIndex = 0;            // ADPCM step index, carried from block to block
+static int16_t audioCodecPending[IMA_ADPCM_BLOCK_SAMPLES]; // ADPCM samples short of a block
+static int audioCodecPendingCount = 0;
+
+static const int16_t IMA_STEP_TABLE[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t IMA_INDEX_TABLE[16] = {
+  -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+const char *audioCodecName() {
+  switch (audioCodecActive) {
+    case UPLOAD_MULAW: return "mu-law";
+    case UPLOAD_IMA_ADPCM: return "ima-adpcm";
+    default: return "pcm16";
+  }
+}
+
+// Encoded bytes for a recording of this many samples (also sizes the audio arena)
+static constexpr size_t audioCodecCapacity(UploadCodec codec, int samples) {
+  return codec == UPLOAD_MULAW ? (size_t)samples
+       : codec == UPLOAD_IMA_ADPCM
+           ? (size_t)((samples + IMA_ADPCM_BLOCK_SAMPLES - 1) / IMA_ADPCM_BLOCK_SAMPLES) * IMA_ADPCM_BLOCK_BYTES
+           : 0;
+}
+
+static uint8_t mulawEncode(int16_t sample) {
+  const int BIAS = 0x84;
+  const int CLIP = 32635;
+  int s = sample;
+  int sign = 0;
+  if (s < 0) {
+    s = -s;
+    sign = 0x80;
+  }
+  if (s > CLIP) s = CLIP;
+  s += BIAS;
+
+  int exponent = 7;
+  for (int mask = 0x4000; (s & mask) == 0 && exponent > 0; mask >>= 1) {
+    exponent--;
+  }
+  int mantissa = (s >> (exponent + 3)) & 0x0F;
+  return ~(sign | (exponent << 4) | mantissa);
+}
+
+static uint8_t imaEncodeNibble(int sample, int &predictor, int &index) {
+  int step = IMA_STEP_TABLE[index];
+  int diff = sample - predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+
+  int delta = step >> 3;
+  if (diff >= step) { nibble |= 4; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 2; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { nibble |= 1; delta += step; }
+
+  predictor += (nibble & 8) ? -delta : delta;
+  if (predictor > 32767) predictor = 32767;
+  if (predictor < -32768) predictor = -32768;
+  index += IMA_INDEX_TABLE[nibble];
+  if (index < 0) index = 0;
+  if (index > 88) index = 88;
+  return nibble;
+}
+
+// One ADPCM block: header with the first sample, then two samples per byte.
+// A short final block is padded with its last sample.
+static void imaEncodeBlock(const int16_t *samples, int count, uint8_t *out) {
+  int predictor = samples[0];
+  out[0] = predictor & 0xFF;
+  out[1] = (predictor >> 8) & 0xFF;
+  out[2] = audioCodecAdpcmIndex;
+  out[3] = 0;
+
+  uint8_t *p = out + 4;
+  for (int i = 1; i < IMA_ADPCM_BLOCK_SAMPLES; i += 2) {
+    int a = samples[i < count ? i : count - 1];
+    int b = samples[i + 1 < count ? i + 1 : count - 1];
+    uint8_t lo = imaEncodeNibble(a, predictor, audioCodecAdpcmIndex);
+    uint8_t hi = imaEncodeNibble(b, predictor, audioCodecAdpcmIndex);
+    *p++ = lo | (hi << 4);
+  }
+}
+
+// Called by recordAudio() when the mic starts. Falls back to PCM16 if the
+// audio arena has no encoded buffer (media_arena.h).
+void audioCodecBegin() {
+  audioCodecActive = STT_UPLOAD_CODEC;
+  audioCodecBytes = 0;
+  audioCodecSamples = 0;
+  audioCodecFirst = -1;
+  audioCodecMicros = 0;
+  audioCodecAdpcmIndex = 0;
+  audioCodecPendingCount = 0;
+  if (audioCodecActive == UPLOAD_PCM16 || audioCodecBuffer) return;
+
+  Serial.println("[CODEC] No encoded buffer - uploading PCM");
+  audioCodecActive = UPLOAD_PCM16;
+}
+
+// Encode audioBuffer[from, to) behind what's already encoded. ADPCM gathers
+// samples until it has a whole block; the rest waits for the next range or
+// audioCodecFinish(). Returns the encoded bytes ready to send.
+int audioCodecAppend(int from, int to) {
+  if (to <= from) return audioCodecBytes;
+  unsigned long start = micros();
+  switch (audioCodecActive) {
+    case UPLOAD_MULAW:
+      for (int i = from; i < to; i++) {
+        audioCodecBuffer[audioCodecSamples++] = mulawEncode(audioBuffer[i]);
+      }
+      audioCodecBytes = audioCodecSamples;
+      break;
+    case UPLOAD_IMA_ADPCM: {
+      int bytes = audioCodecBytes;
+      while (from < to) {
+        int n = IMA_ADPCM_BLOCK_SAMPLES - audioCodecPendingCount;
+        if (n > to - from) n = to - from;
+        memcpy(audioCodecPending + audioCodecPendingCount, audioBuffer + from, n * sizeof(int16_t));
+        audioCodecPendingCount += n;
+        audioCodecSamples += n;
+        from += n;
+        if (audioCodecPendingCount == IMA_ADPCM_BLOCK_SAMPLES) {
+          imaEncodeBlock(audioCodecPending, IMA_ADPCM_BLOCK_SAMPLES, audioCodecBuffer + bytes);
+          audioCodecPendingCount = 0;
+          bytes += IMA_ADPCM_BLOCK_BYTES;
+        }
+      }
+      audioCodecBytes = bytes;
+      break;
+    }
+    default:
+      // Nothing to encode; a gap between ranges can't be left out
+      if (audioCodecFirst < 0) audioCodecFirst = from;
+      audioCodecSamples = to - audioCodecFirst;
+      audioCodecBytes = audioCodecSamples * sizeof(int16_t);
+      break;
+  }
+  audioCodecMicros += micros() - start;
+  return audioCodecBytes;
+}
+
+// Called by recordAudio() when recording stops: encodes the tail (a padded
+// final ADPCM block) and logs size and encode cost against the recordedSamples
+// that would have been uploaded as PCM
+int audioCodecFinish(int recordedSamples) {
+  if (audioCodecActive == UPLOAD_IMA_ADPCM && audioCodecPendingCount > 0) {
+    unsigned long start = micros();
+    imaEncodeBlock(audioCodecPending, audioCodecPendingCount, audioCodecBuffer + audioCodecBytes);
+    audioCodecPendingCount = 0;
+    audioCodecBytes = audioCodecBytes + IMA_ADPCM_BLOCK_BYTES;
+    audioCodecMicros += micros() - start;
+  }
+
+  int pcmBytes = recordedSamples * sizeof(int16_t);
+  float seconds = (float)audioCodecSamples / SAMPLE_RATE;
+  Serial.printf("[CODEC] %s: %d -> %d bytes (%d%%), encode %.2fms per second of audio\n",
+                audioCodecName(), pcmBytes, audioCodecBytes,
+                pcmBytes > 0 ? audioCodecBytes * 100 / pcmBytes : 100,
+                seconds > 0 ? audioCodecMicros / 1000.0f / seconds : 0.0f);
+  return audioCodecBytes;
+}
+
+// False for PCM16, which sends audioBuffer as it is
+bool audioCodecCanSkip() {
+  return audioCodecActive != UPLOAD_PCM16;
+}
+
+const uint8_t *audioCodecData() {
+  if (audioCodecActive != UPLOAD_PCM16) return audioCodecBuffer;
+  return (const uint8_t *)(audioBuffer + (audioCodecFirst > 0 ? audioCodecFirst : 0));
+}
+
+static void audioCodecPut16(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+}
+
+static void audioCodecPut32(uint8_t *p, uint32_t v) {
+  audioCodecPut16(p, v);
+  audioCodecPut16(p + 2, v >> 16);
+}
+
+// WAV header for the encoded data. dataSize -1 marks a streaming WAV
+// (0xFFFFFFFF lengths), which ffmpeg reads until the end of the part.
+// Returns the header length (at most AUDIO_CODEC_HEADER_MAX).
+int audioCodecHeader(uint8_t *header, int dataSize) {
+  int formatTag, bitsPerSample, blockAlign, byteRate, fmtSize;
+  switch (audioCodecActive) {
+    case UPLOAD_MULAW:
+      formatTag = 7;
+      bitsPerSample = 8;
+      blockAlign = 1;
+      byteRate = SAMPLE_RATE;
+      fmtSize = 18;
+      break;
+    case UPLOAD_IMA_ADPCM:
+      formatTag = 0x11;
+      bitsPerSample = 4;
+      blockAlign = IMA_ADPCM_BLOCK_BYTES;
+      byteRate = SAMPLE_RATE * IMA_ADPCM_BLOCK_BYTES / IMA_ADPCM_BLOCK_SAMPLES;
+      fmtSize = 20;
+      break;
+    default:
+      formatTag = 1;
+      bitsPerSample = 16;
+      blockAlign = 2;
+      byteRate = SAMPLE_RATE * 2;
+      fmtSize = 16;
+      break;
+  }
+  bool hasFact = audioCodecActive != UPLOAD_PCM16;
+  int headerSize = 12 + 8 + fmtSize + (hasFact ? 12 : 0) + 8;
+  bool streaming = dataSize < 0;
+
+  uint8_t *p = header;
+  memcpy(p, "RIFF", 4);
+  audioCodecPut32(p + 4, streaming ? 0xFFFFFFFF : headerSize - 8 + dataSize);
+  memcpy(p + 8, "WAVE", 4);
+  p += 12;
+
+  memcpy(p, "fmt ", 4);
+  audioCodecPut32(p + 4, fmtSize);
+  audioCodecPut16(p + 8, formatTag);
+  audioCodecPut16(p + 10, 1);
+  audioCodecPut32(p + 12, SAMPLE_RATE);
+  audioCodecPut32(p + 16, byteRate);
+  audioCodecPut16(p + 20, blockAlign);
+  audioCodecPut16(p + 22, bitsPerSample);
+  if (fmtSize > 16) audioCodecPut16(p + 24, fmtSize - 18);
+  if (fmtSize > 18) audioCodecPut16(p + 26, IMA_ADPCM_BLOCK_SAMPLES);
+  p += 8 + fmtSize;
+
+  // Non-PCM WAVs carry the sample count; 0 = unknown while streaming
+  if (hasFact) {
+    memcpy(p, "fact", 4);
+    audioCodecPut32(p + 4, 4);
+    audioCodecPut32(p + 8, streaming ? 0 : audioCodecSamples);
+    p += 12;
+  }
+
+  memcpy(p, "data", 4);
+  audioCodecPut32(p + 4, streaming ? 0xFFFFFFFF : dataSize);
+  return headerSize;
+}
+
+#endif // AUDIO_CODEC_H
@@ -0,0 +1,75 @@
+#ifndef AUDIO_TRIM_H
+#define AUDIO_TRIM_H
+
+// Dependencies: device_config.h, vad.h and audio_codec.h must be included before this file
+//
+// Leaves silence out of the STT upload. recordAudio() hands every block to
+// audioTrimPush() after the VAD has seen it, and only the part worth sending
+// goes on to the encoder and the streaming upload:
+//
+//   recording: [ pre-roll, click | speech | long pause | speech | 1.5s to stop ]
+//   upload:             [ margin | speech | pause cut | speech | margin ]
+//
+// Nothing is sent until the VAD hears speech. After that, audio is released
+// up to TRIM_MARGIN_MS past the last speech-like frame; the rest waits until
+// speech resumes (sent, or shortened to TRIM_PAUSE_MS) or recording stops
+// (dropped). So the trailing silence that ends the recording is never
+// uploaded at all, not even by the streaming upload. A recording without any
+// speech is sent whole - the VAD may have missed a very quiet question.
+// PCM16 uploads can't leave a gap out, so they keep their pauses.
+
+#define TRIM_MARGIN_MS 150               // Kept before the first and after the last speech
+#define TRIM_PAUSE_MS 600                // Pauses inside the question are cut to this
+
+static int audioTrimCursor = -1;         // Next sample to release, -1 = no speech yet
+
+// Called by recordAudio() after each block; heard is how far the VAD got.
+// Returns the encoded bytes ready to send.
+int audioTrimPush(const Vad &vad, int heard) {
+  if (!ENABLE_SILENCE_TRIM) {
+    if (audioTrimCursor < 0) audioTrimCursor = 0;
+  } else {
+    if (vad.firstSpeechFrame < 0) return audioCodecBytes;
+
+    int margin = SAMPLE_RATE * TRIM_MARGIN_MS / 1000;
+    int segmentStart = vad.segmentStartFrame * vad.frameSamples;
+    if (audioTrimCursor < 0) {
+      audioTrimCursor = max(0, vad.firstSpeechFrame * vad.frameSamples - margin);
+    }
+
+    // Speech resumed after a pause that was held back: keep only its ends
+    int pauseLeft = SAMPLE_RATE * TRIM_PAUSE_MS / 1000 - margin;
+    if (ENABLE_PAUSE_TRIM && audioCodecCanSkip() && segmentStart - audioTrimCursor > pauseLeft) {
+      audioTrimCursor = segmentStart - pauseLeft;
+    }
+
+    int speechEnd = (vad.lastSpeechFrame + 1) * vad.frameSamples;
+    heard = min(heard, speechEnd + margin);
+  }
+
+  if (heard > audioTrimCursor) {
+    audioCodecAppend(audioTrimCursor, heard);
+    audioTrimCursor = heard;
+  }
+  return audioCodecBytes;
+}
+
+// Called by recordAudio() when recording stops. Releases the last margin (or
+// the whole recording if nobody spoke) and returns the samples uploaded.
+int audioTrimFinish(const Vad &vad, int recorded) {
+  if (vad.firstSpeechFrame < 0 || !ENABLE_SILENCE_TRIM) {
+    if (audioTrimCursor < 0) audioTrimCursor = 0;
+    audioCodecAppend(audioTrimCursor, recorded);
+  } else {
+    audioTrimPush(vad, recorded);
+  }
+  audioTrimCursor = -1;
+
+  if (audioCodecSamples < recorded) {
+    Serial.printf("[TRIM] Upload %d of %d samples (%dms of silence left out)\n", audioCodecSamples,
+                  recorded, (int)((int64_t)(recorded - audioCodecSamples) * 1000 / SAMPLE_RATE));
+  }
+  return audioCodecSamples;
+}
+
+#endif // AUDIO_TRIM_H
@@ -0,0 +1,202 @@
+#ifndef CHAT_CONTEXT_H
+#define CHAT_CONTEXT_H
+
+#include <HTTPClient.h>
+#include "http_pool.h"
+#include "json_stream.h"
+#include "chat_history.h"
+
+// Dependencies: secrets.h, device_config.h, str_builder.h, http_pool.h,
+// json_stream.h and chat_history.h must be included before this file
+//
+// Keeps the LLM request size flat in long chats. Only the newest turns of the
+// local chat tree are sent verbatim (CHAT_CONTEXT_KEEP_TURNS questions, within
+// CHAT_CONTEXT_BUDGET_BYTES); everything older is replaced by a short summary.
+// The summary is rolled forward by a background task after each answer, so the
+// question itself never waits for it. It is cached per chat; if it hasn't
+// caught up yet, the oldest turns are simply left out.
+//
+// The window is worked out once, before the request body is built; writing it
+// only copies, so strBuild() can run the fill twice.
+//
+// Usage:
+//   ChatContextWindow window = chatContextWindow();   // in askGPT()
+//   strBuild(body, [&](StrBuilder &b) { ...; chatContextWrite(b, window, systemPrompt); ... });
+//   chatSummaryUpdate();                              // after the turn is saved
+
+#define CHAT_SUMMARY_MAX_WORDS 120
+
+struct ChatSummary {
+  String chatId;           // Chat the summary belongs to
+  String text;
+  int covered;             // Context entries (oldest first) it replaces
+};
+
+static ChatSummary chatSummary = {"", "", 0};
+static SemaphoreHandle_t chatSummaryMutex = NULL;
+static TaskHandle_t chatSummaryTaskHandle = NULL;
+static volatile bool chatSummaryRunning = false;
+static StrBuilder chatSummaryBody;                // Request built for the worker (heap)
+static String chatSummaryBodyChatId = "";
+static int chatSummaryBodyCovered = 0;
+
+static void chatSummaryLock() {
+  if (chatSummaryMutex == NULL) chatSummaryMutex = xSemaphoreCreateMutex();
+  xSemaphoreTake(chatSummaryMutex, portMAX_DELAY);
+}
+
+static void chatSummaryUnlock() {
+  xSemaphoreGive(chatSummaryMutex);
+}
+
+// First context entry sent verbatim: the newest keepTurns questions (and the
+// answers after them) that fit the byte budget. The newest question always fits.
+int chatContextWindowStart(int keepTurns) {
+  int n = chatTree.entryCount;
+  int first = n;
+  int turns = 0;
+  int bytes = 0;
+  for (int i = n - 1; i >= 0; i--) {
+    bytes += chatTreeEntryEnd(i) - chatTree.entries[i].start + 1;
+    if (bytes > CHAT_CONTEXT_BUDGET_BYTES && first < n) break;
+    if (chatTree.entries[i].user) {
+      first = i;
+      if (++turns >= keepTurns) break;
+    }
+  }
+  return first;
+}
+
+// What the next LLM request sends of the chat tree
+struct ChatContextWindow {
+  int first;         // First entry sent verbatim
+  int start;         // Its offset in chatTree.context
+  String summary;    // Stands in for the entries before first ("" = left out)
+};
+
+ChatContextWindow chatContextWindow() {
+  int n = chatTree.entryCount;
+  ChatContextWindow w;
+  w.first = chatContextWindowStart(CHAT_CONTEXT_KEEP_TURNS);
+  w.start = w.first < n ? chatTree.entries[w.first].start : chatTree.context.length();
+  w.summary = "";
+  if (w.first > 0 && w.first < n) {
+    int covered = 0;
+    chatSummaryLock();
+    if (chatSummary.chatId == chatTree.chatId && chatSummary.covered <= w.first) {
+      w.summary = chatSummary.text;
+      covered = chatSummary.covered;
+    }
+    chatSummaryUnlock();
+    Serial.printf("[Context] %d of %d messages sent, %d summarized, %d left out\n", n - w.first, n, covered,
+                  w.first - covered);
+  }
+  return w;
+}
+
+// Messages array contents for the LLM; suffix (the system prompt) is appended
+// to the last user message
+void chatContextWrite(StrBuilder &b, const ChatContextWindow &w, const String &suffix) {
+  if (w.summary.length() > 0) {
+    b.add("{\"role\":\"system\",\"content\":\"Summary of the earlier conversation: ").json(w.summary).add("\"},");
+  }
+  const char *context = chatTree.context.c_str();
+  int end = chatTree.context.length();
+  if (chatTree.lastUserEnd >= w.start) {
+    b.add(context + w.start, chatTree.lastUserEnd - w.start).json(suffix)
+     .add(context + chatTree.lastUserEnd, end - chatTree.lastUserEnd);
+  } else {
+    b.add(context + w.start, end - w.start);
+  }
+}
+
+void chatSummaryTask(void *parameter) {
+  unsigned long start = millis();
+  HTTPClient &http = httpPoolBegin(String(OWUI_BASE_URL) + "/api/v1/chat/completions");
+  http.addHeader("Content-Type", "application/json");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.setTimeout(60000);
+
+  String summary = "";
+  int httpCode = httpPoolSend(http, "POST", chatSummaryBody.c_str(), chatSummaryBody.length());
+  if (httpCode == 200) {
+    JsonStream json;
+    json.capture("choices.0.message.content", summary);
+    jsonStreamHttp(http, json);
+  } else {
+    Serial.printf("[Context] Summary request failed: HTTP %d\n", httpCode);
+  }
+  httpPoolEnd(http);
+  summary.trim();
+
+  if (summary.length() > 0) {
+    chatSummaryLock();
+    chatSummary.chatId = chatSummaryBodyChatId;
+    chatSummary.text = summary;
+    chatSummary.covered = chatSummaryBodyCovered;
+    chatSummaryUnlock();
+    Serial.printf("[Context] Summary of %d messages updated (%d chars) in %lums\n",
+                  chatSummaryBodyCovered, summary.length(), millis() - start);
+  }
+
+  chatSummaryBody.release();
+  chatSummaryTaskHandle = NULL;
+  chatSummaryRunning = false;
+  vTaskDelete(NULL);
+}
+
+// Fold the turns that will fall out of the next question's window into the
+// summary. Returns right away; the request runs on core 0.
+void chatSummaryUpdate() {
+  if (!ENABLE_CHAT_SUMMARY || chatSummaryRunning || chatTree.chatId.length() == 0) return;
+
+  // The next question adds a turn, so look one turn ahead
+  int first = chatContextWindowStart(CHAT_CONTEXT_KEEP_TURNS - 1);
+
+  String previous = "";
+  int covered = 0;
+  chatSummaryLock();
+  if (chatSummary.chatId == chatTree.chatId) {
+    previous = chatSummary.text;
+    covered = chatSummary.covered;
+  }
+  chatSummaryUnlock();
+
+  // Wait for a whole question and answer to fall out of the window
+  if (first - covered < 2) return;
+
+  // Heap, not the body arena: the request outlives the question
+  int from = chatTree.entries[covered].start;
+  int to = chatTreeEntryEnd(first - 1);
+  bool built = strBuild(chatSummaryBody, [&](StrBuilder &b) {
+    b.add("{\"model\":").quoted(LLM_MODEL)
+     .add(",\"stream\":false,\"messages\":["
+          "{\"role\":\"system\",\"content\":\"You keep a running summary of a conversation "
+          "between a user and a voice assistant.\"},");
+    if (previous.length() > 0) {
+      b.add("{\"role\":\"system\",\"content\":\"Summary so far: ").json(previous).add("\"},");
+    }
+    b.add(chatTree.context.c_str() + from, to - from)
+     .add(",{\"role\":\"user\",\"content\":\"Update the summary with the messages above in at most ")
+     .num(CHAT_SUMMARY_MAX_WORDS)
+     .add(" words. Keep names, facts and open questions. Reply with the summary only.\"}]}");
+  }, nullptr);
+  if (!built) {
+    chatSummaryBody.release();
+    Serial.println("[Context] No memory for the summary request");
+    return;
+  }
+  chatSummaryBodyChatId = chatTree.chatId;
+  chatSummaryBodyCovered = first;
+  chatSummaryRunning = true;
+
+  Serial.printf("[Context] Summarizing messages %d-%d in the background\n", covered, first - 1);
+  if (xTaskCreatePinnedToCore(chatSummaryTask, "chatSummary", 8192, NULL, 1, &chatSummaryTaskHandle, 0) != pdPASS) {
+    Serial.println("[Context] Failed to start summary task");
+    chatSummaryBody.release();
+    chatSummaryTaskHandle = NULL;
+    chatSummaryRunning = false;
+  }
+}
+
+#endif // CHAT_CONTEXT_H
@@ -0,0 +1,352 @@
+#ifndef CHAT_HISTORY_H
+#define CHAT_HISTORY_H
+
+#include <HTTPClient.h>
+#include "http_pool.h"
+#include "json_stream.h"
+
+// Dependencies: secrets.h, mem_alloc.h, str_builder.h, http_pool.h and
+// json_stream.h must be included before this file
+//
+// Local copy of the current OpenWebUI chat tree. OpenWebUI stores a chat as
+//
+//   {"id": ..., "updated_at": ..., "chat": {"history": {"messages": {"<msgId>":
+//     {"id": ..., "parentId": ..., "childrenIds": [...], "role": ...,
+//      "content": ...}, ...}, "currentId": ...}, ...}}
+//
+// and every update has to send history.messages in full. Instead of reading the
+// chat back before each write, the device keeps the tree here: it is seeded
+// when the chat is created (or read once with chatTreeSync()), new messages are
+// linked in locally with chatTreeAdd(), and the write body and the LLM context
+// are built from the copy. The server is only asked again when the chat's
+// updated_at no longer matches the version we last wrote, or the chat is gone.
+// A version the server didn't report is unknown: the next check takes the
+// listed one instead of refetching.
+//
+// Messages read from the server are kept verbatim, so fields the device doesn't
+// know about (files, usage, ...) survive the round trip.
+
+#define CHAT_TREE_ID_MAX 40
+#define CHAT_TREE_RECHECK_MS 30000      // A version check this recent is trusted
+#define CHAT_VERSION_UNKNOWN 0          // updated_at missing from a response, or chat not listed
+
+struct ChatTreeNode {
+  char id[CHAT_TREE_ID_MAX];
+  int childrenEnd;         // Offset of the ']' closing childrenIds in ChatTree::messages
+  int children;
+};
+
+struct ChatTreeEntry {
+  int start;               // Offset of the message object in ChatTree::context
+  bool user;
+};
+
+struct ChatTree {
+  String chatId;           // Chat the copy belongs to, "" when empty
+  long updatedAt;          // Server's updated_at after our last read or write (or CHAT_VERSION_UNKNOWN)
+  unsigned long checkedAt; // millis() when the copy was last known to match the server
+  String currentId;        // Leaf of the current branch, "" for a new chat
+  String messages;         // Body of history.messages, without the outer braces
+  String context;          // Chat Completions messages array, in stored order
+  int lastUserEnd;         // Where the last user message's content ends in context
+  ChatTreeNode *nodes;
+  int count;
+  int capacity;
+  ChatTreeEntry *entries;  // One per message in context
+  int entryCount;
+  int entryCapacity;
+};
+
+ChatTree chatTree = {"", 0, 0, "", "", "", -1, nullptr, 0, 0, nullptr, 0, 0};
+
+static String chatJsonEscape(const String &text) {
+  return jsonEscape(text);   // str_builder.h
+}
+
+void chatTreeInvalidate() {
+  chatTree.chatId = "";
+  chatTree.updatedAt = CHAT_VERSION_UNKNOWN;
+  chatTree.checkedAt = 0;
+  chatTree.currentId = "";
+  chatTree.messages = "";
+  chatTree.context = "";
+  chatTree.lastUserEnd = -1;
+  chatTree.count = 0;
+  chatTree.entryCount = 0;
+}
+
+// Start an empty tree for a chat that was just created
+void chatTreeReset(const String &chatId, long updatedAt) {
+  chatTreeInvalidate();
+  chatTree.chatId = chatId;
+  chatTree.updatedAt = updatedAt;
+  chatTree.checkedAt = millis();
+}
+
+static int chatTreeFind(const String &id) {
+  for (int i = 0; i < chatTree.count; i++) {
+    if (id == chatTree.nodes[i].id) return i;
+  }
+  return -1;
+}
+
+bool chatTreeHas(const String &id) {
+  return chatTreeFind(id) >= 0;
+}
+
+static bool chatTreeAddNode(const char *id, int childrenEnd, int children) {
+  if (chatTree.count == chatTree.capacity) {
+    int capacity = chatTree.capacity ? chatTree.capacity * 2 : 16;
+    ChatTreeNode *grown = (ChatTreeNode *)memRealloc(chatTree.nodes, capacity * sizeof(ChatTreeNode), MEM_CHAT);
+    if (!grown) return false;
+    chatTree.nodes = grown;
+    chatTree.capacity = capacity;
+  }
+  ChatTreeNode &node = chatTree.nodes[chatTree.count++];
+  strncpy(node.id, id, CHAT_TREE_ID_MAX - 1);
+  node.id[CHAT_TREE_ID_MAX - 1] = '\0';
+  node.childrenEnd = childrenEnd;
+  node.children = children;
+  return true;
+}
+
+static void chatTreeAddContext(const String &role, const String &content) {
+  if (chatTree.entryCount == chatTree.entryCapacity) {
+    int capacity = chatTree.entryCapacity ? chatTree.entryCapacity * 2 : 16;
+    ChatTreeEntry *grown = (ChatTreeEntry *)memRealloc(chatTree.entries, capacity * sizeof(ChatTreeEntry), MEM_CHAT);
+    if (!grown) return;
+    chatTree.entries = grown;
+    chatTree.entryCapacity = capacity;
+  }
+  if (chatTree.context.length() > 0) chatTree.context += ",";
+  chatTree.entries[chatTree.entryCount].start = chatTree.context.length();
+  chatTree.entries[chatTree.entryCount].user = role == "user";
+  chatTree.entryCount++;
+  chatTree.context += "{\"role\":\"" + role + "\",\"content\":\"" + chatJsonEscape(content);
+  if (role == "user") chatTree.lastUserEnd = chatTree.context.length();
+  chatTree.context += "\"}";
+}
+
+// Append a message and link it under parentId. extraFields are added to the
+// stored message as-is ("\"timestamp\":...,\"model\":\"...\"").
+void chatTreeAdd(const String &id, const String &parentId, const String &role,
+                 const String &content, const String &extraFields) {
+  int parent = parentId.length() > 0 ? chatTreeFind(parentId) : -1;
+  if (parent >= 0) {
+    ChatTreeNode &p = chatTree.nodes[parent];
+    String entry = (p.children > 0 ? ",\"" : "\"") + id + "\"";
+    int pos = p.childrenEnd;
+    chatTree.messages = chatTree.messages.substring(0, pos) + entry + chatTree.messages.substring(pos);
+    p.children++;
+    for (int i = 0; i < chatTree.count; i++) {
+      if (chatTree.nodes[i].childrenEnd >= pos) chatTree.nodes[i].childrenEnd += entry.length();
+    }
+  }
+
+  if (chatTree.messages.length() > 0) chatTree.messages += ",";
+  chatTree.messages += "\"" + id + "\":{"
+                       "\"id\":\"" + id + "\","
+                       "\"parentId\":" + (parentId.length() > 0 ? "\"" + parentId + "\"" : String("null")) + ","
+                       "\"childrenIds\":[";
+  chatTreeAddNode(id.c_str(), chatTree.messages.length(), 0);
+  chatTree.messages += "],"
+                       "\"role\":\"" + role + "\","
+                       "\"content\":\"" + chatJsonEscape(content) + "\"";
+  if (extraFields.length() > 0) chatTree.messages += "," + extraFields;
+  chatTree.messages += "}";
+
+  chatTreeAddContext(role, content);
+  chatTree.currentId = id;
+}
+
+// history object for a chat update body
+void chatTreeHistoryJson(StrBuilder &b) {
+  b.add("{\"messages\":{").add(chatTree.messages).add("},\"currentId\":");
+  if (chatTree.currentId.length() > 0) {
+    b.quoted(chatTree.currentId);
+  } else {
+    b.add("null");
+  }
+  b.add('}');
+}
+
+// End of context entry i (its closing brace + 1)
+int chatTreeEntryEnd(int i) {
+  return i + 1 < chatTree.entryCount ? chatTree.entries[i + 1].start - 1 : chatTree.context.length();
+}
+
+struct ChatTreeReader {
+  String role;
+  String content;
+  int children;            // childrenIds entries of the message being read
+};
+
+static void chatTreeEvent(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx) {
+  ChatTreeReader &r = *(ChatTreeReader *)ctx;
+  switch (event) {
+    case JSON_OBJECT_BEGIN:
+      if (json.match("chat.history.messages")) {
+        json.raw = &chatTree.messages;
+      } else if (json.match("chat.history.messages.*")) {
+        r.role = "";
+        r.content = "";
+      }
+      break;
+    case JSON_OBJECT_END:
+      if (json.match("chat.history.messages")) {
+        json.raw = nullptr;
+        chatTree.messages.remove(chatTree.messages.length() - 1); // Closing brace
+      } else if (json.match("chat.history.messages.*") && r.role.length() > 0) {
+        chatTreeAddContext(r.role, r.content);
+      }
+      break;
+    case JSON_ARRAY_BEGIN:
+      if (json.match("chat.history.messages.*.childrenIds")) r.children = 0;
+      break;
+    case JSON_STRING_END:
+      if (json.match("chat.history.messages.*.childrenIds.*")) r.children++;
+      break;
+    case JSON_ARRAY_END:
+      if (json.match("chat.history.messages.*.childrenIds")) {
+        // messages currently ends with the array's ']'
+        chatTreeAddNode(json.keyAt(3), chatTree.messages.length() - 1, r.children);
+      }
+      break;
+    case JSON_NUMBER:
+      if (json.match("updated_at")) chatTree.updatedAt = atol(data);
+      break;
+    default:
+      break;
+  }
+}
+
+// Replace the copy with the server's chat; returns the HTTP code
+int chatTreeLoad(const String &chatId) {
+  Serial.println("[Chat] Reading chat tree from server...");
+  chatTreeInvalidate();
+
+  HTTPClient &http = httpPoolBegin(String(OWUI_BASE_URL) + "/api/v1/chats/" + chatId);
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  int httpCode = httpPoolSend(http, "GET");
+  if (httpCode != 200) {
+    httpPoolEnd(http);
+    Serial.printf("[Chat] Read failed: HTTP %d\n", httpCode);
+    return httpCode;
+  }
+
+  ChatTreeReader r;
+  r.children = 0;
+  JsonStream json;
+  json.capture("chat.history.currentId", chatTree.currentId);
+  json.capture("chat.history.messages.*.role", r.role);
+  json.capture("chat.history.messages.*.content", r.content);
+  json.onEvent(chatTreeEvent, &r);
+  bool ok = jsonStreamHttp(http, json);
+  httpPoolEnd(http);
+
+  if (!ok) {
+    chatTreeInvalidate();
+    return -1;
+  }
+  chatTree.chatId = chatId;
+  chatTree.checkedAt = millis();
+  Serial.printf("[Chat] %d messages, %d bytes, version %ld\n",
+                chatTree.count, chatTree.messages.length(), chatTree.updatedAt);
+  return 200;
+}
+
+struct ChatVersionReader {
+  const String *chatId;
+  String id;
+  long updatedAt;
+  long found;              // updated_at of chatId, CHAT_VERSION_UNKNOWN if not listed
+};
+
+static void chatVersionEvent(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx) {
+  ChatVersionReader &r = *(ChatVersionReader *)ctx;
+  if (event == JSON_OBJECT_BEGIN && json.match("*")) {
+    r.id = "";
+    r.updatedAt = CHAT_VERSION_UNKNOWN;
+  } else if (event == JSON_NUMBER && json.match("*.updated_at")) {
+    r.updatedAt = atol(data);
+  } else if (event == JSON_OBJECT_END && json.match("*") && r.id == *r.chatId) {
+    r.found = r.updatedAt;
+  }
+}
+
+// Server's updated_at for chatId from the (small) first page of the chat
+// list into version, CHAT_VERSION_UNKNOWN if the chat isn't on it. False if
+// the list couldn't be read.
+static bool chatTreeServerVersion(const String &chatId, long &version) {
+  HTTPClient &http = httpPoolBegin(String(OWUI_BASE_URL) + "/api/v1/chats/list?page=1");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  int httpCode = httpPoolSend(http, "GET");
+  if (httpCode != 200) {
+    httpPoolEnd(http);
+    Serial.printf("[Chat] Version check failed: HTTP %d\n", httpCode);
+    return false;
+  }
+
+  ChatVersionReader r;
+  r.chatId = &chatId;
+  r.updatedAt = CHAT_VERSION_UNKNOWN;
+  r.found = CHAT_VERSION_UNKNOWN;
+  JsonStream json;
+  json.capture("*.id", r.id);
+  json.onEvent(chatVersionEvent, &r);
+  bool ok = jsonStreamHttp(http, json);
+  httpPoolEnd(http);
+  version = r.found;
+  return ok;
+}
+
+// Make sure the copy matches chatId on the server. With checkVersion the
+// server's updated_at is compared first (someone may have edited the chat in
+// the web UI) unless that was already done in the last CHAT_TREE_RECHECK_MS;
+// without it the copy is trusted. The list is newest first, so a chat that
+// isn't on its first page hasn't been edited since it dropped off, and the
+// copy is kept. Returns the HTTP code of the refetch, or 200 when the copy
+// was used.
+int chatTreeSync(const String &chatId, bool checkVersion) {
+  if (chatTree.chatId == chatId) {
+    if (!checkVersion || millis() - chatTree.checkedAt < CHAT_TREE_RECHECK_MS) return 200;
+    long version = CHAT_VERSION_UNKNOWN;
+    if (chatTreeServerVersion(chatId, version)) {
+      if (version == CHAT_VERSION_UNKNOWN) {
+        Serial.println("[Chat] Not on the first page of the chat list, keeping the local copy");
+      } else if (chatTree.updatedAt == CHAT_VERSION_UNKNOWN) {
+        Serial.printf("[Chat] Version %ld taken from the chat list\n", version);
+        chatTree.updatedAt = version;
+      } else if (version != chatTree.updatedAt) {
+        Serial.printf("[Chat] Version changed (%ld -> %ld), refetching\n", chatTree.updatedAt, version);
+        return chatTreeLoad(chatId);
+      }
+      Serial.printf("[Chat] Local copy is current (%d messages)\n", chatTree.count);
+      chatTree.checkedAt = millis();
+      return 200;
+    }
+  }
+  return chatTreeLoad(chatId);
+}
+
+// Top-level updated_at of a chat response into *(long *)ctx
+static void chatVersionField(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx) {
+  if (event == JSON_NUMBER && json.match("updated_at")) *(long *)ctx = atol(data);
+}
+
+// Version (updated_at) from a successful chat create/update response,
+// CHAT_VERSION_UNKNOWN if missing
+long chatReadVersion(HTTPClient &http) {
+  long version = CHAT_VERSION_UNKNOWN;
+  JsonStream json;
+  json.onEvent(chatVersionField, &version);
+  jsonStreamHttp(http, json);
+  return version;
+}
+
+// Pick the new version out of a successful chat update response
+void chatTreeNoteWrite(HTTPClient &http) {
+  chatTree.updatedAt = chatReadVersion(http);
+}
+
+#endif // CHAT_HISTORY_H
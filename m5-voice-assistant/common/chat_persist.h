@@ -0,0 +1,261 @@
+#ifndef CHAT_PERSIST_H
+#define CHAT_PERSIST_H
+
+#include <HTTPClient.h>
+#include "http_pool.h"
+#include "chat_history.h"
+
+// Dependencies: secrets.h, device_config.h, mem_alloc.h, http_pool.h,
+// json_stream.h and chat_history.h must be included before this file
+//
+// Background writes of finished turns to OpenWebUI. chatCompleted() and
+// saveChatHistory() build their request on the main loop (the chat tree is
+// only touched there) and queue it; a low-priority worker on core 0 sends it
+// while the answer is already being shown and spoken.
+//
+// - Saves are coalesced: every save carries the whole history, so a newer
+//   save for the same chat replaces one that hasn't been sent yet, and the
+//   next question's own update (chatPersistSupersede()) replaces both.
+// - Failed requests are kept and retried with exponential backoff; a chat
+//   that is gone (401/404) is dropped and recreated on the next question.
+// - A queued job keeps its own copy of the body (MEM_BODY): the body arena
+//   it was built in is reset by the next question.
+//
+// With ENABLE_CHAT_PERSIST false, requests are sent right away as before.
+
+#define CHAT_PERSIST_QUEUE_LEN 4
+#define CHAT_PERSIST_MAX_ATTEMPTS 6
+#define CHAT_PERSIST_BACKOFF_MS 1000     // Doubled after each failed attempt
+#define CHAT_PERSIST_POLL_MS 100
+
+enum ChatPersistKind {
+  CHAT_PERSIST_COMPLETED,  // POST /api/chat/completed
+  CHAT_PERSIST_SAVE,       // POST /api/v1/chats/{id} with the full history
+};
+
+struct ChatPersistJob {
+  bool used;
+  bool inFlight;
+  ChatPersistKind kind;
+  String chatId;
+  char *body;              // memAlloc(MEM_BODY), NUL-terminated
+  size_t bodyLength;
+  int attempts;
+  unsigned long notBefore; // millis() of the next attempt
+};
+
+static ChatPersistJob chatPersistJobs[CHAT_PERSIST_QUEUE_LEN];
+static SemaphoreHandle_t chatPersistMutex = NULL;
+static TaskHandle_t chatPersistTaskHandle = NULL;
+static String chatPersistVersionChat = "";  // Chat and updated_at of the last save, applied
+static long chatPersistVersion = 0;         // to the chat tree by the main loop
+
+static void chatPersistLock() {
+  xSemaphoreTake(chatPersistMutex, portMAX_DELAY);
+}
+
+static void chatPersistUnlock() {
+  xSemaphoreGive(chatPersistMutex);
+}
+
+static void chatPersistDrop(ChatPersistJob &job) {
+  job.used = false;
+  job.chatId = "";
+  memFree(job.body);
+  job.body = nullptr;
+  job.bodyLength = 0;
+}
+
+// Send one request; returns the HTTP code
+static int chatPersistSend(ChatPersistKind kind, const String &chatId, const char *body, size_t length,
+                           long &version) {
+  String url = kind == CHAT_PERSIST_SAVE ? String(OWUI_BASE_URL) + "/api/v1/chats/" + chatId
+                                         : String(OWUI_BASE_URL) + "/api/chat/completed";
+  HTTPClient &http = httpPoolBegin(url);
+  http.addHeader("Content-Type", "application/json");
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.setTimeout(30000);
+
+  int httpCode = httpPoolSend(http, "POST", body, length);
+  if (httpCode >= 200 && httpCode < 300) {
+    if (kind == CHAT_PERSIST_SAVE) version = chatReadVersion(http);
+  } else {
+    Serial.printf("[Persist] %s failed: HTTP %d\n", kind == CHAT_PERSIST_SAVE ? "Save" : "Completed", httpCode);
+    if (httpCode > 0) Serial.println(http.getString());
+  }
+  httpPoolEnd(http);
+  return httpCode;
+}
+
+static int chatPersistNext() {
+  unsigned long now = millis();
+  for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN; i++) {
+    ChatPersistJob &job = chatPersistJobs[i];
+    if (job.used && !job.inFlight && (long)(now - job.notBefore) >= 0) return i;
+  }
+  return -1;
+}
+
+void chatPersistTask(void *parameter) {
+  for (;;) {
+    chatPersistLock();
+    int slot = chatPersistNext();
+    if (slot >= 0) chatPersistJobs[slot].inFlight = true;
+    chatPersistUnlock();
+
+    if (slot < 0) {
+      delay(CHAT_PERSIST_POLL_MS);
+      continue;
+    }
+
+    // In-flight jobs are left alone by the main loop, so no copy is needed
+    ChatPersistJob &job = chatPersistJobs[slot];
+    unsigned long start = millis();
+    long version = 0;
+    int httpCode = chatPersistSend(job.kind, job.chatId, job.body, job.bodyLength, version);
+    bool ok = httpCode >= 200 && httpCode < 300;
+    bool gone = httpCode == 401 || httpCode == 404;
+
+    chatPersistLock();
+    job.attempts++;
+    if (ok && job.kind == CHAT_PERSIST_SAVE) {
+      chatPersistVersionChat = job.chatId;
+      chatPersistVersion = version;
+    }
+
+    // A newer save for this chat makes a failed one pointless
+    bool replaced = false;
+    for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN; i++) {
+      ChatPersistJob &other = chatPersistJobs[i];
+      if (i != slot && other.used && other.kind == CHAT_PERSIST_SAVE && other.chatId == job.chatId) replaced = true;
+    }
+
+    if (ok || gone || job.attempts >= CHAT_PERSIST_MAX_ATTEMPTS ||
+        (job.kind == CHAT_PERSIST_SAVE && replaced)) {
+      if (ok) {
+        Serial.printf("[Persist] %s stored in %lums\n", job.kind == CHAT_PERSIST_SAVE ? "Save" : "Completed",
+                      millis() - start);
+      } else if (!gone && !replaced) {
+        Serial.printf("[Persist] Giving up after %d attempts\n", job.attempts);
+      }
+      chatPersistDrop(job);
+    } else {
+      unsigned long backoff = (unsigned long)CHAT_PERSIST_BACKOFF_MS << (job.attempts - 1);
+      job.notBefore = millis() + backoff;
+      Serial.printf("[Persist] Retry %d in %lums\n", job.attempts, backoff);
+    }
+    job.inFlight = false;
+    chatPersistUnlock();
+  }
+}
+
+bool chatPersistBegin() {
+  if (!ENABLE_CHAT_PERSIST) return false;
+  if (chatPersistTaskHandle != NULL) return true;
+  chatPersistMutex = xSemaphoreCreateMutex();
+  for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN; i++) {
+    chatPersistJobs[i].used = false;
+    chatPersistJobs[i].inFlight = false;
+    chatPersistJobs[i].body = nullptr;
+    chatPersistJobs[i].bodyLength = 0;
+  }
+
+  // Idle priority: only runs when core 0 has nothing else to do
+  if (xTaskCreatePinnedToCore(chatPersistTask, "chatPersist", 8192, NULL, 0, &chatPersistTaskHandle, 0) != pdPASS) {
+    Serial.println("[Persist] Failed to start worker task");
+    chatPersistTaskHandle = NULL;
+    return false;
+  }
+  return true;
+}
+
+// Queue a copy of the request (or send it now, without the worker or the
+// memory for a copy). Returns false only if it was sent synchronously and failed.
+bool chatPersistPost(ChatPersistKind kind, const String &chatId, const char *body, size_t length) {
+  chatPersistBegin();
+  char *copy = nullptr;
+  if (chatPersistTaskHandle != NULL) {
+    copy = (char *)memAlloc(length + 1, MEM_BODY);
+    if (copy) {
+      memcpy(copy, body, length);
+      copy[length] = '\0';
+    }
+  }
+  if (copy == nullptr) {
+    long version = 0;
+    int httpCode = chatPersistSend(kind, chatId, body, length, version);
+    if (httpCode < 200 || httpCode >= 300) return false;
+    if (kind == CHAT_PERSIST_SAVE && chatTree.chatId == chatId) chatTree.updatedAt = version;
+    return true;
+  }
+
+  for (;;) {
+    chatPersistLock();
+    int slot = -1;
+    for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN && slot < 0; i++) {
+      ChatPersistJob &job = chatPersistJobs[i];
+      // Coalesce: the newer save carries everything the pending one does
+      if (kind == CHAT_PERSIST_SAVE && job.used && !job.inFlight &&
+          job.kind == CHAT_PERSIST_SAVE && job.chatId == chatId) {
+        slot = i;
+      }
+    }
+    for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN && slot < 0; i++) {
+      if (!chatPersistJobs[i].used) slot = i;
+    }
+    if (slot >= 0) {
+      ChatPersistJob &job = chatPersistJobs[slot];
+      memFree(job.body);   // The coalesced save's older body
+      job.used = true;
+      job.inFlight = false;
+      job.kind = kind;
+      job.chatId = chatId;
+      job.body = copy;
+      job.bodyLength = length;
+      job.attempts = 0;
+      job.notBefore = millis();
+    }
+    chatPersistUnlock();
+    if (slot >= 0) return true;
+
+    Serial.println("[Persist] Queue full, waiting...");
+    delay(CHAT_PERSIST_POLL_MS);
+  }
+}
+
+// Apply the version of the last background save to the chat tree
+void chatPersistApplyVersion() {
+  chatPersistLock();
+  if (chatPersistVersionChat.length() > 0 && chatPersistVersionChat == chatTree.chatId) {
+    chatTree.updatedAt = chatPersistVersion;
+  }
+  chatPersistVersionChat = "";
+  chatPersistUnlock();
+}
+
+// Called before the main loop writes the chat itself: drops queued saves for
+// chatId (the new write carries the same history and more) and waits for one
+// that is already being sent, so writes reach the server in order.
+void chatPersistSupersede(const String &chatId) {
+  if (chatPersistTaskHandle == NULL) return;
+  for (;;) {
+    bool sending = false;
+    chatPersistLock();
+    for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN; i++) {
+      ChatPersistJob &job = chatPersistJobs[i];
+      if (!job.used || job.kind != CHAT_PERSIST_SAVE || job.chatId != chatId) continue;
+      if (job.inFlight) {
+        sending = true;
+      } else {
+        chatPersistDrop(job);
+        Serial.println("[Persist] Queued save replaced by chat update");
+      }
+    }
+    chatPersistUnlock();
+    if (!sending) break;
+    delay(20);
+  }
+  chatPersistApplyVersion();
+}
+
+#endif // CHAT_PERSIST_H
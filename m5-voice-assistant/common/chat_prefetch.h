@@ -0,0 +1,119 @@
+#ifndef CHAT_PREFETCH_H
+#define CHAT_PREFETCH_H
+
+#include "http_pool.h"
+#include "chat_history.h"
+#include "chat_persist.h"
+
+// Dependencies: secrets.h, device_config.h, http_pool.h, chat_history.h and
+// chat_persist.h must be included before this file
+//
+// Chat set-up that doesn't depend on the transcript, done on core 0 while the
+// user is still speaking:
+//   - create the OpenWebUI chat session if there is none (first question,
+//     "New Chat"), or check that the local chat tree is still current
+//   - allocate the message IDs for the next question
+//   - open the connection to the LLM host
+// recordAudio() starts it and refreshes the connection when recording ends
+// (a long recording outlives the keep-alive window); askGPT() waits for it
+// before it touches the chat state. A task graph (voice_graph.h) can run the
+// same steps as its own stages instead.
+
+// External references (defined in the main .ino)
+extern String currentChatId;
+extern String currentSessionId;
+String generateUUID();
+String createChatSession(const String &title);
+
+static TaskHandle_t chatPrefetchTaskHandle = NULL;
+static volatile bool chatPrefetchRunning = false;
+static bool chatPrefetchWarmOnly = false;
+static bool chatPrefetchByGraph = false;        // Stages are scheduled by a task graph
+static String chatPrefetchUserMsgId = "";
+static String chatPrefetchAssistantMsgId = "";
+
+static String chatPrefetchLlmUrl() {
+  return USE_OWUI_SESSIONS ? String(OWUI_BASE_URL) : String(LLM_URL);
+}
+
+// Session (created or checked) and message IDs for the next question
+void chatPrefetchChat() {
+  if (USE_OWUI_SESSIONS) {
+    if (currentChatId.length() > 0) {
+      chatPersistApplyVersion();
+      int syncCode = chatTreeSync(currentChatId, true);
+      if (syncCode == 401 || syncCode == 404) {
+        Serial.println("[Prefetch] Chat no longer exists");
+        currentChatId = "";
+      }
+    }
+    if (currentChatId.length() == 0) {
+      currentChatId = createChatSession("M5 Voice Assistant");
+      currentSessionId = generateUUID();
+    }
+    if (chatPrefetchUserMsgId.length() == 0) {
+      chatPrefetchUserMsgId = generateUUID();
+      chatPrefetchAssistantMsgId = generateUUID();
+    }
+  }
+}
+
+// Open the LLM connection; a single pooled socket is busy with the
+// transcription upload, so only with two or more
+bool chatPrefetchConnection() {
+  return HTTP_POOL_SIZE > 1 && httpPoolWarm(chatPrefetchLlmUrl());
+}
+
+void chatPrefetchTask(void *parameter) {
+  unsigned long start = millis();
+  if (!chatPrefetchWarmOnly) chatPrefetchChat();
+  bool warm = chatPrefetchConnection();
+
+  Serial.printf("[Prefetch] %s%s in %lums\n", chatPrefetchWarmOnly ? "" : "Chat ready, ",
+                warm ? "LLM connection open" : "no connection warmed", millis() - start);
+  chatPrefetchTaskHandle = NULL;
+  chatPrefetchRunning = false;
+  vTaskDelete(NULL);
+}
+
+static void chatPrefetchStart(bool warmOnly) {
+  if (!ENABLE_CHAT_PREFETCH || chatPrefetchByGraph || chatPrefetchRunning || WiFi.status() != WL_CONNECTED) return;
+  chatPrefetchWarmOnly = warmOnly;
+  chatPrefetchRunning = true;
+  if (xTaskCreatePinnedToCore(chatPrefetchTask, "chatPrefetch", 8192, NULL, 1, &chatPrefetchTaskHandle, 0) != pdPASS) {
+    Serial.println("[Prefetch] Failed to start task");
+    chatPrefetchTaskHandle = NULL;
+    chatPrefetchRunning = false;
+  }
+}
+
+// Recording started
+void chatPrefetchBegin() {
+  chatPrefetchStart(false);
+}
+
+// Recording ended: reopen the LLM connection if it went idle meanwhile
+void chatPrefetchWarm() {
+  chatPrefetchStart(true);
+}
+
+void chatPrefetchWait() {
+  while (chatPrefetchRunning) {
+    delay(10);
+  }
+}
+
+// Message IDs for the next question (prefetched ones if available)
+void chatPrefetchTakeIds(String &userMsgId, String &assistantMsgId) {
+  if (chatPrefetchUserMsgId.length() > 0) {
+    userMsgId = chatPrefetchUserMsgId;
+    assistantMsgId = chatPrefetchAssistantMsgId;
+    chatPrefetchUserMsgId = "";
+    chatPrefetchAssistantMsgId = "";
+  } else {
+    userMsgId = generateUUID();
+    assistantMsgId = generateUUID();
+  }
+}
+
+#endif // CHAT_PREFETCH_H
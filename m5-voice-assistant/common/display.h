@@ -6,11 +6,11 @@
 // External references
 extern int WIDTH;
 extern int HEIGHT;
-extern const int VAD_SILENCE_THRESHOLD;
 
 // Real-time audio display state
 extern volatile bool isRecording;
 extern volatile int currentRmsLevel;
+extern volatile bool currentVadSpeech;
 extern volatile int recordingSecondsLeft;
 
 // Track previous values to avoid unnecessary redraws
@@ -135,7 +135,7 @@ void drawAudioLevel(int seconds, int rmsLevel) {
   }
   
   // Only update status text if speaking state changed
-  bool isSpeaking = (rmsLevel >= VAD_SILENCE_THRESHOLD);
+  bool isSpeaking = currentVadSpeech;
   if (isSpeaking != lastSpeakingState) {
     // Clear status area
     M5.Display.fillRect(0, HEIGHT - 25, WIDTH, 20, TFT_BLACK);
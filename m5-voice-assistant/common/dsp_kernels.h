@@ -0,0 +1,109 @@
+#ifndef DSP_KERNELS_H
+#define DSP_KERNELS_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Block kernels for 16-bit audio: sum of squares (RMS), peak and mean
+// absolute level. recordAudio() runs them once per mic block and merges the
+// results, so the recording's overall stats are ready when it stops - no
+// second pass over audioBuffer.
+//
+// Everything is portable C. The sum of squares adds two squares in 32 bits
+// before each 64-bit add; peak and absolute level are a load, compare and add
+// per sample. There is no SIMD version, and so no SIMD-vs-scalar test:
+// - a 512-sample block costs a few microseconds against the 32ms it takes
+//   to record, so vector code would save nothing audible
+// - the ESP32-S3 PIE instructions only exist on the CoreS3, and a PIE kernel
+//   would have to be built and checked against these loops on one first
+// - esp-dsp's dsps_dotprod_s16() returns a shifted, saturated int16, not the
+//   exact 64-bit sum the level meter and the STT stats use
+//
+// An empty block (or recording) has all stats 0.
+//
+// Usage:
+//   DspStats block;
+//   dspStats(block, samples, n);        // one block
+//   int rms = dspRms(block);
+//   dspMerge(total, block);             // running stats for the recording
+
+struct DspStats {
+  int64_t sumSquares;
+  int64_t absSum;
+  int16_t minVal;
+  int16_t maxVal;
+  int count;
+};
+
+void dspReset(DspStats &s) {
+  s.sumSquares = 0;
+  s.absSum = 0;
+  s.minVal = 0;
+  s.maxVal = 0;
+  s.count = 0;
+}
+
+int64_t dspSumSquares(const int16_t *x, int n) {
+  int64_t total = 0;
+  int i = 0;
+  // Two squares fit in 32 bits unsigned, which halves the 64-bit adds
+  for (; i + 1 < n; i += 2) {
+    uint32_t pair = (uint32_t)((int32_t)x[i] * x[i]) + (uint32_t)((int32_t)x[i + 1] * x[i + 1]);
+    total += pair;
+  }
+  if (i < n) total += (int32_t)x[i] * x[i];
+  return total;
+}
+
+// Peak (min/max) and sum of absolute values in one pass
+void dspPeakAbs(const int16_t *x, int n, int16_t &minVal, int16_t &maxVal, int64_t &absSum) {
+  int32_t lo = minVal, hi = maxVal;
+  while (n > 0) {
+    int span = n < 65536 ? n : 65536;    // 65536 * 32768 still fits in 32 bits
+    uint32_t sum = 0;
+    for (int i = 0; i < span; i++) {
+      int32_t s = x[i];
+      if (s < lo) lo = s;
+      if (s > hi) hi = s;
+      sum += s < 0 ? -s : s;
+    }
+    absSum += sum;
+    x += span;
+    n -= span;
+  }
+  minVal = lo;
+  maxVal = hi;
+}
+
+void dspStats(DspStats &s, const int16_t *x, int n) {
+  dspReset(s);
+  if (n <= 0) return;
+  s.sumSquares = dspSumSquares(x, n);
+  s.minVal = 32767;
+  s.maxVal = -32768;
+  dspPeakAbs(x, n, s.minVal, s.maxVal, s.absSum);
+  s.count = n;
+}
+
+void dspMerge(DspStats &total, const DspStats &block) {
+  if (block.count == 0) return;
+  if (total.count == 0) {
+    total.minVal = block.minVal;
+    total.maxVal = block.maxVal;
+  }
+  total.sumSquares += block.sumSquares;
+  total.absSum += block.absSum;
+  if (block.minVal < total.minVal) total.minVal = block.minVal;
+  if (block.maxVal > total.maxVal) total.maxVal = block.maxVal;
+  total.count += block.count;
+}
+
+int dspRms(const DspStats &s) {
+  return s.count > 0 ? (int)sqrtf((float)(s.sumSquares / s.count)) : 0;
+}
+
+int dspAbsMean(const DspStats &s) {
+  return s.count > 0 ? (int)(s.absSum / s.count) : 0;
+}
+
+#endif // DSP_KERNELS_H
@@ -0,0 +1,327 @@
+#ifndef HTTP_POOL_H
+#define HTTP_POOL_H
+
+#include <HTTPClient.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include "multipart.h"
+#include "tls_session.h"
+
+// Dependencies: device_config.h must be included before this file (HTTP_POOL_SIZE)
+//
+// Keep-alive connection pool shared by all HTTPClient requests.
+//
+// Every slot owns a persistent HTTPClient plus its socket, so HTTP/1.1
+// keep-alive connections survive between calls (HTTPClient closes the socket
+// in its destructor, which is why call sites can't keep their own locals).
+// A request to a host that has an idle, still-open slot skips the TLS
+// handshake entirely.
+//
+// If every slot stays busy for HTTP_POOL_WAIT_MS (StickC has one), or the
+// caller's cancel flag is set while it waits, the caller gets a client that
+// was never connected: its request fails with HTTPC_ERROR_CONNECTION_REFUSED
+// and goes through the normal error path.
+// Slot ownership is handed out under httpPoolMutex; the counters have their
+// own spinlock because every task updates them.
+//
+// Usage:
+//   HTTPClient &http = httpPoolBegin(url);
+//   http.addHeader(...);
+//   int code = httpPoolSend(http, "POST", body);
+//   String resp = http.getString();   // read the whole body so the socket can be reused
+//   httpPoolEnd(http);
+
+// Sockets idle longer than this are closed before reuse. Stays below the
+// 5s keep-alive timeout of uvicorn (OpenWebUI) so we rarely hit a socket the
+// server already dropped.
+const unsigned long HTTP_POOL_IDLE_MS = 4500;
+const unsigned long HTTP_POOL_WAIT_MS = 10000;   // Longest wait for a free slot
+
+struct HttpPoolSlot {
+  HTTPClient http;
+  TlsClient secureClient;
+  WiFiClient plainClient;
+  String host;
+  int port = 0;
+  bool useSsl = true;
+  bool inUse = false;
+  bool reused = false;          // Current request rides on an existing socket
+  unsigned long lastUsed = 0;
+  WiFiClient &client() { return useSsl ? (WiFiClient &)secureClient : plainClient; }
+};
+
+struct HttpPoolStats {
+  uint32_t requests;
+  uint32_t handshakes;          // New connections (full TLS handshake on https)
+  uint32_t reuses;              // Requests sent on an already-open socket
+  uint32_t retries;             // Reused socket was stale, reconnected and resent
+  uint32_t evictions;           // Idle sockets closed before reuse
+  uint32_t busyTimeouts;        // No slot freed up within HTTP_POOL_WAIT_MS
+  uint32_t handshakeMsTotal;
+};
+
+HttpPoolSlot httpPoolSlots[HTTP_POOL_SIZE];
+HttpPoolStats httpPoolStats = {0, 0, 0, 0, 0, 0, 0};
+static SemaphoreHandle_t httpPoolMutex = NULL;
+static portMUX_TYPE httpPoolStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void httpPoolCount(uint32_t &counter, uint32_t n = 1) {
+  portENTER_CRITICAL(&httpPoolStatsLock);
+  counter += n;
+  portEXIT_CRITICAL(&httpPoolStatsLock);
+}
+
+// Split a base URL like "https://host:8443/prefix" into its parts
+bool parseBaseUrl(const char *url, String &host, int &port, String &path, bool &useSsl) {
+  String u = url;
+  useSsl = u.startsWith("https://");
+  int schemeEnd = u.indexOf("://");
+  int hostStart = schemeEnd >= 0 ? schemeEnd + 3 : 0;
+  int pathStart = u.indexOf('/', hostStart);
+  String hostPort = pathStart >= 0 ? u.substring(hostStart, pathStart) : u.substring(hostStart);
+  path = pathStart >= 0 ? u.substring(pathStart) : "";
+  if (path.endsWith("/")) path.remove(path.length() - 1);
+
+  int colon = hostPort.indexOf(':');
+  if (colon >= 0) {
+    host = hostPort.substring(0, colon);
+    port = hostPort.substring(colon + 1).toInt();
+  } else {
+    host = hostPort;
+    port = useSsl ? 443 : 80;
+  }
+  return host.length() > 0 && port > 0;
+}
+
+// Call once from setup()
+void httpPoolInit() {
+  if (httpPoolMutex == NULL) {
+    httpPoolMutex = xSemaphoreCreateMutex();
+    tlsSessionInit();
+  }
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    httpPoolSlots[i].secureClient.setInsecure();
+    httpPoolSlots[i].http.setReuse(true);
+  }
+}
+
+static HttpPoolSlot *httpPoolSlotFor(HTTPClient &http) {
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    if (&httpPoolSlots[i].http == &http) return &httpPoolSlots[i];
+  }
+  return nullptr;
+}
+
+// False for the never-connected client httpPoolBegin() hands out when the pool
+// stayed busy, so a caller can tell a busy pool from a failed request
+bool httpPoolHasSlot(HTTPClient &http) {
+  return httpPoolSlotFor(http) != nullptr;
+}
+
+// Open (or re-open) the slot's socket, timing the handshake
+static bool httpPoolConnect(HttpPoolSlot &slot) {
+  unsigned long start = millis();
+  bool ok = slot.client().connect(slot.host.c_str(), slot.port);
+  unsigned long elapsed = millis() - start;
+  httpPoolCount(httpPoolStats.handshakes);
+  httpPoolCount(httpPoolStats.handshakeMsTotal, elapsed);
+  Serial.printf("[POOL] %s:%d new %s connection in %lums%s\n", slot.host.c_str(), slot.port,
+                slot.useSsl ? "TLS" : "TCP", elapsed, ok ? "" : " (FAILED)");
+  return ok;
+}
+
+// Pick a slot for the host, preferring an idle open socket to the same host,
+// and point it at the host. nullptr if none came free within HTTP_POOL_WAIT_MS
+// or *cancel was set while waiting.
+static HttpPoolSlot *httpPoolAcquire(const String &host, int port, bool useSsl, volatile bool *cancel = nullptr) {
+  unsigned long start = millis();
+  while (true) {
+    xSemaphoreTake(httpPoolMutex, portMAX_DELAY);
+    HttpPoolSlot *best = nullptr;
+    int bestScore = -1;
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+      HttpPoolSlot &s = httpPoolSlots[i];
+      if (s.inUse) continue;
+      bool sameHost = (s.port == port && s.useSsl == useSsl && s.host == host);
+      // Open socket to same host > closed slot for same host > empty slot > oldest other host
+      int score = sameHost ? (s.client().connected() ? 3 : 2) : (s.host.length() == 0 ? 1 : 0);
+      if (score > bestScore || (score == bestScore && best && s.lastUsed < best->lastUsed)) {
+        best = &s;
+        bestScore = score;
+      }
+    }
+    if (best) {
+      // Slot previously served a different host - its socket has to go
+      bool sameHost = (best->port == port && best->useSsl == useSsl && best->host == host);
+      WiFiClient *stale = !sameHost && best->client().connected() ? &best->client() : nullptr;
+      best->inUse = true;
+      best->host = host;
+      best->port = port;
+      best->useSsl = useSsl;
+      xSemaphoreGive(httpPoolMutex);
+      if (stale) stale->stop();
+      return best;
+    }
+    xSemaphoreGive(httpPoolMutex);
+    if (cancel && *cancel) {
+      Serial.printf("[POOL] Wait for %s cancelled after %lums\n", host.c_str(), millis() - start);
+      return nullptr;
+    }
+    if (millis() - start >= HTTP_POOL_WAIT_MS) {
+      httpPoolCount(httpPoolStats.busyTimeouts);
+      Serial.printf("[POOL] No free connection for %s after %lums\n", host.c_str(), millis() - start);
+      return nullptr;
+    }
+    delay(20); // All slots busy (another task is mid-request)
+  }
+}
+
+// Idle too long - the server has probably closed it already
+static void httpPoolEvictIdle(HttpPoolSlot &slot) {
+  if (slot.client().connected() && millis() - slot.lastUsed > HTTP_POOL_IDLE_MS) {
+    Serial.printf("[POOL] %s idle %lums, closing\n", slot.host.c_str(), millis() - slot.lastUsed);
+    slot.client().stop();
+    httpPoolCount(httpPoolStats.evictions);
+  }
+}
+
+// Get a pooled HTTPClient that has begin() called for url. If the pool stays
+// busy (or cancel is set while waiting), a fresh client that is never
+// connected (freed by httpPoolEnd()).
+HTTPClient &httpPoolBegin(const String &url, volatile bool *cancel = nullptr) {
+  if (httpPoolMutex == NULL) {
+    httpPoolInit();
+  }
+
+  String host, path;
+  int port;
+  bool useSsl;
+  parseBaseUrl(url.c_str(), host, port, path, useSsl);
+
+  httpPoolCount(httpPoolStats.requests);
+  HttpPoolSlot *acquired = httpPoolAcquire(host, port, useSsl, cancel);
+  if (!acquired) return *new HTTPClient();
+  HttpPoolSlot &slot = *acquired;
+  httpPoolEvictIdle(slot);
+
+  slot.reused = slot.client().connected();
+  if (slot.reused) {
+    httpPoolCount(httpPoolStats.reuses);
+    Serial.printf("[POOL] %s:%d reusing connection (idle %lums)\n", host.c_str(), port,
+                  millis() - slot.lastUsed);
+  } else {
+    httpPoolConnect(slot);
+  }
+
+  slot.http.useHTTP10(false); // A streamed request may have switched it on
+  slot.http.setReuse(true);
+  slot.http.begin(slot.client(), url);
+  return slot.http;
+}
+
+// Open a socket to url's host ahead of time (no request is sent), so the next
+// request there skips the handshake. Returns false if it couldn't connect.
+bool httpPoolWarm(const String &url) {
+  if (httpPoolMutex == NULL) {
+    httpPoolInit();
+  }
+
+  String host, path;
+  int port;
+  bool useSsl;
+  parseBaseUrl(url.c_str(), host, port, path, useSsl);
+
+  HttpPoolSlot *acquired = httpPoolAcquire(host, port, useSsl);
+  if (!acquired) return false;
+  HttpPoolSlot &slot = *acquired;
+  httpPoolEvictIdle(slot);
+  bool ok = slot.client().connected() || httpPoolConnect(slot);
+
+  xSemaphoreTake(httpPoolMutex, portMAX_DELAY);
+  slot.lastUsed = millis();
+  slot.inUse = false;
+  xSemaphoreGive(httpPoolMutex);
+  return ok;
+}
+
+// Errors that mean the socket died under us rather than a real server answer
+static bool httpPoolIsStaleError(int code) {
+  return code == HTTPC_ERROR_SEND_HEADER_FAILED || code == HTTPC_ERROR_SEND_PAYLOAD_FAILED ||
+         code == HTTPC_ERROR_NOT_CONNECTED || code == HTTPC_ERROR_CONNECTION_LOST;
+}
+
+// Reconnect once if a reused socket turned out to be closed by the server
+static bool httpPoolShouldRetry(HTTPClient &http, int code) {
+  HttpPoolSlot *slot = httpPoolSlotFor(http);
+  if (!slot || !slot->reused || !httpPoolIsStaleError(code)) return false;
+  Serial.printf("[POOL] Reused connection to %s failed (%d), reconnecting\n", slot->host.c_str(), code);
+  slot->client().stop();
+  slot->reused = false;
+  httpPoolCount(httpPoolStats.retries);
+  return httpPoolConnect(*slot);
+}
+
+// Send a request with a body already in memory (a StrBuilder's, say)
+int httpPoolSend(HTTPClient &http, const char *method, const char *body, size_t length) {
+  int code = http.sendRequest(method, (uint8_t *)body, length);
+  if (httpPoolShouldRetry(http, code)) {
+    code = http.sendRequest(method, (uint8_t *)body, length);
+  }
+  return code;
+}
+
+// Send a request with a String (or empty) body
+int httpPoolSend(HTTPClient &http, const char *method, const String &body = "") {
+  return httpPoolSend(http, method, body.c_str(), body.length());
+}
+
+// Send a request with a streamed multipart body
+int httpPoolSend(HTTPClient &http, const char *method, MultipartStream &body) {
+  int code = http.sendRequest(method, &body, body.contentLength());
+  if (httpPoolShouldRetry(http, code)) {
+    body.rewind();
+    code = http.sendRequest(method, &body, body.contentLength());
+  }
+  return code;
+}
+
+// Finish the request and return the slot. The socket stays open for reuse
+// unless the server asked to close it or the request failed.
+void httpPoolEnd(HTTPClient &http) {
+  HttpPoolSlot *slot = httpPoolSlotFor(http);
+  http.end();
+  if (!slot) {
+    delete &http;   // The stand-in httpPoolBegin() handed out while the pool was busy
+    return;
+  }
+  xSemaphoreTake(httpPoolMutex, portMAX_DELAY);
+  slot->lastUsed = millis();
+  slot->inUse = false;
+  xSemaphoreGive(httpPoolMutex);
+}
+
+// Close every pooled socket (e.g. before a long idle period)
+void httpPoolCloseAll() {
+  if (httpPoolMutex == NULL) return;
+  xSemaphoreTake(httpPoolMutex, portMAX_DELAY);
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    if (!httpPoolSlots[i].inUse && httpPoolSlots[i].client().connected()) {
+      httpPoolSlots[i].client().stop();
+    }
+  }
+  xSemaphoreGive(httpPoolMutex);
+}
+
+void httpPoolPrintStats() {
+  portENTER_CRITICAL(&httpPoolStatsLock);
+  HttpPoolStats st = httpPoolStats;
+  portEXIT_CRITICAL(&httpPoolStatsLock);
+  Serial.printf("[POOL] requests=%u handshakes=%u reuses=%u retries=%u evictions=%u busy=%u avgHandshake=%ums\n",
+                st.requests, st.handshakes, st.reuses, st.retries, st.evictions, st.busyTimeouts,
+                st.handshakes ? st.handshakeMsTotal / st.handshakes : 0);
+#if ENABLE_TLS_RESUMPTION
+  tlsSessionPrintStats();
+#endif
+}
+
+#endif // HTTP_POOL_H
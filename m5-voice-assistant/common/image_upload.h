@@ -3,6 +3,9 @@
 
 #include <HTTPClient.h>
 #include <WiFiClientSecure.h>
+#include "multipart.h"
+#include "http_pool.h"
+#include "json_stream.h"
 
 // External references from camera.h
 extern uint8_t* lastCapturedImage;
@@ -26,87 +29,44 @@ String uploadImageToOWUI(const uint8_t* imageData, size_t imageSize, const char*
   Serial.printf("Image size: %d bytes\n", imageSize);
   Serial.printf("Filename: %s\n", filename);
   
-  HTTPClient http;
-  WiFiClientSecure client;
-  client.setInsecure();
-  
   String url = String(OWUI_BASE_URL) + "/api/v1/files/";
   Serial.printf("Upload URL: %s\n", url.c_str());
   
-  http.begin(client, url);
+  HTTPClient &http = httpPoolBegin(url);
   http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
   http.setTimeout(60000);
   
-  // Build multipart/form-data request
+  // Build multipart/form-data request - parts stream straight from imageData
   String boundary = "----ESP32ImageBoundary";
+  MultipartStream body(boundary.c_str());
+  body.addFile("file", filename, "image/jpeg", imageData, imageSize);
   
-  String bodyStart = "--" + boundary + "\r\n";
-  bodyStart += "Content-Disposition: form-data; name=\"file\"; filename=\"" + String(filename) + "\"\r\n";
-  bodyStart += "Content-Type: image/jpeg\r\n\r\n";
-  
-  String bodyEnd = "\r\n--" + boundary + "--\r\n";
-  
-  int contentLength = bodyStart.length() + imageSize + bodyEnd.length();
+  int contentLength = body.contentLength();
   Serial.printf("Total content length: %d bytes\n", contentLength);
   
-  // Allocate buffer for full body
-  uint8_t* fullBody = (uint8_t*)malloc(contentLength);
-  if (!fullBody) {
-    Serial.println("ERROR: Failed to allocate upload buffer");
-    Serial.println("=============================================\n");
-    return "";
-  }
-  
-  // Build full body
-  int offset = 0;
-  memcpy(fullBody + offset, bodyStart.c_str(), bodyStart.length());
-  offset += bodyStart.length();
-  memcpy(fullBody + offset, imageData, imageSize);
-  offset += imageSize;
-  memcpy(fullBody + offset, bodyEnd.c_str(), bodyEnd.length());
-  
-  http.addHeader("Content-Type", "multipart/form-data; boundary=" + boundary);
+  http.addHeader("Content-Type", body.contentType());
   
   Serial.println("Uploading image...");
-  int httpCode = http.POST(fullBody, contentLength);
-  free(fullBody);
+  int httpCode = httpPoolSend(http, "POST", body);
   
   Serial.printf("HTTP response code: %d\n", httpCode);
   
   String fileId = "";
   if (httpCode == 200 || httpCode == 201) {
-    String response = http.getString();
-    Serial.println("Upload response:");
-    Serial.println(response);
+    // Parse file ID and path as the response arrives
+    // Expected format: {"id": "string", "path": "string", ...}
+    JsonStream json;
+    json.capture("id", fileId);
+    json.capture("path", lastUploadedFilePath);
+    lastUploadedFilePath = "";
+    jsonStreamHttp(http, json);
     
-    // Parse file ID from response
-    // Expected format: {"id": "string", ...}
-    int idIdx = response.indexOf("\"id\"");
-    if (idIdx >= 0) {
-      int start = response.indexOf('"', idIdx + 4);
-      if (start >= 0) {
-        start++;
-        int end = response.indexOf('"', start);
-        if (end >= 0) {
-          fileId = response.substring(start, end);
-          Serial.printf("File ID: %s\n", fileId.c_str());
-          lastUploadedFileId = fileId;
-        }
-      }
+    if (fileId.length() > 0) {
+      Serial.printf("File ID: %s\n", fileId.c_str());
+      lastUploadedFileId = fileId;
     }
-    
-    // Parse path from response
-    int pathIdx = response.indexOf("\"path\"");
-    if (pathIdx >= 0) {
-      int start = response.indexOf('"', pathIdx + 6);
-      if (start >= 0) {
-        start++;
-        int end = response.indexOf('"', start);
-        if (end >= 0) {
-          lastUploadedFilePath = response.substring(start, end);
-          Serial.printf("File path: %s\n", lastUploadedFilePath.c_str());
-        }
-      }
+    if (lastUploadedFilePath.length() > 0) {
+      Serial.printf("File path: %s\n", lastUploadedFilePath.c_str());
     }
     
     // Store filename and size
@@ -123,7 +83,7 @@ String uploadImageToOWUI(const uint8_t* imageData, size_t imageSize, const char*
     Serial.println(errorResponse.substring(0, 500)); // First 500 chars
   }
   
-  http.end();
+  httpPoolEnd(http);
   Serial.println("=============================================\n");
   
   return fileId;
@@ -0,0 +1,346 @@
+#ifndef INTERACTION_H
+#define INTERACTION_H
+
+#include "voice_graph.h"
+
+// Dependencies: mic_capture.h, tts_pipeline.h, voice_graph.h and everything
+// they need must be included before this file
+//
+// Event-driven interaction state machine shared by the device sketches:
+//
+//   IDLE ──ask──> RECORDING ──> UPLOADING ──> THINKING ──> SPEAKING ──> IDLE
+//     │              (photo: UPLOADING first)                  ▲
+//     └──replay────────────────────────────────────────────────┘
+//
+// The work (camera, recording, transcription, LLM request, speech) runs on an
+// interaction task; loop() never blocks. It reads buttons and touch every
+// 20ms, and draws what the worker reports: interactionPoll() hands it the
+// events (state changes, the photo, the answer as it streams in, errors) in
+// order. A press while busy cancels: recording stops at the next chunk, the
+// wait for the answer (SSE stream, socket or polling) within a few ms, speech
+// at once, and remaining stages are skipped.
+//
+// Barge-in: pressing Voice while busy cancels and queues a new question that
+// the worker starts as soon as the old one has let go - the speaker is turned
+// off and its buffers freed before the mic comes on. An HTTP request already
+// sent (a TTS sentence, the completion POST) isn't interrupted; it finishes
+// on its own with its result discarded.
+//
+// Usage (in loop()):
+//   interactionPoll(onInteractionEvent);           // draw what happened
+//   if (M5.BtnA.wasClicked()) {
+//     interactionBargeIn(true, false, nullptr);    // listen, no photo; stops what's running
+//   }
+//   if (M5.BtnB.wasClicked()) interactionCancel();
+//   interactionNewChat();                          // next question starts a new chat
+
+#define INTERACTION_QUEUE_LEN 12
+#define INTERACTION_STACK 12288          // Runs what loop() used to run (8K) plus the graph
+#define INTERACTION_EVENT_WAIT_MS 1000   // Worker waits this long for room in the event queue
+#define INTERACTION_NOTICE_MS 2000       // Errors stay on screen this long
+
+enum InteractionState {
+  INTERACTION_IDLE,
+  INTERACTION_RECORDING,
+  INTERACTION_UPLOADING,    // Photo or recording on its way to the server
+  INTERACTION_THINKING,
+  INTERACTION_SPEAKING,
+};
+
+enum InteractionEventType {
+  INTERACTION_EVENT_STATE,      // New state; message is the status line (may be nullptr)
+  INTERACTION_EVENT_PREVIEW,    // Photo captured, show it
+  INTERACTION_EVENT_PARTIAL,    // More of the answer arrived (interactionText())
+  INTERACTION_EVENT_ANSWER,     // Whole answer (interactionText())
+  INTERACTION_EVENT_ERROR,      // Stopped early; message says why
+  INTERACTION_EVENT_CANCELLED,
+  INTERACTION_EVENT_DONE,
+  INTERACTION_EVENT_READY,      // A notice timed out, show the ready screen
+};
+
+struct InteractionEvent {
+  InteractionEventType type;
+  InteractionState state;
+  const char *message;          // String literal
+};
+
+typedef void (*InteractionHandler)(const InteractionEvent &e);
+
+enum InteractionKind {
+  INTERACTION_ASK,
+  INTERACTION_REPLAY,
+};
+
+struct InteractionRequest {
+  InteractionKind kind;
+  bool listen;
+  bool image;
+  const char *fallbackQuestion;
+};
+
+volatile InteractionState interactionState = INTERACTION_IDLE;
+volatile bool interactionCancelRequested = false;
+static volatile bool interactionNewChatRequested = false;
+static QueueHandle_t interactionRequests = NULL;
+static QueueHandle_t interactionEvents = NULL;
+static SemaphoreHandle_t interactionTextMutex = NULL;
+static TaskHandle_t interactionTaskHandle = NULL;
+static String interactionTextValue = "";
+static unsigned long interactionNoticeUntil = 0;
+
+static void interactionPost(InteractionEventType type, InteractionState state, const char *message) {
+  if (interactionEvents == NULL) return;
+  InteractionEvent e = {type, state, message};
+  // Partial answers are redrawn in full, so a dropped one costs nothing
+  TickType_t wait = type == INTERACTION_EVENT_PARTIAL ? 0 : pdMS_TO_TICKS(INTERACTION_EVENT_WAIT_MS);
+  if (xQueueSend(interactionEvents, &e, wait) != pdPASS && type != INTERACTION_EVENT_PARTIAL) {
+    Serial.printf("[Interaction] Event queue full, event %d dropped\n", type);
+  }
+}
+
+static void interactionSetState(InteractionState state, const char *message) {
+  interactionState = state;
+  interactionPost(INTERACTION_EVENT_STATE, state, message);
+}
+
+static void interactionSetText(const String &text) {
+  if (interactionTextMutex == NULL) return;
+  xSemaphoreTake(interactionTextMutex, portMAX_DELAY);
+  interactionTextValue = text;
+  xSemaphoreGive(interactionTextMutex);
+}
+
+// Answer text of the last ANSWER / PARTIAL event
+String interactionText() {
+  if (interactionTextMutex == NULL) return "";
+  xSemaphoreTake(interactionTextMutex, portMAX_DELAY);
+  String text = interactionTextValue;
+  xSemaphoreGive(interactionTextMutex);
+  return text;
+}
+
+// Answer so far, while the LLM is still generating (called from askGPT())
+void interactionShowText(const String &text) {
+  interactionSetText(text);
+  interactionPost(INTERACTION_EVENT_PARTIAL, interactionState, nullptr);
+}
+
+// Graph stages map onto the states
+static void interactionOnStage(VoiceQuestion &q, const char *stage) {
+  if (strcmp(stage, "capture") == 0) {
+    interactionSetState(INTERACTION_UPLOADING, "Capturing image...");
+  } else if (strcmp(stage, "preview") == 0) {
+    interactionPost(INTERACTION_EVENT_PREVIEW, interactionState, nullptr);
+  } else if (strcmp(stage, "record") == 0) {
+    interactionSetState(INTERACTION_RECORDING, nullptr); // displayTask draws the level meter
+  } else if (strcmp(stage, "transcribe") == 0) {
+    interactionSetState(INTERACTION_UPLOADING, "Transcribing...");
+  } else if (strcmp(stage, "ask") == 0) {
+    interactionSetState(INTERACTION_THINKING, q.image ? "Analyzing image..." : "Thinking...");
+  } else if (strcmp(stage, "answer") == 0) {
+    interactionSetText(q.answer);
+    interactionPost(INTERACTION_EVENT_ANSWER, interactionState, nullptr);
+    if (USE_TTS && isLargeDevice) interactionSetState(INTERACTION_SPEAKING, nullptr);
+  }
+}
+
+// After a cancel: speech off and its buffers freed, so a barge-in can record
+static void interactionStopOutput(bool dropReplay) {
+  ttsPipelineStop();
+  mp3StreamStop();
+  mp3StreamRelease();
+  if (dropReplay) mp3StreamClearReplay(); // Half an answer isn't worth replaying
+}
+
+static void interactionRun(const InteractionRequest &req) {
+  unsigned long start = millis();
+  const char *error = nullptr;
+  // A cancel that reached the previous interaction after it ended isn't for this one
+  interactionCancelRequested = false;
+  mp3StreamReset();
+  // Only a recording uses the armed mic; the speaker may share its I2S bus
+  if (req.kind != INTERACTION_ASK || !req.listen) micCaptureDisarm();
+
+  if (req.kind == INTERACTION_REPLAY) {
+    interactionSetState(INTERACTION_SPEAKING, nullptr);
+    replayTts();
+  } else {
+    Serial.printf("\n*** %s QUESTION TRIGGERED ***\n\n", req.image ? "IMAGE" : "VOICE");
+    Serial.printf("Free heap before recording: %d bytes\n", ESP.getFreeHeap());
+    mediaArenasNewInteraction();
+    if (interactionNewChatRequested) {
+      // The chat ID belongs to this task and the prefetch on core 0, never loop()
+      chatPrefetchWait();
+      currentChatId = "";
+      currentSessionId = "";
+      interactionNewChatRequested = false;
+    }
+
+    VoiceQuestion q;
+    q.listen = req.listen;
+    q.image = req.image;
+    q.fallbackQuestion = req.fallbackQuestion;
+    q.cancel = &interactionCancelRequested;
+    q.onStage = interactionOnStage;
+    if (!voiceQuestionRun(q)) error = q.error;
+  }
+
+  bool cancelled = interactionCancelRequested;
+  if (cancelled) {
+    interactionStopOutput(req.kind == INTERACTION_ASK && interactionState == INTERACTION_SPEAKING);
+  }
+  interactionCancelRequested = false;
+
+  // Idle before the last event, so the sketch can start the next one from it.
+  // A barge-in already waiting keeps it busy and takes over the screen with
+  // its own states.
+  bool superseded = interactionRequests != NULL && uxQueueMessagesWaiting(interactionRequests) > 0;
+  if (!superseded) interactionState = INTERACTION_IDLE;
+  if (superseded) {
+    Serial.println("[Interaction] Next question already waiting");
+  } else if (cancelled) {
+    interactionPost(INTERACTION_EVENT_CANCELLED, INTERACTION_IDLE, "Cancelled");
+  } else if (error) {
+    interactionPost(INTERACTION_EVENT_ERROR, INTERACTION_IDLE, error);
+  } else {
+    interactionPost(INTERACTION_EVENT_DONE, INTERACTION_IDLE, nullptr);
+  }
+
+  Serial.printf("[Interaction] %s in %lums\n", cancelled ? "Cancelled" : error ? error : "Done", millis() - start);
+  Serial.printf("Free heap at end: %d bytes\n", ESP.getFreeHeap());
+  memReport();
+  mediaArenasReport();
+  httpPoolPrintStats();
+  Serial.println("\n*** INTERACTION COMPLETE ***\n");
+}
+
+void interactionTask(void *parameter) {
+  InteractionRequest req;
+  for (;;) {
+    if (xQueueReceive(interactionRequests, &req, portMAX_DELAY) == pdTRUE) {
+      interactionRun(req);
+    }
+  }
+}
+
+// Start the worker; without it interactions run (blocking) on the caller
+bool interactionBegin() {
+  if (interactionTaskHandle != NULL) return true;
+  if (interactionEvents == NULL) {
+    interactionEvents = xQueueCreate(INTERACTION_QUEUE_LEN, sizeof(InteractionEvent));
+    interactionRequests = xQueueCreate(1, sizeof(InteractionRequest));
+    interactionTextMutex = xSemaphoreCreateMutex();
+  }
+
+  // Core 1 next to loop(): mic and speaker handling stay where they were,
+  // core 0 keeps the network workers and graph stages
+  if (xTaskCreatePinnedToCore(interactionTask, "interaction", INTERACTION_STACK, NULL, 1,
+                              &interactionTaskHandle, 1) != pdPASS) {
+    Serial.println("[Interaction] Failed to start worker task");
+    interactionTaskHandle = NULL;
+    return false;
+  }
+  return true;
+}
+
+bool interactionBusy() {
+  return interactionState != INTERACTION_IDLE;
+}
+
+static bool interactionStart(const InteractionRequest &req, InteractionState first) {
+  if (interactionBusy()) return false;
+  interactionNoticeUntil = 0;
+  interactionCancelRequested = false;
+  interactionState = first; // Busy from here on, even before the worker picks it up
+
+  if (!interactionBegin() || xQueueSend(interactionRequests, &req, 0) != pdPASS) {
+    interactionRun(req);
+  }
+  return true;
+}
+
+// Ask a question: listen = record it, image = about a new photo, fallbackQuestion
+// = asked if not listening or nothing was heard. False if already busy.
+bool interactionAsk(bool listen, bool image, const char *fallbackQuestion) {
+  InteractionRequest req = {INTERACTION_ASK, listen, image, fallbackQuestion};
+  return interactionStart(req, image ? INTERACTION_UPLOADING : INTERACTION_RECORDING);
+}
+
+// Start a new chat with the next question (loop() mustn't touch currentChatId)
+void interactionNewChat() {
+  interactionNewChatRequested = true;
+}
+
+// Play the last answer again
+bool interactionReplay() {
+  InteractionRequest req = {INTERACTION_REPLAY, false, false, nullptr};
+  return interactionStart(req, INTERACTION_SPEAKING);
+}
+
+// Stop the running interaction as soon as it can. False if there is none.
+bool interactionCancel() {
+  if (!interactionBusy()) return false;
+  if (!interactionCancelRequested) Serial.println("[Interaction] Cancel requested");
+  interactionCancelRequested = true;
+  ttsPipelineStop();
+  mp3StreamStop();
+  return true;
+}
+
+// Ask a question, stopping the running one first if busy (barge-in). False if
+// a barge-in is already waiting.
+bool interactionBargeIn(bool listen, bool image, const char *fallbackQuestion) {
+  if (!interactionBusy()) return interactionAsk(listen, image, fallbackQuestion);
+
+  // Cancel first: the worker clears the flag when it starts the queued one
+  InteractionRequest req = {INTERACTION_ASK, listen, image, fallbackQuestion};
+  interactionCancel();
+  if (interactionRequests == NULL || xQueueSend(interactionRequests, &req, 0) != pdPASS) return false;
+  Serial.println("[Interaction] Barge-in");
+  interactionNoticeUntil = 0;
+  if (!interactionBusy()) { // It ended just before the cancel
+    interactionState = image ? INTERACTION_UPLOADING : INTERACTION_RECORDING;
+  }
+  return true;
+}
+
+// delay() for the sketch's own waits in the worker (polling for the answer);
+// ends early and returns false on cancel
+bool interactionWait(unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) {
+    if (interactionCancelRequested) return false;
+    delay(10);
+  }
+  return !interactionCancelRequested;
+}
+
+// Show a message for ms, then get a READY event
+void interactionNotice(unsigned long ms) {
+  interactionNoticeUntil = millis() + ms;
+  if (interactionNoticeUntil == 0) interactionNoticeUntil = 1;
+}
+
+// Hand the worker's events to the sketch; call from loop()
+void interactionPoll(InteractionHandler handler) {
+  InteractionEvent e;
+  while (interactionEvents != NULL && xQueueReceive(interactionEvents, &e, 0) == pdTRUE) {
+    if (e.type == INTERACTION_EVENT_ERROR || e.type == INTERACTION_EVENT_CANCELLED) {
+      interactionNotice(INTERACTION_NOTICE_MS);
+    } else if (e.type == INTERACTION_EVENT_STATE) {
+      interactionNoticeUntil = 0; // Next interaction already running
+    }
+    handler(e);
+  }
+
+  if (interactionNoticeUntil != 0 && !interactionBusy() && (long)(millis() - interactionNoticeUntil) >= 0) {
+    interactionNoticeUntil = 0;
+    InteractionEvent ready = {INTERACTION_EVENT_READY, INTERACTION_IDLE, nullptr};
+    handler(ready);
+  }
+
+  // Idle: keep the pre-roll ring filling for the next question
+  if (!interactionBusy()) micCaptureArm();
+}
+
+#endif // INTERACTION_H
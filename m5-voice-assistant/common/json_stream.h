@@ -0,0 +1,508 @@
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+
+// Incremental (SAX-style) JSON tokenizer for HTTP response bodies.
+//
+// Bytes are consumed one at a time straight off the connection - the body is
+// never held as a String. The tokenizer keeps only the current path (one key or
+// array index per level) and a small buffer for the value being read, so it
+// does not allocate. Values are found by path pattern, with "*" matching any
+// key or array index:
+//
+//   JsonStream json;
+//   String text;
+//   json.capture("choices.0.message.content", text);
+//   jsonStreamHttp(http, json);                 // chunked bodies are handled by HTTPClient
+//
+// Strings are unescaped, including \uXXXX and surrogate pairs (emitted as
+// UTF-8). For anything beyond collecting string values, pass an event handler;
+// it sees every value and container boundary together with the current path:
+//
+//   json.onEvent(handler, &state);              // handler(json, event, data, len, ctx)
+//   if (json.match("chat.history.messages.*.role")) ...
+//
+// Setting json.raw copies every byte consumed from then on into that String,
+// which is how a subtree can be passed on verbatim.
+
+#define JSON_STREAM_MAX_DEPTH 20     // Deeper documents are rejected
+#define JSON_STREAM_KEY_MAX 48       // Longer keys are truncated (UUIDs are 36)
+#define JSON_STREAM_CHUNK 64         // String values are delivered in parts of this size
+#define JSON_STREAM_MAX_CAPTURES 4
+
+enum JsonEvent {
+  JSON_OBJECT_BEGIN,   // Path is the object's own path
+  JSON_OBJECT_END,
+  JSON_ARRAY_BEGIN,
+  JSON_ARRAY_END,
+  JSON_STRING_PART,    // Part of a string value (data/len), more follows
+  JSON_STRING_END,     // Last part of a string value (may be empty)
+  JSON_NUMBER,         // data holds the number as text
+  JSON_TRUE,
+  JSON_FALSE,
+  JSON_NULL
+};
+
+class JsonStream;
+typedef void (*JsonEventHandler)(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx);
+
+class JsonStream : public Stream {
+public:
+  String *raw = nullptr;     // When set, every byte consumed is appended
+
+  JsonStream() { reset(); }
+
+  void reset() {
+    _state = ST_VALUE;
+    _depth = 0;
+    _len = 0;
+    _pendingHigh = 0;
+    _captureCount = 0;
+    _handler = nullptr;
+    _ctx = nullptr;
+    _bytes = 0;
+    raw = nullptr;
+  }
+
+  void onEvent(JsonEventHandler handler, void *ctx) {
+    _handler = handler;
+    _ctx = ctx;
+  }
+
+  // Append every string value at a path matching pattern to out. pattern must
+  // stay valid while parsing.
+  bool capture(const char *pattern, String &out) {
+    if (_captureCount >= JSON_STREAM_MAX_CAPTURES) return false;
+    _captures[_captureCount].pattern = pattern;
+    _captures[_captureCount].out = &out;
+    _captureCount++;
+    return true;
+  }
+
+  bool done() const { return _state == ST_DONE; }
+  bool failed() const { return _state == ST_ERROR; }
+  size_t bytesParsed() const { return _bytes; }
+  int depth() const { return _depth; }
+
+  // Key or index of the current path at level (0 = outermost)
+  bool isIndex(int level) const { return _frames[level].isArray; }
+  int indexAt(int level) const { return _frames[level].index; }
+  const char *keyAt(int level) const { return _frames[level].key; }
+
+  // Does the current path match pattern exactly ("a.*.b", "" for the root)?
+  bool match(const char *pattern) const {
+    const char *p = pattern;
+    for (int level = 0; level < _depth; level++) {
+      if (*p == '\0') return false;
+      const char *end = strchr(p, '.');
+      size_t segLen = end ? (size_t)(end - p) : strlen(p);
+      if (!(segLen == 1 && *p == '*')) {
+        const Frame &f = _frames[level];
+        if (f.isArray) {
+          char num[12];
+          int n = snprintf(num, sizeof(num), "%d", f.index);
+          if ((size_t)n != segLen || strncmp(num, p, segLen) != 0) return false;
+        } else {
+          if (strlen(f.key) != segLen || strncmp(f.key, p, segLen) != 0) return false;
+        }
+      }
+      p += segLen;
+      if (*p == '.') p++;
+    }
+    return *p == '\0';
+  }
+
+  void feed(char c) {
+    if (_state == ST_DONE || _state == ST_ERROR) return;
+    _bytes++;
+    if (raw) *raw += c;
+    step(c);
+  }
+
+  // Stream interface - lets HTTPClient::writeToStream() deliver the body
+  size_t write(uint8_t c) override {
+    feed((char)c);
+    return 1;
+  }
+  size_t write(const uint8_t *buf, size_t len) override {
+    for (size_t i = 0; i < len; i++) feed((char)buf[i]);
+    return len;
+  }
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+
+private:
+  enum State {
+    ST_VALUE,          // Expecting a value
+    ST_ARRAY_FIRST,    // After '[' - value or ']'
+    ST_OBJECT_FIRST,   // After '{' - key or '}'
+    ST_KEY,            // After ',' in an object - key
+    ST_COLON,          // After a key
+    ST_AFTER_VALUE,    // ',' or closing bracket
+    ST_STRING,
+    ST_ESCAPE,
+    ST_UNICODE,
+    ST_NUMBER,
+    ST_LITERAL,
+    ST_DONE,
+    ST_ERROR
+  };
+
+  struct Frame {
+    bool isArray;
+    int index;
+    char key[JSON_STREAM_KEY_MAX];
+  };
+
+  struct Capture {
+    const char *pattern;
+    String *out;
+  };
+
+  State _state;
+  bool _readingKey = false;
+  Frame _frames[JSON_STREAM_MAX_DEPTH];
+  int _depth;
+  char _buf[JSON_STREAM_CHUNK];        // String part, number or literal being read
+  size_t _len;
+  size_t _keyLen = 0;
+  uint32_t _unicode = 0;
+  int _unicodeDigits = 0;
+  uint32_t _pendingHigh;               // High surrogate waiting for its pair
+  const char *_literal = nullptr;
+  JsonEvent _literalEvent = JSON_NULL;
+  Capture _captures[JSON_STREAM_MAX_CAPTURES];
+  int _captureCount;
+  JsonEventHandler _handler;
+  void *_ctx;
+  size_t _bytes;
+
+  static bool isSpace(char c) { return c == ' ' || c == '\n' || c == '\r' || c == '\t'; }
+
+  void emit(JsonEvent event, const char *data, size_t len) {
+    if (event == JSON_STRING_PART || event == JSON_STRING_END) {
+      for (int i = 0; i < _captureCount; i++) {
+        if (match(_captures[i].pattern)) _captures[i].out->concat(data, len);
+      }
+    }
+    if (_handler) _handler(*this, event, data, len, _ctx);
+  }
+
+  void fail() { _state = ST_ERROR; }
+
+  // A value finished - what comes next depends on the enclosing container
+  void valueDone() {
+    _state = _depth == 0 ? ST_DONE : ST_AFTER_VALUE;
+  }
+
+  void push(bool isArray) {
+    if (_depth >= JSON_STREAM_MAX_DEPTH) {
+      fail();
+      return;
+    }
+    Frame &f = _frames[_depth++];
+    f.isArray = isArray;
+    f.index = 0;
+    f.key[0] = '\0';
+    _state = isArray ? ST_ARRAY_FIRST : ST_OBJECT_FIRST;
+  }
+
+  void pop(bool isArray) {
+    if (_depth == 0 || _frames[_depth - 1].isArray != isArray) {
+      fail();
+      return;
+    }
+    _depth--;
+    emit(isArray ? JSON_ARRAY_END : JSON_OBJECT_END, "", 0);
+    valueDone();
+  }
+
+  void appendString(char c) {
+    if (_readingKey) {
+      if (_keyLen < JSON_STREAM_KEY_MAX - 1) {
+        _frames[_depth - 1].key[_keyLen++] = c;
+        _frames[_depth - 1].key[_keyLen] = '\0';
+      }
+      return;
+    }
+    _buf[_len++] = c;
+    if (_len >= JSON_STREAM_CHUNK - 4) { // Room for one more UTF-8 sequence
+      emit(JSON_STRING_PART, _buf, _len);
+      _len = 0;
+    }
+  }
+
+  void appendCodePoint(uint32_t cp) {
+    if (cp < 0x80) {
+      appendString((char)cp);
+    } else if (cp < 0x800) {
+      appendString((char)(0xC0 | (cp >> 6)));
+      appendString((char)(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+      appendString((char)(0xE0 | (cp >> 12)));
+      appendString((char)(0x80 | ((cp >> 6) & 0x3F)));
+      appendString((char)(0x80 | (cp & 0x3F)));
+    } else {
+      appendString((char)(0xF0 | (cp >> 18)));
+      appendString((char)(0x80 | ((cp >> 12) & 0x3F)));
+      appendString((char)(0x80 | ((cp >> 6) & 0x3F)));
+      appendString((char)(0x80 | (cp & 0x3F)));
+    }
+  }
+
+  void flushSurrogate() {
+    if (_pendingHigh) {
+      appendCodePoint(0xFFFD); // Unpaired high surrogate
+      _pendingHigh = 0;
+    }
+  }
+
+  void beginString(bool isKey) {
+    _readingKey = isKey;
+    _len = 0;
+    _keyLen = 0;
+    if (isKey) _frames[_depth - 1].key[0] = '\0';
+    _state = ST_STRING;
+  }
+
+  void endString() {
+    flushSurrogate();
+    if (_readingKey) {
+      _readingKey = false;
+      _state = ST_COLON;
+      return;
+    }
+    emit(JSON_STRING_END, _buf, _len);
+    _len = 0;
+    valueDone();
+  }
+
+  void beginValue(char c) {
+    switch (c) {
+      case '{':
+        emit(JSON_OBJECT_BEGIN, "", 0);
+        push(false);
+        return;
+      case '[':
+        emit(JSON_ARRAY_BEGIN, "", 0);
+        push(true);
+        return;
+      case '"':
+        beginString(false);
+        return;
+      case 't':
+        _literal = "true";
+        _literalEvent = JSON_TRUE;
+        break;
+      case 'f':
+        _literal = "false";
+        _literalEvent = JSON_FALSE;
+        break;
+      case 'n':
+        _literal = "null";
+        _literalEvent = JSON_NULL;
+        break;
+      default:
+        if (c == '-' || (c >= '0' && c <= '9')) {
+          _buf[0] = c;
+          _len = 1;
+          _state = ST_NUMBER;
+        } else {
+          fail();
+        }
+        return;
+    }
+    _len = 1;
+    _state = ST_LITERAL;
+  }
+
+  void step(char c) {
+    switch (_state) {
+      case ST_VALUE:
+        if (!isSpace(c)) beginValue(c);
+        break;
+
+      case ST_ARRAY_FIRST:
+        if (isSpace(c)) break;
+        if (c == ']') pop(true);
+        else beginValue(c);
+        break;
+
+      case ST_OBJECT_FIRST:
+      case ST_KEY:
+        if (isSpace(c)) break;
+        if (c == '"') beginString(true);
+        else if (c == '}' && _state == ST_OBJECT_FIRST) pop(false);
+        else fail();
+        break;
+
+      case ST_COLON:
+        if (isSpace(c)) break;
+        if (c == ':') _state = ST_VALUE;
+        else fail();
+        break;
+
+      case ST_AFTER_VALUE:
+        if (isSpace(c)) break;
+        if (c == ',') {
+          Frame &f = _frames[_depth - 1];
+          if (f.isArray) {
+            f.index++;
+            _state = ST_VALUE;
+          } else {
+            _state = ST_KEY;
+          }
+        } else if (c == ']') {
+          pop(true);
+        } else if (c == '}') {
+          pop(false);
+        } else {
+          fail();
+        }
+        break;
+
+      case ST_STRING:
+        if (c == '"') {
+          endString();
+        } else if (c == '\\') {
+          _state = ST_ESCAPE;
+        } else {
+          flushSurrogate();
+          appendString(c);
+        }
+        break;
+
+      case ST_ESCAPE:
+        _state = ST_STRING;
+        if (c == 'u') {
+          _unicode = 0;
+          _unicodeDigits = 0;
+          _state = ST_UNICODE;
+          break;
+        }
+        flushSurrogate();
+        switch (c) {
+          case 'n': appendString('\n'); break;
+          case 't': appendString('\t'); break;
+          case 'r': appendString('\r'); break;
+          case 'b': appendString('\b'); break;
+          case 'f': appendString('\f'); break;
+          default: appendString(c); break; // \" \\ \/
+        }
+        break;
+
+      case ST_UNICODE: {
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else {
+          fail();
+          break;
+        }
+        _unicode = (_unicode << 4) | digit;
+        if (++_unicodeDigits < 4) break;
+        _state = ST_STRING;
+        if (_unicode >= 0xD800 && _unicode <= 0xDBFF) {
+          flushSurrogate();
+          _pendingHigh = _unicode;
+        } else if (_unicode >= 0xDC00 && _unicode <= 0xDFFF) {
+          if (_pendingHigh) {
+            appendCodePoint(0x10000 + ((_pendingHigh - 0xD800) << 10) + (_unicode - 0xDC00));
+            _pendingHigh = 0;
+          } else {
+            appendCodePoint(0xFFFD);
+          }
+        } else {
+          flushSurrogate();
+          appendCodePoint(_unicode);
+        }
+        break;
+      }
+
+      case ST_NUMBER:
+        if ((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+          if (_len < JSON_STREAM_CHUNK - 1) _buf[_len++] = c;
+          break;
+        }
+        _buf[_len] = '\0';
+        emit(JSON_NUMBER, _buf, _len);
+        _len = 0;
+        valueDone();
+        if (_state != ST_DONE) step(c); // The terminator belongs to the container
+        break;
+
+      case ST_LITERAL:
+        if (c != _literal[_len]) {
+          fail();
+          break;
+        }
+        if (_literal[++_len] == '\0') {
+          emit(_literalEvent, _literal, _len);
+          _len = 0;
+          valueDone();
+        }
+        break;
+
+      case ST_DONE:
+      case ST_ERROR:
+        break;
+    }
+  }
+};
+
+// Parse an HTTP response body as it arrives (HTTPClient decodes chunked bodies).
+// Returns false if the body couldn't be read or isn't complete JSON.
+bool jsonStreamHttp(HTTPClient &http, JsonStream &json) {
+  int written = http.writeToStream(&json);
+  if (written < 0) {
+    Serial.printf("[JSON] Read failed: %s\n", http.errorToString(written).c_str());
+    return false;
+  }
+  if (!json.done()) {
+    Serial.printf("[JSON] %s after %d bytes\n", json.failed() ? "Syntax error" : "Truncated body",
+                  json.bytesParsed());
+    return false;
+  }
+  return true;
+}
+
+// Wait for and read up to len bytes from a raw connection
+static int jsonStreamReadSome(WiFiClient &in, uint8_t *buf, int len, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (in.available() <= 0) {
+    if (!in.connected() || millis() - start > timeoutMs) return -1;
+    delay(5);
+  }
+  int n = in.available();
+  return in.read(buf, n < len ? n : len);
+}
+
+// Parse a body from a raw connection (headers already read) until the document
+// is complete. chunked: body uses Transfer-Encoding: chunked.
+bool jsonStreamRead(WiFiClient &in, JsonStream &json, bool chunked, unsigned long timeoutMs) {
+  uint8_t chunk[128];
+  long chunkLeft = -1; // Bytes left in the current chunk (chunked bodies only)
+  while (!json.done() && !json.failed()) {
+    if (chunked && chunkLeft <= 0) {
+      if (chunkLeft == 0) in.readStringUntil('\n'); // CRLF after chunk data
+      String sizeLine = in.readStringUntil('\n');
+      sizeLine.trim();
+      chunkLeft = strtol(sizeLine.c_str(), nullptr, 16);
+      if (chunkLeft <= 0) break;
+    }
+    int want = sizeof(chunk);
+    if (chunked && chunkLeft < want) want = chunkLeft;
+    int n = jsonStreamReadSome(in, chunk, want, timeoutMs);
+    if (n <= 0) break;
+    json.write(chunk, n);
+    if (chunked) chunkLeft -= n;
+  }
+  return json.done();
+}
+
+#endif // JSON_STREAM_H
@@ -0,0 +1,84 @@
+#ifndef JSON_UTIL_H
+#define JSON_UTIL_H
+
+#include <Arduino.h>
+
+// Small helpers for pulling fields out of streamed JSON events (Socket.IO
+// chat-events, SSE data lines) without parsing the whole document.
+
+// Append a code point as UTF-8
+void jsonAppendUtf8(String &out, uint32_t cp) {
+  if (cp < 0x80) {
+    out += (char)cp;
+  } else if (cp < 0x800) {
+    out += (char)(0xC0 | (cp >> 6));
+    out += (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    out += (char)(0xE0 | (cp >> 12));
+    out += (char)(0x80 | ((cp >> 6) & 0x3F));
+    out += (char)(0x80 | (cp & 0x3F));
+  } else {
+    out += (char)(0xF0 | (cp >> 18));
+    out += (char)(0x80 | ((cp >> 12) & 0x3F));
+    out += (char)(0x80 | ((cp >> 6) & 0x3F));
+    out += (char)(0x80 | (cp & 0x3F));
+  }
+}
+
+// Find "key": "<string>" at or after from and unescape the value. Returns the
+// index just past the value, or -1 if the key isn't followed by a string.
+int jsonFindString(const String &json, const char *key, int from, String &out) {
+  String quotedKey = "\"" + String(key) + "\"";
+  int k = json.indexOf(quotedKey, from);
+  if (k < 0) return -1;
+  unsigned int i = k + quotedKey.length();
+  while (i < json.length() && (json[i] == ' ' || json[i] == ':')) i++;
+  if (i >= json.length() || json[i] != '"') return -1;
+
+  out = "";
+  for (i++; i < json.length(); i++) {
+    char c = json[i];
+    if (c == '"') return i + 1;
+    if (c != '\\') {
+      out += c;
+      continue;
+    }
+    if (++i >= json.length()) break;
+    c = json[i];
+    switch (c) {
+      case 'n': out += '\n'; break;
+      case 't': out += '\t'; break;
+      case 'r': out += '\r'; break;
+      case 'b': out += '\b'; break;
+      case 'f': out += '\f'; break;
+      case 'u': {
+        if (i + 4 >= json.length()) return -1;
+        uint32_t cp = strtoul(json.substring(i + 1, i + 5).c_str(), nullptr, 16);
+        i += 4;
+        // Surrogate pair
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 < json.length() && json[i + 1] == '\\' && json[i + 2] == 'u') {
+          uint32_t lo = strtoul(json.substring(i + 3, i + 7).c_str(), nullptr, 16);
+          if (lo >= 0xDC00 && lo <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            i += 6;
+          }
+        }
+        jsonAppendUtf8(out, cp);
+        break;
+      }
+      default: out += c; break; // \" \\ \/
+    }
+  }
+  return -1;
+}
+
+bool jsonFindTrue(const String &json, const char *key) {
+  String quotedKey = "\"" + String(key) + "\"";
+  int k = json.indexOf(quotedKey);
+  if (k < 0) return false;
+  unsigned int i = k + quotedKey.length();
+  while (i < json.length() && (json[i] == ' ' || json[i] == ':')) i++;
+  return json.substring(i, i + 4) == "true";
+}
+
+#endif // JSON_UTIL_H
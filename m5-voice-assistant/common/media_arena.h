@@ -0,0 +1,216 @@
+#ifndef MEDIA_ARENA_H
+#define MEDIA_ARENA_H
+
+// Dependencies: secrets.h, device_config.h, mem_alloc.h and audio_codec.h must
+// be included before this file
+//
+// Fixed media buffers, allocated once in setup() and reused by every
+// question, so hours of questions don't leave the heap in pieces:
+//
+//   audio   audioBuffer + the encoded upload, sized for the largest profile
+//           in the device's table. applyAudioProfile() carves them again for
+//           the new profile instead of freeing and reallocating.
+//   replay  The last answer's MP3 (REPLAY_ARENA_BYTES). Cleared when a new
+//           answer starts; a longer answer isn't kept for replay.
+//   image   The camera JPEG (IMAGE_ARENA_BYTES). Reset at the start of each
+//           question; a larger photo is refused.
+//   body    JSON request bodies (BODY_ARENA_BYTES, str_builder.h). Leased:
+//           it rewinds when the last body built in it is released, so a
+//           request still running on the other core keeps its bytes. A body
+//           that doesn't fit gets its own heap block instead.
+//
+// An arena hands out memory front to back and is only ever reset as a whole.
+// Bodies are built on both cores (session prefetch, TTS worker), so every
+// change to an arena holds a spinlock.
+// The audio budgets in device_config.h are checked at compile time against
+// both profile tables, so a profile that doesn't fit won't build.
+//
+// Usage:
+//   mediaArenasBegin();                          // setup(), after detectDeviceType()
+//   void *p = mediaArenaTake(imageArena, bytes); // nullptr if it doesn't fit
+//   mediaArenaReset(imageArena);
+//   void *b = mediaArenaLease(bodyArena, bytes); // ... mediaArenaRelease(bodyArena)
+//   mediaArenasNewInteraction();                 // start of each question
+//   mediaArenasReport();                         // use and high-water marks
+
+#define MEDIA_ARENA_ALIGN 4
+
+struct MediaArena {
+  const char *name;
+  uint8_t *base;
+  size_t capacity;
+  size_t used;
+  size_t peak;
+  int holders;      // Leases not yet released
+};
+
+MediaArena audioArena = {"audio", nullptr, 0, 0, 0, 0};
+MediaArena replayArena = {"replay", nullptr, 0, 0, 0, 0};
+MediaArena imageArena = {"image", nullptr, 0, 0, 0, 0};
+MediaArena bodyArena = {"body", nullptr, 0, 0, 0, 0};
+static portMUX_TYPE mediaArenaLock = portMUX_INITIALIZER_UNLOCKED;
+
+// External references (defined in the main .ino)
+extern int SAMPLE_RATE;
+extern int RECORD_SAMPLES;
+extern int PRE_ROLL_SAMPLES;
+extern int16_t *audioBuffer;
+extern uint8_t *lastTtsMp3;
+extern size_t lastTtsMp3Length;
+extern bool isLargeDevice;
+extern int numProfiles;
+extern const AudioProfile *deviceProfiles;
+#if ENABLE_CAMERA
+extern uint8_t *lastCapturedImage;
+extern size_t lastCapturedImageSize;
+#endif
+
+constexpr size_t mediaArenaAlign(size_t bytes) {
+  return (bytes + MEDIA_ARENA_ALIGN - 1) & ~(size_t)(MEDIA_ARENA_ALIGN - 1);
+}
+
+// Pre-roll + recording, as applyAudioProfile() works them out
+constexpr int profileSamples(const AudioProfile &p) {
+  return p.sampleRate * p.preRollMs / 1000 + p.sampleRate * p.recordSeconds;
+}
+
+// audioBuffer + encoded upload for one profile
+constexpr size_t profileAudioBytes(const AudioProfile &p) {
+  return mediaArenaAlign(profileSamples(p) * sizeof(int16_t)) +
+         mediaArenaAlign(audioCodecCapacity(STT_UPLOAD_CODEC, profileSamples(p)));
+}
+
+// Largest of a profile table
+constexpr size_t profilesAudioBytes(const AudioProfile *p, int n) {
+  return n <= 0 ? 0
+       : profileAudioBytes(p[0]) > profilesAudioBytes(p + 1, n - 1) ? profileAudioBytes(p[0])
+       : profilesAudioBytes(p + 1, n - 1);
+}
+
+static_assert(profilesAudioBytes(STICK_PROFILES, sizeof(STICK_PROFILES) / sizeof(STICK_PROFILES[0])) <=
+                  STICK_AUDIO_ARENA_BYTES,
+              "A STICK_PROFILES entry doesn't fit STICK_AUDIO_ARENA_BYTES (device_config.h)");
+static_assert(profilesAudioBytes(CORE_PROFILES, sizeof(CORE_PROFILES) / sizeof(CORE_PROFILES[0])) <=
+                  CORE_AUDIO_ARENA_BYTES,
+              "A CORE_PROFILES entry doesn't fit CORE_AUDIO_ARENA_BYTES (device_config.h)");
+// A photo question: the base64 JPEG, the chat context and the rest of the request
+static_assert(BODY_ARENA_BYTES >= (IMAGE_ARENA_BYTES + 2) / 3 * 4 + CHAT_CONTEXT_BUDGET_BYTES + 4096,
+              "An image question's request body doesn't fit BODY_ARENA_BYTES (device_config.h)");
+
+static bool mediaArenaBegin(MediaArena &a, size_t capacity, MemUser user) {
+  if (a.base || capacity == 0) return a.base != nullptr;
+  a.base = (uint8_t *)memAlloc(capacity, user);
+  a.capacity = a.base ? capacity : 0;
+  a.used = 0;
+  if (!a.base) {
+    Serial.printf("[ARENA] %s: can't allocate %d bytes\n", a.name, (int)capacity);
+    return false;
+  }
+  return true;
+}
+
+static void *mediaArenaTakeHeld(MediaArena &a, size_t bytes, bool lease) {
+  portENTER_CRITICAL(&mediaArenaLock);
+  size_t used = a.used;
+  size_t start = mediaArenaAlign(used);
+  bool fits = a.base && start + bytes <= a.capacity;
+  if (fits) {
+    a.used = start + bytes;
+    if (a.used > a.peak) a.peak = a.used;
+    if (lease) a.holders++;
+  }
+  portEXIT_CRITICAL(&mediaArenaLock);
+  if (!fits) {
+    Serial.printf("[ARENA] %s: %d bytes don't fit (%d of %d used)\n", a.name, (int)bytes, (int)used,
+                  (int)a.capacity);
+    return nullptr;
+  }
+  return a.base + start;
+}
+
+void *mediaArenaTake(MediaArena &a, size_t bytes) {
+  return mediaArenaTakeHeld(a, bytes, false);
+}
+
+// Take bytes until mediaArenaRelease(); the arena rewinds when nothing is leased
+void *mediaArenaLease(MediaArena &a, size_t bytes) {
+  return mediaArenaTakeHeld(a, bytes, true);
+}
+
+void mediaArenaRelease(MediaArena &a) {
+  portENTER_CRITICAL(&mediaArenaLock);
+  if (a.holders > 0 && --a.holders == 0) a.used = 0;
+  portEXIT_CRITICAL(&mediaArenaLock);
+}
+
+// For an arena used as one buffer that fills up (replay): bytes now held
+void mediaArenaFill(MediaArena &a, size_t bytes) {
+  portENTER_CRITICAL(&mediaArenaLock);
+  a.used = bytes;
+  if (a.used > a.peak) a.peak = a.used;
+  portEXIT_CRITICAL(&mediaArenaLock);
+}
+
+void mediaArenaReset(MediaArena &a) {
+  portENTER_CRITICAL(&mediaArenaLock);
+  a.used = 0;
+  portEXIT_CRITICAL(&mediaArenaLock);
+}
+
+// audioBuffer and the encoded upload for the current profile. Called by
+// applyAudioProfile() with the mic disarmed.
+bool audioArenaCarve() {
+  mediaArenaReset(audioArena);
+  audioBuffer = nullptr;
+  audioCodecBuffer = nullptr;
+  if (!audioArena.base) return false;
+
+  int samples = PRE_ROLL_SAMPLES + RECORD_SAMPLES;
+  audioBuffer = (int16_t *)mediaArenaTake(audioArena, samples * sizeof(int16_t));
+  size_t encoded = audioCodecCapacity(STT_UPLOAD_CODEC, samples);
+  if (audioBuffer && encoded > 0) {
+    audioCodecBuffer = (uint8_t *)mediaArenaTake(audioArena, encoded);
+  }
+  if (audioBuffer) {
+    Serial.printf("[MIC] Buffer: %d + %d samples, %d of %d arena bytes\n", PRE_ROLL_SAMPLES, RECORD_SAMPLES,
+                  (int)audioArena.used, (int)audioArena.capacity);
+  }
+  return audioBuffer != nullptr;
+}
+
+// Once in setup(), after detectDeviceType() picked the profile table
+void mediaArenasBegin() {
+  mediaArenaBegin(audioArena, profilesAudioBytes(deviceProfiles, numProfiles), MEM_AUDIO);
+  if (USE_TTS && isLargeDevice) {
+    mediaArenaBegin(replayArena, REPLAY_ARENA_BYTES, MEM_REPLAY);
+  }
+  if (ENABLE_CAMERA && isLargeDevice) {
+    mediaArenaBegin(imageArena, IMAGE_ARENA_BYTES, MEM_IMAGE);
+  }
+  mediaArenaBegin(bodyArena, BODY_ARENA_BYTES, MEM_BODY);
+  lastTtsMp3 = replayArena.base;
+  lastTtsMp3Length = 0;
+  Serial.printf("[ARENA] audio %d, replay %d, image %d, body %d bytes\n", (int)audioArena.capacity,
+                (int)replayArena.capacity, (int)imageArena.capacity, (int)bodyArena.capacity);
+}
+
+// Start of a question: the last photo goes. The recording buffers are reused
+// in place (the pre-roll is already running in them), the replay stays until
+// the next answer starts and the body arena rewinds on its own.
+void mediaArenasNewInteraction() {
+  mediaArenaReset(imageArena);
+#if ENABLE_CAMERA
+  lastCapturedImage = nullptr;
+  lastCapturedImageSize = 0;
+#endif
+}
+
+void mediaArenasReport() {
+  const MediaArena *arenas[] = {&audioArena, &replayArena, &imageArena, &bodyArena};
+  for (const MediaArena *a : arenas) {
+    if (!a->base) continue;
+    Serial.printf("[ARENA]   %-8s %7d of %d bytes, peak %d\n", a->name, (int)a->used, (int)a->capacity, (int)a->peak);
+  }
+}
+
+#endif // MEDIA_ARENA_H
@@ -0,0 +1,231 @@
+#ifndef MEM_ALLOC_H
+#define MEM_ALLOC_H
+
+// Dependencies: device_config.h must be included before this file
+//
+// Central allocator for the sketch's own buffers. Every allocation names its
+// user, and the user decides where it goes:
+//
+//   MEM_INTERNAL  small or latency-sensitive buffers (speaker blocks, queued
+//                 sentences, task jobs) - internal RAM. Small sizes come
+//                 from fixed size-class pools, so they don't fragment the heap.
+//   MEM_LARGE     media buffers (recording, upload, replay MP3, camera JPEG,
+//                 chat tree, request bodies) - PSRAM when the board has it, so the internal
+//                 heap stays free for WiFi and TLS. These buffers are only read
+//                 by the CPU, never by DMA. ENABLE_PSRAM_MEDIA false keeps
+//                 them internal.
+//
+// If the preferred region is full, the other one is tried. Each user's
+// current bytes and high-water mark are tracked; memReport() logs them after
+// every interaction.
+//
+// The pools are set up by memBegin(), once in setup() before any task is
+// created; until then small blocks come from the heap like the rest.
+//
+// Usage:
+//   memBegin();                             // setup(), first thing
+//   void *p = memAlloc(bytes, MEM_AUDIO);
+//   p = memRealloc(p, bytes, MEM_CHAT);     // moves to PSRAM once it's large
+//   memFree(p);                             // any pointer from memAlloc/memRealloc, or nullptr
+
+enum MemUser {
+  MEM_AUDIO,        // Audio arena: recording + encoded upload (media_arena.h)
+  MEM_SPEAKER,      // Decoded PCM ring and speaker blocks (mp3_stream.h)
+  MEM_REPLAY,       // Replay arena: last spoken answer (media_arena.h)
+  MEM_IMAGE,        // Image arena: camera JPEG (media_arena.h)
+  MEM_CHAT,         // Chat tree (chat_history.h)
+  MEM_TEXT,         // Queued TTS sentences (tts_pipeline.h)
+  MEM_TASK,         // Task graph jobs (task_graph.h)
+  MEM_BODY,         // Body arena and request bodies that don't fit it (str_builder.h)
+  MEM_USERS
+};
+
+enum MemPlacement {
+  MEM_INTERNAL,
+  MEM_LARGE,
+};
+
+static const char *MEM_USER_NAMES[MEM_USERS] = {
+  "audio", "speaker", "replay", "image", "chat", "text", "task", "body"
+};
+
+static const MemPlacement MEM_POLICY[MEM_USERS] = {
+  MEM_LARGE, MEM_INTERNAL, MEM_LARGE, MEM_LARGE, MEM_LARGE, MEM_INTERNAL, MEM_INTERNAL, MEM_LARGE
+};
+
+#define MEM_PSRAM_MIN_BYTES 1024         // MEM_LARGE below this stays internal
+#define MEM_POOL_CLASSES 3
+static const int MEM_POOL_SIZES[MEM_POOL_CLASSES] = {64, 256, 1024};   // Usable bytes per slot
+static const int MEM_POOL_SLOTS[MEM_POOL_CLASSES] = {16, 8, 4};        // 7KB of internal RAM
+
+// Where a block came from
+enum MemSource : uint8_t {
+  MEM_FROM_POOL,
+  MEM_FROM_INTERNAL,
+  MEM_FROM_PSRAM,
+};
+
+// In front of every block; 8 bytes keeps the caller's data word-aligned
+struct MemHeader {
+  uint32_t size;
+  uint8_t user;
+  uint8_t source;
+  uint8_t poolClass;
+  uint8_t poolSlot;
+};
+
+struct MemUsage {
+  size_t bytes;
+  size_t peak;
+  int blocks;
+  int failures;
+};
+
+static MemUsage memUsage[MEM_USERS];
+static size_t memRegionBytes[3];         // By MemSource
+static uint8_t *memPools[MEM_POOL_CLASSES];
+static uint32_t memPoolFree[MEM_POOL_CLASSES];   // Bit per free slot
+static portMUX_TYPE memLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Once from setup(), before other tasks can allocate: the pools are not
+// guarded while they are set up
+void memBegin() {
+  if (memPools[0]) return;
+  for (int c = 0; c < MEM_POOL_CLASSES; c++) {
+    size_t slot = sizeof(MemHeader) + MEM_POOL_SIZES[c];
+    memPools[c] = (uint8_t *)heap_caps_malloc(slot * MEM_POOL_SLOTS[c], MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    memPoolFree[c] = memPools[c] ? (MEM_POOL_SLOTS[c] == 32 ? 0xFFFFFFFF : (1u << MEM_POOL_SLOTS[c]) - 1) : 0;
+  }
+}
+
+static MemHeader *memPoolTake(size_t bytes) {
+  for (int c = 0; c < MEM_POOL_CLASSES; c++) {
+    if (bytes > (size_t)MEM_POOL_SIZES[c]) continue;
+    portENTER_CRITICAL(&memLock);
+    uint32_t free = memPoolFree[c];
+    int slot = free ? __builtin_ctz(free) : -1;
+    if (slot >= 0) memPoolFree[c] &= ~(1u << slot);
+    portEXIT_CRITICAL(&memLock);
+    if (slot < 0) continue;   // Class full - a bigger one will do
+    MemHeader *h = (MemHeader *)(memPools[c] + slot * (sizeof(MemHeader) + MEM_POOL_SIZES[c]));
+    h->source = MEM_FROM_POOL;
+    h->poolClass = c;
+    h->poolSlot = slot;
+    return h;
+  }
+  return nullptr;
+}
+
+static MemHeader *memHeapTake(size_t bytes, bool psram) {
+  uint32_t caps = (psram ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+  MemHeader *h = (MemHeader *)heap_caps_malloc(sizeof(MemHeader) + bytes, caps);
+  if (h) h->source = psram ? MEM_FROM_PSRAM : MEM_FROM_INTERNAL;
+  return h;
+}
+
+static void memCount(MemHeader *h, bool add) {
+  portENTER_CRITICAL(&memLock);
+  MemUsage &u = memUsage[h->user];
+  if (add) {
+    u.bytes += h->size;
+    u.blocks++;
+    if (u.bytes > u.peak) u.peak = u.bytes;
+    memRegionBytes[h->source] += h->size;
+  } else {
+    u.bytes -= h->size;
+    u.blocks--;
+    memRegionBytes[h->source] -= h->size;
+  }
+  portEXIT_CRITICAL(&memLock);
+}
+
+static bool memIsLarge(size_t bytes, MemUser user) {
+  return MEM_POLICY[user] == MEM_LARGE && bytes >= MEM_PSRAM_MIN_BYTES;
+}
+
+static bool memWantsPsram(size_t bytes, MemUser user) {
+  return memIsLarge(bytes, user) && ENABLE_PSRAM_MEDIA && psramFound();
+}
+
+void *memAlloc(size_t bytes, MemUser user) {
+  bool large = memIsLarge(bytes, user);
+  bool psram = memWantsPsram(bytes, user);
+  MemHeader *h = nullptr;
+
+  if (!large) h = memPoolTake(bytes);
+  if (!h) h = memHeapTake(bytes, psram);
+  if (!h && (psram || psramFound())) h = memHeapTake(bytes, !psram);   // Other region
+  if (!h) {
+    portENTER_CRITICAL(&memLock);
+    memUsage[user].failures++;
+    portEXIT_CRITICAL(&memLock);
+    Serial.printf("[MEM] Failed to allocate %d bytes for %s\n", (int)bytes, MEM_USER_NAMES[user]);
+    return nullptr;
+  }
+  h->size = bytes;
+  h->user = user;
+  memCount(h, true);
+  return h + 1;
+}
+
+void memFree(void *p) {
+  if (!p) return;
+  MemHeader *h = (MemHeader *)p - 1;
+  memCount(h, false);
+  if (h->source == MEM_FROM_POOL) {
+    portENTER_CRITICAL(&memLock);
+    memPoolFree[h->poolClass] |= 1u << h->poolSlot;
+    portEXIT_CRITICAL(&memLock);
+  } else {
+    heap_caps_free(h);
+  }
+}
+
+// Grow or shrink. A heap block already in the right region is resized in
+// place; anything else (a pool slot, a small block outgrowing internal RAM)
+// moves to where memAlloc() would put the new size.
+void *memRealloc(void *p, size_t bytes, MemUser user) {
+  if (!p) return memAlloc(bytes, user);
+  MemHeader *h = (MemHeader *)p - 1;
+  MemSource wanted = memWantsPsram(bytes, user) ? MEM_FROM_PSRAM : MEM_FROM_INTERNAL;
+  if (h->source == wanted) {
+    uint32_t caps = (wanted == MEM_FROM_PSRAM ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+    memCount(h, false);
+    MemHeader *grown = (MemHeader *)heap_caps_realloc(h, sizeof(MemHeader) + bytes, caps);
+    if (grown) {
+      grown->size = bytes;
+      grown->user = user;
+      memCount(grown, true);
+      return grown + 1;
+    }
+    memCount(h, true);
+  }
+
+  void *moved = memAlloc(bytes, user);
+  if (!moved) return nullptr;
+  memcpy(moved, p, h->size < bytes ? h->size : bytes);
+  memFree(p);
+  return moved;
+}
+
+// Copy of a C string (MEM_TEXT)
+char *memStrdup(const char *s, MemUser user) {
+  size_t len = strlen(s) + 1;
+  char *copy = (char *)memAlloc(len, user);
+  if (copy) memcpy(copy, s, len);
+  return copy;
+}
+
+// Per-user usage and high-water marks
+void memReport() {
+  Serial.printf("[MEM] In use: internal %d, psram %d, pools %d bytes\n", (int)memRegionBytes[MEM_FROM_INTERNAL],
+                (int)memRegionBytes[MEM_FROM_PSRAM], (int)memRegionBytes[MEM_FROM_POOL]);
+  for (int i = 0; i < MEM_USERS; i++) {
+    const MemUsage &u = memUsage[i];
+    if (u.peak == 0 && u.failures == 0) continue;
+    Serial.printf("[MEM]   %-8s %7d bytes in %d blocks, peak %d, %d failed\n", MEM_USER_NAMES[i], (int)u.bytes,
+                  u.blocks, (int)u.peak, u.failures);
+  }
+}
+
+#endif // MEM_ALLOC_H
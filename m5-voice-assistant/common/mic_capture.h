@@ -0,0 +1,260 @@
+#ifndef MIC_CAPTURE_H
+#define MIC_CAPTURE_H
+
+#include <algorithm>
+
+// Dependencies: M5Unified.h (M5CoreS3.h on CoreS3) and device_config.h must be
+// included before this file
+//
+// Always-armed microphone capture. While idle the mic keeps filling a ring at
+// the front of audioBuffer with the last PRE_ROLL_SAMPLES of sound, so a
+// question that starts right at the press keeps its first syllable. The mic
+// writes straight into the buffer: record() is kept two blocks deep, so its
+// DMA never waits for us. micCaptureStart() puts the ring in order and the
+// recording carries on right behind it in the same buffer:
+//
+//   audioBuffer: [ pre-roll ring | recording (up to RECORD_SAMPLES)      ]
+//
+// so audioBuffer[0 .. micCaptureStop()) is pre-roll + question back to back,
+// which is what the upload code expects. The buffer is allocated once per
+// audio profile (in PSRAM if there is some) and reused for every recording.
+//
+// Usage:
+//   micCaptureArm();                          // while idle (interactionPoll() does it)
+//   int preRoll = micCaptureStart();          // samples already in audioBuffer
+//   int have = micCaptureWait(preRoll, 500);  // more samples as blocks land
+//   int total = micCaptureStop();             // mic off, total samples in audioBuffer
+//   micCaptureDisarm();                       // before the speaker is used or audioBuffer re-carved
+
+#ifndef CAPTURE_MIC
+#define CAPTURE_MIC M5.Mic               // CoreS3 overrides this in device_config.h
+#endif
+
+#define MIC_CAPTURE_BLOCK_MS 32          // Per record() block - also the level/VAD step
+#define MIC_CAPTURE_RETRY_MS 5000        // Wait this long before arming again after a mic error
+
+// External references (defined in the main .ino)
+extern int SAMPLE_RATE;
+extern int RECORD_SAMPLES;
+extern int PRE_ROLL_SAMPLES;
+extern int16_t *audioBuffer;
+
+enum MicCaptureMode {
+  MIC_CAPTURE_ARMED,        // Filling the pre-roll ring
+  MIC_CAPTURE_RECORDING,    // Writing the recording behind the pre-roll
+};
+
+struct MicCaptureJob {
+  bool ring;                // Block went to the pre-roll ring
+  int length;
+};
+
+// Shared with the caller
+static TaskHandle_t micCaptureTaskHandle = NULL;
+static volatile bool micCaptureRunning = false;
+static volatile MicCaptureMode micCaptureMode = MIC_CAPTURE_ARMED;
+static volatile bool micCaptureTriggered = false;     // micCaptureStart() while armed
+static volatile bool micCaptureStopRequested = false;
+static volatile int micCaptureSamples = -1;           // In order in audioBuffer, -1 = pre-roll not ready
+static volatile int micCapturePreRoll = 0;
+static unsigned long micCaptureRetryAt = 0;
+
+// Owned by the capture task
+static int16_t *micCaptureBuffer = nullptr;
+static int micCaptureBlock = 0;          // Samples per block
+static int micCaptureRingBlocks = 0;
+static int micCaptureRingNext = 0;       // Next ring block to fill (= oldest once wrapped)
+static bool micCaptureRingWrapped = false;
+static int micCaptureRingInFlight = 0;   // Ring blocks still on the mic after the trigger
+static int micCaptureBase = 0;           // Recording starts here in audioBuffer
+static int micCaptureQueued = 0;         // Recording samples handed to the mic
+static int micCaptureDone = 0;           // Recording samples landed
+static MicCaptureJob micCaptureFlight[2];
+static int micCaptureInFlight = 0;
+
+// audioBuffer lives in the audio arena and is carved per profile
+// (applyAudioProfile()); this only retries if that failed
+static bool micCaptureAlloc() {
+  if (audioBuffer || audioArenaCarve()) return true;
+  Serial.println("[MIC] ERROR: No recording buffer");
+  return false;
+}
+
+// Pre-roll complete: oldest ring block first, so the recording follows in order
+static void micCaptureFinishPreRoll() {
+  if (micCaptureRingWrapped && micCaptureRingNext > 0) {
+    int16_t *ring = micCaptureBuffer;
+    std::rotate(ring, ring + micCaptureRingNext * micCaptureBlock, ring + micCaptureRingBlocks * micCaptureBlock);
+  }
+  micCaptureSamples = micCapturePreRoll + micCaptureDone;
+}
+
+// The oldest block on the mic has landed
+static void micCaptureLand() {
+  MicCaptureJob job = micCaptureFlight[0];
+  micCaptureFlight[0] = micCaptureFlight[1];
+  micCaptureInFlight--;
+
+  if (job.ring) {
+    if (micCaptureMode == MIC_CAPTURE_RECORDING && --micCaptureRingInFlight == 0) micCaptureFinishPreRoll();
+  } else {
+    micCaptureDone += job.length;
+    if (micCaptureRingInFlight == 0) micCaptureSamples = micCapturePreRoll + micCaptureDone;
+  }
+}
+
+// Armed -> recording. Ring blocks still on the mic finish first; new blocks go
+// behind the ring (or right behind the last ring block if it never wrapped).
+static void micCaptureBeginRecording() {
+  micCaptureRingInFlight = 0;
+  for (int i = 0; i < micCaptureInFlight; i++) {
+    if (micCaptureFlight[i].ring) micCaptureRingInFlight++;
+  }
+  micCaptureBase = micCaptureRingWrapped ? micCaptureRingBlocks * micCaptureBlock : micCaptureRingNext * micCaptureBlock;
+  micCapturePreRoll = micCaptureBase;
+  micCaptureQueued = 0;
+  micCaptureDone = 0;
+  micCaptureMode = MIC_CAPTURE_RECORDING;
+  if (micCaptureRingInFlight == 0) micCaptureFinishPreRoll();
+}
+
+// Hand the next block to the mic; false if there is nothing left to record
+static bool micCaptureQueueNext() {
+  MicCaptureJob job;
+  int16_t *dst;
+  if (micCaptureMode == MIC_CAPTURE_ARMED) {
+    job = {true, micCaptureBlock};
+    dst = micCaptureBuffer + micCaptureRingNext * micCaptureBlock;
+    if (++micCaptureRingNext == micCaptureRingBlocks) {
+      micCaptureRingNext = 0;
+      micCaptureRingWrapped = true;
+    }
+  } else {
+    int left = RECORD_SAMPLES - micCaptureQueued;
+    if (left <= 0) return false;
+    job = {false, left < micCaptureBlock ? left : micCaptureBlock};
+    dst = micCaptureBuffer + micCaptureBase + micCaptureQueued;
+    micCaptureQueued += job.length;
+  }
+  CAPTURE_MIC.record(dst, job.length, SAMPLE_RATE);
+  micCaptureFlight[micCaptureInFlight++] = job;
+  return true;
+}
+
+void micCaptureTask(void *parameter) {
+  for (;;) {
+    // Blocks land in order; isRecording() counts the ones still queued
+    while (micCaptureInFlight > (int)CAPTURE_MIC.isRecording()) {
+      micCaptureLand();
+    }
+
+    if (micCaptureStopRequested) {
+      if (micCaptureInFlight == 0) break;
+      delay(1);
+      continue;
+    }
+    if (micCaptureTriggered && micCaptureMode == MIC_CAPTURE_ARMED) {
+      micCaptureBeginRecording();
+    }
+    if (micCaptureInFlight < 2 && micCaptureQueueNext()) continue;
+    delay(2);
+  }
+
+  CAPTURE_MIC.end();
+  micCaptureTaskHandle = NULL;
+  micCaptureRunning = false;
+  vTaskDelete(NULL);
+}
+
+static bool micCaptureLaunch(MicCaptureMode mode) {
+  if (!micCaptureAlloc()) return false;
+  if (!CAPTURE_MIC.begin()) {
+    Serial.println("[MIC] ERROR: Mic didn't start");
+    return false;
+  }
+
+  micCaptureBuffer = audioBuffer;
+  micCaptureBlock = SAMPLE_RATE * MIC_CAPTURE_BLOCK_MS / 1000;
+  micCaptureRingBlocks = PRE_ROLL_SAMPLES / micCaptureBlock;
+  micCaptureRingNext = 0;
+  micCaptureRingWrapped = false;
+  micCaptureRingInFlight = 0;
+  micCaptureBase = 0;
+  micCaptureQueued = 0;
+  micCaptureDone = 0;
+  micCaptureInFlight = 0;
+  micCapturePreRoll = 0;
+  micCaptureSamples = mode == MIC_CAPTURE_RECORDING ? 0 : -1;
+  micCaptureMode = mode;
+  micCaptureTriggered = false;
+  micCaptureStopRequested = false;
+  micCaptureRunning = true;
+
+  // Core 1 above loop() and the interaction task, so a block is always queued in time
+  if (xTaskCreatePinnedToCore(micCaptureTask, "micCapture", 4096, NULL, 2, &micCaptureTaskHandle, 1) != pdPASS) {
+    Serial.println("[MIC] Failed to start capture task");
+    micCaptureTaskHandle = NULL;
+    micCaptureRunning = false;
+    CAPTURE_MIC.end();
+    return false;
+  }
+  return true;
+}
+
+// Keep the mic filling the pre-roll ring. No-op if it already runs; false if
+// pre-roll is off or shorter than two blocks for this profile.
+bool micCaptureArm() {
+  if (micCaptureRunning) return true;
+  if (!ENABLE_MIC_PREROLL || PRE_ROLL_SAMPLES < 2 * SAMPLE_RATE * MIC_CAPTURE_BLOCK_MS / 1000) return false;
+  if (micCaptureRetryAt != 0 && (long)(millis() - micCaptureRetryAt) < 0) return false;
+
+  if (!micCaptureLaunch(MIC_CAPTURE_ARMED)) {
+    micCaptureRetryAt = millis() + MIC_CAPTURE_RETRY_MS;
+    return false;
+  }
+  micCaptureRetryAt = 0;
+  Serial.printf("[MIC] Armed, %dms pre-roll\n", PRE_ROLL_SAMPLES * 1000 / SAMPLE_RATE);
+  return true;
+}
+
+// Stop the mic and wait until it no longer writes to audioBuffer
+void micCaptureDisarm() {
+  if (!micCaptureRunning) return;
+  micCaptureStopRequested = true;
+  while (micCaptureRunning) {
+    delay(1);
+  }
+}
+
+// Start a recording. Returns how many samples of pre-roll are already at the
+// start of audioBuffer (0 if the mic wasn't armed), -1 if the mic failed.
+int micCaptureStart() {
+  if (micCaptureRunning && micCaptureMode == MIC_CAPTURE_ARMED && !micCaptureStopRequested) {
+    micCaptureTriggered = true;
+    while (micCaptureSamples < 0 && micCaptureRunning) {
+      delay(1);
+    }
+    return micCapturePreRoll;
+  }
+  micCaptureDisarm();
+  return micCaptureLaunch(MIC_CAPTURE_RECORDING) ? 0 : -1;
+}
+
+// Wait until audioBuffer holds more than have samples. Returns the new count,
+// or have on timeout or once the recording is full.
+int micCaptureWait(int have, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (micCaptureSamples <= have && micCaptureRunning && millis() - start < timeoutMs) {
+    delay(2);
+  }
+  int samples = micCaptureSamples;
+  return samples > have ? samples : have;
+}
+
+// Stop recording (the block in flight still lands). Returns the samples in audioBuffer.
+int micCaptureStop() {
+  micCaptureDisarm();
+  return micCaptureSamples > 0 ? micCaptureSamples : 0;
+}
+
+#endif // MIC_CAPTURE_H
@@ -0,0 +1,139 @@
+#ifndef MIC_PREPROCESS_H
+#define MIC_PREPROCESS_H
+
+// Dependencies: device_config.h and dsp_kernels.h must be included before this file
+//
+// Mic clean-up, run in place on every block as it lands in audioBuffer -
+// before the level meter, the VAD and the upload see it. Integer arithmetic
+// only. Each stage is switched on per AudioProfile (micPreprocess field):
+//
+//   MIC_DC   DC blocker (~5Hz) - the MEMS mic's offset would eat headroom
+//   MIC_HPF  12dB/octave high-pass at MIC_HPF_HZ - desk rumble, handling noise
+//   MIC_AGC  Gain towards AGC_TARGET_RMS. The gain for a block is chosen
+//            after seeing the whole block (look-ahead), so it drops before a
+//            loud syllable instead of clipping it, and rises slowly. Blocks
+//            below AGC_GATE_RMS hold the gain, so silence isn't boosted.
+//            The gain carries over to the next recording - the same person
+//            usually asks the next question from about the same distance.
+//
+// Quiet and far-away speakers reach the STT at a usable level instead of
+// coming back as "Couldn't hear".
+//
+// Usage:
+//   micPreprocessBegin();                 // per recording, stages from MIC_PREPROCESS
+//   micPreprocess(samples, n);            // in place, any length
+
+#define MIC_HPF_HZ 100                   // High-pass corner
+#define MIC_DC_POLE 32702                // DC blocker pole, 0.998 in Q15
+#define AGC_TARGET_RMS 2500              // About -22dBFS
+#define AGC_GATE_RMS 150                 // Quieter blocks are noise - gain is held
+#define AGC_MAX_GAIN (8 << 12)           // +18dB (Q12)
+#define AGC_MIN_GAIN (1 << 11)           // -6dB (Q12)
+#define AGC_RISE 4596                    // Gain rises at most 1dB per block (Q12 factor)
+#define AGC_PEAK_LIMIT 32000             // Largest sample after the gain
+#define AGC_BLOCK_MS 32                  // AGC step (one mic block)
+
+// External references (defined in the main .ino)
+extern int SAMPLE_RATE;
+extern int MIC_PREPROCESS;
+
+static int micPreStages = 0;
+static int32_t micDcX = 0, micDcY = 0;
+static int32_t micDcErr = 0;                // Q15 remainders carried to the next sample
+static int32_t micHpfAlpha = 0;              // Q15
+static int32_t micHpfX[2] = {0, 0}, micHpfY[2] = {0, 0};
+static int32_t micHpfErr[2] = {0, 0};
+static int32_t micAgcGain = 1 << 12;         // Q12, kept between recordings
+static int micAgcBlock = 0;
+
+void micPreprocessBegin() {
+  micPreStages = ENABLE_MIC_PREPROCESS ? MIC_PREPROCESS : 0;
+  float dt = 1.0f / SAMPLE_RATE;
+  float rc = 1.0f / (2.0f * (float)M_PI * MIC_HPF_HZ);
+  micHpfAlpha = (int32_t)(32768.0f * rc / (rc + dt) + 0.5f);
+  micDcX = micDcY = micDcErr = 0;
+  micHpfX[0] = micHpfX[1] = micHpfY[0] = micHpfY[1] = 0;
+  micHpfErr[0] = micHpfErr[1] = 0;
+  micAgcBlock = SAMPLE_RATE * AGC_BLOCK_MS / 1000;
+}
+
+static inline int16_t micClamp(int32_t v) {
+  return v > 32767 ? 32767 : (v < -32768 ? -32768 : v);
+}
+
+// Q15 product with the remainder carried over (error feedback). Dropping it
+// would bias the output: about -250 for the DC blocker with flooring, or a
+// +-250 dead band it can't settle through with rounding.
+static inline int32_t micQ15(int64_t product, int32_t &err) {
+  int64_t acc = product + err;
+  int32_t y = (int32_t)(acc >> 15);
+  err = (int32_t)(acc - ((int64_t)y << 15));
+  return y;
+}
+
+static void micFilter(int16_t *x, int n) {
+  bool dc = micPreStages & MIC_DC;
+  bool hpf = micPreStages & MIC_HPF;
+  for (int i = 0; i < n; i++) {
+    int32_t s = x[i];
+    if (dc) {
+      int32_t y = s - micDcX + micQ15((int64_t)MIC_DC_POLE * micDcY, micDcErr);
+      micDcX = s;
+      micDcY = y;
+      s = y;
+    }
+    if (hpf) {
+      // Two one-pole sections in a row
+      for (int k = 0; k < 2; k++) {
+        int32_t y = micQ15((int64_t)micHpfAlpha * (micHpfY[k] + s - micHpfX[k]), micHpfErr[k]);
+        micHpfX[k] = s;
+        micHpfY[k] = y;
+        s = y;
+      }
+    }
+    x[i] = micClamp(s);
+  }
+}
+
+// One AGC step: pick the gain for this block. A lower gain applies to the
+// whole block (it was picked for this block's peak); a higher one is ramped
+// in across the block so it doesn't click.
+static void micAgc(int16_t *x, int n) {
+  DspStats st;
+  dspStats(st, x, n);
+  int rms = dspRms(st);
+  int peak = max(-(int)st.minVal, (int)st.maxVal);
+
+  int32_t target = micAgcGain;
+  if (rms >= AGC_GATE_RMS) {
+    int32_t wanted = (int32_t)(((int64_t)AGC_TARGET_RMS << 12) / rms);
+    int32_t rise = (int32_t)(((int64_t)micAgcGain * AGC_RISE) >> 12);
+    target = wanted < micAgcGain ? wanted : min(wanted, rise);
+  }
+  if (peak > 0) {
+    int32_t limit = (int32_t)(((int64_t)AGC_PEAK_LIMIT << 12) / peak);
+    if (target > limit) target = limit;
+  }
+  target = constrain(target, AGC_MIN_GAIN, AGC_MAX_GAIN);
+
+  int32_t start = target < micAgcGain ? target : micAgcGain;
+  int32_t step = (target - start) / n;
+  for (int i = 0; i < n; i++) {
+    int32_t gain = i == n - 1 ? target : start + step * (i + 1);
+    x[i] = micClamp((x[i] * gain) >> 12);
+  }
+  micAgcGain = target;
+}
+
+// Clean up samples in place (pre-roll or any number of mic blocks)
+void micPreprocess(int16_t *x, int n) {
+  if (!micPreStages || n <= 0) return;
+  if (micPreStages & (MIC_DC | MIC_HPF)) micFilter(x, n);
+  if (micPreStages & MIC_AGC) {
+    for (int done = 0; done < n; done += micAgcBlock) {
+      micAgc(x + done, min(micAgcBlock, n - done));
+    }
+  }
+}
+
+#endif // MIC_PREPROCESS_H
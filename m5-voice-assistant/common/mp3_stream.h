@@ -0,0 +1,347 @@
+#ifndef MP3_STREAM_H
+#define MP3_STREAM_H
+
+#include <HTTPClient.h>
+#include "http_pool.h"
+
+// Dependencies: device_config.h, mem_alloc.h, media_arena.h, http_pool.h and
+// MP3DecoderHelix.h must be included before this file
+//
+// Streaming MP3 playback for TTS. A player task on core 0 reads the response
+// body in small chunks, feeds them to the Helix decoder and collects the PCM in
+// a fixed ring buffer. Whenever a block's worth of PCM is ready it is copied
+// into one of two block buffers and queued with playRaw() - the speaker channel
+// plays one block while the next one waits, so output is continuous. Playback
+// starts after the first few frames instead of after the whole download, and
+// memory stays at the ring + two blocks + decoder state regardless of length.
+//
+// Usage:
+//   HTTPClient &http = httpPoolBegin(url); ... httpPoolSend(...)
+//   mp3StreamStart(http, http.getSize(), true);  // player returns http to the pool
+//   mp3StreamWait();                             // until the speaker is done
+//
+// Starting a new stream while one is still decoding waits for it to hand off
+// its last block, so back-to-back streams (the TTS pipeline) play gaplessly.
+// The compressed MP3 is kept in lastTtsMp3 (the replay arena) for replay.
+//
+// Barge-in: mp3StreamStop() (any task) makes the player drop the ring, close
+// the socket and exit within a read chunk, and mp3StreamWait() return at once.
+// Streams started after that exit right away until mp3StreamReset(), so a
+// sentence whose TTS request was already under way stays silent.
+// mp3StreamRelease() then turns the speaker off and frees the buffers.
+
+#ifndef TTS_SPEAKER
+#define TTS_SPEAKER M5.Speaker           // CoreS3 overrides this in device_config.h
+#endif
+
+#define MP3_STREAM_CHANNEL 0
+#define MP3_STREAM_RING_SAMPLES 8192     // Decoded PCM not yet handed to the speaker (16KB)
+#define MP3_STREAM_BLOCK_SAMPLES 2304    // Per playRaw() block, two of them (2 x 4.5KB)
+#define MP3_STREAM_READ_CHUNK 512        // Bytes read from the socket per decoder write
+#define MP3_STREAM_STALL_MS 15000        // Give up if the server stops sending
+
+// External references (defined in the main .ino)
+extern uint8_t *lastTtsMp3;
+extern size_t lastTtsMp3Length;
+
+// Ring and block buffers (allocated on first use, kept until mp3StreamRelease())
+static int16_t *mp3StreamRing = nullptr;
+static size_t mp3StreamRingHead = 0;     // Next sample to hand to the speaker
+static size_t mp3StreamRingCount = 0;
+static int16_t *mp3StreamBlocks[2] = {nullptr, nullptr};
+static int mp3StreamNextBlock = 0;
+
+// Player state (one stream at a time)
+static TaskHandle_t mp3StreamTaskHandle = NULL;
+static volatile bool mp3StreamRunning = false;
+static volatile bool mp3StreamStopRequested = false;
+static HTTPClient *mp3StreamHttp = nullptr;
+static WiFiClient *mp3StreamSource = nullptr;
+static const uint8_t *mp3StreamMemory = nullptr;
+static int mp3StreamRemaining = 0;
+static bool mp3StreamKeep = false;
+static size_t mp3StreamReplayCapacity = 0;
+static int mp3StreamSampleRate = 24000;
+static int mp3StreamChannels = 1;
+
+// Stats for the last stream
+static unsigned long mp3StreamStartTime = 0;
+unsigned long mp3StreamFirstAudioMs = 0; // 0 until the first block is queued
+static size_t mp3StreamSamplesPlayed = 0;
+static size_t mp3StreamPeakFill = 0;
+static int mp3StreamUnderruns = 0;
+
+static bool mp3StreamAlloc() {
+  if (!mp3StreamRing) {
+    mp3StreamRing = (int16_t *)memAlloc(MP3_STREAM_RING_SAMPLES * sizeof(int16_t), MEM_SPEAKER);
+  }
+  for (int i = 0; i < 2; i++) {
+    if (!mp3StreamBlocks[i]) {
+      mp3StreamBlocks[i] = (int16_t *)memAlloc(MP3_STREAM_BLOCK_SAMPLES * sizeof(int16_t), MEM_SPEAKER);
+    }
+  }
+  return mp3StreamRing && mp3StreamBlocks[0] && mp3StreamBlocks[1];
+}
+
+// Queue up to one block from the ring on the speaker. With force, a partial
+// block is sent too (end of stream). Returns false if the speaker is busy.
+static bool mp3StreamFeedSpeaker(bool force) {
+  if (mp3StreamRingCount == 0) return true;
+  if (mp3StreamRingCount < MP3_STREAM_BLOCK_SAMPLES && !force) return true;
+
+  // Two blocks in flight: the older one is still playing, its buffer isn't free
+  size_t inFlight = TTS_SPEAKER.isPlaying(MP3_STREAM_CHANNEL);
+  if (inFlight >= 2) return false;
+  if (inFlight == 0 && mp3StreamFirstAudioMs > 0) mp3StreamUnderruns++;
+
+  size_t n = mp3StreamRingCount < MP3_STREAM_BLOCK_SAMPLES ? mp3StreamRingCount : MP3_STREAM_BLOCK_SAMPLES;
+  if (mp3StreamChannels == 2) n &= ~(size_t)1; // Keep L/R pairs together
+  if (n == 0) return true;
+
+  int16_t *block = mp3StreamBlocks[mp3StreamNextBlock];
+  size_t first = MP3_STREAM_RING_SAMPLES - mp3StreamRingHead;
+  if (first > n) first = n;
+  memcpy(block, mp3StreamRing + mp3StreamRingHead, first * sizeof(int16_t));
+  memcpy(block + first, mp3StreamRing, (n - first) * sizeof(int16_t));
+  mp3StreamRingHead = (mp3StreamRingHead + n) % MP3_STREAM_RING_SAMPLES;
+  mp3StreamRingCount -= n;
+
+  TTS_SPEAKER.playRaw(block, n, mp3StreamSampleRate, mp3StreamChannels == 2, 1, MP3_STREAM_CHANNEL, false);
+  mp3StreamNextBlock ^= 1;
+  mp3StreamSamplesPlayed += n;
+
+  if (mp3StreamFirstAudioMs == 0) {
+    mp3StreamFirstAudioMs = millis() - mp3StreamStartTime;
+    if (mp3StreamFirstAudioMs == 0) mp3StreamFirstAudioMs = 1;
+    Serial.printf("[MP3] First audio after %lums\n", mp3StreamFirstAudioMs);
+  }
+  return true;
+}
+
+// libhelix callback - decoded frame into the ring, draining to the speaker if full
+static void mp3StreamDecodeCallback(MP3FrameInfo &info, short *pcm, size_t len, void *ref) {
+  mp3StreamSampleRate = info.samprate;
+  mp3StreamChannels = info.nChans;
+  while (len > 0 && !mp3StreamStopRequested) {
+    size_t space = MP3_STREAM_RING_SAMPLES - mp3StreamRingCount;
+    if (space == 0) {
+      if (!mp3StreamFeedSpeaker(false)) delay(2);
+      continue;
+    }
+    size_t tail = (mp3StreamRingHead + mp3StreamRingCount) % MP3_STREAM_RING_SAMPLES;
+    size_t n = len < space ? len : space;
+    if (n > MP3_STREAM_RING_SAMPLES - tail) n = MP3_STREAM_RING_SAMPLES - tail;
+    memcpy(mp3StreamRing + tail, pcm, n * sizeof(int16_t));
+    mp3StreamRingCount += n;
+    pcm += n;
+    len -= n;
+  }
+  if (mp3StreamRingCount > mp3StreamPeakFill) mp3StreamPeakFill = mp3StreamRingCount;
+}
+
+// Append MP3 bytes to the replay copy (room is checked up front in mp3StreamStart)
+static void mp3StreamKeepBytes(const uint8_t *data, size_t len) {
+  if (!mp3StreamKeep || !lastTtsMp3 || lastTtsMp3Length + len > mp3StreamReplayCapacity) return;
+  memcpy(lastTtsMp3 + lastTtsMp3Length, data, len);
+  lastTtsMp3Length += len;
+  mediaArenaFill(replayArena, lastTtsMp3Length);
+}
+
+void mp3StreamTask(void *parameter) {
+  MP3DecoderHelix decoder;
+  decoder.setDataCallback(mp3StreamDecodeCallback);
+  decoder.begin();
+
+  uint8_t chunk[MP3_STREAM_READ_CHUNK];
+  size_t bytesRead = 0;
+  unsigned long lastData = millis();
+
+  while (mp3StreamRemaining > 0 && !mp3StreamStopRequested) {
+    // Keep the speaker fed before blocking on the network
+    mp3StreamFeedSpeaker(false);
+
+    if (MP3_STREAM_RING_SAMPLES - mp3StreamRingCount < MP3_STREAM_BLOCK_SAMPLES) {
+      delay(2); // Ring is full - wait for the speaker
+      continue;
+    }
+
+    int toRead = mp3StreamRemaining < MP3_STREAM_READ_CHUNK ? mp3StreamRemaining : MP3_STREAM_READ_CHUNK;
+    const uint8_t *data = chunk;
+    int n;
+    if (mp3StreamMemory) {
+      data = mp3StreamMemory + bytesRead;
+      n = toRead;
+    } else {
+      int available = mp3StreamSource->available();
+      if (available <= 0) {
+        if (!mp3StreamSource->connected() || millis() - lastData > MP3_STREAM_STALL_MS) {
+          Serial.printf("[MP3] Stream ended early (%d bytes missing)\n", mp3StreamRemaining);
+          break;
+        }
+        delay(2);
+        continue;
+      }
+      n = mp3StreamSource->read(chunk, available < toRead ? available : toRead);
+      if (n <= 0) continue;
+      lastData = millis();
+      mp3StreamKeepBytes(chunk, n);
+    }
+
+    bytesRead += n;
+    mp3StreamRemaining -= n;
+    decoder.write(data, n);
+  }
+  decoder.end();
+
+  // Body fully read - the connection can serve the next request. A stopped
+  // stream leaves the rest of the body unread, so that socket can't.
+  if (mp3StreamHttp) {
+    if (mp3StreamStopRequested) mp3StreamSource->stop();
+    httpPoolEnd(*mp3StreamHttp);
+    mp3StreamHttp = nullptr;
+  }
+
+  // Hand the rest of the ring to the speaker
+  if (mp3StreamStopRequested) {
+    mp3StreamRingCount = 0;
+    Serial.println("[MP3] Stopped");
+  }
+  while (mp3StreamRingCount > 0) {
+    if (!mp3StreamFeedSpeaker(true)) delay(2);
+  }
+
+  Serial.printf("[MP3] %d bytes -> %d samples at %dHz in %lums (ring peak %d, underruns %d)\n",
+                bytesRead, mp3StreamSamplesPlayed, mp3StreamSampleRate, millis() - mp3StreamStartTime,
+                mp3StreamPeakFill, mp3StreamUnderruns);
+
+  mp3StreamTaskHandle = NULL;
+  mp3StreamRunning = false;
+  vTaskDelete(NULL);
+}
+
+// Wait until the running stream has queued its last block (it may still be playing)
+void mp3StreamWaitDecoded() {
+  while (mp3StreamRunning) {
+    delay(5);
+  }
+}
+
+static bool mp3StreamLaunch() {
+  mp3StreamWaitDecoded();
+  if (!mp3StreamAlloc()) {
+    Serial.println("[MP3] ERROR: Failed to allocate stream buffers");
+    return false;
+  }
+
+  mp3StreamRingHead = 0;
+  mp3StreamRingCount = 0;
+  mp3StreamStartTime = millis();
+  mp3StreamFirstAudioMs = 0;
+  mp3StreamSamplesPlayed = 0;
+  mp3StreamPeakFill = 0;
+  mp3StreamUnderruns = 0;
+  mp3StreamRunning = true;
+
+  // Core 0 alongside displayTask - the caller keeps core 1
+  if (xTaskCreatePinnedToCore(mp3StreamTask, "mp3Stream", 8192, NULL, 2, &mp3StreamTaskHandle, 0) != pdPASS) {
+    Serial.println("[MP3] Failed to start player task");
+    mp3StreamTaskHandle = NULL;
+    mp3StreamRunning = false;
+    return false;
+  }
+  return true;
+}
+
+// Drop the replay copy (before a new answer is spoken)
+void mp3StreamClearReplay() {
+  mediaArenaReset(replayArena);
+  lastTtsMp3Length = 0;
+  mp3StreamReplayCapacity = 0;
+}
+
+// Play the MP3 body of an HTTP response. The player takes over http and returns
+// it to the pool once the body is read (also on failure). With keepForReplay the
+// MP3 is appended to lastTtsMp3.
+bool mp3StreamStart(HTTPClient &http, int contentLength, bool keepForReplay) {
+  mp3StreamWaitDecoded();
+  if (contentLength <= 0 || !http.getStreamPtr()) {
+    Serial.printf("[MP3] Invalid content length: %d\n", contentLength);
+    httpPoolEnd(http);
+    return false;
+  }
+
+  mp3StreamKeep = false;
+  if (keepForReplay && lastTtsMp3 && lastTtsMp3Length + contentLength <= replayArena.capacity) {
+    mp3StreamReplayCapacity = lastTtsMp3Length + contentLength;
+    mp3StreamKeep = true;
+  }
+
+  mp3StreamHttp = &http;
+  mp3StreamSource = http.getStreamPtr();
+  mp3StreamMemory = nullptr;
+  mp3StreamRemaining = contentLength;
+  if (!mp3StreamLaunch()) {
+    httpPoolEnd(http);
+    mp3StreamHttp = nullptr;
+    return false;
+  }
+  return true;
+}
+
+// Play MP3 data already in memory (replay). data must stay valid until mp3StreamWait().
+bool mp3StreamStartBuffer(const uint8_t *data, size_t len) {
+  mp3StreamWaitDecoded();
+  if (!data || len == 0) return false;
+  mp3StreamKeep = false;
+  mp3StreamHttp = nullptr;
+  mp3StreamSource = nullptr;
+  mp3StreamMemory = data;
+  mp3StreamRemaining = len;
+  return mp3StreamLaunch();
+}
+
+// Wait until everything queued has been played (or the stream was stopped)
+void mp3StreamWait() {
+  mp3StreamWaitDecoded();
+  unsigned long waitStart = millis();
+  while (TTS_SPEAKER.isPlaying(MP3_STREAM_CHANNEL) && millis() - waitStart < 10000) {
+    if (mp3StreamStopRequested) {
+      TTS_SPEAKER.stop(MP3_STREAM_CHANNEL);
+      return;
+    }
+    delay(10);
+  }
+  if (!mp3StreamStopRequested) delay(100); // Ensure the buffer is fully consumed
+}
+
+// Stop playback as soon as the player notices (safe from any task)
+void mp3StreamStop() {
+  mp3StreamStopRequested = true;
+}
+
+bool mp3StreamStopped() {
+  return mp3StreamStopRequested;
+}
+
+// Allow streams again after a stop
+void mp3StreamReset() {
+  mp3StreamStopRequested = false;
+}
+
+// After a stop: wait for the player to exit, silence and release the speaker
+// (the mic shares its I2S bus on some devices) and free the ring and blocks.
+// They are allocated again by the next stream.
+void mp3StreamRelease() {
+  mp3StreamWaitDecoded();
+  TTS_SPEAKER.stop(MP3_STREAM_CHANNEL);
+  TTS_SPEAKER.end();
+
+  memFree(mp3StreamRing);
+  mp3StreamRing = nullptr;
+  for (int i = 0; i < 2; i++) {
+    memFree(mp3StreamBlocks[i]);
+    mp3StreamBlocks[i] = nullptr;
+  }
+}
+
+#endif // MP3_STREAM_H
@@ -0,0 +1,207 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <WiFi.h>
+
+// Streaming multipart/form-data body.
+//
+// Parts reference their source buffers (audioBuffer, JPEG data, ...) instead of
+// copying them into one big allocation. The body is exposed as a Stream so it
+// can be handed to HTTPClient::sendRequest("POST", &body, body.contentLength()),
+// which pulls it through its own network-sized buffer, or written directly to a
+// raw socket with writeTo(). Content-Length is known before anything is sent.
+//
+// Source buffers must stay valid until the request has been sent.
+
+#define MULTIPART_MAX_PARTS 4
+
+class MultipartStream : public Stream {
+ public:
+  explicit MultipartStream(const char *boundary) : _boundary(boundary) {}
+
+  // File part: optional header bytes (e.g. a WAV header) followed by data
+  bool addFile(const char *name, const char *filename, const char *contentType,
+               const uint8_t *data, size_t size,
+               const uint8_t *header = nullptr, size_t headerSize = 0) {
+    if (_numParts >= MULTIPART_MAX_PARTS) return false;
+    Part &p = _parts[_numParts++];
+    p.preamble = "--" + _boundary + "\r\n"
+                 "Content-Disposition: form-data; name=\"" + String(name) +
+                 "\"; filename=\"" + String(filename) + "\"\r\n"
+                 "Content-Type: " + String(contentType) + "\r\n\r\n";
+    p.header = header;
+    p.headerSize = header ? headerSize : 0;
+    p.data = data;
+    p.dataSize = size;
+    return true;
+  }
+
+  // Simple text field
+  bool addField(const char *name, const String &value) {
+    if (_numParts >= MULTIPART_MAX_PARTS) return false;
+    Part &p = _parts[_numParts++];
+    p.preamble = "--" + _boundary + "\r\n"
+                 "Content-Disposition: form-data; name=\"" + String(name) + "\"\r\n\r\n" +
+                 value;
+    p.header = nullptr;
+    p.headerSize = 0;
+    p.data = nullptr;
+    p.dataSize = 0;
+    return true;
+  }
+
+  String contentType() const {
+    return "multipart/form-data; boundary=" + _boundary;
+  }
+
+  size_t contentLength() const {
+    size_t total = 0;
+    for (int i = 0; i < _numParts; i++) {
+      total += _parts[i].preamble.length() + _parts[i].headerSize + _parts[i].dataSize + 2;
+    }
+    return total + _boundary.length() + 6; // "--" boundary "--\r\n"
+  }
+
+  // Write the whole body to a connected socket in small pieces
+  bool writeTo(Client &client) {
+    rewind();
+    uint8_t buf[1024];
+    size_t total = contentLength();
+    size_t sent = 0;
+    while (true) {
+      size_t n = readBytes((char *)buf, sizeof(buf));
+      if (n == 0) break;
+      size_t off = 0;
+      while (off < n) {
+        if (!client.connected()) {
+          Serial.println("ERROR: Connection lost during upload");
+          return false;
+        }
+        size_t written = client.write(buf + off, n - off);
+        if (written == 0) {
+          Serial.println("WARNING: 0 bytes written, retrying...");
+          delay(100);
+          continue;
+        }
+        off += written;
+      }
+      sent += n;
+      if (sent % 8192 < sizeof(buf)) {
+        Serial.printf("  Sent %d / %d bytes\n", sent, total);
+      }
+      delay(2); // Small delay to let network stack process
+    }
+    return sent == total;
+  }
+
+  void rewind() {
+    _segment = 0;
+    _offset = 0;
+  }
+
+  // Stream interface (read side only)
+  int available() {
+    size_t remaining = remainingBytes();
+    return remaining > 0x7FFFFFFF ? 0x7FFFFFFF : (int)remaining;
+  }
+
+  int peek() {
+    const uint8_t *ptr;
+    size_t len;
+    if (!currentSegment(ptr, len)) return -1;
+    return ptr[_offset];
+  }
+
+  int read() {
+    int c = peek();
+    if (c >= 0) advance(1);
+    return c;
+  }
+
+  size_t readBytes(char *buffer, size_t length) {
+    size_t copied = 0;
+    while (copied < length) {
+      const uint8_t *ptr;
+      size_t len;
+      if (!currentSegment(ptr, len)) break;
+      size_t n = len - _offset;
+      if (n > length - copied) n = length - copied;
+      memcpy(buffer + copied, ptr + _offset, n);
+      copied += n;
+      advance(n);
+    }
+    return copied;
+  }
+
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    return readBytes((char *)buffer, length);
+  }
+
+  size_t write(uint8_t) { return 0; }
+
+ private:
+  struct Part {
+    String preamble;
+    const uint8_t *header;
+    size_t headerSize;
+    const uint8_t *data;
+    size_t dataSize;
+  };
+
+  // Each part is four segments: preamble, header, data, CRLF.
+  // One final segment holds the closing delimiter.
+  static const int SEGMENTS_PER_PART = 4;
+
+  bool segmentAt(int index, const uint8_t *&ptr, size_t &len) {
+    if (index < _numParts * SEGMENTS_PER_PART) {
+      const Part &p = _parts[index / SEGMENTS_PER_PART];
+      switch (index % SEGMENTS_PER_PART) {
+        case 0: ptr = (const uint8_t *)p.preamble.c_str(); len = p.preamble.length(); break;
+        case 1: ptr = p.header; len = p.headerSize; break;
+        case 2: ptr = p.data; len = p.dataSize; break;
+        default: ptr = (const uint8_t *)"\r\n"; len = 2; break;
+      }
+      return true;
+    }
+    if (index == _numParts * SEGMENTS_PER_PART) {
+      if (_closing.length() == 0) _closing = "--" + _boundary + "--\r\n";
+      ptr = (const uint8_t *)_closing.c_str();
+      len = _closing.length();
+      return true;
+    }
+    return false;
+  }
+
+  // Current non-empty segment, skipping empty ones
+  bool currentSegment(const uint8_t *&ptr, size_t &len) {
+    while (segmentAt(_segment, ptr, len)) {
+      if (_offset < len && ptr) return true;
+      _segment++;
+      _offset = 0;
+    }
+    return false;
+  }
+
+  void advance(size_t n) {
+    _offset += n;
+  }
+
+  size_t remainingBytes() {
+    size_t total = 0;
+    const uint8_t *ptr;
+    size_t len;
+    for (int i = _segment; segmentAt(i, ptr, len); i++) {
+      total += len;
+    }
+    return total - _offset;
+  }
+
+  String _boundary;
+  String _closing;
+  Part _parts[MULTIPART_MAX_PARTS];
+  int _numParts = 0;
+  int _segment = 0;
+  size_t _offset = 0;
+};
+
+#endif // MULTIPART_H
@@ -0,0 +1,398 @@
+#ifndef OWUI_SOCKET_H
+#define OWUI_SOCKET_H
+
+#include <WiFi.h>
+#include "http_pool.h"
+#include "json_util.h"
+
+// Dependencies: secrets.h, device_config.h and http_pool.h must be included before this file
+//
+// Minimal Socket.IO (Engine.IO v4 over WebSocket) client for OpenWebUI's
+// completion events. OpenWebUI's own web client works the same way: open
+// /ws/socket.io, join with the API key, send the socket id as session_id in
+// /api/v1/chat/completions, then receive "chat-events" for the assistant
+// message as tokens are generated. This replaces polling the whole chat JSON.
+//
+// Usage:
+//   bool socketReady = owuiSocketConnect();          // before the completion POST
+//   if (socketReady) currentSessionId = owuiSocketSid;
+//   ... POST /api/v1/chat/completions ...
+//   owuiSocketWatch(chatId, assistantMsgId, onDelta);
+//   int status = owuiSocketWait(result, 60000);      // 1 = done, 0 = timeout, -1 = lost/cancelled
+//   owuiSocketClose();
+//
+// Works against plain ws:// too (OWUI_BASE_URL = "http://..."), so a local
+// WebSocket stand-in can replay recorded events. owuiSocketHandlePacket() takes
+// one Engine.IO packet and has no network dependencies.
+
+#define OWUI_SOCKET_MAX_FRAME 16384     // Larger messages are skipped
+
+// WebSocket opcodes
+#define WS_OP_CONTINUATION 0x0
+#define WS_OP_TEXT 0x1
+#define WS_OP_CLOSE 0x8
+#define WS_OP_PING 0x9
+#define WS_OP_PONG 0xA
+
+// Set when the user cancels the interaction (interaction.h)
+extern volatile bool interactionCancelRequested;
+
+static TlsClient owuiSocketSecure;
+static WiFiClient owuiSocketPlain;
+static WiFiClient *owuiSocketClient = nullptr;
+
+String owuiSocketSid = "";              // Socket.IO id - send as session_id
+static String owuiSocketChatId = "";
+static String owuiSocketMessageId = "";
+static String owuiSocketContent = "";
+static bool owuiSocketDone = false;
+static bool owuiSocketLost = false;
+static void (*owuiSocketOnDelta)(const String &delta) = nullptr;
+
+static String owuiSocketBase64(const uint8_t *data, size_t length) {
+  static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  String out;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = (uint32_t)data[i] << 16;
+    if (i + 1 < length) n |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    out += chars[(n >> 18) & 0x3F];
+    out += chars[(n >> 12) & 0x3F];
+    out += (i + 1 < length) ? chars[(n >> 6) & 0x3F] : '=';
+    out += (i + 2 < length) ? chars[n & 0x3F] : '=';
+  }
+  return out;
+}
+
+// Read exactly len bytes or give up after timeoutMs
+static bool owuiSocketReadExact(uint8_t *buf, size_t len, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  size_t got = 0;
+  while (got < len) {
+    int n = owuiSocketClient->read(buf + got, len - got);
+    if (n > 0) {
+      got += n;
+      start = millis();
+    } else if (!owuiSocketClient->connected() || millis() - start > timeoutMs) {
+      return false;
+    } else {
+      delay(2);
+    }
+  }
+  return true;
+}
+
+// Send one masked frame (clients must mask everything they send)
+static bool owuiSocketSendFrame(uint8_t opcode, const uint8_t *data, size_t len) {
+  if (!owuiSocketClient) return false;
+  uint8_t header[14];
+  size_t h = 0;
+  header[h++] = 0x80 | opcode; // FIN
+  if (len < 126) {
+    header[h++] = 0x80 | len;
+  } else if (len < 65536) {
+    header[h++] = 0x80 | 126;
+    header[h++] = len >> 8;
+    header[h++] = len & 0xFF;
+  } else {
+    header[h++] = 0x80 | 127;
+    for (int i = 7; i >= 0; i--) header[h++] = (i < 4) ? (len >> (8 * i)) & 0xFF : 0;
+  }
+  uint32_t maskKey = esp_random();
+  uint8_t *mask = header + h;
+  memcpy(mask, &maskKey, 4);
+  h += 4;
+  if (owuiSocketClient->write(header, h) != h) return false;
+
+  uint8_t buf[256];
+  for (size_t off = 0; off < len; off += sizeof(buf)) {
+    size_t n = (len - off < sizeof(buf)) ? len - off : sizeof(buf);
+    for (size_t i = 0; i < n; i++) buf[i] = data[off + i] ^ mask[(off + i) & 3];
+    if (owuiSocketClient->write(buf, n) != n) return false;
+  }
+  return true;
+}
+
+static bool owuiSocketSendText(const String &text) {
+  return owuiSocketSendFrame(WS_OP_TEXT, (const uint8_t *)text.c_str(), text.length());
+}
+
+// Read one complete message. Returns 1 with a text message in payload, 0 if
+// nothing arrived within waitMs, -1 if the socket closed or broke.
+static int owuiSocketReadMessage(String &payload, unsigned long waitMs) {
+  unsigned long start = millis();
+  while (owuiSocketClient->available() == 0) {
+    if (!owuiSocketClient->connected()) return -1;
+    if (millis() - start > waitMs) return 0;
+    delay(5);
+  }
+
+  payload = "";
+  bool skipping = false;
+  while (true) {
+    uint8_t hdr[2];
+    if (!owuiSocketReadExact(hdr, 2, 5000)) return -1;
+    bool fin = hdr[0] & 0x80;
+    uint8_t opcode = hdr[0] & 0x0F;
+    uint64_t len = hdr[1] & 0x7F;
+    if (len == 126) {
+      uint8_t ext[2];
+      if (!owuiSocketReadExact(ext, 2, 5000)) return -1;
+      len = ((uint64_t)ext[0] << 8) | ext[1];
+    } else if (len == 127) {
+      uint8_t ext[8];
+      if (!owuiSocketReadExact(ext, 8, 5000)) return -1;
+      len = 0;
+      for (int i = 0; i < 8; i++) len = (len << 8) | ext[i];
+    }
+    // Server frames are never masked
+
+    if (opcode == WS_OP_CLOSE) return -1;
+
+    bool control = opcode >= 0x8;
+    bool keep = !skipping && (control || payload.length() + len <= OWUI_SOCKET_MAX_FRAME);
+    if (!control && !keep && !skipping) {
+      Serial.printf("[SOCKET] Skipping %llu byte message\n", (unsigned long long)len);
+      skipping = true;
+      payload = "";
+    }
+
+    String data;
+    uint8_t buf[256];
+    while (len > 0) {
+      size_t n = len > sizeof(buf) ? sizeof(buf) : (size_t)len;
+      if (!owuiSocketReadExact(buf, n, 5000)) return -1;
+      if (keep) (control ? data : payload).concat((const char *)buf, n);
+      len -= n;
+    }
+
+    if (opcode == WS_OP_PING) {
+      owuiSocketSendFrame(WS_OP_PONG, (const uint8_t *)data.c_str(), data.length());
+      continue;
+    }
+    if (control) continue; // Unsolicited pong
+    if (fin) return skipping ? 0 : 1;
+  }
+}
+
+// Handle one Engine.IO packet
+void owuiSocketHandlePacket(const String &packet) {
+  if (packet == "2") {
+    owuiSocketSendText("3"); // Engine.IO ping -> pong
+    return;
+  }
+  if (packet.startsWith("41")) {
+    Serial.println("[SOCKET] Server disconnected namespace");
+    owuiSocketLost = true;
+    return;
+  }
+  if (!packet.startsWith("42[\"chat-events\"")) return;
+
+  // Only events for the message we're waiting on
+  if (owuiSocketMessageId.length() > 0 &&
+      packet.indexOf("\"message_id\":\"" + owuiSocketMessageId + "\"") < 0) {
+    return;
+  }
+  if (owuiSocketChatId.length() > 0 && packet.indexOf("\"chat_id\":\"" + owuiSocketChatId + "\"") < 0) {
+    return;
+  }
+
+  String type;
+  if (jsonFindString(packet, "type", 0, type) < 0) return;
+
+  String delta;
+  if (type == "chat:message:delta") {
+    // {"type":"chat:message:delta","data":{"content":"<token>"}}
+    jsonFindString(packet, "content", packet.indexOf("\"data\"", packet.indexOf(type)), delta);
+    owuiSocketContent += delta;
+  } else if (type == "chat:completion") {
+    int choices = packet.indexOf("\"choices\"");
+    if (choices >= 0) {
+      // Streaming delta: {"choices":[{"delta":{"content":"<token>"}}]}
+      int d = packet.indexOf("\"delta\"", choices);
+      if (d >= 0) jsonFindString(packet, "content", d, delta);
+      owuiSocketContent += delta;
+    } else {
+      // Accumulated text so far: {"content":"<everything>", "done":true}
+      String content;
+      if (jsonFindString(packet, "content", packet.indexOf(type), content) >= 0) {
+        if (content.startsWith(owuiSocketContent)) {
+          delta = content.substring(owuiSocketContent.length());
+        } else {
+          delta = content;
+        }
+        owuiSocketContent = content;
+      }
+    }
+    if (jsonFindTrue(packet, "done")) {
+      owuiSocketDone = true;
+    }
+    if (packet.indexOf("\"error\"") >= 0) {
+      Serial.println("[SOCKET] Completion error event");
+      owuiSocketDone = true;
+    }
+  } else {
+    return;
+  }
+
+  if (delta.length() > 0 && owuiSocketOnDelta) {
+    owuiSocketOnDelta(delta);
+  }
+}
+
+void owuiSocketClose() {
+  if (!owuiSocketClient) return;
+  if (owuiSocketClient->connected()) {
+    owuiSocketSendText("41");
+    owuiSocketSendFrame(WS_OP_CLOSE, nullptr, 0);
+  }
+  owuiSocketClient->stop();
+  owuiSocketClient = nullptr;
+  owuiSocketSid = "";
+}
+
+// Open the socket, join the default namespace and the user's room
+bool owuiSocketConnect() {
+  if (!ENABLE_OWUI_SOCKET || WiFi.status() != WL_CONNECTED) return false;
+  owuiSocketClose();
+
+  String host, path;
+  int port;
+  bool useSsl;
+  if (!parseBaseUrl(OWUI_BASE_URL, host, port, path, useSsl)) return false;
+  path += "/ws/socket.io/?EIO=4&transport=websocket";
+
+  unsigned long start = millis();
+  owuiSocketClient = useSsl ? (WiFiClient *)&owuiSocketSecure : &owuiSocketPlain;
+  if (useSsl) {
+    owuiSocketSecure.setInsecure();
+  }
+  if (!owuiSocketClient->connect(host.c_str(), port)) {
+    Serial.printf("[SOCKET] Connection to %s:%d failed\n", host.c_str(), port);
+    owuiSocketClient = nullptr;
+    return false;
+  }
+
+  uint8_t keyBytes[16];
+  for (int i = 0; i < 16; i += 4) {
+    uint32_t r = esp_random();
+    memcpy(keyBytes + i, &r, 4);
+  }
+
+  String request = "GET " + path + " HTTP/1.1\r\n";
+  request += "Host: " + host + "\r\n";
+  request += "Upgrade: websocket\r\n";
+  request += "Connection: Upgrade\r\n";
+  request += "Sec-WebSocket-Key: " + owuiSocketBase64(keyBytes, 16) + "\r\n";
+  request += "Sec-WebSocket-Version: 13\r\n";
+  request += "Authorization: Bearer " + String(LLM_API_KEY) + "\r\n\r\n";
+  owuiSocketClient->print(request);
+
+  // "HTTP/1.1 101 Switching Protocols" then headers
+  unsigned long waitStart = millis();
+  while (!owuiSocketClient->available()) {
+    if (!owuiSocketClient->connected() || millis() - waitStart > 10000) {
+      Serial.println("[SOCKET] No upgrade response");
+      owuiSocketClose();
+      return false;
+    }
+    delay(5);
+  }
+  String status = owuiSocketClient->readStringUntil('\n');
+  while (true) {
+    String line = owuiSocketClient->readStringUntil('\n');
+    if (line == "\r" || line.length() == 0) break;
+  }
+  if (status.indexOf(" 101") < 0) {
+    Serial.println("[SOCKET] Upgrade refused: " + status);
+    owuiSocketClose();
+    return false;
+  }
+
+  // Engine.IO open packet: 0{"sid":...,"pingInterval":...}
+  String packet;
+  if (owuiSocketReadMessage(packet, 5000) != 1 || !packet.startsWith("0")) {
+    Serial.println("[SOCKET] No Engine.IO open packet");
+    owuiSocketClose();
+    return false;
+  }
+
+  // Socket.IO connect to the default namespace with the API key as auth
+  owuiSocketSendText("40{\"token\":\"" + String(LLM_API_KEY) + "\"}");
+  while (true) {
+    int r = owuiSocketReadMessage(packet, 5000);
+    if (r != 1) {
+      Serial.println("[SOCKET] No namespace connect response");
+      owuiSocketClose();
+      return false;
+    }
+    if (packet.startsWith("40")) break;
+    if (packet.startsWith("44")) {
+      Serial.println("[SOCKET] Connect refused: " + packet);
+      owuiSocketClose();
+      return false;
+    }
+    owuiSocketHandlePacket(packet); // e.g. an early ping
+  }
+  if (jsonFindString(packet, "sid", 0, owuiSocketSid) < 0) {
+    Serial.println("[SOCKET] No sid in connect response");
+    owuiSocketClose();
+    return false;
+  }
+
+  // Join the user's room so events sent to the user (not just the sid) arrive too
+  owuiSocketSendText("42[\"user-join\",{\"auth\":{\"token\":\"" + String(LLM_API_KEY) + "\"}}]");
+
+  Serial.printf("[SOCKET] Connected in %lums, sid=%s\n", millis() - start, owuiSocketSid.c_str());
+  return true;
+}
+
+// Start listening for events of one assistant message
+void owuiSocketWatch(const String &chatId, const String &messageId, void (*onDelta)(const String &delta)) {
+  owuiSocketChatId = chatId;
+  owuiSocketMessageId = messageId;
+  owuiSocketOnDelta = onDelta;
+  owuiSocketContent = "";
+  owuiSocketDone = false;
+  owuiSocketLost = false;
+}
+
+// Pump the socket until the watched message is done.
+// Returns 1 when done (result = full text), 0 on timeout, -1 if the socket was
+// lost or the interaction was cancelled.
+int owuiSocketWait(String &result, unsigned long timeoutMs) {
+  if (!owuiSocketClient) return -1;
+  unsigned long start = millis();
+  bool firstToken = true;
+  String packet;
+
+  while (!owuiSocketDone && millis() - start < timeoutMs) {
+    if (interactionCancelRequested) {
+      Serial.println("[SOCKET] Cancelled while waiting for completion");
+      result = owuiSocketContent;
+      return -1;
+    }
+    int r = owuiSocketReadMessage(packet, 100);
+    if (r < 0 || owuiSocketLost) {
+      Serial.println("[SOCKET] Connection lost while waiting for completion");
+      result = owuiSocketContent;
+      return -1;
+    }
+    if (r == 0) continue;
+    owuiSocketHandlePacket(packet);
+    if (firstToken && owuiSocketContent.length() > 0) {
+      Serial.printf("[SOCKET] First token after %lums\n", millis() - start);
+      firstToken = false;
+    }
+  }
+
+  result = owuiSocketContent;
+  if (!owuiSocketDone) {
+    Serial.println("[SOCKET] Timeout waiting for completion");
+    return 0;
+  }
+  Serial.printf("[SOCKET] Completion done after %lums (%d chars)\n", millis() - start, result.length());
+  return 1;
+}
+
+#endif // OWUI_SOCKET_H
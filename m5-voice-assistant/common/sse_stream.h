@@ -0,0 +1,116 @@
+#ifndef SSE_STREAM_H
+#define SSE_STREAM_H
+
+#include <HTTPClient.h>
+#include "json_util.h"
+
+// Server-sent events reader for OpenAI-style streaming ("stream": true).
+//
+// Chat Completions sends   data: {"choices":[{"delta":{"content":"<token>"}}]}
+//                          data: [DONE]
+// Responses API sends      event: response.output_text.delta
+//                          data: {"type":"response.output_text.delta","delta":"<token>"}
+//                          ... data: {"type":"response.completed",...}
+//
+// Each text delta is handed to onDelta as soon as its event is complete. The
+// request must be sent with http.useHTTP10(true) so the body isn't chunked and
+// SSE lines can be read straight off the socket.
+
+// Set when the user cancels the interaction (interaction.h)
+extern volatile bool interactionCancelRequested;
+
+// Returns 1 when the stream signalled completion, 0 if it ended early (result
+// holds what arrived), -1 on an error event, timeout or cancel.
+int sseReadCompletion(HTTPClient &http, bool responsesApi, void (*onDelta)(const String &delta),
+                      String &result, unsigned long timeoutMs) {
+  WiFiClient *stream = http.getStreamPtr();
+  result = "";
+  if (!stream) return -1;
+
+  unsigned long start = millis();
+  unsigned long lastData = millis();
+  bool firstToken = true;
+  String line;
+  String data;
+  int status = 0;
+
+  while (status == 0) {
+    if (millis() - start > timeoutMs) {
+      Serial.println("[SSE] Timeout");
+      return -1;
+    }
+    if (interactionCancelRequested) {
+      Serial.println("[SSE] Cancelled");
+      stream->stop(); // Rest of the body unread, the socket can't be reused
+      return -1;
+    }
+    int c = stream->read();
+    if (c < 0) {
+      if (!stream->connected() && stream->available() == 0) break;
+      if (millis() - lastData > 30000) {
+        Serial.println("[SSE] Stream stalled");
+        return -1;
+      }
+      delay(2);
+      continue;
+    }
+    lastData = millis();
+    if (c == '\r') continue;
+    if (c != '\n') {
+      line += (char)c;
+      continue;
+    }
+
+    // Complete line
+    if (line.startsWith("data:")) {
+      int skip = (line.length() > 5 && line[5] == ' ') ? 6 : 5;
+      if (data.length() > 0) data += '\n';
+      data += line.substring(skip);
+      line = "";
+      continue;
+    }
+    bool endOfEvent = line.length() == 0;
+    line = ""; // "event:", "id:", ": comment" lines carry nothing we need
+    if (!endOfEvent || data.length() == 0) continue;
+
+    // Dispatch one event
+    String delta;
+    if (data == "[DONE]") {
+      status = 1;
+    } else if (responsesApi) {
+      String type;
+      jsonFindString(data, "type", 0, type);
+      if (type == "response.output_text.delta") {
+        jsonFindString(data, "delta", 0, delta);
+      } else if (type == "response.completed") {
+        status = 1;
+      } else if (type == "response.failed" || type == "response.incomplete" || type == "error") {
+        Serial.println("[SSE] Error event: " + data);
+        status = -1;
+      }
+    } else {
+      int d = data.indexOf("\"delta\"");
+      if (d >= 0) jsonFindString(data, "content", d, delta);
+      if (data.indexOf("\"error\"") >= 0 && data.indexOf("\"choices\"") < 0) {
+        Serial.println("[SSE] Error event: " + data);
+        status = -1;
+      }
+    }
+    data = "";
+
+    if (delta.length() > 0) {
+      if (firstToken) {
+        Serial.printf("[SSE] First token after %lums\n", millis() - start);
+        firstToken = false;
+      }
+      result += delta;
+      if (onDelta) onDelta(delta);
+    }
+  }
+
+  Serial.printf("[SSE] Stream %s after %lums (%d chars)\n",
+                status == 1 ? "complete" : (status < 0 ? "failed" : "ended"), millis() - start, result.length());
+  return status;
+}
+
+#endif // SSE_STREAM_H
@@ -0,0 +1,276 @@
+#ifndef STR_BUILDER_H
+#define STR_BUILDER_H
+
+// Dependencies: device_config.h, mem_alloc.h and media_arena.h must be included before this file
+//
+// Request bodies without String churn. Building a body with String + and
+// .replace() copies it once per piece and again per escaped character, and
+// every copy is a heap allocation of a growing buffer - for a chat save that
+// carries the whole history, or a base64 photo, that is tens of KB each time.
+//
+// StrBuilder appends into one fixed buffer and never grows it. strBuild()
+// runs the body's fill function twice: first with no buffer (only the length
+// is counted), then into exactly that many bytes leased from the body arena,
+// or a single heap block if the arena is full. The lease ends with the
+// builder, and the arena rewinds once no body is held.
+// The result goes straight to httpPoolSend(); no String is made of it.
+//
+// json() escapes in one pass: quote, backslash and every control character
+// (\n, \r, \t, \b, \f, the rest as \u00XX). Valid UTF-8 is copied as it is;
+// a byte that isn't valid UTF-8 becomes U+FFFD, so the server never sees
+// broken JSON because the STT or LLM returned a stray byte.
+//
+// Usage:
+//   StrBuilder body;
+//   strBuild(body, [&](StrBuilder &b) {
+//     b.add("{\"input\":").quoted(text).add(",\"n\":").num(n).add("}");
+//   });
+//   httpPoolSend(http, "POST", body.c_str(), body.length());
+//   strLogBody("Body", body);                   // length and the first STR_LOG_PREVIEW bytes
+//
+//   String escaped = jsonEscape(text);          // escaped contents, no quotes
+//   String fields = strBuildString([&](StrBuilder &b) { b.add("\"id\":").quoted(id); });
+
+#define STR_LOG_PREVIEW 200  // Bytes of a request body shown in the Serial log
+
+class StrBuilder {
+ public:
+  StrBuilder() {}                                  // Counts only, until use()/allocate()
+  StrBuilder(char *buf, size_t capacity) { use(buf, capacity); }
+  ~StrBuilder() { release(); }
+  StrBuilder(const StrBuilder &) = delete;
+  StrBuilder &operator=(const StrBuilder &) = delete;
+
+  // Write into buf (capacity includes the terminating NUL)
+  void use(char *buf, size_t capacity) {
+    release();
+    _buf = buf;
+    _capacity = capacity;
+    clear();
+  }
+
+  // Write into a heap block owned (and freed) by the builder
+  bool allocate(size_t capacity, MemUser user) {
+    char *block = (char *)memAlloc(capacity, user);
+    use(block, block ? capacity : 0);
+    _owned = block;
+    return block != nullptr;
+  }
+
+  // Write into bytes leased from an arena, released with the builder
+  bool lease(MediaArena &arena, size_t capacity) {
+    char *block = (char *)mediaArenaLease(arena, capacity);
+    if (!block) return false;
+    use(block, capacity);
+    _leased = &arena;
+    return true;
+  }
+
+  void clear() {
+    _length = 0;
+    _overflow = false;
+    if (_buf && _capacity) _buf[0] = '\0';
+  }
+
+  StrBuilder &add(const char *s, size_t n) {
+    if (_buf) {
+      if (_length + n < _capacity) {
+        memcpy(_buf + _length, s, n);
+        _buf[_length + n] = '\0';
+      } else {
+        _overflow = true;
+      }
+    }
+    _length += n;
+    return *this;
+  }
+
+  StrBuilder &add(const char *s) { return add(s, strlen(s)); }
+  StrBuilder &add(const String &s) { return add(s.c_str(), s.length()); }
+  StrBuilder &add(char c) { return add(&c, 1); }
+
+  StrBuilder &num(long long v) {
+    char digits[24];
+    return add(digits, snprintf(digits, sizeof(digits), "%lld", v));
+  }
+
+  StrBuilder &num(unsigned long long v) {
+    char digits[24];
+    return add(digits, snprintf(digits, sizeof(digits), "%llu", v));
+  }
+
+  StrBuilder &num(int v) { return num((long long)v); }
+  StrBuilder &num(long v) { return num((long long)v); }
+  StrBuilder &num(unsigned int v) { return num((unsigned long long)v); }
+  StrBuilder &num(unsigned long v) { return num((unsigned long long)v); }
+
+  // JSON string contents (no quotes)
+  StrBuilder &json(const char *s, size_t n) {
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t *p = (const uint8_t *)s;
+    size_t run = 0;                      // Bytes copied as they are, not yet added
+    size_t i = 0;
+    while (i < n) {
+      uint8_t c = p[i];
+      if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+        run++;
+        i++;
+        continue;
+      }
+      if (c >= 0x80) {
+        size_t seq = strUtf8Length(p + i, n - i);
+        if (seq > 0) {
+          run += seq;
+          i += seq;
+          continue;
+        }
+      }
+      add(s + i - run, run);
+      run = 0;
+      i++;
+      switch (c) {
+        case '"': add("\\\"", 2); break;
+        case '\\': add("\\\\", 2); break;
+        case '\n': add("\\n", 2); break;
+        case '\r': add("\\r", 2); break;
+        case '\t': add("\\t", 2); break;
+        case '\b': add("\\b", 2); break;
+        case '\f': add("\\f", 2); break;
+        default:
+          if (c >= 0x80) {
+            add("\\ufffd", 6);
+          } else {
+            char esc[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+            add(esc, 6);
+          }
+      }
+    }
+    return add(s + n - run, run);
+  }
+
+  StrBuilder &json(const String &s) { return json(s.c_str(), s.length()); }
+
+  // "escaped"
+  StrBuilder &quoted(const String &s) { return add('"').json(s).add('"'); }
+  StrBuilder &quoted(const char *s) { return add('"').json(s, strlen(s)).add('"'); }
+
+  // Standard base64 with padding
+  StrBuilder &base64(const uint8_t *data, size_t n) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t out = (n + 2) / 3 * 4;
+    if (!_buf || _length + out >= _capacity) {
+      if (_buf) _overflow = true;
+      _length += out;
+      return *this;
+    }
+    char *w = _buf + _length;
+    size_t i = 0;
+    for (; i + 2 < n; i += 3) {
+      uint32_t v = (uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2];
+      *w++ = alphabet[v >> 18];
+      *w++ = alphabet[(v >> 12) & 63];
+      *w++ = alphabet[(v >> 6) & 63];
+      *w++ = alphabet[v & 63];
+    }
+    if (i < n) {
+      uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < n ? (uint32_t)data[i + 1] << 8 : 0);
+      *w++ = alphabet[v >> 18];
+      *w++ = alphabet[(v >> 12) & 63];
+      *w++ = i + 1 < n ? alphabet[(v >> 6) & 63] : '=';
+      *w++ = '=';
+    }
+    *w = '\0';
+    _length += out;
+    return *this;
+  }
+
+  // Give the buffer back (arena lease or heap block); counts only after this
+  void release() {
+    memFree(_owned);
+    _owned = nullptr;
+    if (_leased) mediaArenaRelease(*_leased);
+    _leased = nullptr;
+    _buf = nullptr;
+    _capacity = 0;
+    clear();
+  }
+
+  const char *c_str() const { return _buf && !_overflow ? _buf : ""; }
+  size_t length() const { return _length; }       // Counted even past the capacity
+  bool ok() const { return _buf && !_overflow; }
+
+ private:
+  // Length of the valid UTF-8 sequence at p, 0 if it isn't one
+  static size_t strUtf8Length(const uint8_t *p, size_t n) {
+    uint8_t c = p[0];
+    size_t len;
+    uint8_t lo = 0x80, hi = 0xBF;        // Allowed range of the second byte
+    if (c >= 0xC2 && c <= 0xDF) {
+      len = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+      len = 3;
+      if (c == 0xE0) lo = 0xA0;          // Overlong
+      if (c == 0xED) hi = 0x9F;          // Surrogates
+    } else if (c >= 0xF0 && c <= 0xF4) {
+      len = 4;
+      if (c == 0xF0) lo = 0x90;          // Overlong
+      if (c == 0xF4) hi = 0x8F;          // Past U+10FFFF
+    } else {
+      return 0;
+    }
+    if (n < len || p[1] < lo || p[1] > hi) return 0;
+    for (size_t k = 2; k < len; k++) {
+      if ((p[k] & 0xC0) != 0x80) return 0;
+    }
+    return len;
+  }
+
+  char *_buf = nullptr;
+  char *_owned = nullptr;
+  MediaArena *_leased = nullptr;
+  size_t _capacity = 0;
+  size_t _length = 0;
+  bool _overflow = false;
+};
+
+// Build a body: fill(StrBuilder &) is run once to count, then again into
+// exactly that much of the arena (or the heap; arena = nullptr for a body
+// that outlives the question). fill has to append the same text both times -
+// work out timestamps and IDs before calling.
+template <typename Fill>
+bool strBuild(StrBuilder &out, Fill fill, MediaArena *arena = &bodyArena) {
+  StrBuilder count;
+  fill(count);
+  size_t bytes = count.length() + 1;
+  if (!(arena && out.lease(*arena, bytes)) && !out.allocate(bytes, MEM_BODY)) return false;
+  fill(out);
+  return out.ok();
+}
+
+// A body in the log: its length and how it starts (a photo body is ~90KB)
+void strLogBody(const char *label, const StrBuilder &b) {
+  Serial.printf("%s (%d bytes): %.*s%s\n", label, (int)b.length(), STR_LOG_PREVIEW, b.c_str(),
+                b.length() > STR_LOG_PREVIEW ? "..." : "");
+}
+
+// Same two passes into a String, for text that is kept (the chat tree)
+template <typename Fill>
+String strBuildString(Fill fill) {
+  StrBuilder count;
+  fill(count);
+  StrBuilder text;
+  if (!text.allocate(count.length() + 1, MEM_TEXT)) return "";
+  fill(text);
+  return String(text.c_str());
+}
+
+// Escaped JSON string contents as a String
+String jsonEscape(const char *s, size_t n) {
+  return strBuildString([&](StrBuilder &b) { b.json(s, n); });
+}
+
+String jsonEscape(const String &s) {
+  return jsonEscape(s.c_str(), s.length());
+}
+
+#endif // STR_BUILDER_H
@@ -0,0 +1,287 @@
+#ifndef STT_STREAM_H
+#define STT_STREAM_H
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include "http_pool.h"
+
+// Dependencies: secrets.h, device_config.h, audio.h and audio_codec.h must be included before this file
+//
+// Streaming transcription upload. recordAudio() calls sttStreamBegin() when the
+// mic starts and sttStreamPush() after every chunk is encoded (audio_codec.h).
+// An uploader task on core 0
+// opens the STT connection in parallel with the recording and sends the audio
+// with HTTP chunked transfer encoding, so by the time the user stops talking
+// only the tail of the recording is still in flight. transcribeAudio() collects
+// the result with sttStreamFinish() and falls back to the buffered upload if
+// the stream failed at any point (the encoded recording stays in memory).
+
+// External references
+extern int16_t *audioBuffer;
+extern int SAMPLE_RATE;
+
+// Uploader state (written by the uploader task, read by the main loop)
+volatile bool sttStreamActive = false;      // Stream started for the current recording
+volatile bool sttStreamFailed = false;      // Connection or write error - use buffered upload
+volatile bool sttStreamDone = false;        // Uploader task finished (response read or failed)
+volatile int sttStreamBytesReady = 0;       // Encoded bytes ready to send
+volatile bool sttStreamAudioComplete = false;
+static TaskHandle_t sttStreamTaskHandle = NULL;
+static String sttStreamResponse = "";
+static int sttStreamHttpCode = 0;
+static unsigned long sttStreamStartTime = 0;
+
+static const char *STT_STREAM_BOUNDARY = "----ESP32StreamBoundary";
+
+// Write all bytes, retrying short writes like the buffered Whisper upload does
+static bool sttStreamWriteAll(WiFiClient &client, const uint8_t *data, size_t len) {
+  while (len > 0) {
+    if (!client.connected()) {
+      Serial.println("[STT-STREAM] Connection lost during upload");
+      return false;
+    }
+    size_t toSend = len > 1024 ? 1024 : len;
+    size_t written = client.write(data, toSend);
+    if (written == 0) {
+      delay(50);
+      continue;
+    }
+    data += written;
+    len -= written;
+  }
+  return true;
+}
+
+// Send one HTTP/1.1 chunk: "<hex size>\r\n<data>\r\n"
+static bool sttStreamWriteChunk(WiFiClient &client, const uint8_t *data, size_t len) {
+  if (len == 0) return true;
+  char sizeLine[12];
+  int n = snprintf(sizeLine, sizeof(sizeLine), "%X\r\n", (unsigned int)len);
+  return sttStreamWriteAll(client, (const uint8_t *)sizeLine, n) &&
+         sttStreamWriteAll(client, data, len) &&
+         sttStreamWriteAll(client, (const uint8_t *)"\r\n", 2);
+}
+
+// Read status line, headers and body (plain or chunked) from an HTTP response
+static int readHttpResponse(WiFiClient &client, String &body, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while (!client.available()) {
+    if (!client.connected() || millis() - start > timeoutMs) return -1;
+    delay(10);
+  }
+
+  String statusLine = client.readStringUntil('\n');
+  int sp = statusLine.indexOf(' ');
+  int code = sp >= 0 ? statusLine.substring(sp + 1).toInt() : -1;
+
+  bool chunked = false;
+  while (client.connected() || client.available()) {
+    String line = client.readStringUntil('\n');
+    if (line == "\r" || line.length() == 0) break;
+    line.toLowerCase();
+    if (line.startsWith("transfer-encoding:") && line.indexOf("chunked") >= 0) chunked = true;
+  }
+
+  body = "";
+  if (!chunked) {
+    body = client.readString();
+    return code;
+  }
+
+  while (client.connected() || client.available()) {
+    String sizeLine = client.readStringUntil('\n');
+    sizeLine.trim();
+    if (sizeLine.length() == 0) continue;
+    long chunkSize = strtol(sizeLine.c_str(), nullptr, 16);
+    if (chunkSize <= 0) break;
+    while (chunkSize > 0 && (client.connected() || client.available())) {
+      int c = client.read();
+      if (c < 0) {
+        delay(1);
+        continue;
+      }
+      body += (char)c;
+      chunkSize--;
+    }
+    client.readStringUntil('\n'); // CRLF after chunk data
+  }
+  return code;
+}
+
+// Uploader task - connects, streams audio as it is recorded, then reads the response
+void sttStreamTask(void *parameter) {
+  String host, path;
+  int port;
+  bool useSsl;
+  const char *apiKey;
+
+  if (USE_OWUI_STT) {
+    parseBaseUrl(OWUI_BASE_URL, host, port, path, useSsl);
+    path += "/api/v1/audio/transcriptions";
+    apiKey = LLM_API_KEY;
+  } else {
+    host = STT_HOST;
+    port = STT_PORT;
+    path = STT_PATH;
+    useSsl = STT_USE_SSL;
+    apiKey = STT_API_KEY;
+  }
+
+  TlsClient secureClient;
+  WiFiClient plainClient;
+  WiFiClient &client = useSsl ? (WiFiClient &)secureClient : plainClient;
+  if (useSsl) {
+    secureClient.setInsecure();
+  }
+  client.setTimeout(60);
+
+  unsigned long connectStart = millis();
+  if (!client.connect(host.c_str(), port)) {
+    Serial.printf("[STT-STREAM] Connection to %s:%d failed\n", host.c_str(), port);
+    sttStreamFailed = true;
+    sttStreamDone = true;
+    sttStreamTaskHandle = NULL;
+    vTaskDelete(NULL);
+    return;
+  }
+  Serial.printf("[STT-STREAM] Connected to %s:%d in %lums\n", host.c_str(), port, millis() - connectStart);
+
+  String headers = "POST " + path + " HTTP/1.1\r\n";
+  headers += "Host: " + host + "\r\n";
+  headers += "Authorization: Bearer " + String(apiKey) + "\r\n";
+  headers += "Content-Type: multipart/form-data; boundary=" + String(STT_STREAM_BOUNDARY) + "\r\n";
+  headers += "Transfer-Encoding: chunked\r\n";
+  headers += "Connection: close\r\n\r\n";
+
+  String bodyStart = "--" + String(STT_STREAM_BOUNDARY) + "\r\n";
+  bodyStart += "Content-Disposition: form-data; name=\"file\"; filename=\"audio.wav\"\r\n";
+  bodyStart += "Content-Type: audio/wav\r\n\r\n";
+
+  // Total length is unknown while recording - 0xFFFFFFFF marks a streaming WAV,
+  // which ffmpeg (used by both Whisper and OpenWebUI) reads until end of part
+  uint8_t wavHeader[AUDIO_CODEC_HEADER_MAX];
+  int wavHeaderSize = audioCodecHeader(wavHeader, -1);
+
+  bool ok = sttStreamWriteAll(client, (const uint8_t *)headers.c_str(), headers.length()) &&
+            sttStreamWriteChunk(client, (const uint8_t *)bodyStart.c_str(), bodyStart.length()) &&
+            sttStreamWriteChunk(client, wavHeader, wavHeaderSize);
+
+  // Send audio as the recorder makes it available
+  int bytesSent = 0;
+  int chunksSent = 0;
+  while (ok) {
+    int ready = sttStreamBytesReady;
+    if (bytesSent < ready) {
+      ok = sttStreamWriteChunk(client, audioCodecData() + bytesSent, ready - bytesSent);
+      bytesSent = ready;
+      chunksSent++;
+    } else if (sttStreamAudioComplete) {
+      break;
+    } else {
+      vTaskDelay(10 / portTICK_PERIOD_MS);
+    }
+  }
+
+  if (ok) {
+    // OpenWebUI only needs the file part, Whisper also needs the model field
+    String bodyEnd = "\r\n--" + String(STT_STREAM_BOUNDARY);
+    if (!USE_OWUI_STT) {
+      bodyEnd += "\r\nContent-Disposition: form-data; name=\"model\"\r\n\r\n";
+      bodyEnd += String(STT_MODEL) + "\r\n--" + String(STT_STREAM_BOUNDARY);
+    }
+    bodyEnd += "--\r\n";
+    ok = sttStreamWriteChunk(client, (const uint8_t *)bodyEnd.c_str(), bodyEnd.length()) &&
+         sttStreamWriteAll(client, (const uint8_t *)"0\r\n\r\n", 5);
+  }
+
+  if (ok) {
+    Serial.printf("[STT-STREAM] Sent %d bytes of %s in %d chunks, waiting for response...\n",
+                  bytesSent, audioCodecName(), chunksSent);
+    sttStreamHttpCode = readHttpResponse(client, sttStreamResponse, 60000);
+    Serial.printf("[STT-STREAM] HTTP response code: %d\n", sttStreamHttpCode);
+    if (sttStreamHttpCode != 200) {
+      Serial.println(sttStreamResponse);
+      sttStreamFailed = true;
+    }
+  } else {
+    sttStreamFailed = true;
+  }
+
+  client.stop();
+  sttStreamDone = true;
+  sttStreamTaskHandle = NULL;
+  vTaskDelete(NULL);
+}
+
+// Called by recordAudio() when the mic starts
+void sttStreamBegin() {
+  if (!ENABLE_STT_STREAMING || WiFi.status() != WL_CONNECTED) {
+    sttStreamActive = false;
+    return;
+  }
+  if (sttStreamTaskHandle != NULL) {
+    Serial.println("[STT-STREAM] Previous upload still running - using buffered upload");
+    sttStreamActive = false;
+    return;
+  }
+
+  sttStreamBytesReady = 0;
+  sttStreamAudioComplete = false;
+  sttStreamFailed = false;
+  sttStreamDone = false;
+  sttStreamResponse = "";
+  sttStreamHttpCode = 0;
+  sttStreamStartTime = millis();
+  sttStreamActive = true;
+
+  // Core 0 alongside displayTask - main loop and mic handling stay on core 1
+  if (xTaskCreatePinnedToCore(sttStreamTask, "sttStream", 8192, NULL, 1, &sttStreamTaskHandle, 0) != pdPASS) {
+    Serial.println("[STT-STREAM] Failed to start uploader task");
+    sttStreamTaskHandle = NULL;
+    sttStreamActive = false;
+  }
+}
+
+// Called by recordAudio() after each chunk is encoded (audioCodecAppend())
+void sttStreamPush(int bytesReady) {
+  if (sttStreamActive) {
+    sttStreamBytesReady = bytesReady;
+  }
+}
+
+// Called by recordAudio() when recording stops
+void sttStreamEndOfAudio() {
+  if (sttStreamActive) {
+    sttStreamAudioComplete = true;
+  }
+}
+
+// Recording was cancelled: ignore the transcript, the uploader finishes on its own
+void sttStreamDiscard() {
+  sttStreamAudioComplete = true;
+  sttStreamActive = false;
+}
+
+// Wait for the uploader and return the response body ("" if the stream failed)
+String sttStreamFinish() {
+  if (!sttStreamActive) return "";
+  sttStreamActive = false;
+
+  unsigned long waitStart = millis();
+  while (!sttStreamDone && millis() - waitStart < 65000) {
+    delay(10);
+  }
+
+  if (!sttStreamDone || sttStreamFailed) {
+    Serial.println("[STT-STREAM] Streamed upload failed");
+    return "";
+  }
+
+  Serial.printf("[STT-STREAM] Transcript ready %lums after recording stopped (%lums total)\n",
+                millis() - waitStart, millis() - sttStreamStartTime);
+  String result = sttStreamResponse;
+  sttStreamResponse = "";
+  return result;
+}
+
+#endif // STT_STREAM_H
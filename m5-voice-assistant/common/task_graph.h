@@ -0,0 +1,199 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+// Small dependency-driven executor for one interaction. Stages declare which
+// stages they need; background stages run as tasks on core 0 as soon as their
+// dependencies are done, foreground stages run on the calling task (core 1).
+// A stage that fails (returns false) skips everything that depends on it.
+//
+// Usage:
+//   TaskGraph g;
+//   taskGraphInit(g, "voice", &ctx);
+//   int rec = taskGraphAdd(g, "record", stageRecord, 0, false);
+//   int chat = taskGraphAdd(g, "chat", stageChat, 0, true);
+//   taskGraphAdd(g, "ask", stageAsk, TASK_DEP(rec) | TASK_DEP(chat), false);
+//   taskGraphRun(g);      // returns when every stage has finished or been skipped
+//   taskGraphReport(g);   // per-stage timing and the critical path
+
+#define TASK_GRAPH_MAX_STAGES 8
+#define TASK_GRAPH_STACK 8192
+#define TASK_DEP(i) (1u << (i))
+
+typedef bool (*TaskStageFn)(void *ctx);
+
+enum TaskStageState {
+  TASK_STAGE_PENDING,
+  TASK_STAGE_RUNNING,
+  TASK_STAGE_DONE,
+  TASK_STAGE_FAILED,
+  TASK_STAGE_SKIPPED,
+};
+
+struct TaskStage {
+  const char *name;
+  TaskStageFn fn;
+  uint32_t deps;           // TASK_DEP() of the stages that must be done first
+  bool background;         // Run on core 0 instead of the calling task
+  volatile TaskStageState state;
+  unsigned long startMs;   // Relative to the start of the graph
+  unsigned long endMs;
+};
+
+struct TaskGraph {
+  const char *name;
+  void *ctx;
+  TaskStage stages[TASK_GRAPH_MAX_STAGES];
+  int count;
+  unsigned long startMs;
+};
+
+struct TaskGraphJob {
+  TaskGraph *graph;
+  int index;
+};
+
+void taskGraphInit(TaskGraph &g, const char *name, void *ctx) {
+  g.name = name;
+  g.ctx = ctx;
+  g.count = 0;
+  g.startMs = 0;
+}
+
+// Returns the stage index (for TASK_DEP), -1 if the graph is full
+int taskGraphAdd(TaskGraph &g, const char *name, TaskStageFn fn, uint32_t deps, bool background) {
+  if (g.count >= TASK_GRAPH_MAX_STAGES) return -1;
+  TaskStage &s = g.stages[g.count];
+  s.name = name;
+  s.fn = fn;
+  s.deps = deps;
+  s.background = background;
+  s.state = TASK_STAGE_PENDING;
+  s.startMs = 0;
+  s.endMs = 0;
+  return g.count++;
+}
+
+static void taskGraphExecute(TaskGraph &g, int i) {
+  TaskStage &s = g.stages[i];
+  bool ok = s.fn(g.ctx);
+  s.endMs = millis() - g.startMs;
+  s.state = ok ? TASK_STAGE_DONE : TASK_STAGE_FAILED;
+}
+
+static void taskGraphWorker(void *parameter) {
+  TaskGraphJob job = *(TaskGraphJob *)parameter;
+  memFree(parameter);
+  taskGraphExecute(*job.graph, job.index);
+  vTaskDelete(NULL);
+}
+
+static void taskGraphStart(TaskGraph &g, int i) {
+  TaskStage &s = g.stages[i];
+  s.state = TASK_STAGE_RUNNING;
+  s.startMs = millis() - g.startMs;
+
+  if (s.background) {
+    TaskGraphJob *job = (TaskGraphJob *)memAlloc(sizeof(TaskGraphJob), MEM_TASK);
+    if (job) {
+      job->graph = &g;
+      job->index = i;
+      if (xTaskCreatePinnedToCore(taskGraphWorker, s.name, TASK_GRAPH_STACK, job, 1, NULL, 0) == pdPASS) {
+        return;
+      }
+      memFree(job);
+    }
+    Serial.printf("[Graph] Can't start %s on core 0, running it here\n", s.name);
+  }
+  taskGraphExecute(g, i);
+}
+
+// 1 = ready, 0 = waiting, -1 = a dependency failed
+static int taskGraphReady(TaskGraph &g, int i) {
+  for (int d = 0; d < g.count; d++) {
+    if (!(g.stages[i].deps & TASK_DEP(d))) continue;
+    TaskStageState state = g.stages[d].state;
+    if (state == TASK_STAGE_FAILED || state == TASK_STAGE_SKIPPED) return -1;
+    if (state != TASK_STAGE_DONE) return 0;
+  }
+  return 1;
+}
+
+// Run the graph to completion. Returns true if every stage succeeded.
+bool taskGraphRun(TaskGraph &g) {
+  g.startMs = millis();
+  for (;;) {
+    bool progress = false;
+    bool finished = true;
+    int foreground = -1;
+
+    for (int i = 0; i < g.count; i++) {
+      TaskStage &s = g.stages[i];
+      if (s.state == TASK_STAGE_RUNNING) finished = false;
+      if (s.state != TASK_STAGE_PENDING) continue;
+      finished = false;
+
+      int ready = taskGraphReady(g, i);
+      if (ready < 0) {
+        s.state = TASK_STAGE_SKIPPED;
+        progress = true;
+      } else if (ready > 0 && s.background) {
+        taskGraphStart(g, i);
+        progress = true;
+      } else if (ready > 0 && foreground < 0) {
+        foreground = i;
+      }
+    }
+    if (finished) break;
+
+    // Background stages are launched first so they overlap with this one
+    if (foreground >= 0) {
+      taskGraphStart(g, foreground);
+    } else if (!progress) {
+      delay(2);
+    }
+  }
+
+  for (int i = 0; i < g.count; i++) {
+    if (g.stages[i].state != TASK_STAGE_DONE) return false;
+  }
+  return true;
+}
+
+// Per-stage timing and the chain of stages that decided the total time
+void taskGraphReport(TaskGraph &g) {
+  static const char *stateNames[] = {"pending", "running", "ok", "FAILED", "skipped"};
+  unsigned long total = 0;
+  int last = -1;
+  for (int i = 0; i < g.count; i++) {
+    TaskStage &s = g.stages[i];
+    if (s.state == TASK_STAGE_DONE || s.state == TASK_STAGE_FAILED) {
+      if (last < 0 || s.endMs > g.stages[last].endMs) last = i;
+      if (s.endMs > total) total = s.endMs;
+    }
+  }
+
+  Serial.printf("\n[Graph] %s: %lums\n", g.name, total);
+  for (int i = 0; i < g.count; i++) {
+    TaskStage &s = g.stages[i];
+    if (s.state == TASK_STAGE_SKIPPED || s.state == TASK_STAGE_PENDING) {
+      Serial.printf("[Graph]   %-11s %-6s %s\n", s.name, s.background ? "core0" : "main", stateNames[s.state]);
+    } else {
+      Serial.printf("[Graph]   %-11s %-6s %6lu -> %6lums  %6lums  %s\n", s.name, s.background ? "core0" : "main",
+                    s.startMs, s.endMs, s.endMs - s.startMs, stateNames[s.state]);
+    }
+  }
+
+  // Walk back from the last stage through the dependency that finished last
+  String path = "";
+  for (int i = last; i >= 0;) {
+    path = path.length() > 0 ? String(g.stages[i].name) + " > " + path : String(g.stages[i].name);
+    int next = -1;
+    for (int d = 0; d < g.count; d++) {
+      if ((g.stages[i].deps & TASK_DEP(d)) && (next < 0 || g.stages[d].endMs > g.stages[next].endMs)) next = d;
+    }
+    i = next;
+  }
+  Serial.println("[Graph] Critical path: " + path);
+}
+
+#endif // TASK_GRAPH_H
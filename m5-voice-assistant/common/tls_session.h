@@ -0,0 +1,471 @@
+#ifndef TLS_SESSION_H
+#define TLS_SESSION_H
+
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/platform.h"
+#include "mbedtls/x509_crt.h"
+
+// Dependencies: device_config.h must be included before this file (ENABLE_TLS_RESUMPTION)
+//
+// TLS session resumption for OWUI_BASE_URL and STT_HOST.
+//
+// WiFiClientSecure has no way to offer a saved session, so TlsResumableClient
+// runs mbedTLS itself on top of a plain WiFiClient socket. After every
+// handshake the session (ID + ticket) is serialized into a small cache keyed
+// by host:port, and the next connect to that host offers it. If the server
+// accepts, the handshake is one round trip with no certificate or key
+// exchange - that key exchange is most of the ~1s a full handshake takes here.
+//
+// The cache lives in RTC_NOINIT memory, so it survives light sleep, deep sleep
+// and software resets. Entries carry a checksum so power-on garbage is ignored.
+// The peer certificate is left out of the saved session: certificates aren't
+// verified, and a real chain would not fit the RTC entry.
+//
+// A connect counts as resumed when the negotiated session has the master
+// secret of the session that was offered - a full handshake always derives
+// a new one.
+//
+// The rest of the code uses TlsClient for https sockets. ENABLE_TLS_RESUMPTION
+// is off on every board until this client has been built and measured on a
+// device; TlsClient is then plain WiFiClientSecure.
+
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+#define TLS_SESSION_CACHE_SIZE 2        // OWUI + STT host
+#define TLS_SESSION_BLOB_MAX 1600       // Serialized session without the peer certificate (ticket included)
+#define TLS_SESSION_HOST_MAX 64
+#define TLS_SESSION_MAGIC 0x544C5331    // "TLS1"
+
+#define TLS_MASTER_LEN 48
+
+const unsigned long TLS_HANDSHAKE_TIMEOUT_MS = 15000;
+
+struct TlsSessionEntry {
+  uint32_t magic;
+  uint32_t checksum;
+  uint32_t sequence;                    // Higher = saved more recently
+  char host[TLS_SESSION_HOST_MAX];
+  uint16_t port;
+  uint16_t length;
+  uint8_t blob[TLS_SESSION_BLOB_MAX];
+};
+
+struct TlsSessionStats {
+  uint32_t fullHandshakes;
+  uint32_t resumed;
+  uint32_t offered;                     // Connects that offered a cached session
+  uint32_t fullMsTotal;
+  uint32_t resumedMsTotal;
+};
+
+RTC_NOINIT_ATTR TlsSessionEntry tlsSessionCache[TLS_SESSION_CACHE_SIZE];
+RTC_NOINIT_ATTR uint32_t tlsSessionSequence;
+TlsSessionStats tlsSessionStats = {0, 0, 0, 0, 0};
+static SemaphoreHandle_t tlsSessionMutex = NULL;
+static portMUX_TYPE tlsSessionStatsLock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint32_t tlsSessionChecksum(const TlsSessionEntry &e) {
+  uint32_t h = 2166136261u; // FNV-1a
+  const uint8_t *parts[3] = {(const uint8_t *)e.host, (const uint8_t *)&e.port, e.blob};
+  size_t sizes[3] = {sizeof(e.host), sizeof(e.port) + sizeof(e.length), e.length};
+  for (int p = 0; p < 3; p++) {
+    for (size_t i = 0; i < sizes[p]; i++) {
+      h = (h ^ parts[p][i]) * 16777619u;
+    }
+  }
+  return h ^ e.sequence;
+}
+
+static bool tlsSessionValid(const TlsSessionEntry &e) {
+  return e.magic == TLS_SESSION_MAGIC && e.length > 0 && e.length <= TLS_SESSION_BLOB_MAX &&
+         e.host[TLS_SESSION_HOST_MAX - 1] == '\0' && e.checksum == tlsSessionChecksum(e);
+}
+
+// Call once from setup() - drops RTC entries that didn't survive power-off
+void tlsSessionInit() {
+  if (tlsSessionMutex == NULL) {
+    tlsSessionMutex = xSemaphoreCreateMutex();
+  }
+  int restored = 0;
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    if (tlsSessionValid(tlsSessionCache[i])) {
+      Serial.printf("[TLS] Cached session for %s:%d kept from before reset\n",
+                    tlsSessionCache[i].host, tlsSessionCache[i].port);
+      restored++;
+    } else {
+      tlsSessionCache[i].magic = 0;
+    }
+  }
+  if (restored == 0) {
+    tlsSessionSequence = 0;
+  }
+}
+
+static TlsSessionEntry *tlsSessionFind(const char *host, uint16_t port) {
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+    TlsSessionEntry &e = tlsSessionCache[i];
+    if (e.magic == TLS_SESSION_MAGIC && e.port == port && strcmp(e.host, host) == 0) return &e;
+  }
+  return nullptr;
+}
+
+// Offer the cached session for host:port on a fresh (not yet handshaken)
+// context; master receives its master secret
+static bool tlsSessionOffer(mbedtls_ssl_context *ssl, const char *host, uint16_t port, uint8_t *master) {
+  bool offered = false;
+  xSemaphoreTake(tlsSessionMutex, portMAX_DELAY);
+  TlsSessionEntry *e = tlsSessionFind(host, port);
+  if (e) {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    offered = mbedtls_ssl_session_load(&session, e->blob, e->length) == 0 &&
+              mbedtls_ssl_set_session(ssl, &session) == 0;
+    if (offered) memcpy(master, session.MBEDTLS_PRIVATE(master), TLS_MASTER_LEN);
+    mbedtls_ssl_session_free(&session);
+    if (!offered) {
+      e->magic = 0; // Unusable (e.g. written by a different firmware build)
+    }
+  }
+  xSemaphoreGive(tlsSessionMutex);
+  return offered;
+}
+
+// The certificate chain is most of a serialized session and isn't needed to
+// resume (nothing is verified), so it isn't cached
+static void tlsSessionDropPeerCert(mbedtls_ssl_session &session) {
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+  if (session.MBEDTLS_PRIVATE(peer_cert) != NULL) {
+    mbedtls_x509_crt_free(session.MBEDTLS_PRIVATE(peer_cert));
+    mbedtls_free(session.MBEDTLS_PRIVATE(peer_cert));
+    session.MBEDTLS_PRIVATE(peer_cert) = NULL;
+  }
+#endif
+}
+
+// Store the session of a completed handshake, replacing the oldest entry if needed
+static void tlsSessionStore(mbedtls_ssl_session &session, const char *host, uint16_t port) {
+  if (strlen(host) >= TLS_SESSION_HOST_MAX) return;
+  tlsSessionDropPeerCert(session);
+
+  size_t needed = 0;
+  if (mbedtls_ssl_session_save(&session, NULL, 0, &needed) == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL &&
+      needed > TLS_SESSION_BLOB_MAX) {
+    Serial.printf("[TLS] Session for %s needs %d bytes, cache holds %d - not cached\n", host, (int)needed,
+                  TLS_SESSION_BLOB_MAX);
+    return;
+  }
+
+  xSemaphoreTake(tlsSessionMutex, portMAX_DELAY);
+  TlsSessionEntry *e = tlsSessionFind(host, port);
+  for (int i = 0; !e && i < TLS_SESSION_CACHE_SIZE; i++) {
+    if (tlsSessionCache[i].magic != TLS_SESSION_MAGIC) e = &tlsSessionCache[i];
+  }
+  if (!e) {
+    e = &tlsSessionCache[0];
+    for (int i = 1; i < TLS_SESSION_CACHE_SIZE; i++) {
+      if (tlsSessionCache[i].sequence < e->sequence) e = &tlsSessionCache[i];
+    }
+  }
+
+  e->magic = 0; // Invalid while being rewritten
+  size_t length = 0;
+  if (mbedtls_ssl_session_save(&session, e->blob, TLS_SESSION_BLOB_MAX, &length) == 0 && length > 0) {
+    memset(e->host, 0, sizeof(e->host));
+    strcpy(e->host, host);
+    e->port = port;
+    e->length = length;
+    e->sequence = ++tlsSessionSequence;
+    e->checksum = tlsSessionChecksum(*e);
+    e->magic = TLS_SESSION_MAGIC;
+  }
+  xSemaphoreGive(tlsSessionMutex);
+}
+
+static void tlsSessionCount(bool offered, bool resumed, unsigned long ms) {
+  portENTER_CRITICAL(&tlsSessionStatsLock);
+  if (offered) tlsSessionStats.offered++;
+  if (resumed) {
+    tlsSessionStats.resumed++;
+    tlsSessionStats.resumedMsTotal += ms;
+  } else {
+    tlsSessionStats.fullHandshakes++;
+    tlsSessionStats.fullMsTotal += ms;
+  }
+  portEXIT_CRITICAL(&tlsSessionStatsLock);
+}
+
+// Full vs resumed handshake count and average time - the before/after of resumption
+void tlsSessionPrintStats() {
+  portENTER_CRITICAL(&tlsSessionStatsLock);
+  TlsSessionStats st = tlsSessionStats;
+  portEXIT_CRITICAL(&tlsSessionStatsLock);
+  Serial.printf("[TLS] full=%u (avg %ums) resumed=%u/%u offered (avg %ums)\n", st.fullHandshakes,
+                st.fullHandshakes ? st.fullMsTotal / st.fullHandshakes : 0, st.resumed, st.offered,
+                st.resumed ? st.resumedMsTotal / st.resumed : 0);
+}
+
+// Drop-in for WiFiClientSecure (insecure mode) that resumes cached sessions.
+// The WiFiClient base is the raw TCP socket; the overrides below are the TLS layer.
+class TlsResumableClient : public WiFiClient {
+ public:
+  TlsResumableClient() {}
+
+  ~TlsResumableClient() {
+    stop();
+    if (_rngReady) {
+      mbedtls_ctr_drbg_free(&_drbg);
+      mbedtls_entropy_free(&_entropy);
+    }
+  }
+
+  // Certificates are never verified, same as WiFiClientSecure::setInsecure()
+  void setInsecure() {}
+
+  bool resumed() const { return _resumed; }
+  unsigned long lastConnectMs() const { return _lastConnectMs; }
+
+  int connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port, (int32_t)TLS_HANDSHAKE_TIMEOUT_MS);
+  }
+
+  int connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    return connect(ip.toString().c_str(), port, timeout);
+  }
+
+  int connect(const char *host, uint16_t port) {
+    return connect(host, port, (int32_t)TLS_HANDSHAKE_TIMEOUT_MS);
+  }
+
+  int connect(const char *host, uint16_t port, int32_t timeout) {
+    stop();
+    unsigned long start = millis();
+    _resumed = false;
+
+    if (!WiFiClient::connect(host, port, timeout)) {
+      return 0;
+    }
+    if (!startTls(host, port, start)) {
+      stop();
+      return 0;
+    }
+    return 1;
+  }
+
+  using WiFiClient::write;
+
+  size_t write(const uint8_t *buf, size_t size) {
+    if (!_tlsActive) return 0;
+    size_t sent = 0;
+    unsigned long lastProgress = millis();
+    while (sent < size) {
+      int ret = mbedtls_ssl_write(&_ssl, buf + sent, size - sent);
+      if (ret > 0) {
+        sent += ret;
+        lastProgress = millis();
+      } else if ((ret == MBEDTLS_ERR_SSL_WANT_WRITE || ret == MBEDTLS_ERR_SSL_WANT_READ) &&
+                 millis() - lastProgress < getTimeout()) {
+        delay(1);
+      } else {
+        break;
+      }
+    }
+    return sent;
+  }
+
+  size_t write(uint8_t data) {
+    return write(&data, 1);
+  }
+
+  int available() {
+    if (!_tlsActive) return 0;
+    int pending = _peekByte >= 0 ? 1 : 0;
+    if (mbedtls_ssl_get_bytes_avail(&_ssl) == 0 && !_peerClosed) {
+      int ret = mbedtls_ssl_read(&_ssl, NULL, 0); // Process one record, if any
+      if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+        _peerClosed = true;
+      } else if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        _peerClosed = true;
+      }
+    }
+    return pending + mbedtls_ssl_get_bytes_avail(&_ssl);
+  }
+
+  int read(uint8_t *buf, size_t size) {
+    if (!_tlsActive || size == 0) return -1;
+    size_t n = 0;
+    if (_peekByte >= 0) {
+      buf[n++] = (uint8_t)_peekByte;
+      _peekByte = -1;
+      if (n == size) return n;
+    }
+    if (_peerClosed && mbedtls_ssl_get_bytes_avail(&_ssl) == 0) {
+      return n > 0 ? (int)n : -1;
+    }
+    int ret = mbedtls_ssl_read(&_ssl, buf + n, size - n);
+    if (ret > 0) return n + ret;
+    if (ret == 0 || (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE)) {
+      _peerClosed = true; // EOF, close_notify or fatal error
+    }
+    return n > 0 ? (int)n : -1;
+  }
+
+  int read() {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  int peek() {
+    if (_peekByte < 0) {
+      uint8_t c;
+      if (read(&c, 1) == 1) _peekByte = c;
+    }
+    return _peekByte;
+  }
+
+  void flush() {}
+
+  uint8_t connected() {
+    if (!_tlsActive) return 0;
+    if (_peekByte >= 0 || mbedtls_ssl_get_bytes_avail(&_ssl) > 0) return 1;
+    return !_peerClosed && WiFiClient::connected();
+  }
+
+  void stop() {
+    if (_tlsActive && _bioDepth == 0) {
+      _tlsActive = false;
+      if (!_peerClosed && WiFiClient::connected()) {
+        mbedtls_ssl_close_notify(&_ssl);
+      }
+      mbedtls_ssl_free(&_ssl);
+      mbedtls_ssl_config_free(&_conf);
+    } else if (_tlsActive) {
+      // The socket failed inside an mbedTLS call - finish the teardown on the next stop()
+      _peerClosed = true;
+    }
+    if (!_tlsActive) {
+      _peekByte = -1;
+      _peerClosed = false;
+    }
+    WiFiClient::stop();
+  }
+
+ private:
+  bool startTls(const char *host, uint16_t port, unsigned long start) {
+    if (!_rngReady) {
+      mbedtls_entropy_init(&_entropy);
+      mbedtls_ctr_drbg_init(&_drbg);
+      const char *pers = "m5-voice-tls";
+      if (mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+                                (const unsigned char *)pers, strlen(pers)) != 0) {
+        mbedtls_ctr_drbg_free(&_drbg);
+        mbedtls_entropy_free(&_entropy);
+        Serial.println("[TLS] ERROR: RNG seed failed");
+        return false;
+      }
+      _rngReady = true;
+    }
+
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_config_init(&_conf);
+    _tlsActive = true;
+    _peerClosed = false;
+
+    if (mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
+      return false;
+    }
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+    if (mbedtls_ssl_setup(&_ssl, &_conf) != 0 || mbedtls_ssl_set_hostname(&_ssl, host) != 0) {
+      return false;
+    }
+    mbedtls_ssl_set_bio(&_ssl, this, bioSend, bioRecv, NULL);
+
+    uint8_t offeredMaster[TLS_MASTER_LEN];
+    bool offered = tlsSessionOffer(&_ssl, host, port, offeredMaster);
+
+    int ret;
+    while ((ret = mbedtls_ssl_handshake(&_ssl)) != 0) {
+      if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        Serial.printf("[TLS] Handshake with %s failed: -0x%04X\n", host, -ret);
+        return false;
+      }
+      if (millis() - start > TLS_HANDSHAKE_TIMEOUT_MS) {
+        Serial.printf("[TLS] Handshake with %s timed out\n", host);
+        return false;
+      }
+      delay(2);
+    }
+
+    _lastConnectMs = millis() - start;
+
+    // Resumed only if the server kept the offered session's master secret
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    bool haveSession = mbedtls_ssl_get_session(&_ssl, &session) == 0;
+    _resumed = offered && haveSession &&
+               memcmp(session.MBEDTLS_PRIVATE(master), offeredMaster, TLS_MASTER_LEN) == 0;
+    tlsSessionCount(offered, _resumed, _lastConnectMs);
+    Serial.printf("[TLS] %s:%d %s in %lums\n", host, port,
+                  _resumed ? "session resumed" : (offered ? "resume refused, full handshake" : "full handshake"),
+                  _lastConnectMs);
+
+    if (haveSession) tlsSessionStore(session, host, port);
+    mbedtls_ssl_session_free(&session);
+    return true;
+  }
+
+  static int bioSend(void *ctx, const unsigned char *buf, size_t len) {
+    TlsResumableClient *c = (TlsResumableClient *)ctx;
+    c->_bioDepth++;
+    size_t written = c->WiFiClient::write(buf, len);
+    bool alive = written > 0 || c->WiFiClient::connected();
+    c->_bioDepth--;
+    if (written > 0) return written;
+    return alive ? MBEDTLS_ERR_SSL_WANT_WRITE : MBEDTLS_ERR_NET_CONN_RESET;
+  }
+
+  static int bioRecv(void *ctx, unsigned char *buf, size_t len) {
+    TlsResumableClient *c = (TlsResumableClient *)ctx;
+    c->_bioDepth++;
+    int result = MBEDTLS_ERR_SSL_WANT_READ;
+    if (c->WiFiClient::available() > 0) {
+      int n = c->WiFiClient::read(buf, len);
+      if (n > 0) result = n;
+    } else if (!c->WiFiClient::connected()) {
+      result = MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    c->_bioDepth--;
+    return result;
+  }
+
+  mbedtls_ssl_context _ssl;
+  mbedtls_ssl_config _conf;
+  mbedtls_entropy_context _entropy;
+  mbedtls_ctr_drbg_context _drbg;
+  bool _rngReady = false;
+  bool _tlsActive = false;
+  bool _peerClosed = false;
+  bool _resumed = false;
+  int _peekByte = -1;
+  int _bioDepth = 0;
+  unsigned long _lastConnectMs = 0;
+};
+
+#if ENABLE_TLS_RESUMPTION
+typedef TlsResumableClient TlsClient;
+#else
+typedef WiFiClientSecure TlsClient;
+#endif
+
+#endif // TLS_SESSION_H
@@ -0,0 +1,285 @@
+#ifndef TTS_PIPELINE_H
+#define TTS_PIPELINE_H
+
+#include <HTTPClient.h>
+#include "http_pool.h"
+#include "mp3_stream.h"
+
+// Dependencies: secrets.h, device_config.h, mem_alloc.h, str_builder.h, http_pool.h,
+// mp3_stream.h and MP3DecoderHelix.h must be included before this file
+//
+// Sentence-pipelined text-to-speech. The answer (or its token stream) is cut
+// into sentences; a worker task on core 0 requests TTS for each sentence and
+// streams it through the MP3 player. The request for the next sentence is sent
+// while the current one is still playing, and the player hands over between
+// streams without draining the speaker, so sentences play back to back.
+//
+// Usage:
+//   ttsPipelineBegin();              // before askGPT()
+//   ttsPipelineFeed(delta);          // from the answer delta callback
+//   ttsPipelineFinish(answer);       // speaks whatever wasn't fed, waits for playback
+//
+// The spoken MP3 is also collected into lastTtsMp3 for replay.
+//
+// ttsPipelineStop() (barge-in, any task) drops the sentences not spoken yet
+// and stops the player; ttsPipelineFinish() then returns at once. A TTS
+// request already sent is left to finish on its own and its audio discarded;
+// the next ttsPipelineBegin() waits for that.
+//
+// While the answer streams in, its SSE request and the MP3 that is playing
+// each hold a pool slot, so the next sentence needs a third (HTTP_POOL_SIZE 3).
+// If a background request has taken it, the sentence waits for a slot and is
+// tried again; a stop ends the wait at once. A sentence that still can't be
+// fetched plays a short tone in its place instead of vanishing silently.
+
+#define TTS_SENTENCE_MIN_CHARS 20        // Shorter sentences are merged with the next one
+#define TTS_SENTENCE_MAX_CHARS 250       // Longer ones are split at a comma or space
+#define TTS_SENTENCE_QUEUE_LEN 16
+#define TTS_REQUEST_ATTEMPTS 3           // Waits for a free pool slot, HTTP_POOL_WAIT_MS each
+#define TTS_SKIPPED_TONE_HZ 440
+#define TTS_SKIPPED_TONE_MS 150
+
+static_assert(!ENABLE_TTS_PIPELINE || HTTP_POOL_SIZE >= 3,
+              "The TTS pipeline needs a pool slot next to the answer stream and the sentence playing");
+
+// External references (defined in the main .ino)
+extern bool useTtsVoice1;
+
+static QueueHandle_t ttsSentenceQueue = NULL;   // Heap-allocated char*, nullptr = end of answer
+static TaskHandle_t ttsPipelineTaskHandle = NULL;
+static volatile bool ttsPipelineRunning = false;
+static volatile bool ttsPipelineStopRequested = false;
+static String ttsPendingText = "";              // Fed text not yet forming a sentence
+static String ttsFedText = "";                  // Everything fed for this answer
+static unsigned long ttsPipelineStartTime = 0;
+
+// Request TTS for one sentence; on success the response body is ready to stream
+static HTTPClient *ttsRequest(const String &text, int &contentLength) {
+  const char *voice = useTtsVoice1 ? TTS_VOICE_1 : TTS_VOICE_2;
+  StrBuilder body;
+  bool built = strBuild(body, [&](StrBuilder &b) {
+    b.add("{\"model\":").quoted(TTS_MODEL)
+     .add(",\"input\":").quoted(text)
+     .add(",\"voice\":").quoted(voice).add('}');
+  });
+  if (!built) return nullptr;
+
+  unsigned long start = millis();
+  String url = String(OWUI_BASE_URL) + "/api/v1/audio/speech";
+  HTTPClient *pooled = &httpPoolBegin(url, &ttsPipelineStopRequested);
+  for (int attempt = 1; !httpPoolHasSlot(*pooled); attempt++) {
+    httpPoolEnd(*pooled);
+    if (attempt == TTS_REQUEST_ATTEMPTS || ttsPipelineStopRequested) {
+      Serial.printf("[TTS] No free connection after %lums\n", millis() - start);
+      return nullptr;
+    }
+    Serial.printf("[TTS] Pool busy, trying again (%d/%d)\n", attempt + 1, TTS_REQUEST_ATTEMPTS);
+    pooled = &httpPoolBegin(url, &ttsPipelineStopRequested);
+  }
+
+  HTTPClient &http = *pooled;
+  http.addHeader("Authorization", String("Bearer ") + LLM_API_KEY);
+  http.addHeader("Content-Type", "application/json");
+  http.setTimeout(30000);
+
+  int httpCode = httpPoolSend(http, "POST", body.c_str(), body.length());
+  if (httpCode != 200) {
+    Serial.printf("[TTS] Request failed: HTTP %d\n", httpCode);
+    Serial.println(http.getString());
+    httpPoolEnd(http);
+    return nullptr;
+  }
+  contentLength = http.getSize();
+  Serial.printf("[TTS] \"%.30s...\" %d bytes MP3, headers after %lums\n",
+                text.c_str(), contentLength, millis() - start);
+  return &http;
+}
+
+// A sentence that couldn't be fetched: a tone where it would have played
+static void ttsSkippedTone() {
+  mp3StreamWait();
+  if (ttsPipelineStopRequested) return;
+  TTS_SPEAKER.tone(TTS_SKIPPED_TONE_HZ, TTS_SKIPPED_TONE_MS, MP3_STREAM_CHANNEL);
+  delay(TTS_SKIPPED_TONE_MS);
+}
+
+void ttsPipelineTask(void *parameter) {
+  TTS_SPEAKER.end();
+  delay(50);
+  TTS_SPEAKER.begin();
+  TTS_SPEAKER.setVolume(200);
+
+  int sentences = 0;
+  int skipped = 0;
+  unsigned long firstAudio = 0;
+  char *sentence;
+  while (xQueueReceive(ttsSentenceQueue, &sentence, portMAX_DELAY) == pdTRUE && sentence != nullptr) {
+    if (ttsPipelineStopRequested) {
+      memFree(sentence);
+      continue;
+    }
+
+    // Sent while the previous sentence is still playing
+    int contentLength = 0;
+    HTTPClient *http = ttsRequest(String(sentence), contentLength);
+    memFree(sentence);
+    if (!http) {
+      if (!ttsPipelineStopRequested) {
+        skipped++;
+        ttsSkippedTone();
+      }
+      continue;
+    }
+    if (ttsPipelineStopRequested) {
+      http->getStreamPtr()->stop(); // Body unread, the socket can't be reused
+      httpPoolEnd(*http);
+      continue;
+    }
+
+    // Waits for the previous stream to queue its last block, then takes over
+    if (mp3StreamStart(*http, contentLength, true)) {
+      sentences++;
+      if (firstAudio == 0) {
+        while (mp3StreamRunning && mp3StreamFirstAudioMs == 0) delay(5);
+        firstAudio = millis() - ttsPipelineStartTime;
+        Serial.printf("[TTS] First audio %lums after pipeline start\n", firstAudio);
+      }
+    }
+  }
+
+  // After a stop the interaction turns the speaker off (mp3StreamRelease())
+  if (!ttsPipelineStopRequested) {
+    mp3StreamWait();
+    TTS_SPEAKER.end();
+  }
+
+  Serial.printf("[TTS] Pipeline %s: %d sentences, %d skipped, in %lums\n",
+                ttsPipelineStopRequested ? "stopped" : "done", sentences, skipped, millis() - ttsPipelineStartTime);
+  ttsPipelineTaskHandle = NULL;
+  ttsPipelineRunning = false;
+  vTaskDelete(NULL);
+}
+
+// Cut the next sentence off the front of text ("" if none is complete yet)
+static String ttsTakeSentence(String &text, bool flush) {
+  int cut = -1;
+  for (unsigned int i = 0; i < text.length(); i++) {
+    char c = text[i];
+    // Punctuation must be followed by whitespace, so "3.5" stays together
+    bool boundary = c == '\n' ||
+                    ((c == '.' || c == '!' || c == '?') && i + 1 < text.length() &&
+                     (text[i + 1] == ' ' || text[i + 1] == '\n'));
+    if (boundary && i + 1 >= TTS_SENTENCE_MIN_CHARS) {
+      cut = i + 1;
+      break;
+    }
+    if (i + 1 >= TTS_SENTENCE_MAX_CHARS) {
+      int comma = text.substring(0, i).lastIndexOf(", ");
+      int space = text.substring(0, i).lastIndexOf(' ');
+      cut = comma > TTS_SENTENCE_MIN_CHARS ? comma + 1 : (space > 0 ? space : i + 1);
+      break;
+    }
+  }
+  if (cut < 0 && flush) cut = text.length();
+  if (cut < 0) return "";
+
+  String sentence = text.substring(0, cut);
+  text = text.substring(cut);
+  sentence.trim();
+  return sentence;
+}
+
+static void ttsEnqueueSentence(const String &sentence) {
+  if (sentence.length() == 0 || ttsPipelineStopRequested) return;
+  char *copy = memStrdup(sentence.c_str(), MEM_TEXT);
+  if (copy && xQueueSend(ttsSentenceQueue, &copy, portMAX_DELAY) != pdTRUE) {
+    memFree(copy);
+  }
+}
+
+bool ttsPipelineActive() {
+  return ttsPipelineRunning && !ttsPipelineStopRequested;
+}
+
+// Free sentences left in the queue
+static void ttsPipelineDrain() {
+  char *sentence;
+  while (xQueueReceive(ttsSentenceQueue, &sentence, 0) == pdTRUE) {
+    memFree(sentence);
+  }
+}
+
+// Start the worker for a new answer
+bool ttsPipelineBegin() {
+  if (!ENABLE_TTS_PIPELINE) return false;
+  // A stopped worker only has its last TTS request to finish
+  while (ttsPipelineRunning && ttsPipelineStopRequested) {
+    delay(10);
+  }
+  if (ttsPipelineRunning) return false;
+  if (ttsSentenceQueue == NULL) {
+    ttsSentenceQueue = xQueueCreate(TTS_SENTENCE_QUEUE_LEN, sizeof(char *));
+  }
+  ttsPipelineDrain(); // Fed after a stop
+  ttsPipelineStopRequested = false;
+
+  // Replay copy is rebuilt from this answer's sentences
+  mp3StreamClearReplay();
+
+  ttsPendingText = "";
+  ttsFedText = "";
+  ttsPipelineStartTime = millis();
+  ttsPipelineRunning = true;
+
+  if (xTaskCreatePinnedToCore(ttsPipelineTask, "ttsPipeline", 8192, NULL, 1, &ttsPipelineTaskHandle, 0) != pdPASS) {
+    Serial.println("[TTS] Failed to start pipeline task");
+    ttsPipelineTaskHandle = NULL;
+    ttsPipelineRunning = false;
+    return false;
+  }
+  return true;
+}
+
+// Add streamed answer text; complete sentences are sent to TTS right away
+void ttsPipelineFeed(const String &delta) {
+  if (!ttsPipelineActive()) return;
+  ttsPendingText += delta;
+  ttsFedText += delta;
+  String sentence;
+  while ((sentence = ttsTakeSentence(ttsPendingText, false)).length() > 0) {
+    ttsEnqueueSentence(sentence);
+  }
+}
+
+// Speak whatever of the final answer wasn't fed yet, then wait for playback to end
+void ttsPipelineFinish(const String &fullText) {
+  if (!ttsPipelineActive()) return;
+
+  // Buffered answers (or a polling fallback) arrive here in one piece
+  if (fullText.startsWith(ttsFedText)) {
+    ttsPipelineFeed(fullText.substring(ttsFedText.length()));
+  }
+  String sentence;
+  while ((sentence = ttsTakeSentence(ttsPendingText, true)).length() > 0) {
+    ttsEnqueueSentence(sentence);
+  }
+
+  char *endMarker = nullptr;
+  xQueueSend(ttsSentenceQueue, &endMarker, portMAX_DELAY);
+
+  while (ttsPipelineRunning && !ttsPipelineStopRequested) {
+    delay(20);
+  }
+}
+
+// Barge-in: drop what isn't spoken yet, stop playback and end the worker
+void ttsPipelineStop() {
+  if (!ttsPipelineRunning) return;
+  ttsPipelineStopRequested = true;
+  mp3StreamStop();
+  ttsPipelineDrain();
+  char *endMarker = nullptr;
+  xQueueSend(ttsSentenceQueue, &endMarker, 0);
+}
+
+#endif // TTS_PIPELINE_H
@@ -0,0 +1,188 @@
+#ifndef VAD_H
+#define VAD_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Voice activity detection on short frames, with pluggable engines. An engine
+// looks at one frame and says whether it sounds like speech; vadFeed() adds
+// what every engine needs around that: onset (a few speech-like frames in a
+// row before speech starts, so a click doesn't count) and hangover (speech
+// continues a little past the last speech-like frame, so pauses between words
+// don't end it).
+//
+// Engines:
+//   vadSpectral - band energy (200Hz-3.4kHz) against an adaptive noise floor,
+//                 plus zero-crossing rate to keep quiet fricatives ("s", "f")
+//                 that are barely above the floor. Follows the room's noise,
+//                 so it works in a noisy office as well as a quiet one.
+//   vadRms      - the old single RMS threshold (rmsThreshold), for comparison
+//
+// Usage:
+//   Vad vad;
+//   vadBegin(vad, vadSpectral, SAMPLE_RATE, VAD_SILENCE_THRESHOLD);
+//   pos = vadFeed(vad, audioBuffer, pos, samplesRecorded);  // whole frames only
+//   if (vad.speech) ...;  vadSilenceMs(vad);                // since the last speech-like frame
+//
+// No Arduino dependencies: the same code can be run over WAV files on a PC.
+
+#define VAD_FRAME_MS 16                  // Frame length (two per mic block)
+#define VAD_ONSET_FRAMES 2               // Speech-like frames in a row before speech starts
+#define VAD_HANGOVER_MS 240              // Speech lasts this long past the last speech-like frame
+#define VAD_BAND_LOW_HZ 200.0f           // Band energy excludes rumble below this...
+#define VAD_BAND_HIGH_HZ 3400.0f         // ...and hiss above this
+#define VAD_SNR_VOICED 4.0f              // Band energy over the noise floor for a voiced frame (6dB)
+#define VAD_SNR_UNVOICED 2.0f            // Same for a fricative, which needs a high ZCR too (3dB)
+#define VAD_ZCR_UNVOICED 0.25f           // Zero crossings per sample that sound like a fricative
+#define VAD_MIN_ENERGY 100.0f            // Mean square below which nothing is speech (RMS 10)
+#define VAD_FLOOR_RISE 0.02f             // Noise floor follows louder noise slowly...
+#define VAD_FLOOR_FALL 0.2f              // ...and quieter noise quickly
+#define VAD_FLOOR_CREEP 0.002f           // Rise during speech, so a noise step can't lock it out
+
+struct Vad;
+typedef bool (*VadFrameFn)(Vad &v, const int16_t *frame, int n);
+
+struct VadEngine {
+  const char *name;
+  VadFrameFn frame;           // True if the frame sounds like speech
+};
+
+struct Vad {
+  const VadEngine *engine;
+  int sampleRate;
+  int frameSamples;
+  int rmsThreshold;           // vadRms only
+
+  // Band filter (one-pole high-pass then low-pass) and noise floor
+  float hpAlpha, lpAlpha;
+  float hpPrevIn, hpPrevOut, lpOut;
+  float noiseFloor;           // Mean square of the band, 0 until the first frame
+
+  // Last frame
+  float energy;               // Band mean square
+  float zcr;                  // Zero crossings per sample
+  bool rawSpeech;             // Engine's verdict before onset/hangover
+
+  // Smoothed decision
+  bool speech;
+  int onsetRun;
+  int hangoverLeft;
+
+  // Stats (frame indices, -1 = none yet)
+  int frames;
+  int speechFrames;
+  int firstSpeechFrame;
+  int lastSpeechFrame;
+  int segmentStartFrame;      // Start of the current stretch of speech (after a pause)
+};
+
+// Band-pass one frame into energy and zero-crossing rate
+static void vadMeasure(Vad &v, const int16_t *frame, int n) {
+  float sum = 0;
+  int crossings = 0;
+  bool wasPositive = v.lpOut >= 0;
+  for (int i = 0; i < n; i++) {
+    float x = frame[i];
+    v.hpPrevOut = v.hpAlpha * (v.hpPrevOut + x - v.hpPrevIn);
+    v.hpPrevIn = x;
+    v.lpOut += v.lpAlpha * (v.hpPrevOut - v.lpOut);
+    sum += v.lpOut * v.lpOut;
+    bool positive = v.lpOut >= 0;
+    if (positive != wasPositive) crossings++;
+    wasPositive = positive;
+  }
+  v.energy = sum / n;
+  v.zcr = (float)crossings / n;
+}
+
+static bool vadSpectralFrame(Vad &v, const int16_t *frame, int n) {
+  vadMeasure(v, frame, n);
+  if (v.noiseFloor <= 0) v.noiseFloor = v.energy > VAD_MIN_ENERGY ? v.energy : VAD_MIN_ENERGY;
+
+  bool voiced = v.energy > v.noiseFloor * VAD_SNR_VOICED;
+  bool unvoiced = v.energy > v.noiseFloor * VAD_SNR_UNVOICED && v.zcr > VAD_ZCR_UNVOICED;
+  bool speechLike = v.energy > VAD_MIN_ENERGY && (voiced || unvoiced);
+
+  // The floor learns from frames that aren't speech (down fast, up slowly)
+  float rate = speechLike ? VAD_FLOOR_CREEP : (v.energy < v.noiseFloor ? VAD_FLOOR_FALL : VAD_FLOOR_RISE);
+  v.noiseFloor += rate * (v.energy - v.noiseFloor);
+  if (v.noiseFloor < VAD_MIN_ENERGY) v.noiseFloor = VAD_MIN_ENERGY;
+  return speechLike;
+}
+
+static bool vadRmsFrame(Vad &v, const int16_t *frame, int n) {
+  int64_t sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum += (int64_t)frame[i] * frame[i];
+  }
+  v.energy = (float)sum / n;
+  v.zcr = 0;
+  return sqrtf(v.energy) >= v.rmsThreshold;
+}
+
+const VadEngine vadSpectral = {"spectral", vadSpectralFrame};
+const VadEngine vadRms = {"rms", vadRmsFrame};
+
+void vadBegin(Vad &v, const VadEngine &engine, int sampleRate, int rmsThreshold) {
+  v.engine = &engine;
+  v.sampleRate = sampleRate;
+  v.frameSamples = sampleRate * VAD_FRAME_MS / 1000;
+  v.rmsThreshold = rmsThreshold;
+
+  float dt = 1.0f / sampleRate;
+  float hpRc = 1.0f / (2.0f * (float)M_PI * VAD_BAND_LOW_HZ);
+  float lpRc = 1.0f / (2.0f * (float)M_PI * VAD_BAND_HIGH_HZ);
+  v.hpAlpha = hpRc / (hpRc + dt);
+  v.lpAlpha = dt / (lpRc + dt);
+  v.hpPrevIn = v.hpPrevOut = v.lpOut = 0;
+  v.noiseFloor = 0;
+
+  v.energy = 0;
+  v.zcr = 0;
+  v.rawSpeech = false;
+  v.speech = false;
+  v.onsetRun = 0;
+  v.hangoverLeft = 0;
+  v.frames = 0;
+  v.speechFrames = 0;
+  v.firstSpeechFrame = -1;
+  v.lastSpeechFrame = -1;
+  v.segmentStartFrame = -1;
+}
+
+// One frame through the engine, onset and hangover
+static void vadFrame(Vad &v, const int16_t *frame) {
+  v.rawSpeech = v.engine->frame(v, frame, v.frameSamples);
+  v.onsetRun = v.rawSpeech ? v.onsetRun + 1 : 0;
+
+  if (v.onsetRun >= VAD_ONSET_FRAMES || (v.speech && v.rawSpeech)) {
+    if (!v.speech) {
+      v.speech = true;
+      // The onset frames were speech too
+      v.segmentStartFrame = v.frames - (VAD_ONSET_FRAMES - 1);
+      if (v.firstSpeechFrame < 0) v.firstSpeechFrame = v.segmentStartFrame;
+    }
+    v.hangoverLeft = VAD_HANGOVER_MS / VAD_FRAME_MS;
+    v.lastSpeechFrame = v.frames;
+  } else if (v.speech && --v.hangoverLeft <= 0) {
+    v.speech = false;
+  }
+  if (v.speech) v.speechFrames++;
+  v.frames++;
+}
+
+// Run the whole frames in samples[from, to); returns where the next frame starts
+int vadFeed(Vad &v, const int16_t *samples, int from, int to) {
+  while (to - from >= v.frameSamples) {
+    vadFrame(v, samples + from);
+    from += v.frameSamples;
+  }
+  return from;
+}
+
+// Time since the last speech-like frame (since the first frame if there was none)
+int vadSilenceMs(const Vad &v) {
+  return (v.frames - 1 - v.lastSpeechFrame) * VAD_FRAME_MS;
+}
+
+#endif // VAD_H
@@ -0,0 +1,191 @@
+#ifndef VOICE_GRAPH_H
+#define VOICE_GRAPH_H
+
+#include "task_graph.h"
+#include "chat_prefetch.h"
+
+// Dependencies: audio.h, stt_stream.h, chat_prefetch.h and api_functions.h
+// must be included before this file
+//
+// One spoken question as a task graph:
+//
+//   record (main) ──> transcribe (main) ──┬──> ask (main) ──> answer (main)
+//        │                                │
+//        └──> warm (core 0)     chat (core 0)
+//
+// "chat" (session, chat tree check, message IDs) starts with the recording,
+// "warm" reopens the LLM connection while the transcript is being fetched, and
+// "ask" only waits for what it needs. "answer" shows and speaks the result.
+// A question about a photo adds "capture" (main) before the recording and
+// "upload" (core 0) alongside it; without listen the fallback question is
+// asked about the photo right away.
+// The sketch draws the screen from onStage(), called as each main-loop stage
+// starts ("capture", "preview", "record", "transcribe", "ask", "answer").
+
+#define VOICE_PREVIEW_MS 1000           // Captured photo stays on screen this long
+
+struct VoiceQuestion {
+  bool listen;                    // Record and transcribe the question
+  bool image;                     // Capture and upload a photo to ask about
+  const char *fallbackQuestion;   // Asked without listen or if nothing was heard (nullptr = fail)
+  volatile bool *cancel;          // Stops at the next stage when set (nullptr = never)
+  String question;
+  String answer;
+  String fileId;                  // Uploaded photo
+  const char *error;              // Screen message when a stage failed
+  void (*onStage)(VoiceQuestion &q, const char *stage);
+};
+
+// Transcription results that are really error strings or noise
+bool voiceTranscriptOk(const String &question) {
+  return !(question.length() < 2 || question.startsWith("No ") ||
+           question.startsWith("Parse") || question.startsWith("Connection") ||
+           question.startsWith("Timeout"));
+}
+
+static bool voiceCancelled(VoiceQuestion &q) {
+  if (!q.cancel || !*q.cancel) return false;
+  q.error = "Cancelled";
+  return true;
+}
+
+// delay() that ends early on cancel; false if cancelled
+static bool voiceWait(VoiceQuestion &q, unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) {
+    if (voiceCancelled(q)) return false;
+    delay(10);
+  }
+  return true;
+}
+
+// Announce a main-loop stage; false if the question was cancelled
+static bool voiceStage(VoiceQuestion &q, const char *stage) {
+  if (voiceCancelled(q)) return false;
+  if (q.onStage) q.onStage(q, stage);
+  return true;
+}
+
+static bool voiceStageCapture(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (!voiceStage(q, "capture")) return false;
+  if (!captureImage()) {
+    q.error = "Camera error";
+    return false;
+  }
+  if (!voiceStage(q, "preview")) return false;
+  return voiceWait(q, VOICE_PREVIEW_MS);
+}
+
+static bool voiceStageUpload(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (voiceCancelled(q)) return false;
+  q.fileId = uploadLastCapturedImage();
+  if (q.fileId.length() == 0) {
+    q.error = "Upload failed";
+    return false;
+  }
+  Serial.printf("Image uploaded, file ID: %s\n", q.fileId.c_str());
+  return true;
+}
+
+static bool voiceStageRecord(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (!voiceStage(q, "record")) return false;
+  if (!recordAudio()) {
+    q.error = "Mic error";
+    return false;
+  }
+  if (voiceCancelled(q)) {
+    sttStreamDiscard();
+    return false;
+  }
+  Serial.printf("Free heap after recording: %d bytes\n", ESP.getFreeHeap());
+  return true;
+}
+
+static bool voiceStageChat(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (voiceCancelled(q)) return false;
+  chatPrefetchChat();
+  return true; // askGPT() retries the session itself
+}
+
+static bool voiceStageWarm(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (voiceCancelled(q)) return false;
+  chatPrefetchConnection();
+  return true;
+}
+
+static bool voiceStageTranscribe(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (!voiceStage(q, "transcribe")) return false;
+  q.question = transcribeAudio();
+  Serial.printf("Transcription: %s\n", q.question.c_str());
+  if (voiceTranscriptOk(q.question)) return true;
+
+  if (q.fallbackQuestion) {
+    Serial.println("Transcription failed, using default question");
+    q.question = q.fallbackQuestion;
+    return true;
+  }
+  Serial.println("Transcription failed or empty");
+  q.error = "Couldn't hear.\nTry again.";
+  return false;
+}
+
+static bool voiceStageAsk(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (!voiceStage(q, "ask")) return false;
+  q.answer = q.fileId.length() > 0 ? askGPTWithImage(q.question, q.fileId) : askGPT(q.question);
+  return true;
+}
+
+static bool voiceStageAnswer(void *ctx) {
+  VoiceQuestion &q = *(VoiceQuestion *)ctx;
+  if (!voiceStage(q, "answer")) return false;
+  if (USE_TTS && isLargeDevice) {
+    speakText(q.answer);
+  }
+  return true;
+}
+
+// Run the whole interaction; false if it stopped early (q.error says why)
+bool voiceQuestionRun(VoiceQuestion &q) {
+  q.error = nullptr;
+  bool prefetch = ENABLE_CHAT_PREFETCH && WiFi.status() == WL_CONNECTED;
+
+  TaskGraph g;
+  taskGraphInit(g, q.image ? "image question" : "voice question", &q);
+  uint32_t askDeps = 0;
+  uint32_t recordDeps = 0;
+  if (ENABLE_CAMERA && q.image) {
+    int capture = taskGraphAdd(g, "capture", voiceStageCapture, 0, false);
+    askDeps |= TASK_DEP(taskGraphAdd(g, "upload", voiceStageUpload, TASK_DEP(capture), true));
+    recordDeps = TASK_DEP(capture); // Photo first, then the question about it
+  }
+  if (q.listen) {
+    int record = taskGraphAdd(g, "record", voiceStageRecord, recordDeps, false);
+    askDeps |= TASK_DEP(taskGraphAdd(g, "transcribe", voiceStageTranscribe, TASK_DEP(record), false));
+    if (prefetch) taskGraphAdd(g, "warm", voiceStageWarm, TASK_DEP(record), true);
+  } else {
+    q.question = q.fallbackQuestion ? q.fallbackQuestion : "";
+  }
+  if (prefetch) {
+    askDeps |= TASK_DEP(taskGraphAdd(g, "chat", voiceStageChat, 0, true));
+  }
+  int ask = taskGraphAdd(g, "ask", voiceStageAsk, askDeps, false);
+  taskGraphAdd(g, "answer", voiceStageAnswer, TASK_DEP(ask), false);
+
+  // recordAudio() leaves the chat set-up to the graph
+  chatPrefetchByGraph = true;
+  bool ok = taskGraphRun(g);
+  chatPrefetchByGraph = false;
+
+  taskGraphReport(g);
+  if (!ok && !q.error) q.error = "Something went wrong";
+  return ok;
+}
+
+#endif // VOICE_GRAPH_H
@@ -165,12 +165,10 @@ bool captureImage() {
   
   Serial.println("\n========== CAPTURING IMAGE ==========");
   
-  // Free previous image if exists
-  if (lastCapturedImage) {
-    free(lastCapturedImage);
-    lastCapturedImage = nullptr;
-    lastCapturedImageSize = 0;
-  }
+  // Previous image is overwritten in the image arena
+  mediaArenaReset(imageArena);
+  lastCapturedImage = nullptr;
+  lastCapturedImageSize = 0;
   
   // Capture frame
   camera_fb_t* fb = esp_camera_fb_get();
@@ -183,15 +181,15 @@ bool captureImage() {
   Serial.printf("Image captured: %dx%d, %d bytes\n", fb->width, fb->height, fb->len);
   
   // Store the image data
-  lastCapturedImageSize = fb->len;
-  lastCapturedImage = (uint8_t*)malloc(lastCapturedImageSize);
+  lastCapturedImage = (uint8_t*)mediaArenaTake(imageArena, fb->len);
   if (!lastCapturedImage) {
-    Serial.println("Failed to allocate memory for image");
+    Serial.println("Image doesn't fit the image arena");
     esp_camera_fb_return(fb);
     Serial.println("=====================================\n");
     return false;
   }
   
+  lastCapturedImageSize = fb->len;
   memcpy(lastCapturedImage, fb->buf, lastCapturedImageSize);
   
   // Return the frame buffer
@@ -215,11 +213,9 @@ void displayCapturedImage() {
 
 // Cleanup camera resources
 void cleanupCamera() {
-  if (lastCapturedImage) {
-    free(lastCapturedImage);
-    lastCapturedImage = nullptr;
-    lastCapturedImageSize = 0;
-  }
+  mediaArenaReset(imageArena);
+  lastCapturedImage = nullptr;
+  lastCapturedImageSize = 0;
   
   if (cameraInitialized) {
     esp_camera_deinit();
@@ -3,31 +3,39 @@
 
 // Note: M5Unified.h must be included before this header in the main .ino file
 
+// Mic clean-up stages for AudioProfile::micPreprocess (mic_preprocess.h)
+#define MIC_DC 1                     // Remove DC offset
+#define MIC_HPF 2                    // High-pass (rumble, handling noise)
+#define MIC_AGC 4                    // Automatic gain control
+
 // Audio quality profiles
 struct AudioProfile {
   const char* name;
   int sampleRate;
   int recordSeconds;
   const char* quality;
+  int preRollMs;            // Audio kept from before the press (0 = none)
+  int micPreprocess;        // Clean-up stages (MIC_DC | MIC_HPF | MIC_AGC, 0 = raw)
 };
 
 // Profiles for M5StickC Plus2 (limited RAM ~120KB safe)
-static const AudioProfile STICK_PROFILES[] = {
-  {"Standard", 8000, 5, "Good"},      // 80KB - default
-  {"HQ Short", 16000, 3, "Excellent"} // 96KB - high quality
+static constexpr AudioProfile STICK_PROFILES[] = {
+  {"Standard", 8000, 5, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},      // 80KB + 8KB pre-roll - default
+  {"HQ Short", 16000, 3, "Excellent", 300, MIC_DC | MIC_HPF | MIC_AGC} // 96KB + 9.6KB pre-roll - high quality
 };
 
 // Profiles for Core2/CoreS3 (more RAM ~300KB+ safe)
-static const AudioProfile CORE_PROFILES[] = {
-  {"HQ", 16000, 5, "Excellent"},       // 160KB - high quality default (better STT)
-  {"Standard", 8000, 8, "Good"},       // 128KB - balanced
-  {"Long", 8000, 15, "Good"}           // 240KB - extended recording
+static constexpr AudioProfile CORE_PROFILES[] = {
+  {"HQ", 16000, 5, "Excellent", 500, MIC_DC | MIC_HPF | MIC_AGC},       // 160KB + 16KB pre-roll - high quality default (better STT)
+  {"Standard", 8000, 8, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},       // 128KB + 8KB pre-roll - balanced
+  {"Long", 8000, 15, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC}           // 240KB + 8KB pre-roll - extended recording
 };
 
 // Voice Activity Detection (VAD) settings - defined in main .ino
 // const int VAD_SILENCE_THRESHOLD = 500;
 // const float VAD_SILENCE_DURATION = 1.5;
 // const bool VAD_ENABLED = true;
+// const VadEngine *vadEngine = &vadSpectral;
 
 // UI Mode Configuration
 // Core2 has physical A/B/C buttons, so prefer those over touch UI
@@ -37,12 +45,68 @@ static const AudioProfile CORE_PROFILES[] = {
 // Hardware Features
 // Camera support (requires external camera module for Core2)
 #define ENABLE_CAMERA false          // Set to true if camera module is connected
+#define VISION_INLINE_IMAGE false    // Photo questions reference the uploaded file (common/assistant.h)
 
 // M5GO-Bottom2 LED support (10 RGB LEDs on GPIO 25)
 #define ENABLE_M5GO_LEDS true        // Enable M5GO-Bottom2 LED ring
 #define M5GO_DATA_PIN 25             // GPIO pin for M5GO LED data
 #define M5GO_NUM_LEDS 10             // Number of LEDs in M5GO-Bottom2
 
+// Network Features
+// Stream audio to the STT endpoint while recording (chunked transfer encoding)
+#define ENABLE_STT_STREAMING true    // Falls back to buffered upload on failure
+
+// Upload codec for the STT request, encoded per mic block while recording (audio_codec.h)
+#define STT_UPLOAD_CODEC UPLOAD_MULAW // 2:1 - UPLOAD_IMA_ADPCM (~4:1) or UPLOAD_PCM16
+
+// Leave silence out of the STT upload (audio_trim.h)
+#define ENABLE_SILENCE_TRIM true     // Only speech plus a short margin is uploaded
+#define ENABLE_PAUSE_TRIM true       // Long pauses inside a question are shortened too
+
+// Keep-alive connection pool shared by all HTTP requests
+#define HTTP_POOL_SIZE 3    // Keep-alive sockets (~40KB heap each while open) - answer stream,
+                            // sentence playing and the next sentence (ENABLE_TTS_PIPELINE)
+
+// Resume TLS sessions (cached in RTC memory) instead of a full handshake per connection
+#define ENABLE_TLS_RESUMPTION false  // Opt-in: true swaps WiFiClientSecure for the mbedTLS client in tls_session.h
+
+// Receive OpenWebUI completion events over Socket.IO instead of polling chat history
+#define ENABLE_OWUI_SOCKET true      // Falls back to polling if the socket can't be opened
+
+// Stream OpenAI Chat Completions / Responses answers (server-sent events)
+#define ENABLE_LLM_STREAMING true    // Answer is drawn while it is generated
+
+// Speak the answer sentence by sentence while the rest is still being synthesized
+#define ENABLE_TTS_PIPELINE true    // First sentence plays while later ones are fetched
+
+// Chat context sent to the LLM: newest turns within a byte budget (~4 bytes per token)
+#define CHAT_CONTEXT_BUDGET_BYTES 8192 // Older turns are replaced by a summary
+#define CHAT_CONTEXT_KEEP_TURNS 6      // Most recent questions kept verbatim
+#define ENABLE_CHAT_SUMMARY true     // Summarize dropped turns in the background
+
+// Save finished turns to OpenWebUI from a background worker (queued, retried)
+#define ENABLE_CHAT_PERSIST true     // false = save before the answer is shown
+
+// Create the chat session, message IDs and LLM connection while the user speaks
+#define ENABLE_CHAT_PREFETCH true    // Done on core 0 during recordAudio()
+
+// Keep the mic recording into a pre-roll ring while idle (length per AudioProfile)
+#define ENABLE_MIC_PREROLL true      // First syllable isn't lost if speech starts with the press
+
+// Mic clean-up (DC, high-pass, AGC) on each block, stages per AudioProfile (mic_preprocess.h)
+#define ENABLE_MIC_PREPROCESS true   // false = raw mic samples for every profile
+
+// Media buffers (recording, upload, replay, camera, chat tree) in PSRAM when present (mem_alloc.h)
+#define ENABLE_PSRAM_MEDIA true      // false = everything from internal RAM
+
+// Media arenas, allocated once in setup() and reused by every question (media_arena.h).
+// The audio budgets are checked against the profile tables at compile time.
+#define STICK_AUDIO_ARENA_BYTES 163840 // Recording + encoded upload, largest STICK_PROFILES entry
+#define CORE_AUDIO_ARENA_BYTES 393216  // Recording + encoded upload, largest CORE_PROFILES entry
+#define REPLAY_ARENA_BYTES 131072      // Last answer's MP3 - longer answers aren't kept for replay
+#define IMAGE_ARENA_BYTES 65536        // Camera JPEG (QVGA) - larger photos are refused
+#define BODY_ARENA_BYTES 131072        // JSON request bodies per question (a base64 photo fits)
+
 // Display dimensions - set dynamically in setup()
 extern int WIDTH;
 extern int HEIGHT;
@@ -57,8 +121,15 @@ extern const AudioProfile* deviceProfiles;
 extern int SAMPLE_RATE;
 extern int RECORD_SECONDS;
 extern int RECORD_SAMPLES;
+extern int PRE_ROLL_SAMPLES;
+extern int MIC_PREPROCESS;
 extern int16_t *audioBuffer;
 
+// Stops the pre-roll capture before audioBuffer is re-carved (mic_capture.h)
+void micCaptureDisarm();
+// Carves audioBuffer and the encoded upload for the profile (media_arena.h)
+bool audioArenaCarve();
+
 // Dynamic system prompt
 extern int currentMaxWords;
 extern String systemPrompt;
@@ -104,16 +175,18 @@ void applyAudioProfile(int profileIndex) {
   SAMPLE_RATE = profile.sampleRate;
   RECORD_SECONDS = profile.recordSeconds;
   RECORD_SAMPLES = SAMPLE_RATE * RECORD_SECONDS;
+  PRE_ROLL_SAMPLES = SAMPLE_RATE * profile.preRollMs / 1000;
+  MIC_PREPROCESS = profile.micPreprocess;
   currentProfileIndex = profileIndex;
   
-  // Free old buffer if exists (will reallocate on next recording)
-  if (audioBuffer != nullptr) {
-    free(audioBuffer);
-    audioBuffer = nullptr;
-  }
+  // Same audio arena, cut up for the new profile (no free/malloc)
+  micCaptureDisarm();
+  audioArenaCarve();
   
-  Serial.printf("Profile: %s (%dHz, %ds, %s)\n", 
-                profile.name, profile.sampleRate, profile.recordSeconds, profile.quality);
+  Serial.printf("Profile: %s (%dHz, %ds, %s, %dms pre-roll, mic%s%s%s)\n", 
+                profile.name, profile.sampleRate, profile.recordSeconds, profile.quality, profile.preRollMs,
+                profile.micPreprocess & MIC_DC ? " DC" : "", profile.micPreprocess & MIC_HPF ? " HPF" : "",
+                profile.micPreprocess & MIC_AGC ? " AGC" : (profile.micPreprocess ? "" : " raw"));
 }
 
 // Cycle to next profile
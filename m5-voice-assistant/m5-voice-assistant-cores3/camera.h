@@ -86,12 +86,10 @@ bool captureImage() {
   
   Serial.println("\n========== CAPTURING IMAGE ==========");
   
-  // Free previous image if exists
-  if (lastCapturedImage) {
-    free(lastCapturedImage);
-    lastCapturedImage = nullptr;
-    lastCapturedImageSize = 0;
-  }
+  // Previous image is overwritten in the image arena
+  mediaArenaReset(imageArena);
+  lastCapturedImage = nullptr;
+  lastCapturedImageSize = 0;
   
   // Capture frame using CoreS3.Camera
   if (!CoreS3.Camera.get()) {
@@ -128,16 +126,16 @@ bool captureImage() {
   Serial.printf("JPEG converted: %d bytes\n", jpgLen);
   
   // Store the JPEG data
-  lastCapturedImageSize = jpgLen;
-  lastCapturedImage = (uint8_t*)malloc(lastCapturedImageSize);
+  lastCapturedImage = (uint8_t*)mediaArenaTake(imageArena, jpgLen);
   if (!lastCapturedImage) {
-    Serial.println("Failed to allocate memory for JPEG");
+    Serial.println("JPEG doesn't fit the image arena");
     free(jpgBuf);
     CoreS3.Camera.free();
     Serial.println("=====================================\n");
     return false;
   }
   
+  lastCapturedImageSize = jpgLen;
   memcpy(lastCapturedImage, jpgBuf, lastCapturedImageSize);
   free(jpgBuf);
   
@@ -164,11 +162,9 @@ void displayCapturedImage() {
 
 // Cleanup camera resources
 void cleanupCamera() {
-  if (lastCapturedImage) {
-    free(lastCapturedImage);
-    lastCapturedImage = nullptr;
-    lastCapturedImageSize = 0;
-  }
+  mediaArenaReset(imageArena);
+  lastCapturedImage = nullptr;
+  lastCapturedImageSize = 0;
   
   // Note: M5CoreS3 library doesn't have explicit deinit
   cameraInitialized = false;
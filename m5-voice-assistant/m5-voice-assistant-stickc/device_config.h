@@ -3,25 +3,32 @@
 
 // Note: M5Unified.h must be included before this header in the main .ino file
 
+// Mic clean-up stages for AudioProfile::micPreprocess (mic_preprocess.h)
+#define MIC_DC 1                     // Remove DC offset
+#define MIC_HPF 2                    // High-pass (rumble, handling noise)
+#define MIC_AGC 4                    // Automatic gain control
+
 // Audio quality profiles
 struct AudioProfile {
   const char* name;
   int sampleRate;
   int recordSeconds;
   const char* quality;
+  int preRollMs;            // Audio kept from before the press (0 = none)
+  int micPreprocess;        // Clean-up stages (MIC_DC | MIC_HPF | MIC_AGC, 0 = raw)
 };
 
 // Profiles for M5StickC Plus2 (limited RAM ~120KB safe)
-static const AudioProfile STICK_PROFILES[] = {
-  {"Standard", 8000, 5, "Good"},      // 80KB - default
-  {"HQ Short", 16000, 3, "Excellent"} // 96KB - high quality
+static constexpr AudioProfile STICK_PROFILES[] = {
+  {"Standard", 8000, 5, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},      // 80KB + 8KB pre-roll - default
+  {"HQ Short", 16000, 3, "Excellent", 300, MIC_DC | MIC_HPF | MIC_AGC} // 96KB + 9.6KB pre-roll - high quality
 };
 
 // Profiles for Core2/CoreS3 (more RAM ~300KB+ safe)
-static const AudioProfile CORE_PROFILES[] = {
-  {"Standard", 8000, 8, "Good"},       // 128KB - balanced default
-  {"Long", 8000, 15, "Good"},           // 240KB - extended recording
-  {"HQ Short", 16000, 5, "Excellent"} // 160KB - high quality, quick
+static constexpr AudioProfile CORE_PROFILES[] = {
+  {"Standard", 8000, 8, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},       // 128KB + 8KB pre-roll - balanced default
+  {"Long", 8000, 15, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},           // 240KB + 8KB pre-roll - extended recording
+  {"HQ Short", 16000, 5, "Excellent", 500, MIC_DC | MIC_HPF | MIC_AGC} // 160KB + 16KB pre-roll - high quality, quick
 
 };
 
@@ -29,6 +36,7 @@ static const AudioProfile CORE_PROFILES[] = {
 // const int VAD_SILENCE_THRESHOLD = 500;
 // const float VAD_SILENCE_DURATION = 1.5;
 // const bool VAD_ENABLED = true;
+// const VadEngine *vadEngine = &vadSpectral;
 
 // UI Mode Configuration
 // StickC Plus2 has physical button A only, no touch screen or camera
@@ -38,12 +46,67 @@ static const AudioProfile CORE_PROFILES[] = {
 // Hardware Features
 // Camera support (StickC has no camera)
 #define ENABLE_CAMERA false          // No camera on StickC Plus2
+#define VISION_INLINE_IMAGE false    // No camera, no photo questions
 
 // M5GO-Bottom2 LED support (optional accessory for StickC)
 #define ENABLE_M5GO_LEDS false       // Set to true if M5GO-Bottom2 is connected
 #define M5GO_DATA_PIN 25             // GPIO pin for M5GO LED data
 #define M5GO_NUM_LEDS 10             // Number of LEDs in M5GO-Bottom2
 
+// Network Features
+// Stream audio to the STT endpoint while recording (chunked transfer encoding)
+#define ENABLE_STT_STREAMING true    // Falls back to buffered upload on failure
+
+// Upload codec for the STT request, encoded per mic block while recording (audio_codec.h)
+#define STT_UPLOAD_CODEC UPLOAD_IMA_ADPCM // ~4:1, small buffer - UPLOAD_MULAW or UPLOAD_PCM16
+
+// Leave silence out of the STT upload (audio_trim.h)
+#define ENABLE_SILENCE_TRIM true     // Only speech plus a short margin is uploaded
+#define ENABLE_PAUSE_TRIM true       // Long pauses inside a question are shortened too
+
+// Keep-alive connection pool shared by all HTTP requests
+#define HTTP_POOL_SIZE 1    // One TLS socket (~40KB heap each) - RAM is tight
+
+// Resume TLS sessions (cached in RTC memory) instead of a full handshake per connection
+#define ENABLE_TLS_RESUMPTION false  // Opt-in: true swaps WiFiClientSecure for the mbedTLS client in tls_session.h
+
+// Receive OpenWebUI completion events over Socket.IO instead of polling chat history
+#define ENABLE_OWUI_SOCKET false  // Second TLS socket (~40KB) - enable on Plus2 (PSRAM)
+
+// Stream OpenAI Chat Completions / Responses answers (server-sent events)
+#define ENABLE_LLM_STREAMING true    // Answer is drawn while it is generated
+
+// Speak the answer sentence by sentence while the rest is still being synthesized
+#define ENABLE_TTS_PIPELINE false   // No speaker on StickC Plus2
+
+// Chat context sent to the LLM: newest turns within a byte budget (~4 bytes per token)
+#define CHAT_CONTEXT_BUDGET_BYTES 4096 // Older turns are replaced by a summary
+#define CHAT_CONTEXT_KEEP_TURNS 4      // Most recent questions kept verbatim
+#define ENABLE_CHAT_SUMMARY true     // Summarize dropped turns in the background
+
+// Save finished turns to OpenWebUI from a background worker (queued, retried)
+#define ENABLE_CHAT_PERSIST true     // false = save before the answer is shown
+
+// Create the chat session, message IDs and LLM connection while the user speaks
+#define ENABLE_CHAT_PREFETCH true    // Done on core 0 during recordAudio()
+
+// Keep the mic recording into a pre-roll ring while idle (length per AudioProfile)
+#define ENABLE_MIC_PREROLL true      // First syllable isn't lost if speech starts with the press
+
+// Mic clean-up (DC, high-pass, AGC) on each block, stages per AudioProfile (mic_preprocess.h)
+#define ENABLE_MIC_PREPROCESS true   // false = raw mic samples for every profile
+
+// Media buffers (recording, upload, replay, camera, chat tree) in PSRAM when present (mem_alloc.h)
+#define ENABLE_PSRAM_MEDIA true      // false = everything from internal RAM
+
+// Media arenas, allocated once in setup() and reused by every question (media_arena.h).
+// The audio budgets are checked against the profile tables at compile time.
+#define STICK_AUDIO_ARENA_BYTES 139264 // Recording + encoded upload, largest STICK_PROFILES entry
+#define CORE_AUDIO_ARENA_BYTES 327680  // Recording + encoded upload, largest CORE_PROFILES entry
+#define REPLAY_ARENA_BYTES 131072      // Last answer's MP3 - longer answers aren't kept for replay
+#define IMAGE_ARENA_BYTES 0            // No camera
+#define BODY_ARENA_BYTES 16384         // JSON request bodies per question
+
 // Display dimensions - set dynamically in setup()
 extern int WIDTH;
 extern int HEIGHT;
@@ -58,8 +121,15 @@ extern const AudioProfile* deviceProfiles;
 extern int SAMPLE_RATE;
 extern int RECORD_SECONDS;
 extern int RECORD_SAMPLES;
+extern int PRE_ROLL_SAMPLES;
+extern int MIC_PREPROCESS;
 extern int16_t *audioBuffer;
 
+// Stops the pre-roll capture before audioBuffer is re-carved (mic_capture.h)
+void micCaptureDisarm();
+// Carves audioBuffer and the encoded upload for the profile (media_arena.h)
+bool audioArenaCarve();
+
 // Dynamic system prompt
 extern int currentMaxWords;
 extern String systemPrompt;
@@ -105,16 +175,18 @@ void applyAudioProfile(int profileIndex) {
   SAMPLE_RATE = profile.sampleRate;
   RECORD_SECONDS = profile.recordSeconds;
   RECORD_SAMPLES = SAMPLE_RATE * RECORD_SECONDS;
+  PRE_ROLL_SAMPLES = SAMPLE_RATE * profile.preRollMs / 1000;
+  MIC_PREPROCESS = profile.micPreprocess;
   currentProfileIndex = profileIndex;
   
-  // Free old buffer if exists (will reallocate on next recording)
-  if (audioBuffer != nullptr) {
-    free(audioBuffer);
-    audioBuffer = nullptr;
-  }
+  // Same audio arena, cut up for the new profile (no free/malloc)
+  micCaptureDisarm();
+  audioArenaCarve();
   
-  Serial.printf("Profile: %s (%dHz, %ds, %s)\n", 
-                profile.name, profile.sampleRate, profile.recordSeconds, profile.quality);
+  Serial.printf("Profile: %s (%dHz, %ds, %s, %dms pre-roll, mic%s%s%s)\n", 
+                profile.name, profile.sampleRate, profile.recordSeconds, profile.quality, profile.preRollMs,
+                profile.micPreprocess & MIC_DC ? " DC" : "", profile.micPreprocess & MIC_HPF ? " HPF" : "",
+                profile.micPreprocess & MIC_AGC ? " AGC" : (profile.micPreprocess ? "" : " raw"));
 }
 
 // Cycle to next profile
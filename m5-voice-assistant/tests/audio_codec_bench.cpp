@@ -0,0 +1,91 @@
+// Benchmark: the upload codecs of common/audio_codec.h on a speech-band
+// signal, encoded in mic-block ranges as recordAudio() appends them. Reports
+// encode cost per second of audio, bytes, round-trip SNR, and the upload time
+// of a 5s and a 15s recording at a few WiFi throughputs.
+//
+//   ./audio_codec_bench [seconds]
+//
+// Encode times are for this machine; on the device the same figure is in the
+// "[CODEC] ... encode X ms per second of audio" log line after each recording.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+#include "codec_reference.h"
+#include "test_signal.h"
+
+#include <chrono>
+
+#define BENCH_BLOCK_SAMPLES 512                // One MIC_CAPTURE_BLOCK_MS block at 16kHz
+
+static const float LINK_KBPS[] = {250, 1000, 4000};    // Weak, fair and good WiFi throughput
+static const int PROFILE_SECONDS[] = {5, 15};          // HQ and Long recordings
+
+struct CodecResult {
+  UploadCodec codec;
+  const char *name;
+  double usPerSecond;
+  int bytes;
+  double snr;
+};
+
+static CodecResult run(UploadCodec codec, std::vector<int16_t> &pcm, int iterations) {
+  std::vector<uint8_t> encoded(audioCodecCapacity(codec, pcm.size()));
+  testUploadCodec = codec;
+  audioBuffer = pcm.data();
+  audioCodecBuffer = encoded.data();
+  int n = pcm.size();
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < iterations; it++) {
+    audioCodecBegin();
+    for (int pos = 0; pos < n; pos += BENCH_BLOCK_SAMPLES) audioCodecAppend(pos, std::min(pos + BENCH_BLOCK_SAMPLES, n));
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  audioCodecFinish(n);                       // Tail of the last run only (and its log line)
+
+  CodecResult r = {codec, audioCodecName(), us / iterations / ((double)n / SAMPLE_RATE), audioCodecBytes, 0};
+  std::vector<int16_t> back(pcm);
+  if (codec == UPLOAD_MULAW) {
+    for (int i = 0; i < n; i++) back[i] = mulawDecode(encoded[i]);
+  } else if (codec == UPLOAD_IMA_ADPCM) {
+    back = imaDecode(encoded.data(), audioCodecBytes);
+    back.resize(n);
+  }
+  r.snr = snrDb(pcm, back);
+  return r;
+}
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 5;
+  std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE * seconds, 6000);
+  printf("%ds of speech-band audio at %dHz, appended in %d-sample blocks\n\n", seconds, SAMPLE_RATE, BENCH_BLOCK_SAMPLES);
+
+  CodecResult results[3];
+  UploadCodec codecs[] = {UPLOAD_PCM16, UPLOAD_MULAW, UPLOAD_IMA_ADPCM};
+  for (int c = 0; c < 3; c++) results[c] = run(codecs[c], pcm, 200);
+
+  printf("\n%-10s %12s %10s %7s %8s\n", "codec", "encode us/s", "bytes", "ratio", "SNR");
+  for (CodecResult &r : results) {
+    char snr[16] = "exact";
+    if (r.codec != UPLOAD_PCM16) snprintf(snr, sizeof(snr), "%.1fdB", r.snr);
+    printf("%-10s %12.1f %10d %6.2f:1 %8s\n", r.name, r.usPerSecond, r.bytes,
+           (double)results[0].bytes / r.bytes, snr);
+  }
+
+  // Upload time is the body over the link; the WAV header and multipart framing add ~250 bytes
+  printf("\nUpload time (saved against PCM16):\n");
+  for (int profile : PROFILE_SECONDS) {
+    for (float kbps : LINK_KBPS) {
+      printf("  %2ds at %4.0f kbit/s:", profile, kbps);
+      double pcmMs = results[0].bytes * (double)profile / seconds * 8 / kbps;
+      for (CodecResult &r : results) {
+        double ms = r.bytes * (double)profile / seconds * 8 / kbps;
+        printf("  %s %6.0fms", r.name, ms);
+        if (r.codec != UPLOAD_PCM16) printf(" (-%.0fms)", pcmMs - ms);
+      }
+      printf("\n");
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,244 @@
+// Upload codecs (common/audio_codec.h): mu-law and IMA ADPCM decoded again
+// with reference decoders and held to error bounds, the same bytes however
+// the recording is split into ranges, and the WAV headers ffmpeg reads.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+#include "codec_reference.h"
+#include "test.h"
+#include "test_signal.h"
+
+static std::vector<int16_t> source;
+static std::vector<uint8_t> encoded;
+
+// Encode pcm with the given codec, appended in ranges of rangeSamples
+static void encode(UploadCodec codec, const std::vector<int16_t> &pcm, int rangeSamples) {
+  testUploadCodec = codec;
+  source = pcm;
+  audioBuffer = source.data();
+  encoded.assign(audioCodecCapacity(codec, pcm.size()), 0);
+  audioCodecBuffer = encoded.data();
+  audioCodecBegin();
+  int n = pcm.size();
+  for (int pos = 0; pos < n; pos += rangeSamples) audioCodecAppend(pos, std::min(pos + rangeSamples, n));
+  audioCodecFinish(n);
+}
+
+TEST(mulaw_error_is_bounded_by_the_segment_step) {
+  int worst = 0;
+  for (int x = -32768; x <= 32767; x++) {
+    int magnitude = std::min(abs(x), 32635);          // The encoder clips here
+    int y = mulawDecode(mulawEncode(x));
+    // Half a quantization step: steps double with each segment (2^(exponent+3))
+    int bound = (magnitude + 0x84) / 32 + 1;
+    int error = abs(y - (x < 0 ? -magnitude : magnitude));
+    if (error > bound && worst++ < 5) TEST_FAIL("%d -> %d, error %d > %d", x, y, error, bound);
+  }
+  CHECK_EQ(worst, 0);
+  CHECK_EQ((int)mulawEncode(0), 0xFF);
+  CHECK_EQ(mulawDecode(mulawEncode(32767)), 32124);   // G.711's largest value
+  CHECK_EQ(mulawDecode(mulawEncode(-32768)), -32124);
+
+  // Monotonic: a louder sample never decodes quieter
+  int previous = -32768;
+  for (int x = -32768; x <= 32767; x += 7) {
+    int y = mulawDecode(mulawEncode(x));
+    if (y < previous) {
+      TEST_FAIL("%d decodes to %d, below %d", x, y, previous);
+      break;
+    }
+    previous = y;
+  }
+}
+
+TEST(mulaw_round_trip_keeps_the_same_snr_at_any_level) {
+  for (float level : {500.0f, 4000.0f, 30000.0f}) {
+    std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE, level);
+    encode(UPLOAD_MULAW, pcm, 512);
+    CHECK_EQ(audioCodecBytes, (int)pcm.size());
+    std::vector<int16_t> back(pcm.size());
+    for (size_t i = 0; i < pcm.size(); i++) back[i] = mulawDecode(encoded[i]);
+    double snr = snrDb(pcm, back);
+    if (snr < 33) TEST_FAIL("level %.0f: SNR %.1fdB", level, snr);
+  }
+}
+
+TEST(adpcm_round_trip_tracks_the_signal) {
+  struct Case {
+    const char *name;
+    std::vector<int16_t> pcm;
+    double minSnr;
+  } cases[] = {
+    {"tone", testTone(SAMPLE_RATE, 440, 8000, SAMPLE_RATE), 30},
+    {"voice", testVoice(SAMPLE_RATE, SAMPLE_RATE * 2, 6000), 20},
+    {"quiet voice", testVoice(SAMPLE_RATE, SAMPLE_RATE * 2, 300), 20},
+  };
+  for (Case &c : cases) {
+    encode(UPLOAD_IMA_ADPCM, c.pcm, 512);
+    int blocks = (c.pcm.size() + IMA_ADPCM_BLOCK_SAMPLES - 1) / IMA_ADPCM_BLOCK_SAMPLES;
+    CHECK_EQ(audioCodecBytes, blocks * IMA_ADPCM_BLOCK_BYTES);
+    CHECK_EQ(audioCodecSamples, (int)c.pcm.size());
+    std::vector<int16_t> back = imaDecode(encoded.data(), audioCodecBytes);
+    CHECK_EQ(back.size(), (size_t)blocks * IMA_ADPCM_BLOCK_SAMPLES);
+    back.resize(c.pcm.size());
+    double snr = snrDb(c.pcm, back);
+    if (snr < c.minSnr) TEST_FAIL("%s: SNR %.1fdB, expected %.0fdB", c.name, snr, c.minSnr);
+
+    // Each block starts from an exact sample
+    for (size_t i = 0; i < c.pcm.size(); i += IMA_ADPCM_BLOCK_SAMPLES) CHECK_EQ(back[i], c.pcm[i]);
+  }
+}
+
+TEST(adpcm_recovers_from_a_step) {
+  // Silence, then full scale: the step size has to catch up within a few ms
+  std::vector<int16_t> pcm(SAMPLE_RATE / 2, 0);
+  std::vector<int16_t> loud = testTone(SAMPLE_RATE, 300, 30000, SAMPLE_RATE / 2);
+  pcm.insert(pcm.end(), loud.begin(), loud.end());
+  encode(UPLOAD_IMA_ADPCM, pcm, 512);
+  std::vector<int16_t> back = imaDecode(encoded.data(), audioCodecBytes);
+  int settled = SAMPLE_RATE / 2 + SAMPLE_RATE / 200;   // 5ms after the step
+  int worst = 0;
+  for (size_t i = settled; i < pcm.size(); i++) worst = std::max(worst, abs(back[i] - pcm[i]));
+  CHECK(worst < 2000);
+  CHECK(std::all_of(back.begin(), back.begin() + SAMPLE_RATE / 2, [](int16_t s) { return s == 0; }));
+}
+
+TEST(ranges_of_any_size_give_the_same_bytes) {
+  std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE + 123, 5000);
+  for (UploadCodec codec : {UPLOAD_MULAW, UPLOAD_IMA_ADPCM}) {
+    encode(codec, pcm, pcm.size());
+    std::vector<uint8_t> whole(encoded.begin(), encoded.begin() + audioCodecBytes);
+    for (int range : {1, 7, 504, 505, 506, 512, 1600}) {
+      encode(codec, pcm, range);
+      if (std::vector<uint8_t>(encoded.begin(), encoded.begin() + audioCodecBytes) != whole) {
+        TEST_FAIL("%s: ranges of %d differ", audioCodecName(), range);
+      }
+    }
+  }
+
+  // ADPCM only hands out whole blocks until the end
+  testUploadCodec = UPLOAD_IMA_ADPCM;
+  audioCodecBegin();
+  CHECK_EQ(audioCodecAppend(0, IMA_ADPCM_BLOCK_SAMPLES - 1), 0);
+  CHECK_EQ(audioCodecAppend(IMA_ADPCM_BLOCK_SAMPLES - 1, IMA_ADPCM_BLOCK_SAMPLES + 10), IMA_ADPCM_BLOCK_BYTES);
+  CHECK_EQ(audioCodecFinish(IMA_ADPCM_BLOCK_SAMPLES + 10), 2 * IMA_ADPCM_BLOCK_BYTES);
+  // The short final block is padded with its last sample
+  std::vector<int16_t> back = imaDecode(encoded.data(), audioCodecBytes);
+  CHECK_EQ(back[IMA_ADPCM_BLOCK_SAMPLES], pcm[IMA_ADPCM_BLOCK_SAMPLES]);
+  CHECK(abs(back.back() - pcm[IMA_ADPCM_BLOCK_SAMPLES + 9]) < 600);
+}
+
+TEST(skipped_ranges_are_left_out) {
+  std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE, 5000);
+  encode(UPLOAD_MULAW, pcm, pcm.size());
+  std::vector<uint8_t> whole(encoded.begin(), encoded.end());
+
+  audioCodecBegin();
+  audioCodecAppend(0, 1000);
+  audioCodecAppend(5000, 6000);                      // audio_trim.h left out 1000-5000
+  CHECK_EQ(audioCodecFinish(6000), 2000);
+  CHECK_EQ(audioCodecSamples, 2000);
+  CHECK(std::equal(encoded.begin(), encoded.begin() + 1000, whole.begin()));
+  CHECK(std::equal(encoded.begin() + 1000, encoded.begin() + 2000, whole.begin() + 5000));
+
+  // PCM16 sends audioBuffer itself: one range, from its start
+  testUploadCodec = UPLOAD_PCM16;
+  audioCodecBegin();
+  audioCodecAppend(800, 1600);
+  CHECK_EQ(audioCodecAppend(1600, 3200), 2400 * 2);
+  CHECK(audioCodecData() == (const uint8_t *)(audioBuffer + 800));
+  CHECK(!audioCodecCanSkip());
+}
+
+TEST(no_encoded_buffer_falls_back_to_pcm) {
+  testUploadCodec = UPLOAD_IMA_ADPCM;
+  audioCodecBuffer = nullptr;
+  audioCodecBegin();
+  CHECK_EQ(std::string(audioCodecName()), std::string("pcm16"));
+  CHECK_EQ(audioCodecAppend(0, 100), 200);
+}
+
+// Fields of a WAV header as ffmpeg reads them
+struct WavInfo {
+  int riffSize, format, channels, rate, byteRate, blockAlign, bits, samplesPerBlock, fact, dataSize, dataAt;
+};
+
+static WavInfo parseHeader(const uint8_t *h, int len) {
+  auto le16 = [&](int at) { return h[at] | h[at + 1] << 8; };
+  auto le32 = [&](int at) { return (int)((uint32_t)le16(at) | (uint32_t)le16(at + 2) << 16); };
+  WavInfo w = {};
+  w.riffSize = le32(4);
+  w.fact = -1;
+  for (int pos = 12; pos + 8 <= len;) {
+    int size = le32(pos + 4);
+    if (!memcmp(h + pos, "fmt ", 4)) {
+      w.format = le16(pos + 8);
+      w.channels = le16(pos + 10);
+      w.rate = le32(pos + 12);
+      w.byteRate = le32(pos + 16);
+      w.blockAlign = le16(pos + 20);
+      w.bits = le16(pos + 22);
+      if (size >= 20) w.samplesPerBlock = le16(pos + 26);
+    } else if (!memcmp(h + pos, "fact", 4)) {
+      w.fact = le32(pos + 8);
+    } else if (!memcmp(h + pos, "data", 4)) {
+      w.dataSize = size;
+      w.dataAt = pos + 8;
+      break;
+    }
+    pos += 8 + size;
+  }
+  return w;
+}
+
+TEST(wav_headers_describe_the_data) {
+  std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE, 5000);
+  uint8_t header[AUDIO_CODEC_HEADER_MAX];
+
+  encode(UPLOAD_MULAW, pcm, 512);
+  int len = audioCodecHeader(header, audioCodecBytes);
+  WavInfo w = parseHeader(header, len);
+  CHECK_EQ(w.format, 7);
+  CHECK_EQ(w.channels, 1);
+  CHECK_EQ(w.rate, SAMPLE_RATE);
+  CHECK_EQ(w.bits, 8);
+  CHECK_EQ(w.byteRate, SAMPLE_RATE);
+  CHECK_EQ(w.fact, SAMPLE_RATE);
+  CHECK_EQ(w.dataSize, audioCodecBytes);
+  CHECK_EQ(w.dataAt, len);
+  CHECK_EQ(w.riffSize, len - 8 + audioCodecBytes);
+
+  encode(UPLOAD_IMA_ADPCM, pcm, 512);
+  len = audioCodecHeader(header, audioCodecBytes);
+  CHECK(len <= AUDIO_CODEC_HEADER_MAX);
+  w = parseHeader(header, len);
+  CHECK_EQ(w.format, 0x11);
+  CHECK_EQ(w.bits, 4);
+  CHECK_EQ(w.blockAlign, IMA_ADPCM_BLOCK_BYTES);
+  CHECK_EQ(w.samplesPerBlock, IMA_ADPCM_BLOCK_SAMPLES);
+  CHECK_EQ(w.byteRate, SAMPLE_RATE * IMA_ADPCM_BLOCK_BYTES / IMA_ADPCM_BLOCK_SAMPLES);
+  CHECK_EQ(w.fact, SAMPLE_RATE);
+  CHECK_EQ(w.dataSize, audioCodecBytes);
+  CHECK_EQ(w.dataAt, len);
+
+  // Streaming: lengths unknown
+  len = audioCodecHeader(header, -1);
+  w = parseHeader(header, len);
+  CHECK_EQ(w.riffSize, -1);
+  CHECK_EQ(w.fact, 0);
+  CHECK_EQ(w.dataSize, -1);
+
+  testUploadCodec = UPLOAD_PCM16;
+  audioCodecBegin();
+  audioCodecAppend(0, pcm.size());
+  len = audioCodecHeader(header, pcm.size() * 2);
+  w = parseHeader(header, len);
+  CHECK_EQ(len, 44);
+  CHECK_EQ(w.format, 1);
+  CHECK_EQ(w.bits, 16);
+  CHECK_EQ(w.fact, -1);
+}
+
+TEST_MAIN()
@@ -0,0 +1,117 @@
+// Silence trimming (common/audio_trim.h): a recording fed block by block
+// through the VAD and the trimmer the way recordAudio() does, checking which
+// part of it reaches the encoder and when.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "vad_replay.h"
+#include "../common/audio_codec.h"
+#include "../common/audio_trim.h"
+
+#include "test.h"
+
+static const int BLOCK = 512;                  // MIC_CAPTURE_BLOCK_MS at 16kHz
+
+struct TrimRun {
+  int uploaded;          // Samples encoded
+  int bytesBeforeSpeech; // Released before the VAD heard anything
+  int firstSample;       // Recording sample the upload starts with
+};
+
+static std::vector<int16_t> recording;
+static std::vector<uint8_t> encoded;
+
+static int ms(int samples) { return (int)((int64_t)samples * 1000 / SAMPLE_RATE); }
+
+// Where recording[sample..] starts in a mu-law upload, -1 if it isn't there
+static int uploadIndexOf(int sample) {
+  for (int at = 0; at + 64 <= audioCodecBytes; at++) {
+    bool match = true;
+    for (int k = 0; k < 64 && match; k++) match = mulawEncode(recording[sample + k]) == encoded[at + k];
+    if (match) return at;
+  }
+  return -1;
+}
+
+static TrimRun record(UploadCodec codec, const SpeechSynth &s) {
+  testUploadCodec = codec;
+  recording = s.pcm();
+  audioBuffer = recording.data();
+  int n = recording.size();
+  encoded.assign(audioCodecCapacity(codec, n), 0);
+  audioCodecBuffer = encoded.data();
+  audioCodecBegin();
+
+  TrimRun r = {0, 0, -1};
+  Vad vad;
+  vadBegin(vad, vadSpectral, SAMPLE_RATE, 500);
+  int heard = 0;
+  for (int recorded = BLOCK; recorded <= n; recorded += BLOCK) {
+    heard = vadFeed(vad, recording.data(), heard, recorded);
+    int bytes = audioTrimPush(vad, heard);
+    if (vad.firstSpeechFrame < 0) r.bytesBeforeSpeech = bytes;
+  }
+  r.uploaded = audioTrimFinish(vad, n);
+
+  // mu-law is one byte per sample: find where the upload starts
+  if (codec == UPLOAD_MULAW) {
+    for (int i = 0; i + 64 <= n && r.firstSample < 0; i++) {
+      bool match = true;
+      for (int k = 0; k < 64 && match; k++) match = mulawEncode(recording[i + k]) == encoded[k];
+      if (match) r.firstSample = i;
+    }
+  }
+  return r;
+}
+
+TEST(silence_before_and_after_the_speech_is_left_out) {
+  SpeechSynth s(SAMPLE_RATE, 4000, 1);
+  s.noise(30);
+  s.tone(500, 3000, 1000, 2000);
+  TrimRun r = record(UPLOAD_MULAW, s);
+
+  CHECK_EQ(r.bytesBeforeSpeech, 0);
+  // Speech plus TRIM_MARGIN_MS each side, give or take the onset and a frame
+  int expected = 1000 + 2 * TRIM_MARGIN_MS;
+  if (abs(ms(r.uploaded) - expected) > 2 * VAD_FRAME_MS) TEST_FAIL("uploaded %dms, expected %dms", ms(r.uploaded), expected);
+  CHECK(abs(ms(r.firstSample) - (1000 - TRIM_MARGIN_MS)) <= 2 * VAD_FRAME_MS);
+  CHECK_EQ(audioCodecBytes, r.uploaded);
+}
+
+TEST(long_pause_is_cut_to_the_pause_length) {
+  SpeechSynth s(SAMPLE_RATE, 4500, 2);
+  s.noise(30);
+  s.tone(500, 3000, 500, 1000);
+  s.tone(500, 3000, 2500, 3000);
+  TrimRun r = record(UPLOAD_MULAW, s);
+
+  int expected = 500 + TRIM_PAUSE_MS + 500 + 2 * TRIM_MARGIN_MS;
+  if (abs(ms(r.uploaded) - expected) > 3 * VAD_FRAME_MS) TEST_FAIL("uploaded %dms, expected %dms", ms(r.uploaded), expected);
+
+  // The second word follows the shortened pause
+  int at = uploadIndexOf(2500 * SAMPLE_RATE / 1000);
+  CHECK(at >= 0);
+  CHECK(abs(ms(at) - (TRIM_MARGIN_MS + 500 + TRIM_PAUSE_MS)) <= 3 * VAD_FRAME_MS);
+}
+
+TEST(pcm_keeps_the_pauses) {
+  SpeechSynth s(SAMPLE_RATE, 4500, 2);
+  s.noise(30);
+  s.tone(500, 3000, 500, 1000);
+  s.tone(500, 3000, 2500, 3000);
+  TrimRun r = record(UPLOAD_PCM16, s);
+
+  int expected = 2500 + 2 * TRIM_MARGIN_MS;
+  if (abs(ms(r.uploaded) - expected) > 3 * VAD_FRAME_MS) TEST_FAIL("uploaded %dms, expected %dms", ms(r.uploaded), expected);
+}
+
+TEST(recording_without_speech_is_sent_whole) {
+  SpeechSynth s(SAMPLE_RATE, 2000, 3);
+  s.noise(30);
+  TrimRun r = record(UPLOAD_MULAW, s);
+  CHECK_EQ(r.bytesBeforeSpeech, 0);
+  CHECK_EQ(r.uploaded, (int)recording.size());
+  CHECK_EQ(r.firstSample, 0);
+}
+
+TEST_MAIN()
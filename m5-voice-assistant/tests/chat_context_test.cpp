@@ -0,0 +1,187 @@
+// Context budget (common/chat_context.h): which turns of the local chat tree
+// are sent, where the system prompt goes, and the rolling summary requested
+// from a mock OpenWebUI and used in place of the older turns.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+#include "../common/str_builder.h"
+#include "../common/http_pool.h"
+#include "../common/json_stream.h"
+#include "../common/chat_history.h"
+#include "../common/chat_context.h"
+
+#include "mock_owui.h"
+#include "test.h"
+
+static const char *SUMMARY_REPLY = "{\"choices\":[{\"message\":{\"role\":\"assistant\","
+                                   "\"content\":\" They asked about soup. \"}}]}";
+
+// Questions 0..turns-1 with their answers, each answer answerBytes long or so
+static void addTurns(int turns, int answerBytes = 0) {
+  String parent = "";
+  for (int t = 0; t < turns; t++) {
+    String answer = String("Answer ") + t;
+    while ((int)answer.length() < answerBytes) answer += " and more";
+    chatTreeAdd(String("u") + t, parent, "user", String("Question ") + t, "");
+    chatTreeAdd(String("a") + t, String("u") + t, "assistant", answer, "");
+    parent = String("a") + t;
+  }
+}
+
+static void askQuestion(int t, const String &text = "") {
+  chatTreeAdd(String("u") + t, String("a") + (t - 1), "user", text.length() ? text : String("Question ") + t, "");
+}
+
+// The messages array as askGPT() writes it into the request body
+static JsonValues buildContext(const String &suffix = "") {
+  ChatContextWindow window = chatContextWindow();
+  return parseJson(strBuildString([&](StrBuilder &b) {
+    b.add("[");
+    chatContextWrite(b, window, suffix);
+    b.add("]");
+  }));
+}
+
+static bool waitForSummary() {
+  unsigned long start = millis();
+  while (chatSummaryRunning && millis() - start < 5000) delay(5);
+  return !chatSummaryRunning;
+}
+
+TEST(short_chat_is_sent_whole_with_the_prompt_on_the_last_question) {
+  chatTreeReset("chat-short", 1);
+  addTurns(2);
+  askQuestion(2);
+
+  JsonValues context = buildContext(" Be brief.");
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.role"], std::string("user"));
+  CHECK_EQ(context.values["0.content"], std::string("Question 0"));
+  CHECK_EQ(context.values["2.content"], std::string("Question 1"));
+  CHECK_EQ(context.values["4.content"], std::string("Question 2 Be brief."));
+  CHECK_EQ(context.values.count("5.role"), (size_t)0);
+
+  // LLM_SYSTEM_PROMPT_BASE is free text: quotes, backslashes and newlines are escaped
+  const char *prompt = " Say \"hi\"\nthen C:\\path.";
+  context = buildContext(prompt);
+  CHECK(context.done);
+  CHECK_EQ(context.values["4.content"], std::string("Question 2") + prompt);
+}
+
+TEST(only_the_newest_turns_are_sent) {
+  chatTreeReset("chat-long", 1);
+  addTurns(10);
+  askQuestion(10);
+
+  // CHAT_CONTEXT_KEEP_TURNS (6) questions: 5..10 and the answers between them
+  JsonValues context = buildContext();
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.content"], std::string("Question 5"));
+  CHECK_EQ(context.values["10.content"], std::string("Question 10"));
+  CHECK_EQ(context.values.count("11.role"), (size_t)0);
+}
+
+TEST(byte_budget_drops_turns_that_do_not_fit) {
+  chatTreeReset("chat-wordy", 1);
+  addTurns(10, 3000);
+  askQuestion(10);
+
+  // Two 3KB answers fit in 8KB, the third doesn't
+  JsonValues context = buildContext();
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.content"], std::string("Question 8"));
+  CHECK_EQ(context.values["4.content"], std::string("Question 10"));
+
+  // The newest question is sent even when it alone is over budget
+  chatTreeReset("chat-wordy", 1);
+  addTurns(2);
+  String longQuestion = "Why";
+  while (longQuestion.length() < CHAT_CONTEXT_BUDGET_BYTES + 100) longQuestion += " why";
+  askQuestion(2, longQuestion);
+  context = buildContext();
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.content"], std::string(longQuestion.c_str()));
+  CHECK_EQ(context.values.count("1.role"), (size_t)0);
+}
+
+TEST(summary_rolls_forward_in_the_background) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chat/completions"] = {200, SUMMARY_REPLY};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-sum", 1);
+  addTurns(7);
+
+  // The next question leaves 0 and 1 out of the window: summarize them
+  chatSummaryUpdate();
+  CHECK(waitForSummary());
+  CHECK_EQ(owui.count(), (size_t)1);
+  JsonValues request = parseJson(owui.bodies[0]);
+  CHECK(request.done);
+  CHECK_EQ(request.values["model"], std::string("gpt-4o-mini"));
+  CHECK_EQ(request.values["messages.0.role"], std::string("system"));
+  CHECK_EQ(request.values["messages.1.content"], std::string("Question 0"));
+  CHECK_EQ(request.values["messages.4.content"], std::string("Answer 1"));
+  CHECK(request.values["messages.5.content"].find("Update the summary") == 0);
+
+  askQuestion(7);
+  JsonValues context = buildContext();
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.role"], std::string("system"));
+  CHECK_EQ(context.values["0.content"], std::string("Summary of the earlier conversation: They asked about soup."));
+  CHECK_EQ(context.values["1.content"], std::string("Question 2"));
+
+  // One more turn: the request carries the summary so far and only turn 2
+  chatTreeAdd("a7", "u7", "assistant", "Answer 7", "");
+  chatSummaryUpdate();
+  CHECK(waitForSummary());
+  CHECK_EQ(owui.count(), (size_t)2);
+  request = parseJson(owui.bodies[1]);
+  CHECK_EQ(request.values["messages.1.content"], std::string("Summary so far: They asked about soup."));
+  CHECK_EQ(request.values["messages.2.content"], std::string("Question 2"));
+  CHECK_EQ(request.values["messages.3.content"], std::string("Answer 2"));
+  CHECK(request.values["messages.4.content"].find("Update the summary") == 0);
+
+  // Nothing new has left the window
+  chatSummaryUpdate();
+  CHECK(!chatSummaryRunning);
+  finish(server);
+  CHECK_EQ(owui.count(), (size_t)2);
+}
+
+TEST(another_chats_summary_is_not_used) {
+  chatTreeReset("chat-other", 1);
+  addTurns(7);
+  askQuestion(7);
+
+  // Turns 0 and 1 are left out rather than summarized with chat-sum's text
+  JsonValues context = buildContext();
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.content"], std::string("Question 2"));
+}
+
+TEST(failed_summary_request_keeps_the_old_summary) {
+  MockOwui owui;
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-fail", 1);
+  addTurns(7);
+  chatSummaryUpdate();
+  CHECK(waitForSummary());
+  finish(server);
+  CHECK_EQ(owui.count(), (size_t)1);
+
+  askQuestion(7);
+  JsonValues context = buildContext();
+  CHECK_EQ(context.values["0.content"], std::string("Question 2"));
+}
+
+TEST_MAIN()
@@ -0,0 +1,71 @@
+#ifndef CHAT_DOCUMENT_H
+#define CHAT_DOCUMENT_H
+
+// Synthetic OpenWebUI chat (GET /api/v1/chats/{id}) for the JSON tests and
+// benchmark: the history.messages tree, currentId, and the flat messages list,
+// with escapes (\n, \", \uXXXX, a surrogate pair) in the content.
+
+#include <stdio.h>
+#include <string>
+
+// Message i as it appears in both history.messages and messages
+inline std::string chatDocumentMessage(int i, int turns, const std::string &content) {
+  char id[40], parent[48], children[48];
+  snprintf(id, sizeof(id), "m%04d-0000-4000-8000-000000000000", i);
+  if (i == 0) {
+    snprintf(parent, sizeof(parent), "null");
+  } else {
+    snprintf(parent, sizeof(parent), "\"m%04d-0000-4000-8000-000000000000\"", i - 1);
+  }
+  if (i + 1 < turns) {
+    snprintf(children, sizeof(children), "[\"m%04d-0000-4000-8000-000000000000\"]", i + 1);
+  } else {
+    snprintf(children, sizeof(children), "[]");
+  }
+  return std::string("{\"id\":\"") + id + "\",\"parentId\":" + parent + ",\"childrenIds\":" + children +
+         ",\"role\":\"" + (i % 2 ? "assistant" : "user") + "\",\"content\":\"" + content +
+         "\",\"timestamp\":" + std::to_string(1700000000 + i) + ",\"models\":[\"gpt-4o-mini\"]" +
+         (i % 2 ? ",\"done\":true" : "") + "}";
+}
+
+// Escaped JSON content of message i; chatDocumentText(i) is the same text decoded
+inline std::string chatDocumentContent(int i) {
+  if (i % 2 == 0) return "Question " + std::to_string(i) + ": what's the caf\\u00e9 \\\"special\\\" today?";
+  return "Answer " + std::to_string(i) + ": the special is soup.\\nIt comes with bread \\ud83d\\ude00 and a "
+         "long explanation that keeps going so the message spans more than one 64-byte part of the tokenizer.";
+}
+
+inline std::string chatDocumentText(int i) {
+  if (i % 2 == 0) return "Question " + std::to_string(i) + ": what's the caf\xC3\xA9 \"special\" today?";
+  return "Answer " + std::to_string(i) + ": the special is soup.\nIt comes with bread \xF0\x9F\x98\x80 and a "
+         "long explanation that keeps going so the message spans more than one 64-byte part of the tokenizer.";
+}
+
+// A chat of `turns` messages
+inline std::string chatDocument(int turns) {
+  std::string history, list;
+  for (int i = 0; i < turns; i++) {
+    std::string message = chatDocumentMessage(i, turns, chatDocumentContent(i));
+    char id[40];
+    snprintf(id, sizeof(id), "m%04d-0000-4000-8000-000000000000", i);
+    history += std::string(i ? "," : "") + "\"" + id + "\":" + message;
+    list += std::string(i ? "," : "") + message;
+  }
+  char current[40];
+  snprintf(current, sizeof(current), "m%04d-0000-4000-8000-000000000000", turns - 1);
+  return std::string("{\"id\":\"chat-1\",\"user_id\":\"user-1\",\"title\":\"Voice chat\",\"chat\":{") +
+         "\"id\":\"\",\"title\":\"Voice chat\",\"models\":[\"gpt-4o-mini\"],\"params\":{}," +
+         "\"history\":{\"messages\":{" + history + "},\"currentId\":\"" + current + "\"}," +
+         "\"messages\":[" + list + "],\"tags\":[],\"timestamp\":1700000000000,\"files\":[]}," +
+         "\"updated_at\":1700000100,\"created_at\":1700000000,\"share_id\":null,\"archived\":false," +
+         "\"pinned\":false,\"meta\":{},\"folder_id\":null}";
+}
+
+// Enough turns for a document of at least `bytes`
+inline int chatDocumentTurns(size_t bytes) {
+  int turns = 2;
+  while (chatDocument(turns).size() < bytes) turns += 2;
+  return turns;
+}
+
+#endif // CHAT_DOCUMENT_H
@@ -0,0 +1,246 @@
+// Local chat tree (common/chat_history.h): messages linked in locally, a chat
+// read from a mock OpenWebUI and extended, the write body and context entries
+// built from the copy, and when the copy is trusted or read again.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+#include "../common/str_builder.h"
+#include "../common/http_pool.h"
+#include "../common/json_stream.h"
+#include "../common/chat_history.h"
+
+#include "chat_document.h"
+#include "mock_owui.h"
+#include "test.h"
+
+static std::string messageId(int i) {
+  char id[40];
+  snprintf(id, sizeof(id), "m%04d-0000-4000-8000-000000000000", i);
+  return id;
+}
+
+// The history object as saveChatHistory() writes it into a request body
+static String historyJson() {
+  return strBuildString([](StrBuilder &b) { chatTreeHistoryJson(b); });
+}
+
+TEST(new_chat_links_messages_locally) {
+  chatTreeReset("chat-new", 100);
+  chatTreeAdd("u1", "", "user", "Hi \"there\"\nsecond line", "\"timestamp\":1");
+  chatTreeAdd("a1", "u1", "assistant", "Hello", "\"model\":\"gpt-4o-mini\"");
+  chatTreeAdd("u2", "a1", "user", "And now?", "");
+
+  CHECK_EQ(chatTree.count, 3);
+  CHECK(chatTreeHas("a1"));
+  CHECK(!chatTreeHas("a2"));
+  CHECK_EQ(chatTree.currentId, String("u2"));
+
+  JsonValues history = parseJson(historyJson());
+  CHECK(history.done);
+  CHECK_EQ(history.values["currentId"], std::string("u2"));
+  CHECK_EQ(history.values["messages.u1.content"], std::string("Hi \"there\"\nsecond line"));
+  CHECK_EQ(history.values["messages.u1.childrenIds.0"], std::string("a1"));
+  CHECK_EQ(history.values["messages.a1.parentId"], std::string("u1"));
+  CHECK_EQ(history.values["messages.a1.childrenIds.0"], std::string("u2"));
+  CHECK_EQ(history.values["messages.a1.model"], std::string("gpt-4o-mini"));
+  CHECK_EQ(history.values["messages.u1.timestamp"], std::string("1"));
+  CHECK_EQ(history.values.count("messages.u2.childrenIds.0"), (size_t)0);
+
+  JsonValues context = parseJson("[" + chatTree.context + "]");
+  CHECK(context.done);
+  CHECK_EQ(context.values["0.content"], std::string("Hi \"there\"\nsecond line"));
+  CHECK_EQ(context.values["1.role"], std::string("assistant"));
+  CHECK_EQ(context.values["2.content"], std::string("And now?"));
+
+  // One entry per message, each a complete object
+  CHECK_EQ(chatTree.entryCount, 3);
+  CHECK(chatTree.entries[0].user && !chatTree.entries[1].user && chatTree.entries[2].user);
+  for (int i = 0; i < chatTree.entryCount; i++) {
+    String entry = chatTree.context.substring(chatTree.entries[i].start, chatTreeEntryEnd(i));
+    CHECK(entry.startsWith("{\"role\":") && entry.endsWith("\"}"));
+  }
+}
+
+TEST(loaded_chat_keeps_unknown_fields_and_links_new_messages) {
+  MockOwui owui;
+  owui.routes["GET /api/v1/chats/chat-1"] = {200, chatDocument(4)};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  CHECK_EQ(chatTreeLoad("chat-1"), 200);
+  CHECK_EQ(chatTree.chatId, String("chat-1"));
+  CHECK_EQ(chatTree.count, 4);
+  CHECK_EQ(chatTree.updatedAt, 1700000100L);
+  CHECK_EQ(chatTree.currentId, String(messageId(3).c_str()));
+
+  chatTreeAdd("new-user", messageId(3).c_str(), "user", "Next?", "");
+  JsonValues history = parseJson(historyJson());
+  CHECK(history.done);
+  std::string last = "messages." + messageId(3);
+  CHECK_EQ(history.values[last + ".childrenIds.0"], std::string("new-user"));
+  CHECK_EQ(history.values["messages.new-user.parentId"], messageId(3));
+  // Earlier links untouched by the splice, server-only fields kept verbatim
+  CHECK_EQ(history.values["messages." + messageId(0) + ".childrenIds.0"], messageId(1));
+  CHECK_EQ(history.values["messages." + messageId(1) + ".models.0"], std::string("gpt-4o-mini"));
+  CHECK_EQ(history.values["messages." + messageId(2) + ".timestamp"], std::string("1700000002"));
+  CHECK_EQ(history.values["messages." + messageId(1) + ".content"], chatDocumentText(1));
+
+  JsonValues context = parseJson("[" + chatTree.context + "]");
+  CHECK(context.done);
+  for (int i = 0; i < 4; i++) CHECK_EQ(context.values[std::to_string(i) + ".content"], chatDocumentText(i));
+  CHECK_EQ(context.values["4.content"], std::string("Next?"));
+
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)1);
+}
+
+TEST(sync_uses_the_copy_while_the_version_matches) {
+  MockOwui owui;
+  owui.routes["GET /api/v1/chats/chat-1"] = {200, chatDocument(2)};
+  owui.routes["GET /api/v1/chats/list?page=1"] =
+      {200, "[{\"id\":\"other\",\"updated_at\":5},{\"id\":\"chat-1\",\"updated_at\":1700000100}]"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeInvalidate();
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);          // No copy yet: read
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);          // Just read: trusted
+  CHECK_EQ(owui.count(), (size_t)1);
+
+  chatTree.checkedAt = millis() - CHAT_TREE_RECHECK_MS;
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);          // Same version: kept
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);          // Checked just now
+  CHECK_EQ(chatTreeSync("chat-1", false), 200);         // Trusted without asking
+  CHECK_EQ(chatTree.count, 2);
+
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+  CHECK_EQ(owui.requests[0], std::string("GET /api/v1/chats/chat-1"));
+  CHECK_EQ(owui.requests[1], std::string("GET /api/v1/chats/list?page=1"));
+}
+
+TEST(sync_reads_the_chat_again_after_an_edit_elsewhere) {
+  MockOwui owui;
+  owui.routes["GET /api/v1/chats/chat-1"] = {200, chatDocument(4)};
+  owui.routes["GET /api/v1/chats/list?page=1"] = {200, "[{\"id\":\"chat-1\",\"updated_at\":1700000999}]"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000000);
+  chatTreeAdd("stale", "", "user", "Old", "");
+  chatTree.checkedAt = millis() - CHAT_TREE_RECHECK_MS;
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);
+  CHECK_EQ(chatTree.count, 4);
+  CHECK(!chatTreeHas("stale"));
+
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+  CHECK_EQ(owui.requests[1], std::string("GET /api/v1/chats/chat-1"));
+}
+
+TEST(sync_keeps_the_copy_of_a_chat_off_the_first_list_page) {
+  MockOwui owui;
+  owui.routes["GET /api/v1/chats/list?page=1"] = {200, "[{\"id\":\"newer\",\"updated_at\":1700000500}]"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000100);
+  chatTreeAdd("u1", "", "user", "Hi", "");
+  for (int i = 0; i < 2; i++) {
+    chatTree.checkedAt = millis() - CHAT_TREE_RECHECK_MS;
+    CHECK_EQ(chatTreeSync("chat-1", true), 200);
+  }
+  CHECK(chatTreeHas("u1"));
+  CHECK_EQ(chatTree.updatedAt, 1700000100L);
+
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+  CHECK_EQ(owui.requests[1], std::string("GET /api/v1/chats/list?page=1"));
+}
+
+TEST(unknown_version_is_taken_from_the_list) {
+  MockOwui owui;
+  owui.routes["GET /api/v1/chats/list?page=1"] = {200, "[{\"id\":\"chat-1\",\"updated_at\":1700000300}]"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", CHAT_VERSION_UNKNOWN);
+  chatTreeAdd("u1", "", "user", "Hi", "");
+  chatTree.checkedAt = millis() - CHAT_TREE_RECHECK_MS;
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);
+  CHECK(chatTreeHas("u1"));
+  CHECK_EQ(chatTree.updatedAt, 1700000300L);
+
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)1);
+}
+
+TEST(failed_version_check_reads_the_chat_again) {
+  MockOwui owui;
+  owui.routes["GET /api/v1/chats/chat-1"] = {200, chatDocument(2)};
+  owui.routes["GET /api/v1/chats/list?page=1"] = {500, "{}"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000100);
+  chatTree.checkedAt = millis() - CHAT_TREE_RECHECK_MS;
+  CHECK_EQ(chatTreeSync("chat-1", true), 200);
+  CHECK_EQ(chatTree.count, 2);
+
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+  CHECK_EQ(owui.requests[1], std::string("GET /api/v1/chats/chat-1"));
+}
+
+TEST(deleted_chat_empties_the_copy) {
+  MockOwui owui;
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-gone", 1);
+  chatTreeAdd("u1", "", "user", "Hi", "");
+  chatTree.checkedAt = millis() - CHAT_TREE_RECHECK_MS;
+  CHECK_EQ(chatTreeSync("chat-gone", true), 404);
+  CHECK_EQ(chatTree.chatId, String(""));
+  CHECK_EQ(chatTree.count, 0);
+  finish(server);
+}
+
+TEST(write_response_sets_the_version) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chats/chat-1"] =
+      {200, "{\"id\":\"chat-1\",\"chat\":{\"updated_at\":1},\"updated_at\":1700000300}"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000100);
+  HTTPClient &http = httpPoolBegin(String(OWUI_BASE_URL) + "/api/v1/chats/chat-1");
+  CHECK_EQ(httpPoolSend(http, "POST", "{\"chat\":{}}"), 200);
+  chatTreeNoteWrite(http);
+  httpPoolEnd(http);
+  CHECK_EQ(chatTree.updatedAt, 1700000300L);
+  finish(server);
+}
+
+TEST(write_response_without_a_version_leaves_it_unknown) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chats/chat-1"] = {200, "{\"id\":\"chat-1\",\"chat\":{\"updated_at\":1}}"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000100);
+  HTTPClient &http = httpPoolBegin(String(OWUI_BASE_URL) + "/api/v1/chats/chat-1");
+  CHECK_EQ(httpPoolSend(http, "POST", "{\"chat\":{}}"), 200);
+  chatTreeNoteWrite(http);
+  httpPoolEnd(http);
+  CHECK_EQ(chatTree.updatedAt, (long)CHAT_VERSION_UNKNOWN);
+  finish(server);
+}
+
+TEST_MAIN()
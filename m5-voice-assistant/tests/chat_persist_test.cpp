@@ -0,0 +1,132 @@
+// Background chat writes (common/chat_persist.h): queued saves sent by the
+// worker, coalesced and superseded, retried after a failure and dropped for a
+// chat that is gone, with the stored version handed back to the chat tree.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+#include "../common/str_builder.h"
+#include "../common/http_pool.h"
+#include "../common/json_stream.h"
+#include "../common/chat_history.h"
+#include "../common/chat_persist.h"
+
+#include "mock_owui.h"
+#include "test.h"
+
+#include <functional>
+
+static const char *SAVE_REPLY = "{\"id\":\"chat-1\",\"updated_at\":1700000300}";
+
+// A body as strBuild() hands it over: pointer and length
+static bool post(ChatPersistKind kind, const char *chatId, const char *body) {
+  return chatPersistPost(kind, chatId, body, strlen(body));
+}
+
+static bool waitFor(std::function<bool()> done, unsigned long ms = 3000) {
+  unsigned long start = millis();
+  while (!done() && millis() - start < ms) delay(5);
+  return done();
+}
+
+static bool queueEmpty() {
+  chatPersistLock();
+  bool empty = true;
+  for (int i = 0; i < CHAT_PERSIST_QUEUE_LEN; i++) {
+    if (chatPersistJobs[i].used) empty = false;
+  }
+  chatPersistUnlock();
+  return empty;
+}
+
+TEST(save_is_sent_in_the_background_and_its_version_applied) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chats/chat-1"] = {200, SAVE_REPLY};
+  owui.routes["POST /api/chat/completed"] = {200, "{}"};
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000100);
+  CHECK(post(CHAT_PERSIST_COMPLETED, "chat-1", "{\"completed\":1}"));
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":1}"));
+  CHECK(waitFor(queueEmpty));
+  CHECK_EQ(chatTree.updatedAt, 1700000100L);   // Only the main loop touches the tree
+
+  chatPersistSupersede("chat-1");
+  CHECK_EQ(chatTree.updatedAt, 1700000300L);
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+  CHECK_EQ(owui.bodies[0], std::string("{\"completed\":1}"));
+  CHECK_EQ(owui.bodies[1], std::string("{\"save\":1}"));
+}
+
+TEST(newer_save_replaces_the_one_still_queued) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chats/chat-1"] = {200, SAVE_REPLY};
+  owui.delayMs = 300;
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":1}"));
+  CHECK(waitFor([&] { return owui.count() == 1; }));
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":2}"));
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":3}"));
+  CHECK(waitFor(queueEmpty));
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+  CHECK_EQ(owui.bodies[1], std::string("{\"save\":3}"));
+}
+
+TEST(supersede_drops_queued_saves_and_waits_for_the_one_being_sent) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chats/chat-1"] = {200, SAVE_REPLY};
+  owui.delayMs = 300;
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  chatTreeReset("chat-1", 1700000100);
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":1}"));
+  CHECK(waitFor([&] { return owui.count() == 1; }));
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":2}"));
+  chatPersistSupersede("chat-1");
+  CHECK(queueEmpty());
+  CHECK_EQ(chatTree.updatedAt, 1700000300L);
+
+  delay(CHAT_PERSIST_POLL_MS * 3);
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)1);
+}
+
+TEST(failed_save_is_retried_after_a_backoff) {
+  MockOwui owui;
+  owui.routes["POST /api/v1/chats/chat-1"] = {200, SAVE_REPLY};
+  owui.failures["POST /api/v1/chats/chat-1"] = 1;
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  unsigned long start = millis();
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-1", "{\"save\":1}"));
+  CHECK(waitFor(queueEmpty, CHAT_PERSIST_BACKOFF_MS * 3));
+  CHECK(millis() - start >= CHAT_PERSIST_BACKOFF_MS);
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)2);
+}
+
+TEST(save_for_a_gone_chat_is_dropped) {
+  MockOwui owui;
+  MockServer server([&](MockConnection &c) { owui.serve(c); });
+  useServer(server);
+
+  CHECK(post(CHAT_PERSIST_SAVE, "chat-gone", "{\"save\":1}"));
+  CHECK(waitFor(queueEmpty));
+  delay(CHAT_PERSIST_BACKOFF_MS + 200);
+  finish(server);
+  CHECK_EQ(owui.requests.size(), (size_t)1);
+}
+
+TEST_MAIN()
@@ -0,0 +1,49 @@
+#ifndef CODEC_REFERENCE_H
+#define CODEC_REFERENCE_H
+
+// Decoders for what common/audio_codec.h encodes, written from the formats
+// (G.711 mu-law, IMA ADPCM as in Microsoft WAV files) rather than from the
+// encoder, and the SNR of a round trip. Include after audio_codec.h.
+
+#include <algorithm>
+#include <math.h>
+#include <vector>
+
+inline int16_t mulawDecode(uint8_t u) {
+  u = ~u;
+  int magnitude = ((((u & 0x0F) << 3) + 0x84) << ((u & 0x70) >> 4)) - 0x84;
+  return (u & 0x80) ? -magnitude : magnitude;
+}
+
+inline std::vector<int16_t> imaDecode(const uint8_t *data, int bytes) {
+  std::vector<int16_t> out;
+  for (const uint8_t *block = data; block + IMA_ADPCM_BLOCK_BYTES <= data + bytes; block += IMA_ADPCM_BLOCK_BYTES) {
+    int predictor = (int16_t)(block[0] | block[1] << 8);
+    int index = block[2];
+    out.push_back(predictor);
+    for (int i = 4; i < IMA_ADPCM_BLOCK_BYTES; i++) {
+      for (int nibble : {block[i] & 0x0F, block[i] >> 4}) {
+        int step = IMA_STEP_TABLE[index];
+        int diff = step >> 3;
+        if (nibble & 4) diff += step;
+        if (nibble & 2) diff += step >> 1;
+        if (nibble & 1) diff += step >> 2;
+        predictor = std::max(-32768, std::min(32767, predictor + ((nibble & 8) ? -diff : diff)));
+        index = std::max(0, std::min(88, index + IMA_INDEX_TABLE[nibble]));
+        out.push_back(predictor);
+      }
+    }
+  }
+  return out;
+}
+
+inline double snrDb(const std::vector<int16_t> &a, const std::vector<int16_t> &b) {
+  double signal = 0, noise = 0;
+  for (size_t i = 0; i < a.size(); i++) {
+    signal += (double)a[i] * a[i];
+    noise += (double)(a[i] - b[i]) * (a[i] - b[i]);
+  }
+  return 10 * log10(signal / std::max(noise, 1.0));
+}
+
+#endif // CODEC_REFERENCE_H
@@ -0,0 +1,109 @@
+// Benchmark: recording stats the old way (an int64 sum-of-squares loop per
+// mic block for the level meter, then a second pass over the whole buffer for
+// min, max and mean) against dspStats() per block merged with dspMerge(), and
+// the sum-of-squares kernels on their own. Time while recording is per second
+// of audio; time at the stop delays the upload.
+//
+//   ./dsp_kernels_bench [seconds]
+
+#include "test_config.h"
+#include "../common/dsp_kernels.h"
+
+#include "test_signal.h"
+
+#include <chrono>
+
+#define BENCH_BLOCK_SAMPLES 512                // One MIC_CAPTURE_BLOCK_MS block at 16kHz
+
+static volatile int64_t sink;
+
+// One way of keeping the level meter and the recording's stats: block() runs
+// as each mic block lands, stop() between the end of recording and the upload
+struct StatsPath {
+  const char *name;
+  void (*block)(const int16_t *pcm, int pos, int count);
+  void (*stop)(const int16_t *pcm, int n);
+};
+
+// Before: recordAudio()'s per-chunk RMS loop, then a stats pass over the recording
+static void oldBlock(const int16_t *pcm, int pos, int count) {
+  int64_t sum = 0;
+  for (int i = 0; i < count; i++) {
+    int16_t sample = pcm[pos + i];
+    sum += (int64_t)sample * sample;
+  }
+  sink = (int)sqrt(sum / count);
+}
+
+static void oldStop(const int16_t *pcm, int n) {
+  int16_t minVal = 32767, maxVal = -32768;
+  int64_t sum = 0;
+  for (int i = 0; i < n; i++) {
+    if (pcm[i] < minVal) minVal = pcm[i];
+    if (pcm[i] > maxVal) maxVal = pcm[i];
+    sum += abs(pcm[i]);
+  }
+  sink = minVal + maxVal + sum / n;
+}
+
+// After: one pass per block, merged as the blocks land; nothing left at the stop
+static DspStats total;
+
+static void newBlock(const int16_t *pcm, int pos, int count) {
+  DspStats block;
+  if (pos == 0) dspReset(total);
+  dspStats(block, pcm + pos, count);
+  dspMerge(total, block);
+  sink = dspRms(block);
+}
+
+static void newStop(const int16_t *, int) {
+  sink = total.minVal + total.maxVal + dspAbsMean(total);
+}
+
+// The sum of squares alone: the old int64 loop and dspSumSquares()
+static void int64Block(const int16_t *pcm, int pos, int count) {
+  int64_t sum = 0;
+  for (int i = 0; i < count; i++) sum += (int64_t)pcm[pos + i] * pcm[pos + i];
+  sink = sum;
+}
+
+static void scalarBlock(const int16_t *pcm, int pos, int count) { sink = dspSumSquares(pcm + pos, count); }
+
+static void noStop(const int16_t *, int) {}
+
+static const StatsPath PATHS[] = {
+  {"level + stats pass", oldBlock, oldStop},
+  {"dspStats + dspMerge", newBlock, newStop},
+  {"sum of squares, int64", int64Block, noStop},
+  {"sum of squares, pairs", scalarBlock, noStop},
+};
+
+static void run(const StatsPath &path, const std::vector<int16_t> &pcm, int iterations) {
+  int n = pcm.size();
+  double blockUs = 0, stopUs = 0;
+  for (int it = -1; it < iterations; it++) {     // The first run warms the caches
+    auto start = std::chrono::steady_clock::now();
+    for (int pos = 0; pos < n; pos += BENCH_BLOCK_SAMPLES) path.block(pcm.data(), pos, std::min(BENCH_BLOCK_SAMPLES, n - pos));
+    auto stopped = std::chrono::steady_clock::now();
+    path.stop(pcm.data(), n);
+    auto end = std::chrono::steady_clock::now();
+    if (it < 0) continue;
+    blockUs += std::chrono::duration<double, std::micro>(stopped - start).count();
+    stopUs += std::chrono::duration<double, std::micro>(end - stopped).count();
+  }
+  blockUs /= iterations;
+  stopUs /= iterations;
+  double seconds = (double)n / SAMPLE_RATE;
+  printf("%-24s %8.1f us/s while recording %8.1f us at the stop %7.3f ns/sample\n", path.name, blockUs / seconds,
+         stopUs, (blockUs + stopUs) * 1000 / n);
+}
+
+int main(int argc, char **argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 15;
+  std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE * seconds, 12000);
+  printf("%ds recording at %dHz in %d-sample blocks\n", seconds, SAMPLE_RATE, BENCH_BLOCK_SAMPLES);
+
+  for (const StatsPath &path : PATHS) run(path, pcm, 200);
+  return 0;
+}
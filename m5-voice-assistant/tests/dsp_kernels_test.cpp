@@ -0,0 +1,122 @@
+// Block kernels (common/dsp_kernels.h) against plain 64-bit reference loops:
+// random and full-scale blocks of every small length, merged block stats
+// against one pass over the whole recording.
+
+#include "test_config.h"
+#include "../common/dsp_kernels.h"
+
+#include "test.h"
+#include "test_signal.h"
+
+#include <random>
+
+static int64_t refSumSquares(const int16_t *x, int n) {
+  int64_t total = 0;
+  for (int i = 0; i < n; i++) total += (int64_t)x[i] * x[i];
+  return total;
+}
+
+static DspStats refStats(const int16_t *x, int n) {
+  DspStats s;
+  dspReset(s);
+  if (n == 0) return s;
+  s.minVal = 32767;
+  s.maxVal = -32768;
+  for (int i = 0; i < n; i++) {
+    s.sumSquares += (int64_t)x[i] * x[i];
+    s.absSum += x[i] < 0 ? -(int64_t)x[i] : x[i];
+    s.minVal = std::min(s.minVal, x[i]);
+    s.maxVal = std::max(s.maxVal, x[i]);
+  }
+  s.count = n;
+  return s;
+}
+
+static bool sameStats(const DspStats &a, const DspStats &b) {
+  return a.sumSquares == b.sumSquares && a.absSum == b.absSum && a.minVal == b.minVal && a.maxVal == b.maxVal &&
+         a.count == b.count;
+}
+
+TEST(sum_of_squares_matches_the_reference) {
+  std::mt19937 rng(21);
+  std::vector<int16_t> x(4096 + 1);
+  for (int16_t &s : x) s = (int16_t)rng();
+  int mismatches = 0;
+  for (int n = 0; n <= 1030; n++) {
+    for (int offset : {0, 1}) {                   // Odd lengths and unaligned starts
+      if (dspSumSquares(x.data() + offset, n) != refSumSquares(x.data() + offset, n)) mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+  CHECK_EQ(dspSumSquares(x.data(), x.size()), refSumSquares(x.data(), x.size()));
+
+  // Full scale: each pair of squares is 2^31, the most the 32-bit pair sum holds
+  std::vector<int16_t> full(1001, -32768);
+  CHECK_EQ(dspSumSquares(full.data(), full.size()), (int64_t)1001 << 30);
+}
+
+TEST(peak_and_absolute_level_match_the_reference) {
+  std::mt19937 rng(23);
+  std::vector<int16_t> x(3000);
+  for (int16_t &s : x) s = (int16_t)(rng() % 2001) - 1000;
+  x[1234] = -32768;                               // |-32768| doesn't fit an int16
+  x[2345] = 32767;
+  for (int n : {1, 2, 3, 1235, 2346, 3000}) {
+    DspStats s, ref = refStats(x.data(), n);
+    dspStats(s, x.data(), n);
+    if (!sameStats(s, ref)) TEST_FAIL("n=%d: min %d max %d abs %lld", n, s.minVal, s.maxVal, (long long)s.absSum);
+  }
+
+  // Past 65536 samples the absolute sum is split into 32-bit runs
+  std::vector<int16_t> full(200000, -32768);
+  DspStats s;
+  dspStats(s, full.data(), full.size());
+  CHECK_EQ(s.absSum, (int64_t)200000 * 32768);
+  CHECK_EQ(s.sumSquares, (int64_t)200000 << 30);
+  CHECK_EQ(dspAbsMean(s), 32768);
+  CHECK_EQ(dspRms(s), 32768);
+}
+
+TEST(merged_blocks_equal_one_pass) {
+  std::vector<int16_t> pcm = testVoice(SAMPLE_RATE, SAMPLE_RATE * 3, 12000);
+  DspStats whole = refStats(pcm.data(), pcm.size());
+  std::mt19937 rng(24);
+  for (int run = 0; run < 20; run++) {
+    // Blocks of any size, as micCaptureWait() returns them, empty ones included
+    DspStats total, block;
+    dspReset(total);
+    for (size_t pos = 0; pos < pcm.size();) {
+      int n = std::min<int>(rng() % 1500, pcm.size() - pos);
+      dspStats(block, pcm.data() + pos, n);
+      dspMerge(total, block);
+      pos += n;
+    }
+    CHECK(sameStats(total, whole));
+  }
+  CHECK_EQ(dspRms(whole), (int)sqrt((double)whole.sumSquares / whole.count));
+}
+
+TEST(levels_of_known_signals) {
+  std::vector<int16_t> tone = testTone(SAMPLE_RATE, 250, 10000, SAMPLE_RATE);
+  DspStats s;
+  dspStats(s, tone.data(), tone.size());
+  // Truncated to int16 and to int, and 64 samples per cycle: a little under the ideal
+  CHECK_NEAR(dspRms(s), 10000 / sqrt(2), 2);
+  CHECK_NEAR(dspAbsMean(s), 10000 * 2 / M_PI, 8);
+  CHECK(s.maxVal <= 10000 && s.maxVal > 9990);
+  CHECK(s.minVal >= -10000 && s.minVal < -9990);
+
+  // Empty: everything 0, and merging it changes nothing
+  DspStats empty, total;
+  dspStats(empty, tone.data(), 0);
+  CHECK(sameStats(empty, refStats(tone.data(), 0)));
+  CHECK_EQ(dspRms(empty), 0);
+  CHECK_EQ(dspAbsMean(empty), 0);
+  dspReset(total);
+  dspMerge(total, empty);
+  dspMerge(total, s);
+  dspMerge(total, empty);
+  CHECK(sameStats(total, s));
+}
+
+TEST_MAIN()
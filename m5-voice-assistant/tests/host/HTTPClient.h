@@ -0,0 +1,77 @@
+#ifndef HOST_HTTP_CLIENT_H
+#define HOST_HTTP_CLIENT_H
+
+// Host stand-in for the ESP32 HTTPClient: plain HTTP/1.1 over the WiFiClient
+// passed to begin(), so pooled requests reach the mock servers in
+// mock_server.h. Like the ESP32 core it connects on the first request, adds
+// Content-Length to requests with a body, un-chunks the response in
+// getString() and writeToStream(), and keeps the socket after end() when
+// setReuse(true) and the server didn't ask to close it (dropping whatever of
+// the body has arrived unread). Only http:// is supported.
+
+#include "WiFi.h"
+
+#include <string>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient {
+ public:
+  bool begin(WiFiClient &client, const String &url);
+  void end();
+  void setReuse(bool reuse) { _reuse = reuse; }
+  void useHTTP10(bool = true) {}
+  void setTimeout(uint16_t ms) { _timeoutMs = ms; }
+  void setConnectTimeout(int32_t) {}
+  void addHeader(const String &name, const String &value, bool = false, bool = true);
+  void collectHeaders(const char *names[], size_t count);
+  String header(const char *name);
+  bool connected() { return _client && _client->connected(); }
+
+  int GET() { return sendRequest("GET", (uint8_t *)nullptr, 0); }
+  int POST(const String &body) { return sendRequest("POST", body); }
+  int POST(uint8_t *body, size_t size) { return sendRequest("POST", body, size); }
+  int sendRequest(const char *method, const String &body) {
+    return sendRequest(method, (uint8_t *)body.c_str(), body.length());
+  }
+  int sendRequest(const char *method, uint8_t *body, size_t size);
+  int sendRequest(const char *method, Stream *body, size_t size);
+
+  int getSize() { return _size; }
+  String getString();
+  WiFiClient *getStreamPtr() { return connected() ? _client : nullptr; }
+  int writeToStream(Stream *stream);
+  static String errorToString(int error) { return String("HTTP error ") + error; }
+
+ private:
+  bool sendHeader(const char *method, size_t size);
+  int readResponseHeader();
+  int readBody(Stream *stream, String *text);
+
+  WiFiClient *_client = nullptr;
+  String _host;
+  uint16_t _port = 80;
+  String _path;
+  String _headers;                      // Request headers added for this request
+  std::vector<std::string> _collectNames;
+  std::vector<String> _collectValues;
+  bool _reuse = true;
+  bool _canReuse = false;               // Server allows keep-alive
+  bool _chunked = false;
+  bool _bodyRead = true;                // Response body fully consumed
+  int _size = -1;
+  uint16_t _timeoutMs = 5000;
+};
+
+#endif // HOST_HTTP_CLIENT_H
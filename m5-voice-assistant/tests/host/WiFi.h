@@ -0,0 +1,89 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+// Host stand-in for the ESP32 WiFi library: WiFi is always connected and
+// WiFiClient is a POSIX TCP socket, so the headers under test talk to the mock
+// servers in mock_server.h over 127.0.0.1. As on the ESP32, setTimeout() on a
+// client takes seconds. A read past the end of a closed connection returns -1
+// at once instead of waiting out the timeout.
+
+#include "Arduino.h"
+
+#define WL_IDLE_STATUS 0
+#define WL_CONNECTED 3
+#define WL_DISCONNECTED 6
+
+class IPAddress {
+ public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _addr{a, b, c, d} {}
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _addr[0], _addr[1], _addr[2], _addr[3]);
+    return String(buf);
+  }
+
+ private:
+  uint8_t _addr[4] = {0, 0, 0, 0};
+};
+
+class Client : public Stream {
+ public:
+  virtual int connect(const char *host, uint16_t port) = 0;
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t n) = 0;
+  virtual int read(uint8_t *buf, size_t n) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  using Print::write;
+  using Stream::read;
+};
+
+class WiFiClient : public Client {
+ public:
+  WiFiClient() {}
+  ~WiFiClient() override { stop(); }
+  WiFiClient(const WiFiClient &) = delete;
+  WiFiClient &operator=(const WiFiClient &) = delete;
+
+  int connect(const char *host, uint16_t port) override;
+  int connect(const char *host, uint16_t port, int32_t timeoutMs) { (void)timeoutMs; return connect(host, port); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buf, size_t n) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buf, size_t n) override;
+  int peek() override;
+  uint8_t connected() override;
+  void stop() override;
+  void flush() override {}
+
+  void setTimeout(uint32_t seconds) { Stream::setTimeout(seconds * 1000); }
+  void setNoDelay(bool) {}
+  int fd() const { return _fd; }
+  operator bool() { return connected(); }
+
+ protected:
+  int timedRead() override;
+
+ private:
+  bool fill(int waitMs);            // Read what the socket has into _buf
+  int _fd = -1;
+  bool _eof = false;                // Peer closed its side
+  uint8_t _buf[1024];
+  size_t _head = 0, _tail = 0;
+};
+
+class WiFiClass {
+ public:
+  void begin(const char *, const char *) {}
+  int status() { return WL_CONNECTED; }
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  int RSSI() { return -50; }
+  void setSleep(bool) {}
+  void disconnect(bool = false) {}
+};
+extern WiFiClass WiFi;
+
+#endif // HOST_WIFI_H
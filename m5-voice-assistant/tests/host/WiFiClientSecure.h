@@ -0,0 +1,16 @@
+#ifndef HOST_WIFI_CLIENT_SECURE_H
+#define HOST_WIFI_CLIENT_SECURE_H
+
+// No TLS on the host: the tests use http:// and ws:// URLs, this only has to
+// compile for the https:// branches.
+
+#include "WiFi.h"
+
+class WiFiClientSecure : public WiFiClient {
+ public:
+  void setInsecure() {}
+  void setCACert(const char *) {}
+  void setHandshakeTimeout(unsigned long) {}
+};
+
+#endif // HOST_WIFI_CLIENT_SECURE_H
@@ -0,0 +1,538 @@
+// Host implementations behind Arduino.h, WiFi.h and HTTPClient.h (see there)
+
+#include "Arduino.h"
+#include "HTTPClient.h"
+#include "WiFi.h"
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+
+// ---- Time ----
+
+static const auto hostStart = std::chrono::steady_clock::now();
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - hostStart).count();
+}
+
+unsigned long millis() { return micros() / 1000; }
+int64_t esp_timer_get_time() { return (int64_t)micros(); }
+uint32_t EspClass::getCycleCount() { return (uint32_t)(micros() * 240); }
+
+void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+void delayMicroseconds(unsigned int us) { std::this_thread::sleep_for(std::chrono::microseconds(us)); }
+void yield() { std::this_thread::yield(); }
+
+static std::mt19937 &hostRng() {
+  static std::mt19937 rng(12345);      // Fixed seed: test runs are repeatable
+  return rng;
+}
+
+uint32_t esp_random() {
+  static std::mutex lock;
+  std::lock_guard<std::mutex> guard(lock);
+  return hostRng()();
+}
+
+long random(long max) { return max > 0 ? (long)(esp_random() % (uint32_t)max) : 0; }
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+
+// ---- Stream ----
+
+int Stream::timedRead() {
+  unsigned long start = millis();
+  do {
+    int c = read();
+    if (c >= 0) return c;
+    delay(1);
+  } while (millis() - start < _timeout);
+  return -1;
+}
+
+// ---- Heap ----
+
+void *ps_malloc(size_t size) { return malloc(size); }
+void *heap_caps_malloc(size_t size, uint32_t) { return malloc(size); }
+void *heap_caps_calloc(size_t n, size_t size, uint32_t) { return calloc(n, size); }
+void *heap_caps_realloc(void *ptr, size_t size, uint32_t) { return realloc(ptr, size); }
+void heap_caps_free(void *ptr) { free(ptr); }
+size_t heap_caps_get_free_size(uint32_t caps) { return caps & MALLOC_CAP_SPIRAM ? 0 : 256 * 1024; }
+size_t heap_caps_get_largest_free_block(uint32_t caps) { return caps & MALLOC_CAP_SPIRAM ? 0 : 128 * 1024; }
+size_t heap_caps_get_minimum_free_size(uint32_t caps) { return heap_caps_get_free_size(caps); }
+
+// ---- FreeRTOS ----
+
+namespace {
+
+struct HostTask {
+  TaskFunction_t fn;
+  void *arg;
+  std::mutex lock;
+  std::condition_variable cv;
+  uint32_t notifications = 0;
+};
+
+thread_local HostTask *currentTask = nullptr;
+
+void *hostTaskMain(void *p) {
+  HostTask *task = (HostTask *)p;
+  currentTask = task;
+  task->fn(task->arg);
+  return nullptr;                       // A task that returns without vTaskDelete
+}
+
+// Counting semaphore; a mutex is one that starts full
+struct HostSemaphore {
+  std::mutex lock;
+  std::condition_variable cv;
+  unsigned int count;
+  unsigned int max;
+};
+
+struct HostQueue {
+  std::mutex lock;
+  std::condition_variable cv;
+  std::deque<std::vector<uint8_t>> items;
+  unsigned int length;
+  unsigned int itemSize;
+};
+
+template <class Ready>
+bool waitFor(std::condition_variable &cv, std::unique_lock<std::mutex> &guard, TickType_t wait, Ready ready) {
+  if (wait == portMAX_DELAY) {
+    cv.wait(guard, ready);
+    return true;
+  }
+  return cv.wait_for(guard, std::chrono::milliseconds(wait), ready);
+}
+
+std::recursive_mutex criticalLock;
+
+}  // namespace
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void *arg, UBaseType_t,
+                                   TaskHandle_t *handle, BaseType_t) {
+  HostTask *task = new HostTask();
+  task->fn = fn;
+  task->arg = arg;
+  if (handle) *handle = task;
+  pthread_t thread;
+  if (pthread_create(&thread, nullptr, hostTaskMain, task) != 0) {
+    delete task;
+    if (handle) *handle = nullptr;
+    return pdFAIL;
+  }
+  pthread_detach(thread);
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t priority,
+                       TaskHandle_t *handle) {
+  return xTaskCreatePinnedToCore(fn, name, stack, arg, priority, handle, tskNO_AFFINITY);
+}
+
+// Only a task can end itself here; the handle of a running task stays valid
+// (it is leaked) because other threads may still notify it
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == currentTask) pthread_exit(nullptr);
+}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+TickType_t xTaskGetTickCount() { return (TickType_t)millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle() { return currentTask; }
+BaseType_t xPortGetCoreID() { return currentTask ? 0 : 1; }
+
+void xTaskNotifyGive(TaskHandle_t handle) {
+  HostTask *task = (HostTask *)handle;
+  if (!task) return;
+  std::lock_guard<std::mutex> guard(task->lock);
+  task->notifications++;
+  task->cv.notify_all();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) {
+  HostTask *task = currentTask;
+  if (!task) return 0;
+  std::unique_lock<std::mutex> guard(task->lock);
+  if (!waitFor(task->cv, guard, wait, [&] { return task->notifications > 0; })) return 0;
+  uint32_t value = task->notifications;
+  task->notifications = clear ? 0 : value - 1;
+  return value;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial) {
+  HostSemaphore *sem = new HostSemaphore();
+  sem->count = initial;
+  sem->max = max;
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return xSemaphoreCreateCounting(1, 1); }
+SemaphoreHandle_t xSemaphoreCreateBinary() { return xSemaphoreCreateCounting(1, 0); }
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t handle, TickType_t wait) {
+  HostSemaphore *sem = (HostSemaphore *)handle;
+  std::unique_lock<std::mutex> guard(sem->lock);
+  if (!waitFor(sem->cv, guard, wait, [&] { return sem->count > 0; })) return pdFALSE;
+  sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t handle) {
+  HostSemaphore *sem = (HostSemaphore *)handle;
+  std::lock_guard<std::mutex> guard(sem->lock);
+  if (sem->count >= sem->max) return pdFALSE;
+  sem->count++;
+  sem->cv.notify_one();
+  return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t handle) { delete (HostSemaphore *)handle; }
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostQueue *q = new HostQueue();
+  q->length = length;
+  q->itemSize = itemSize;
+  return q;
+}
+
+static BaseType_t hostQueuePut(QueueHandle_t handle, const void *item, TickType_t wait, bool front) {
+  HostQueue *q = (HostQueue *)handle;
+  std::unique_lock<std::mutex> guard(q->lock);
+  if (!waitFor(q->cv, guard, wait, [&] { return q->items.size() < q->length; })) return pdFALSE;
+  std::vector<uint8_t> bytes((const uint8_t *)item, (const uint8_t *)item + q->itemSize);
+  if (front) {
+    q->items.push_front(std::move(bytes));
+  } else {
+    q->items.push_back(std::move(bytes));
+  }
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait) { return hostQueuePut(q, item, wait, false); }
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t wait) { return hostQueuePut(q, item, wait, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t wait) { return hostQueuePut(q, item, wait, true); }
+
+static BaseType_t hostQueueGet(QueueHandle_t handle, void *item, TickType_t wait, bool remove) {
+  HostQueue *q = (HostQueue *)handle;
+  std::unique_lock<std::mutex> guard(q->lock);
+  if (!waitFor(q->cv, guard, wait, [&] { return !q->items.empty(); })) return pdFALSE;
+  memcpy(item, q->items.front().data(), q->itemSize);
+  if (remove) {
+    q->items.pop_front();
+    q->cv.notify_all();
+  }
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait) { return hostQueueGet(q, item, wait, true); }
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait) { return hostQueueGet(q, item, wait, false); }
+
+BaseType_t xQueueReset(QueueHandle_t handle) {
+  HostQueue *q = (HostQueue *)handle;
+  std::lock_guard<std::mutex> guard(q->lock);
+  q->items.clear();
+  q->cv.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+  HostQueue *q = (HostQueue *)handle;
+  std::lock_guard<std::mutex> guard(q->lock);
+  return q->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t handle) {
+  HostQueue *q = (HostQueue *)handle;
+  std::lock_guard<std::mutex> guard(q->lock);
+  return q->length - q->items.size();
+}
+
+void vQueueDelete(QueueHandle_t handle) { delete (HostQueue *)handle; }
+
+void hostEnterCritical() { criticalLock.lock(); }
+void hostExitCritical() { criticalLock.unlock(); }
+
+// ---- WiFiClient ----
+
+int WiFiClient::connect(const char *host, uint16_t port) {
+  stop();
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *found = nullptr;
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &found) != 0 || !found) return 0;
+  int fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+  bool ok = fd >= 0 && ::connect(fd, found->ai_addr, found->ai_addrlen) == 0;
+  freeaddrinfo(found);
+  if (!ok) {
+    if (fd >= 0) close(fd);
+    return 0;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  _fd = fd;
+  _eof = false;
+  _head = _tail = 0;
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t n) {
+  if (_fd < 0) return 0;
+  ssize_t sent = send(_fd, buf, n, MSG_NOSIGNAL);
+  if (sent < 0) {
+    stop();
+    return 0;
+  }
+  return (size_t)sent;
+}
+
+bool WiFiClient::fill(int waitMs) {
+  if (_head < _tail) return true;
+  if (_fd < 0 || _eof) return false;
+  pollfd p = {_fd, POLLIN, 0};
+  if (poll(&p, 1, waitMs) <= 0) return false;
+  ssize_t got = recv(_fd, _buf, sizeof(_buf), MSG_DONTWAIT);
+  if (got <= 0) {
+    if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) _eof = true;
+    return false;
+  }
+  _head = 0;
+  _tail = (size_t)got;
+  return true;
+}
+
+int WiFiClient::available() {
+  fill(0);
+  return (int)(_tail - _head);
+}
+
+int WiFiClient::read() {
+  if (!fill(0)) return -1;
+  return _buf[_head++];
+}
+
+int WiFiClient::read(uint8_t *buf, size_t n) {
+  if (!fill(0)) return -1;
+  size_t take = std::min(n, _tail - _head);
+  memcpy(buf, _buf + _head, take);
+  _head += take;
+  return (int)take;
+}
+
+int WiFiClient::peek() {
+  if (!fill(0)) return -1;
+  return _buf[_head];
+}
+
+int WiFiClient::timedRead() {
+  unsigned long start = millis();
+  while (!fill(10)) {
+    if (_fd < 0 || _eof || millis() - start >= _timeout) return -1;
+  }
+  return _buf[_head++];
+}
+
+uint8_t WiFiClient::connected() {
+  if (_fd < 0) return 0;
+  fill(0);
+  return _head < _tail || !_eof;
+}
+
+void WiFiClient::stop() {
+  if (_fd >= 0) close(_fd);
+  _fd = -1;
+  _eof = false;
+  _head = _tail = 0;
+}
+
+// ---- HTTPClient ----
+
+bool HTTPClient::begin(WiFiClient &client, const String &url) {
+  _client = &client;
+  String u = url;
+  int hostStart = u.indexOf("://") >= 0 ? u.indexOf("://") + 3 : 0;
+  int pathStart = u.indexOf('/', hostStart);
+  String hostPort = pathStart >= 0 ? u.substring(hostStart, pathStart) : u.substring(hostStart);
+  _path = pathStart >= 0 ? u.substring(pathStart) : String("/");
+  int colon = hostPort.indexOf(':');
+  _host = colon >= 0 ? hostPort.substring(0, colon) : hostPort;
+  _port = colon >= 0 ? hostPort.substring(colon + 1).toInt() : 80;
+  _headers = "";
+  _size = -1;
+  _chunked = false;
+  _bodyRead = true;
+  return true;
+}
+
+// As on the ESP32, an unread body is dropped as far as it has arrived
+void HTTPClient::end() {
+  if (!_client) return;
+  while (_client->available() > 0) _client->read();
+  if (!_reuse || !_canReuse) _client->stop();
+  _client = nullptr;
+}
+
+void HTTPClient::addHeader(const String &name, const String &value, bool, bool) {
+  _headers += name + ": " + value + "\r\n";
+}
+
+void HTTPClient::collectHeaders(const char *names[], size_t count) {
+  _collectNames.assign(names, names + count);
+  _collectValues.assign(count, String());
+}
+
+String HTTPClient::header(const char *name) {
+  for (size_t i = 0; i < _collectNames.size(); i++) {
+    if (strcasecmp(_collectNames[i].c_str(), name) == 0) return _collectValues[i];
+  }
+  return String();
+}
+
+bool HTTPClient::sendHeader(const char *method, size_t size) {
+  if (!_client->connected() && !_client->connect(_host.c_str(), _port)) return false;
+  String head = String(method) + " " + _path + " HTTP/1.1\r\nHost: " + _host + ":" + (int)_port +
+                "\r\nConnection: " + (_reuse ? "keep-alive" : "close") + "\r\n" + _headers;
+  if (size > 0) head += String("Content-Length: ") + (int)size + "\r\n";
+  head += "\r\n";
+  return _client->write((const uint8_t *)head.c_str(), head.length()) == head.length();
+}
+
+int HTTPClient::sendRequest(const char *method, uint8_t *body, size_t size) {
+  if (!_client) return HTTPC_ERROR_NOT_CONNECTED;
+  bool wasOpen = _client->connected();
+  if (!sendHeader(method, size)) {
+    return wasOpen ? HTTPC_ERROR_SEND_HEADER_FAILED : HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  if (size > 0 && _client->write(body, size) != size) return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+  return readResponseHeader();
+}
+
+int HTTPClient::sendRequest(const char *method, Stream *body, size_t size) {
+  if (!_client) return HTTPC_ERROR_NOT_CONNECTED;
+  bool wasOpen = _client->connected();
+  if (!sendHeader(method, size)) {
+    return wasOpen ? HTTPC_ERROR_SEND_HEADER_FAILED : HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  uint8_t buf[1024];
+  size_t sent = 0;
+  while (sent < size) {
+    int n = body->readBytes(buf, std::min(sizeof(buf), size - sent));
+    if (n <= 0 || _client->write(buf, n) != (size_t)n) return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+    sent += n;
+  }
+  return readResponseHeader();
+}
+
+int HTTPClient::readResponseHeader() {
+  _size = -1;
+  _chunked = false;
+  _canReuse = _reuse;
+  _bodyRead = false;
+  for (auto &v : _collectValues) v = String();
+
+  unsigned long start = millis();
+  while (!_client->available()) {
+    if (!_client->connected()) return HTTPC_ERROR_CONNECTION_LOST;
+    if (millis() - start > _timeoutMs) return HTTPC_ERROR_READ_TIMEOUT;
+    delay(1);
+  }
+  String status = _client->readStringUntil('\n');
+  int code = status.substring(status.indexOf(' ') + 1).toInt();
+  if (code <= 0) return HTTPC_ERROR_NO_HTTP_SERVER;
+
+  for (;;) {
+    String line = _client->readStringUntil('\n');
+    line.trim();
+    if (line.length() == 0) break;
+    int colon = line.indexOf(':');
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    value.trim();
+    name.toLowerCase();
+    if (name == "content-length") _size = value.toInt();
+    if (name == "transfer-encoding" && value.indexOf("chunked") >= 0) _chunked = true;
+    if (name == "connection" && value.equalsIgnoreCase("close")) _canReuse = false;
+    for (size_t i = 0; i < _collectNames.size(); i++) {
+      if (strcasecmp(_collectNames[i].c_str(), name.c_str()) == 0) _collectValues[i] = value;
+    }
+  }
+  if (!_chunked && _size < 0) _canReuse = false;    // Body runs to the end of the connection
+  if (_size == 0 && !_chunked) _bodyRead = true;
+  return code;
+}
+
+// Copy the body into stream and/or text; bytes read, or an error
+int HTTPClient::readBody(Stream *stream, String *text) {
+  if (!_client) return HTTPC_ERROR_NOT_CONNECTED;
+  uint8_t buf[1024];
+  int total = 0;
+  auto copy = [&](long want) -> bool {           // want < 0: until the server closes
+    while (want != 0) {
+      int n = _client->readBytes(buf, want < 0 ? sizeof(buf) : std::min((long)sizeof(buf), want));
+      if (n <= 0) return want < 0;
+      if (stream && stream->write(buf, n) != (size_t)n) return false;
+      if (text) text->concat((const char *)buf, n);
+      total += n;
+      if (want > 0) want -= n;
+    }
+    return true;
+  };
+
+  bool ok;
+  if (_chunked) {
+    ok = true;
+    for (;;) {
+      String sizeLine = _client->readStringUntil('\n');
+      long size = strtol(sizeLine.c_str(), nullptr, 16);
+      if (size <= 0) {
+        _client->readStringUntil('\n');           // Blank line after the last chunk
+        ok = sizeLine.length() > 0;
+        break;
+      }
+      if (!copy(size)) {
+        ok = false;
+        break;
+      }
+      _client->readStringUntil('\n');
+    }
+  } else {
+    ok = copy(_size);
+  }
+  _bodyRead = ok;
+  return ok ? total : HTTPC_ERROR_READ_TIMEOUT;
+}
+
+String HTTPClient::getString() {
+  String text;
+  if (!_bodyRead) readBody(nullptr, &text);
+  return text;
+}
+
+int HTTPClient::writeToStream(Stream *stream) {
+  if (!stream) return HTTPC_ERROR_NO_STREAM;
+  return readBody(stream, nullptr);
+}
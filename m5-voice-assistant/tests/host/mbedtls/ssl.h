@@ -0,0 +1,115 @@
+#ifndef HOST_MBEDTLS_SSL_H
+#define HOST_MBEDTLS_SSL_H
+
+// Just enough of the mbedTLS API for tls_session.h to compile on the host.
+// The tests build with ENABLE_TLS_RESUMPTION false and plain http://, so no
+// handshake ever runs: those calls fail or do nothing. Sessions can be saved,
+// loaded and set on a context, so the session cache is tested without one.
+// The saved form is the stub's own: ID, master secret and ticket_len bytes
+// standing in for the ticket.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MBEDTLS_PRIVATE(member) member
+#define MBEDTLS_SSL_SESSION_TICKETS
+#define MBEDTLS_X509_CRT_PARSE_C
+#define MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
+
+#define MBEDTLS_ERR_NET_CONN_RESET -0x0050
+#define MBEDTLS_ERR_SSL_WANT_READ -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE -0x6880
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY -0x7880
+#define MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL -0x6A00
+#define MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE -0x7080
+
+#define MBEDTLS_SSL_IS_CLIENT 0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT 0
+#define MBEDTLS_SSL_VERIFY_NONE 0
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED 1
+
+struct mbedtls_x509_crt { int unused; };
+struct mbedtls_ssl_config { int unused; };
+struct mbedtls_entropy_context { int unused; };
+struct mbedtls_ctr_drbg_context { int unused; };
+struct mbedtls_ssl_session {
+  unsigned char id[32];
+  size_t id_len;
+  unsigned char master[48];
+  size_t ticket_len;
+  mbedtls_x509_crt *peer_cert;
+};
+struct mbedtls_ssl_context {
+  mbedtls_ssl_session session;  // Last one passed to mbedtls_ssl_set_session()
+};
+
+typedef int mbedtls_ssl_send_t(void *, const unsigned char *, size_t);
+typedef int mbedtls_ssl_recv_t(void *, unsigned char *, size_t);
+typedef int mbedtls_ssl_recv_timeout_t(void *, unsigned char *, size_t, unsigned int);
+
+inline void mbedtls_free(void *p) { free(p); }
+inline void mbedtls_x509_crt_free(mbedtls_x509_crt *) {}
+
+inline void mbedtls_ssl_init(mbedtls_ssl_context *) {}
+inline void mbedtls_ssl_free(mbedtls_ssl_context *) {}
+inline void mbedtls_ssl_config_init(mbedtls_ssl_config *) {}
+inline void mbedtls_ssl_config_free(mbedtls_ssl_config *) {}
+inline int mbedtls_ssl_config_defaults(mbedtls_ssl_config *, int, int, int) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+inline void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *, int) {}
+inline void mbedtls_ssl_conf_rng(mbedtls_ssl_config *, int (*)(void *, unsigned char *, size_t), void *) {}
+inline void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *, int) {}
+inline int mbedtls_ssl_setup(mbedtls_ssl_context *, const mbedtls_ssl_config *) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+inline int mbedtls_ssl_set_hostname(mbedtls_ssl_context *, const char *) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+inline void mbedtls_ssl_set_bio(mbedtls_ssl_context *, void *, mbedtls_ssl_send_t *, mbedtls_ssl_recv_t *,
+                                mbedtls_ssl_recv_timeout_t *) {}
+inline int mbedtls_ssl_handshake(mbedtls_ssl_context *) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+inline int mbedtls_ssl_read(mbedtls_ssl_context *, unsigned char *, size_t) { return MBEDTLS_ERR_NET_CONN_RESET; }
+inline int mbedtls_ssl_write(mbedtls_ssl_context *, const unsigned char *, size_t) { return MBEDTLS_ERR_NET_CONN_RESET; }
+inline size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *) { return 0; }
+inline int mbedtls_ssl_close_notify(mbedtls_ssl_context *) { return 0; }
+
+inline void mbedtls_ssl_session_init(mbedtls_ssl_session *s) { *s = mbedtls_ssl_session(); }
+inline void mbedtls_ssl_session_free(mbedtls_ssl_session *) {}
+inline int mbedtls_ssl_get_session(const mbedtls_ssl_context *, mbedtls_ssl_session *) { return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE; }
+inline int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session) {
+  ssl->session = *session;
+  return 0;
+}
+
+#define HOST_SSL_SESSION_FIXED (1 + 32 + 48 + 2) // id_len, id, master, ticket_len
+
+inline int mbedtls_ssl_session_save(const mbedtls_ssl_session *s, unsigned char *buf, size_t size, size_t *olen) {
+  size_t needed = HOST_SSL_SESSION_FIXED + s->ticket_len;
+  *olen = needed;
+  if (size < needed) return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+  buf[0] = (unsigned char)s->id_len;
+  memcpy(buf + 1, s->id, 32);
+  memcpy(buf + 33, s->master, 48);
+  buf[81] = (unsigned char)(s->ticket_len >> 8);
+  buf[82] = (unsigned char)s->ticket_len;
+  for (size_t i = 0; i < s->ticket_len; i++) buf[HOST_SSL_SESSION_FIXED + i] = (unsigned char)i;
+  return 0;
+}
+inline int mbedtls_ssl_session_load(mbedtls_ssl_session *s, const unsigned char *buf, size_t len) {
+  if (len < HOST_SSL_SESSION_FIXED) return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+  s->id_len = buf[0];
+  memcpy(s->id, buf + 1, 32);
+  memcpy(s->master, buf + 33, 48);
+  s->ticket_len = ((size_t)buf[81] << 8) | buf[82];
+  if (len != HOST_SSL_SESSION_FIXED + s->ticket_len) return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+  s->peer_cert = NULL;
+  return 0;
+}
+
+inline void mbedtls_entropy_init(mbedtls_entropy_context *) {}
+inline void mbedtls_entropy_free(mbedtls_entropy_context *) {}
+inline int mbedtls_entropy_func(void *, unsigned char *, size_t) { return -1; }
+inline void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *) {}
+inline void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context *) {}
+inline int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *, int (*)(void *, unsigned char *, size_t), void *,
+                                 const unsigned char *, size_t) { return -1; }
+inline int mbedtls_ctr_drbg_random(void *, unsigned char *, size_t) { return -1; }
+
+#endif // HOST_MBEDTLS_SSL_H
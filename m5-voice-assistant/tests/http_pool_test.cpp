@@ -0,0 +1,81 @@
+// Connection pool (common/http_pool.h) when every slot is taken: a waiting
+// caller gets a slot as soon as one is returned, and a cancel flag ends the
+// wait at once with the never-connected stand-in.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/http_pool.h"
+
+#include "test.h"
+
+#include <thread>
+
+static const char *POOL_URL = "http://127.0.0.1:1/api/v1/audio/speech"; // Nothing listens there
+
+// Take every slot; the sockets fail to connect but the slots stay in use
+static void takeAll(HTTPClient *held[HTTP_POOL_SIZE]) {
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+    held[i] = &httpPoolBegin(POOL_URL);
+    CHECK(httpPoolHasSlot(*held[i]));
+  }
+}
+
+static void endAll(HTTPClient *held[HTTP_POOL_SIZE]) {
+  for (int i = 0; i < HTTP_POOL_SIZE; i++) httpPoolEnd(*held[i]);
+}
+
+TEST(waiting_caller_gets_the_slot_that_is_returned) {
+  HTTPClient *held[HTTP_POOL_SIZE];
+  takeAll(held);
+
+  std::thread release([&] {
+    delay(200);
+    httpPoolEnd(*held[0]);
+  });
+  unsigned long start = millis();
+  HTTPClient &http = httpPoolBegin(POOL_URL);
+  unsigned long waited = millis() - start;
+  release.join();
+  CHECK(httpPoolHasSlot(http));
+  CHECK(&http == held[0]);
+  CHECK(waited >= 150 && waited < HTTP_POOL_WAIT_MS);
+
+  held[0] = &http;
+  endAll(held);
+}
+
+TEST(cancel_ends_the_wait_for_a_slot) {
+  HTTPClient *held[HTTP_POOL_SIZE];
+  takeAll(held);
+  uint32_t busy = httpPoolStats.busyTimeouts;
+
+  volatile bool cancel = false;
+  std::thread stop([&] {
+    delay(200);
+    cancel = true;
+  });
+  unsigned long start = millis();
+  HTTPClient &http = httpPoolBegin(POOL_URL, &cancel);
+  unsigned long waited = millis() - start;
+  stop.join();
+  CHECK(!httpPoolHasSlot(http));
+  CHECK(waited >= 150 && waited < 1000);
+  CHECK_EQ(httpPoolStats.busyTimeouts, busy); // Not counted as the pool running out
+  CHECK(httpPoolSend(http, "POST", "{}") < 0);      // Never connected
+  httpPoolEnd(http);
+
+  // Already set: no wait at all
+  HTTPClient &again = httpPoolBegin(POOL_URL, &cancel);
+  CHECK(!httpPoolHasSlot(again));
+  httpPoolEnd(again);
+  endAll(held);
+}
+
+TEST(free_slot_is_taken_even_with_cancel_set) {
+  volatile bool cancel = true;
+  HTTPClient &http = httpPoolBegin(POOL_URL, &cancel);
+  CHECK(httpPoolHasSlot(http));
+  httpPoolEnd(http);
+}
+
+TEST_MAIN()
@@ -0,0 +1,150 @@
+// Benchmark: reading role and content of every message out of a 200KB
+// OpenWebUI chat, the old way (whole body in a String, then indexOf/substring
+// as askGPT() did before json_stream.h) against JsonStream fed in TCP-sized
+// segments. Reports time, heap allocations and peak heap per parse.
+//
+//   ./json_stream_bench [bytes]
+
+#include "test_config.h"
+#include "../common/json_stream.h"
+
+#include "chat_document.h"
+
+#include <chrono>
+#include <malloc.h>
+#include <new>
+#include <vector>
+
+// ---- Heap accounting (every operator new in the process) ----
+
+static size_t heapAllocs = 0, heapLive = 0, heapPeak = 0;
+
+void *operator new(size_t size) {
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  heapAllocs++;
+  heapLive += malloc_usable_size(p);
+  if (heapLive > heapPeak) heapPeak = heapLive;
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  if (!p) return;
+  heapLive -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+struct Message {
+  String role;
+  String content;
+};
+
+#define SEGMENT_BYTES 1460                   // One TCP segment
+
+// Before: HTTPClient::getString() into a String, then the indexOf loop
+static void parseIndexOf(const std::string &doc, std::vector<Message> &out) {
+  String chatData;
+  for (size_t pos = 0; pos < doc.size(); pos += SEGMENT_BYTES) {
+    chatData.concat(doc.data() + pos, std::min<size_t>(SEGMENT_BYTES, doc.size() - pos));
+  }
+
+  int historyIdx = chatData.indexOf("\"history\"");
+  if (historyIdx < 0) return;
+  int messagesIdx = chatData.indexOf("\"messages\"", historyIdx);
+  if (messagesIdx < 0) return;
+  int msgStart = messagesIdx;
+  while (true) {
+    int roleIdx = chatData.indexOf("\"role\":", msgStart);
+    if (roleIdx < 0 || roleIdx > chatData.indexOf("\"currentId\"", historyIdx)) break;
+    int roleStart = chatData.indexOf('"', roleIdx + 7);
+    if (roleStart < 0) break;
+    roleStart++;
+    int roleEnd = chatData.indexOf('"', roleStart);
+    String role = chatData.substring(roleStart, roleEnd);
+
+    int contentIdx = chatData.indexOf("\"content\":", roleIdx);
+    if (contentIdx > 0) {
+      int contentStart = chatData.indexOf('"', contentIdx + 10);
+      if (contentStart >= 0) {
+        contentStart++;
+        String content = "";
+        bool esc = false;
+        for (unsigned int i = contentStart; i < chatData.length(); i++) {
+          char c = chatData[i];
+          if (esc) {
+            if (c == 'n') content += '\n';
+            else if (c == 't') content += '\t';
+            else content += c;                 // \uXXXX comes out as "uXXXX"
+            esc = false;
+          } else if (c == '\\') {
+            esc = true;
+          } else if (c == '"') {
+            break;
+          } else {
+            content += c;
+          }
+        }
+        out.push_back({role, content});
+      }
+    }
+    msgStart = roleIdx + 1;
+  }
+}
+
+// After: JsonStream straight off the segments, nothing but the results kept
+static void collectMessage(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx) {
+  std::vector<Message> &out = *(std::vector<Message> *)ctx;
+  if (json.match("chat.history.messages.*")) {
+    if (event == JSON_OBJECT_BEGIN) out.push_back({});
+    return;
+  }
+  if (event != JSON_STRING_PART && event != JSON_STRING_END) return;
+  if (json.match("chat.history.messages.*.role")) out.back().role.concat(data, len);
+  else if (json.match("chat.history.messages.*.content")) out.back().content.concat(data, len);
+}
+
+static void parseStream(const std::string &doc, std::vector<Message> &out) {
+  JsonStream json;
+  json.onEvent(collectMessage, &out);
+  for (size_t pos = 0; pos < doc.size(); pos += SEGMENT_BYTES) {
+    json.write((const uint8_t *)doc.data() + pos, std::min<size_t>(SEGMENT_BYTES, doc.size() - pos));
+  }
+  if (!json.done()) printf("JsonStream did not finish the document\n");
+}
+
+template <typename Parse>
+static void run(const char *name, const std::string &doc, int iterations, Parse parse) {
+  std::vector<Message> messages;
+  messages.reserve(1024);
+  size_t allocsBefore = heapAllocs;
+  size_t liveBefore = heapLive;
+  heapPeak = heapLive;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    messages.clear();
+    parse(doc, messages);
+  }
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+  printf("%-10s %9.1f us/parse %7.1f MB/s %8.1f allocs/parse %9zu bytes peak heap  (%zu messages)\n", name, us,
+         doc.size() / us, (double)(heapAllocs - allocsBefore) / iterations, heapPeak - liveBefore, messages.size());
+}
+
+int main(int argc, char **argv) {
+  size_t bytes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200 * 1024;
+  std::string doc = chatDocument(chatDocumentTurns(bytes));
+  printf("Chat document: %zu bytes, JsonStream state %zu bytes\n", doc.size(), sizeof(JsonStream));
+
+  // Same messages either way (the old parser mangles \uXXXX escapes)
+  std::vector<Message> a, b;
+  parseIndexOf(doc, a);
+  parseStream(doc, b);
+  size_t same = 0;
+  for (size_t i = 0; i < a.size() && i < b.size(); i++) same += a[i].role == b[i].role;
+  printf("Messages: %zu indexOf, %zu JsonStream, %zu roles agree\n", a.size(), b.size(), same);
+
+  run("indexOf", doc, 5, parseIndexOf);
+  run("JsonStream", doc, 50, parseStream);
+  return 0;
+}
@@ -0,0 +1,244 @@
+// Incremental JSON tokenizer (common/json_stream.h): the same events and
+// captures however the document is split into chunks, path patterns,
+// unescaping, raw subtrees, malformed input, and a chunked body read off a
+// socket with jsonStreamRead().
+
+#include "test_config.h"
+#include "../common/json_stream.h"
+
+#include "chat_document.h"
+#include "mock_server.h"
+#include "test.h"
+
+#include <random>
+
+static const char *EVENT_NAMES[] = {"{", "}", "[", "]", "part", "str", "num", "true", "false", "null"};
+
+// Every event with its path, one per line
+static void traceEvent(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx) {
+  std::string &trace = *(std::string *)ctx;
+  for (int level = 0; level < json.depth(); level++) {
+    if (level) trace += '.';
+    trace += json.isIndex(level) ? std::to_string(json.indexAt(level)) : json.keyAt(level);
+  }
+  trace += std::string(" ") + EVENT_NAMES[event] + " " + std::string(data, len) + "\n";
+}
+
+struct Parsed {
+  std::string trace;
+  String contents;
+  String roles;
+  bool done;
+  size_t bytes;
+};
+
+// Parse doc delivered in the given chunk sizes (the last one repeats)
+static Parsed parseInChunks(const std::string &doc, const std::vector<size_t> &sizes) {
+  Parsed p;
+  JsonStream json;
+  json.onEvent(traceEvent, &p.trace);
+  json.capture("chat.history.messages.*.content", p.contents);
+  json.capture("chat.messages.*.role", p.roles);
+  size_t pos = 0;
+  for (size_t i = 0; pos < doc.size(); i++) {
+    size_t n = std::min(sizes[std::min(i, sizes.size() - 1)], doc.size() - pos);
+    json.write((const uint8_t *)doc.data() + pos, n);
+    pos += n;
+  }
+  p.done = json.done() && !json.failed();
+  p.bytes = json.bytesParsed();
+  return p;
+}
+
+TEST(every_split_point_gives_the_same_events) {
+  std::string doc = chatDocument(4);
+  Parsed whole = parseInChunks(doc, {doc.size()});
+  CHECK(whole.done);
+  CHECK_EQ(whole.bytes, doc.size());
+
+  int mismatches = 0;
+  for (size_t split = 1; split < doc.size(); split++) {
+    Parsed p = parseInChunks(doc, {split, doc.size()});
+    if (p.trace != whole.trace || p.contents != whole.contents || !p.done) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+TEST(random_chunk_sizes_give_the_same_events) {
+  std::string doc = chatDocument(12);
+  Parsed whole = parseInChunks(doc, {doc.size()});
+  std::mt19937 rng(7);
+  for (int run = 0; run < 50; run++) {
+    std::vector<size_t> sizes;
+    for (size_t total = 0; total < doc.size();) {
+      size_t n = 1 + rng() % (run < 25 ? 8 : 1460);
+      sizes.push_back(n);
+      total += n;
+    }
+    Parsed p = parseInChunks(doc, sizes);
+    CHECK(p.done);
+    CHECK(p.trace == whole.trace);
+    CHECK(p.contents == whole.contents);
+  }
+  CHECK(parseInChunks(doc, {1}).trace == whole.trace);
+}
+
+TEST(captures_follow_path_patterns) {
+  const int turns = 6;
+  Parsed p = parseInChunks(chatDocument(turns), {7});
+  std::string expected;
+  for (int i = 0; i < turns; i++) expected += chatDocumentText(i);
+  CHECK_EQ(p.contents, String(expected.c_str()));
+  CHECK_EQ(p.roles, String("userassistantuserassistantuserassistant"));
+
+  JsonStream json;
+  String content, second, none;
+  json.capture("choices.0.message.content", content);
+  json.capture("choices.1.message.content", second);
+  json.capture("choices.*.message", none);          // An object, not a string
+  const char *doc = "{\"choices\":[{\"message\":{\"role\":\"assistant\",\"content\":\"Hi\"}},"
+                    "{\"message\":{\"content\":\"Two\"}}],\"usage\":{\"total_tokens\":12}}";
+  json.write((const uint8_t *)doc, strlen(doc));
+  CHECK(json.done());
+  CHECK_EQ(content, String("Hi"));
+  CHECK_EQ(second, String("Two"));
+  CHECK_EQ(none, String(""));
+}
+
+struct MatchProbe {
+  const char *pattern;
+  JsonEvent event;
+  int hits;
+};
+
+static void probeEvent(JsonStream &json, JsonEvent event, const char *, size_t, void *ctx) {
+  MatchProbe *probe = (MatchProbe *)ctx;
+  if (event == probe->event && json.match(probe->pattern)) probe->hits++;
+}
+
+TEST(match_wildcards_keys_and_indexes) {
+  std::string doc = chatDocument(4);
+  MatchProbe probes[] = {
+    {"chat.history.messages.*.role", JSON_STRING_END, 0},
+    {"chat.messages.*.childrenIds.0", JSON_STRING_END, 0},
+    {"chat.messages.3.done", JSON_TRUE, 0},
+    {"chat.history.messages.*.parentId", JSON_NULL, 0},
+    {"chat.history", JSON_OBJECT_END, 0},
+    {"", JSON_OBJECT_END, 0},
+    {"chat.messages.*", JSON_OBJECT_END, 0},
+    {"chat.messages.*.timestamp", JSON_NUMBER, 0},
+    {"chat.history.messages.*.role.x", JSON_STRING_END, 0},
+  };
+  int expected[] = {4, 3, 1, 1, 1, 1, 4, 4, 0};
+  for (size_t i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+    JsonStream json;
+    json.onEvent(probeEvent, &probes[i]);
+    json.write((const uint8_t *)doc.data(), doc.size());
+    CHECK(json.done());
+    if (probes[i].hits != expected[i]) TEST_FAIL("%s: %d hits, expected %d", probes[i].pattern, probes[i].hits, expected[i]);
+  }
+}
+
+TEST(strings_are_unescaped_to_utf8) {
+  JsonStream json;
+  String out;
+  json.capture("s.*", out);
+  const char *doc = "{\"s\":[\"a\\\"b\\\\c\\/d\", \"\\n\\t\\r\\b\\f\", \"\\u00e9\\u20AC\", \"\\ud83d\\ude00\","
+                    " \"\\ud83dx\", \"\\ude00\", \"\\u0041\"]}";
+  for (const char *p = doc; *p; p++) json.write((uint8_t)*p);
+  CHECK(json.done());
+  CHECK_EQ(out, String("a\"b\\c/d" "\n\t\r\b\f" "\xC3\xA9\xE2\x82\xAC" "\xF0\x9F\x98\x80"
+                       "\xEF\xBF\xBDx" "\xEF\xBF\xBD" "A"));
+}
+
+TEST(long_strings_arrive_in_parts) {
+  std::string text(1000, 'x');
+  for (size_t i = 0; i < text.size(); i += 7) text[i] = 'a' + i % 26;
+  std::string doc = "{\"k\":\"" + text + "\"}";
+  std::string trace;
+  JsonStream json;
+  json.onEvent(traceEvent, &trace);
+  String out;
+  json.capture("k", out);
+  json.write((const uint8_t *)doc.data(), doc.size());
+  CHECK(json.done());
+  CHECK_EQ(std::string(out.c_str()), text);
+  // Parts never exceed JSON_STREAM_CHUNK
+  size_t parts = 0;
+  for (size_t at = trace.find("k part "); at != std::string::npos; at = trace.find("k part ", at + 1)) parts++;
+  CHECK(parts >= text.size() / JSON_STREAM_CHUNK);
+}
+
+TEST(raw_copies_a_subtree) {
+  // As chat_history.h keeps history.messages verbatim
+  String messages;
+  JsonStream json;
+  json.onEvent([](JsonStream &j, JsonEvent event, const char *, size_t, void *ctx) {
+    String *out = (String *)ctx;
+    if (event == JSON_OBJECT_BEGIN && j.match("chat.history.messages")) {
+      *out = "{";                        // Raw starts after the brace that began the object
+      j.raw = out;
+    } else if (event == JSON_OBJECT_END && j.match("chat.history.messages")) {
+      j.raw = nullptr;
+    }
+  }, &messages);
+  std::string doc = chatDocument(4);
+  json.write((const uint8_t *)doc.data(), doc.size());
+  CHECK(json.done());
+  size_t start = doc.find("\"messages\":{") + 11;
+  size_t end = doc.find(",\"currentId\"");
+  CHECK_EQ(std::string(messages.c_str()), doc.substr(start, end - start));
+}
+
+TEST(malformed_documents_fail) {
+  const char *bad[] = {
+    "{\"a\":1,}", "{\"a\" 1}", "[1,2", "{\"a\":tru}", "{\"a\":\"\\uZZZZ\"}", "{]", "[}", "{\"a\":01x}", "nul",
+  };
+  for (const char *doc : bad) {
+    JsonStream json;
+    json.write((const uint8_t *)doc, strlen(doc));
+    if (json.done()) TEST_FAIL("accepted %s", doc);
+  }
+
+  std::string deep(JSON_STREAM_MAX_DEPTH + 1, '[');
+  JsonStream json;
+  json.write((const uint8_t *)deep.data(), deep.size());
+  CHECK(json.failed());
+
+  // Bytes after the document are not consumed
+  JsonStream tail;
+  tail.write((const uint8_t *)"{} trailing", 11);
+  CHECK(tail.done());
+  CHECK_EQ(tail.bytesParsed(), (size_t)2);
+}
+
+TEST(reads_a_chunked_body_from_a_socket) {
+  std::string doc = chatDocument(8);
+  MockServer server([&](MockConnection &c) {
+    c.send("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n");
+    for (size_t pos = 0; pos < doc.size();) {
+      size_t n = std::min<size_t>(777, doc.size() - pos);
+      char size[16];
+      snprintf(size, sizeof(size), "%zx\r\n", n);
+      c.send(size, strlen(size));
+      c.send(doc.data() + pos, n);
+      c.send("\r\n", 2);
+      pos += n;
+      delay(1);
+    }
+    c.send("0\r\n\r\n", 5);
+  });
+
+  WiFiClient client;
+  CHECK(client.connect("127.0.0.1", server.port()));
+  client.readStringUntil('\n');
+  while (client.readStringUntil('\n') != "\r") {}
+  JsonStream json;
+  String contents;
+  json.capture("chat.history.messages.*.content", contents);
+  CHECK(jsonStreamRead(client, json, true, 5000));
+  CHECK_EQ(json.bytesParsed(), doc.size());
+  CHECK_EQ(contents, parseInChunks(doc, {doc.size()}).contents);
+}
+
+TEST_MAIN()
@@ -0,0 +1,77 @@
+// Media arenas (common/media_arena.h): allocated once, carved again for each
+// audio profile without touching the heap, and refusing what doesn't fit.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+
+#include "test.h"
+
+static void useProfile(const AudioProfile &p) {
+  SAMPLE_RATE = p.sampleRate;
+  PRE_ROLL_SAMPLES = p.sampleRate * p.preRollMs / 1000;
+  RECORD_SAMPLES = p.sampleRate * p.recordSeconds;
+}
+
+TEST(arenas_are_allocated_once) {
+  mediaArenasBegin();
+  CHECK_EQ(audioArena.capacity, profilesAudioBytes(CORE_PROFILES, 3));
+  CHECK_EQ(replayArena.capacity, (size_t)REPLAY_ARENA_BYTES);
+  CHECK(imageArena.base == nullptr);               // ENABLE_CAMERA is false
+  CHECK(lastTtsMp3 == replayArena.base);
+  CHECK_EQ(memUsage[MEM_AUDIO].blocks, 1);
+
+  uint8_t *audio = audioArena.base;
+  mediaArenasBegin();
+  CHECK(audioArena.base == audio);
+  CHECK_EQ(memUsage[MEM_AUDIO].blocks, 1);
+}
+
+TEST(every_profile_is_carved_from_the_same_arena) {
+  mediaArenasBegin();
+  int blocks = memUsage[MEM_AUDIO].blocks;
+  for (const AudioProfile &p : CORE_PROFILES) {
+    useProfile(p);
+    CHECK(audioArenaCarve());
+    int samples = PRE_ROLL_SAMPLES + RECORD_SAMPLES;
+    CHECK((uint8_t *)audioBuffer == audioArena.base);
+    CHECK(audioCodecBuffer >= (uint8_t *)(audioBuffer + samples));
+    CHECK(audioCodecBuffer + samples <= audioArena.base + audioArena.capacity);
+    CHECK_EQ((int)((uintptr_t)audioCodecBuffer % MEDIA_ARENA_ALIGN), 0);
+  }
+  CHECK_EQ(memUsage[MEM_AUDIO].blocks, blocks);
+  CHECK(audioArena.peak <= audioArena.capacity);
+}
+
+TEST(take_refuses_what_does_not_fit) {
+  CHECK(mediaArenaBegin(imageArena, 1000, MEM_IMAGE));
+  void *a = mediaArenaTake(imageArena, 601);
+  CHECK(a == imageArena.base);
+  CHECK(mediaArenaTake(imageArena, 400) == nullptr); // 601 rounds up to 604
+  void *b = mediaArenaTake(imageArena, 396);
+  CHECK(b == imageArena.base + 604);
+  CHECK_EQ(imageArena.used, (size_t)1000);
+
+  mediaArenasNewInteraction();
+  CHECK_EQ(imageArena.used, (size_t)0);
+  CHECK_EQ(imageArena.peak, (size_t)1000);
+  CHECK(mediaArenaTake(imageArena, 1001) == nullptr);
+  mediaArenasReport();
+}
+
+TEST(replay_fill_tracks_the_peak) {
+  mediaArenasBegin();
+  mediaArenaFill(replayArena, 5000);
+  mediaArenaFill(replayArena, 200);
+  CHECK_EQ(replayArena.used, (size_t)200);
+  CHECK_EQ(replayArena.peak, (size_t)5000);
+  mediaArenaReset(replayArena);
+  CHECK_EQ(replayArena.used, (size_t)0);
+}
+
+TEST_MAIN()
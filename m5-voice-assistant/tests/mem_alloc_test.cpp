@@ -0,0 +1,156 @@
+// Central allocator (common/mem_alloc.h): which blocks come from the size-class
+// pools (once memBegin() has set them up) and which from the heap, moving
+// between them on realloc, and the per-user and per-region accounting
+// memReport() prints.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+
+#include "test.h"
+
+#include <thread>
+
+static int source(void *p) { return ((MemHeader *)p - 1)->source; }
+static int poolClass(void *p) { return ((MemHeader *)p - 1)->poolClass; }
+
+static uint32_t fullPool(int c) { return (1u << MEM_POOL_SLOTS[c]) - 1; }
+
+static bool poolsAllFree() {
+  for (int c = 0; c < MEM_POOL_CLASSES; c++) {
+    if (memPoolFree[c] != fullPool(c)) return false;
+  }
+  return true;
+}
+
+TEST(small_blocks_use_the_heap_until_the_pools_are_set_up) {
+  void *early = memAlloc(50, MEM_TEXT);
+  CHECK_EQ(source(early), (int)MEM_FROM_INTERNAL);
+
+  memBegin();
+  CHECK(poolsAllFree());
+  uint8_t *pool = memPools[0];
+  memBegin();                                     // A second call changes nothing
+  CHECK(memPools[0] == pool);
+
+  // A heap block from before memBegin() still goes back to the heap
+  memFree(early);
+  CHECK(poolsAllFree());
+  CHECK_EQ(memRegionBytes[MEM_FROM_INTERNAL], (size_t)0);
+}
+
+TEST(small_block_comes_from_a_pool_and_is_counted) {
+  void *p = memAlloc(50, MEM_TEXT);
+  CHECK(p != nullptr);
+  CHECK_EQ(source(p), (int)MEM_FROM_POOL);
+  CHECK_EQ(poolClass(p), 0);
+  CHECK_EQ((int)((uintptr_t)p % 8), 0);
+  CHECK_EQ(memUsage[MEM_TEXT].bytes, (size_t)50);
+  CHECK_EQ(memUsage[MEM_TEXT].blocks, 1);
+  CHECK_EQ(memRegionBytes[MEM_FROM_POOL], (size_t)50);
+
+  memFree(p);
+  CHECK_EQ(memUsage[MEM_TEXT].bytes, (size_t)0);
+  CHECK_EQ(memUsage[MEM_TEXT].blocks, 0);
+  CHECK_EQ(memUsage[MEM_TEXT].peak, (size_t)50);
+  CHECK_EQ(memRegionBytes[MEM_FROM_POOL], (size_t)0);
+  CHECK(poolsAllFree());
+  memFree(nullptr);
+}
+
+TEST(full_class_spills_into_a_bigger_one_then_the_heap) {
+  int slots = MEM_POOL_SLOTS[0] + MEM_POOL_SLOTS[1] + MEM_POOL_SLOTS[2];
+  std::vector<void *> blocks;
+  for (int i = 0; i < slots; i++) blocks.push_back(memAlloc(64, MEM_TASK));
+  CHECK_EQ(poolClass(blocks[MEM_POOL_SLOTS[0] - 1]), 0);
+  CHECK_EQ(poolClass(blocks[MEM_POOL_SLOTS[0]]), 1);
+  CHECK_EQ(poolClass(blocks[slots - 1]), 2);
+  for (void *p : blocks) CHECK_EQ(source(p), (int)MEM_FROM_POOL);
+
+  void *heap = memAlloc(64, MEM_TASK);
+  CHECK_EQ(source(heap), (int)MEM_FROM_INTERNAL);
+  CHECK_EQ(memUsage[MEM_TASK].blocks, slots + 1);
+  CHECK_EQ(memRegionBytes[MEM_FROM_POOL], (size_t)slots * 64);
+  CHECK_EQ(memRegionBytes[MEM_FROM_INTERNAL], (size_t)64);
+
+  // A freed slot is handed out again
+  memFree(blocks[3]);
+  blocks[3] = memAlloc(10, MEM_TASK);
+  CHECK_EQ(source(blocks[3]), (int)MEM_FROM_POOL);
+  CHECK_EQ(poolClass(blocks[3]), 0);
+
+  for (void *p : blocks) memFree(p);
+  memFree(heap);
+  CHECK(poolsAllFree());
+  CHECK_EQ(memUsage[MEM_TASK].bytes, (size_t)0);
+  CHECK_EQ(memRegionBytes[MEM_FROM_INTERNAL], (size_t)0);
+}
+
+TEST(media_buffers_skip_the_pools) {
+  // No PSRAM on the host: large media stays internal, small media uses the pools
+  void *recording = memAlloc(4096, MEM_AUDIO);
+  void *small = memAlloc(100, MEM_AUDIO);
+  void *speaker = memAlloc(4096, MEM_SPEAKER);
+  CHECK_EQ(source(recording), (int)MEM_FROM_INTERNAL);
+  CHECK_EQ(source(small), (int)MEM_FROM_POOL);
+  CHECK_EQ(source(speaker), (int)MEM_FROM_INTERNAL);
+  CHECK_EQ(memUsage[MEM_AUDIO].bytes, (size_t)4196);
+  memFree(recording);
+  memFree(small);
+  memFree(speaker);
+  CHECK_EQ(memUsage[MEM_AUDIO].peak, (size_t)4196);
+}
+
+TEST(realloc_moves_out_of_the_pool_and_keeps_the_data) {
+  char *p = (char *)memAlloc(40, MEM_CHAT);
+  CHECK_EQ(source(p), (int)MEM_FROM_POOL);
+  for (int i = 0; i < 40; i++) p[i] = (char)i;
+
+  p = (char *)memRealloc(p, 5000, MEM_CHAT);
+  CHECK_EQ(source(p), (int)MEM_FROM_INTERNAL);
+  bool kept = true;
+  for (int i = 0; i < 40; i++) kept = kept && p[i] == (char)i;
+  CHECK(kept);
+  CHECK(poolsAllFree());
+  CHECK_EQ(memUsage[MEM_CHAT].bytes, (size_t)5000);
+  CHECK_EQ(memUsage[MEM_CHAT].blocks, 1);
+
+  p = (char *)memRealloc(p, 20000, MEM_CHAT);
+  CHECK_EQ(p[39], (char)39);
+  CHECK_EQ(memUsage[MEM_CHAT].bytes, (size_t)20000);
+  CHECK_EQ(memRegionBytes[MEM_FROM_INTERNAL], (size_t)20000);
+  memFree(p);
+  CHECK_EQ(memUsage[MEM_CHAT].blocks, 0);
+  CHECK_EQ(memUsage[MEM_CHAT].peak, (size_t)20000);
+
+  char *copy = memStrdup("hello", MEM_TEXT);
+  CHECK_EQ(std::string(copy), std::string("hello"));
+  memFree(copy);
+}
+
+TEST(failed_allocation_is_counted) {
+  CHECK(memAlloc((size_t)1 << 60, MEM_IMAGE) == nullptr);
+  CHECK_EQ(memUsage[MEM_IMAGE].failures, 1);
+  CHECK_EQ(memUsage[MEM_IMAGE].blocks, 0);
+  memReport();
+}
+
+TEST(tasks_share_the_pools) {
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([t] {
+      for (int i = 0; i < 2000; i++) {
+        void *a = memAlloc(16 + (i * 7 + t) % 200, MEM_TEXT);
+        void *b = memAlloc(8, MEM_TASK);
+        memFree(a);
+        memFree(b);
+      }
+    });
+  }
+  for (std::thread &t : threads) t.join();
+  CHECK(poolsAllFree());
+  CHECK_EQ(memUsage[MEM_TEXT].bytes, (size_t)0);
+  CHECK_EQ(memUsage[MEM_TASK].blocks, 0);
+  CHECK_EQ(memRegionBytes[MEM_FROM_POOL], (size_t)0);
+}
+
+TEST_MAIN()
@@ -0,0 +1,129 @@
+// Always-armed capture (common/mic_capture.h) against a stand-in mic that
+// lands each record() block in real time and fills it with a running sample
+// counter, so audioBuffer shows whether pre-roll and recording are in order.
+// audioBuffer is carved from the audio arena per profile, as on the device.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+
+#include <deque>
+#include <mutex>
+
+// Like M5.Mic: record() queues a block, isRecording() counts the queued ones
+struct FakeMic {
+  struct Block {
+    int16_t *dst;
+    size_t length;
+    unsigned long dueMs;
+  };
+  std::mutex lock;
+  std::deque<Block> blocks;
+  uint16_t counter = 0;
+  bool running = false;
+
+  bool begin() {
+    running = true;
+    return true;
+  }
+  void end() {
+    std::lock_guard<std::mutex> guard(lock);
+    blocks.clear();
+    running = false;
+  }
+  bool record(int16_t *dst, size_t length, uint32_t rate) {
+    std::lock_guard<std::mutex> guard(lock);
+    unsigned long start = blocks.empty() ? millis() : blocks.back().dueMs;
+    blocks.push_back({dst, length, start + (unsigned long)(length * 1000 / rate)});
+    return true;
+  }
+  size_t isRecording() {
+    std::lock_guard<std::mutex> guard(lock);
+    while (!blocks.empty() && (long)(millis() - blocks.front().dueMs) >= 0) {
+      Block &b = blocks.front();
+      for (size_t i = 0; i < b.length; i++) b.dst[i] = (int16_t)counter++;
+      blocks.pop_front();
+    }
+    return blocks.size();
+  }
+};
+
+static FakeMic fakeMic;
+#define CAPTURE_MIC fakeMic
+
+#include "../common/mic_capture.h"
+
+#include "test.h"
+
+static const int BLOCK = 16000 * MIC_CAPTURE_BLOCK_MS / 1000;
+
+static void useProfile(int preRollMs, int recordMs) {
+  mediaArenasBegin();
+  micCaptureDisarm();
+  PRE_ROLL_SAMPLES = SAMPLE_RATE * preRollMs / 1000;
+  RECORD_SAMPLES = SAMPLE_RATE * recordMs / 1000;
+  audioArenaCarve();
+}
+
+// Index of the first sample that doesn't follow the one before it, -1 if none
+static int firstGap(int samples) {
+  for (int i = 1; i < samples; i++) {
+    if ((uint16_t)(audioBuffer[i] - audioBuffer[i - 1]) != 1) return i;
+  }
+  return -1;
+}
+
+TEST(wrapped_ring_is_put_in_order_before_the_recording) {
+  useProfile(500, 5000);
+  CHECK(micCaptureArm());
+  delay(700);
+
+  int preRoll = micCaptureStart();
+  CHECK_EQ(preRoll, PRE_ROLL_SAMPLES / BLOCK * BLOCK);
+  int have = micCaptureWait(preRoll, 500);
+  CHECK(have > preRoll);
+  delay(200);
+  int total = micCaptureStop();
+  CHECK(total >= preRoll + 4 * BLOCK);
+  CHECK(!fakeMic.running);
+  CHECK_EQ(firstGap(total), -1);
+}
+
+TEST(short_pre_roll_is_kept_as_far_as_it_got) {
+  useProfile(500, 5000);
+  CHECK(micCaptureArm());
+  delay(150);
+
+  int preRoll = micCaptureStart();
+  CHECK(preRoll >= BLOCK && preRoll < PRE_ROLL_SAMPLES / BLOCK * BLOCK);
+  CHECK_EQ(preRoll % BLOCK, 0);
+  micCaptureWait(preRoll, 500);
+  int total = micCaptureStop();
+  CHECK(total > preRoll);
+  CHECK_EQ(firstGap(total), -1);
+}
+
+TEST(recording_without_pre_roll_stops_when_full) {
+  useProfile(500, 300);
+  CHECK_EQ(micCaptureStart(), 0);
+  int have = 0;
+  for (int next; (next = micCaptureWait(have, 500)) > have;) have = next;
+  CHECK_EQ(have, RECORD_SAMPLES);
+
+  // The last block is cut to fit
+  CHECK_EQ(micCaptureStop(), RECORD_SAMPLES);
+  CHECK_EQ(firstGap(RECORD_SAMPLES), -1);
+}
+
+TEST(pre_roll_shorter_than_two_blocks_is_not_armed) {
+  useProfile(40, 5000);
+  CHECK(!micCaptureArm());
+  CHECK(!micCaptureRunning);
+}
+
+TEST_MAIN()
@@ -0,0 +1,170 @@
+// Mic clean-up (common/mic_preprocess.h): the DC blocker and high-pass on
+// tones either side of the corner, the same output however the samples are
+// split into calls, and the AGC's target level, look-ahead peak limit, noise
+// gate, rise rate and gain carried between recordings.
+
+#include "test_config.h"
+#include "../common/dsp_kernels.h"
+#include "../common/mic_preprocess.h"
+
+#include "test.h"
+#include "test_signal.h"
+
+#include <random>
+
+#define TEST_BLOCK (SAMPLE_RATE * AGC_BLOCK_MS / 1000)
+
+static void begin(int stages, int32_t gain = 1 << 12) {
+  MIC_PREPROCESS = stages;
+  micPreprocessBegin();
+  micAgcGain = gain;
+}
+
+// Process in mic blocks, as recordAudio() does
+static std::vector<int16_t> process(std::vector<int16_t> x) {
+  for (size_t pos = 0; pos < x.size(); pos += TEST_BLOCK) {
+    micPreprocess(x.data() + pos, std::min<int>(TEST_BLOCK, x.size() - pos));
+  }
+  return x;
+}
+
+static DspStats statsOf(const std::vector<int16_t> &x, size_t from, size_t to) {
+  DspStats s;
+  dspStats(s, x.data() + from, to - from);
+  return s;
+}
+
+static std::vector<int16_t> concat(std::vector<int16_t> a, const std::vector<int16_t> &b) {
+  a.insert(a.end(), b.begin(), b.end());
+  return a;
+}
+
+TEST(no_stages_leave_samples_alone) {
+  std::vector<int16_t> in = testVoice(SAMPLE_RATE, SAMPLE_RATE, 3000);
+  begin(0);
+  CHECK(process(in) == in);
+}
+
+TEST(dc_blocker_removes_the_offset) {
+  std::vector<int16_t> in = testTone(SAMPLE_RATE, 440, 3000, SAMPLE_RATE * 2);
+  for (int16_t &s : in) s += 2000;
+  begin(MIC_DC);
+  std::vector<int16_t> out = process(in);
+  DspStats settled = statsOf(out, SAMPLE_RATE, out.size());
+  int64_t sum = 0;
+  for (size_t i = SAMPLE_RATE; i < out.size(); i++) sum += out[i];
+  CHECK(llabs(sum / (int64_t)(out.size() - SAMPLE_RATE)) < 5);
+  CHECK_NEAR(dspRms(settled), 3000 / sqrt(2), 30);
+
+  // A bare offset decays all the way (no dead band from rounding the feedback)
+  std::vector<int16_t> offset(SAMPLE_RATE, 2000);
+  begin(MIC_DC);
+  out = process(offset);
+  CHECK_EQ(out.back(), 0);
+}
+
+TEST(high_pass_cuts_rumble_and_keeps_speech) {
+  begin(MIC_HPF);
+  std::vector<int16_t> rumble = process(testTone(SAMPLE_RATE, 30, 10000, SAMPLE_RATE));
+  begin(MIC_HPF);
+  std::vector<int16_t> voice = process(testTone(SAMPLE_RATE, 1000, 10000, SAMPLE_RATE));
+
+  // Two one-pole sections at 100Hz: about -22dB at 30Hz, -0.4dB at 1kHz
+  int rumbleRms = dspRms(statsOf(rumble, SAMPLE_RATE / 2, rumble.size()));
+  int voiceRms = dspRms(statsOf(voice, SAMPLE_RATE / 2, voice.size()));
+  CHECK(rumbleRms < 7071 / 10);
+  CHECK(voiceRms > 7071 * 0.94);
+}
+
+TEST(filters_carry_state_across_calls) {
+  std::vector<int16_t> in = testVoice(SAMPLE_RATE, SAMPLE_RATE, 8000);
+  for (size_t i = 0; i < in.size(); i++) in[i] += 1500 + (int16_t)(4000 * sin(2 * M_PI * 40 * i / SAMPLE_RATE));
+  begin(MIC_DC | MIC_HPF);
+  std::vector<int16_t> whole = in;
+  micPreprocess(whole.data(), whole.size());
+
+  std::mt19937 rng(22);
+  begin(MIC_DC | MIC_HPF);
+  std::vector<int16_t> pieces = in;
+  for (size_t pos = 0; pos < pieces.size();) {
+    int n = std::min<int>(1 + rng() % 700, pieces.size() - pos);
+    micPreprocess(pieces.data() + pos, n);
+    pos += n;
+  }
+  CHECK(pieces == whole);
+}
+
+TEST(agc_brings_a_quiet_voice_to_the_target) {
+  begin(MIC_AGC);
+  std::vector<int16_t> out = process(testVoice(SAMPLE_RATE, SAMPLE_RATE * 4, 1200));
+  int inRms = dspRms(statsOf(testVoice(SAMPLE_RATE, SAMPLE_RATE * 4, 1200), 0, SAMPLE_RATE * 4));
+  int outRms = dspRms(statsOf(out, SAMPLE_RATE * 2, out.size()));
+  CHECK(inRms < AGC_TARGET_RMS / 2);
+  CHECK(outRms > AGC_TARGET_RMS * 0.8 && outRms < AGC_TARGET_RMS * 1.2);
+
+  // Too quiet for the largest gain: boosted by exactly that much
+  begin(MIC_AGC);
+  std::vector<int16_t> faint = testTone(SAMPLE_RATE, 500, 250, SAMPLE_RATE * 3);
+  out = process(faint);
+  CHECK_EQ(micAgcGain, AGC_MAX_GAIN);
+  CHECK_NEAR(dspRms(statsOf(out, SAMPLE_RATE * 2, out.size())), 250 / sqrt(2) * (AGC_MAX_GAIN >> 12), 8);
+}
+
+TEST(agc_gain_rises_at_most_a_decibel_per_block) {
+  begin(MIC_AGC);
+  std::vector<int16_t> quiet = testTone(SAMPLE_RATE, 500, 400, TEST_BLOCK);
+  int32_t previous = micAgcGain;
+  int rises = 0;
+  for (int b = 0; b < 40; b++) {
+    std::vector<int16_t> block = quiet;
+    micPreprocess(block.data(), block.size());
+    if (micAgcGain > (int32_t)(((int64_t)previous * AGC_RISE) >> 12)) TEST_FAIL("block %d: %d -> %d", b, previous, micAgcGain);
+    rises += micAgcGain > previous;
+    previous = micAgcGain;
+  }
+  CHECK(rises >= 10);
+  CHECK(micAgcGain > 3 << 12);
+}
+
+TEST(agc_look_ahead_keeps_a_loud_burst_from_clipping) {
+  // The quiet start pushes the gain up; the burst's first block must not clip
+  std::vector<int16_t> in = concat(testTone(SAMPLE_RATE, 300, 300, SAMPLE_RATE * 2),
+                                   testTone(SAMPLE_RATE, 300, 20000, SAMPLE_RATE / 2));
+  begin(MIC_AGC);
+  std::vector<int16_t> out = process(in);
+  DspStats burst = statsOf(out, SAMPLE_RATE * 2, out.size());
+  CHECK(statsOf(out, SAMPLE_RATE, SAMPLE_RATE * 2).maxVal > 300 * 4);
+  CHECK(burst.maxVal <= AGC_PEAK_LIMIT && burst.minVal >= -AGC_PEAK_LIMIT);
+  CHECK(burst.maxVal >= 20000 * AGC_MIN_GAIN >> 12);   // Turned down, but only to AGC_MIN_GAIN
+  CHECK(micAgcGain >= AGC_MIN_GAIN);
+}
+
+TEST(agc_holds_the_gain_through_silence) {
+  begin(MIC_AGC);
+  process(testVoice(SAMPLE_RATE, SAMPLE_RATE * 2, 1200));
+  int32_t speechGain = micAgcGain;
+  std::mt19937 rng(23);
+  std::normal_distribution<float> gauss(0, 60);
+  std::vector<int16_t> hiss(SAMPLE_RATE * 2);
+  for (int16_t &s : hiss) s = (int16_t)gauss(rng);
+  std::vector<int16_t> out = process(hiss);
+  CHECK_EQ(micAgcGain, speechGain);
+  CHECK(dspRms(statsOf(out, 0, out.size())) < 60 * speechGain / 4096 + 5);
+
+  // ...and into the next recording
+  micPreprocessBegin();
+  CHECK_EQ(micAgcGain, speechGain);
+}
+
+TEST(stages_are_picked_at_begin) {
+  std::vector<int16_t> in = testTone(SAMPLE_RATE, 30, 5000, SAMPLE_RATE / 4);
+  for (int16_t &s : in) s += 1000;
+  begin(MIC_DC | MIC_HPF);
+  MIC_PREPROCESS = 0;                              // A profile change mid-recording waits for the next one
+  CHECK(process(in) != in);
+  begin(0, 3 << 12);
+  CHECK(process(in) == in);
+  CHECK_EQ(micAgcGain, 3 << 12);
+}
+
+TEST_MAIN()
@@ -0,0 +1,102 @@
+#ifndef MOCK_OWUI_H
+#define MOCK_OWUI_H
+
+// Mock OpenWebUI for the chat tests: answers each request on the pooled
+// connection from a route table and logs what was asked, plus a helper that
+// reads a JSON body back into path -> value pairs. A route can be made to fail
+// its first few requests with 503, and every answer can be held back a while.
+//
+//   MockOwui owui;
+//   owui.routes["GET /api/v1/chats/chat-1"] = {200, chatDocument(4)};
+//   MockServer server([&](MockConnection &c) { owui.serve(c); });
+//   useServer(server);
+//   ... run the code under test ...
+//   finish(server);
+
+#include "mock_server.h"
+#include "../common/json_stream.h"
+
+#include <map>
+#include <mutex>
+
+struct MockOwui {
+  std::map<std::string, std::pair<int, std::string>> routes;   // "METHOD path" -> code, body
+  std::map<std::string, int> failures;                          // 503s left before the route answers
+  int delayMs = 0;                                              // Before each answer
+  std::vector<std::string> requests;
+  std::vector<std::string> bodies;
+  std::mutex lock;
+
+  void serve(MockConnection &c) {
+    String line, headers;
+    std::string body;
+    while (c.readRequest(line, headers, body)) {
+      std::string request = line.substring(0, line.lastIndexOf(' ')).c_str();
+      std::pair<int, std::string> response = {404, "{\"detail\":\"Not Found\"}"};
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        requests.push_back(request);
+        bodies.push_back(body);
+        auto route = routes.find(request);
+        if (route != routes.end()) response = route->second;
+        if (failures[request] > 0) {
+          failures[request]--;
+          response = {503, "{\"detail\":\"Busy\"}"};
+        }
+      }
+      if (delayMs > 0) delay(delayMs);
+      c.sendResponse(response.first, response.second);
+    }
+  }
+
+  size_t count() {
+    std::lock_guard<std::mutex> guard(lock);
+    return requests.size();
+  }
+};
+
+inline void useServer(MockServer &server) {
+  static String baseUrl;
+  baseUrl = String("http://127.0.0.1:") + server.port();
+  OWUI_BASE_URL = baseUrl.c_str();
+}
+
+// Close the pooled sockets so the mock's request loop ends
+inline void finish(MockServer &server) {
+  httpPoolCloseAll();
+  server.join();
+}
+
+// Every string and number of a JSON document by its dotted path
+struct JsonValues {
+  std::map<std::string, std::string> values;
+  std::string current;
+  bool done = false;
+};
+
+inline void collectJsonValue(JsonStream &json, JsonEvent event, const char *data, size_t len, void *ctx) {
+  JsonValues &v = *(JsonValues *)ctx;
+  if (event != JSON_STRING_PART && event != JSON_STRING_END && event != JSON_NUMBER) return;
+  v.current.append(data, len);
+  if (event == JSON_STRING_PART) return;
+  std::string path;
+  for (int level = 0; level < json.depth(); level++) {
+    if (level) path += '.';
+    path += json.isIndex(level) ? std::to_string(json.indexAt(level)) : json.keyAt(level);
+  }
+  v.values[path] = v.current;
+  v.current.clear();
+}
+
+inline JsonValues parseJson(const std::string &text) {
+  JsonValues v;
+  JsonStream json;
+  json.onEvent(collectJsonValue, &v);
+  json.write((const uint8_t *)text.data(), text.size());
+  v.done = json.done() && !json.failed();
+  return v;
+}
+
+inline JsonValues parseJson(const String &text) { return parseJson(std::string(text.c_str())); }
+
+#endif // MOCK_OWUI_H
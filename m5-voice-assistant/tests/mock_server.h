@@ -0,0 +1,169 @@
+#ifndef MOCK_SERVER_H
+#define MOCK_SERVER_H
+
+// One-connection TCP server on 127.0.0.1 for the host tests. The handler runs
+// on its own thread with the accepted socket, reading what the code under test
+// sends and replying like the real server would:
+//
+//   MockServer server([&](MockConnection &c) {
+//     String request = c.readLine();
+//     ...
+//     c.send("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+//   });
+//   STT_PORT = server.port();
+//   ... run the code under test ...
+//   server.join();
+
+#include <Arduino.h>
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+class MockConnection {
+ public:
+  explicit MockConnection(int fd) : _fd(fd) {}
+
+  // Next byte, -1 once the client closed or nothing came for timeoutMs
+  int readByte(int timeoutMs = 5000) {
+    pollfd p = {_fd, POLLIN, 0};
+    if (poll(&p, 1, timeoutMs) <= 0) return -1;
+    uint8_t c;
+    return recv(_fd, &c, 1, 0) == 1 ? c : -1;
+  }
+
+  // Line without its CRLF; stops early at end of stream
+  String readLine() {
+    String line;
+    int c;
+    while ((c = readByte()) >= 0 && c != '\n') {
+      if (c != '\r') line += (char)c;
+    }
+    return line;
+  }
+
+  bool readExact(std::string &out, size_t n) {
+    while (n-- > 0) {
+      int c = readByte();
+      if (c < 0) return false;
+      out += (char)c;
+    }
+    return true;
+  }
+
+  // Request headers up to the blank line, lowercased names: "name: value\n"...
+  String readHeaders() {
+    String headers;
+    for (String line = readLine(); line.length() > 0; line = readLine()) {
+      int colon = line.indexOf(':');
+      String name = line.substring(0, colon);
+      name.toLowerCase();
+      headers += name + line.substring(colon) + "\n";
+    }
+    return headers;
+  }
+
+  // Decode a chunked body; chunkSizes receives the size of every data chunk
+  bool readChunked(std::string &body, std::vector<size_t> *chunkSizes = nullptr) {
+    for (;;) {
+      String sizeLine = readLine();
+      if (sizeLine.length() == 0) return false;
+      size_t size = strtoul(sizeLine.c_str(), nullptr, 16);
+      if (size == 0) return readLine().length() == 0;   // Trailer ends with an empty line
+      if (chunkSizes) chunkSizes->push_back(size);
+      if (!readExact(body, size)) return false;
+      if (readLine().length() != 0) return false;       // CRLF after the data
+    }
+  }
+
+  // One HTTP request: request line, headers and a Content-Length or chunked
+  // body. False once the client has closed the connection.
+  bool readRequest(String &requestLine, String &headers, std::string &body) {
+    requestLine = readLine();
+    if (requestLine.length() == 0) return false;
+    headers = readHeaders();
+    body.clear();
+    if (headers.indexOf("transfer-encoding: chunked\n") >= 0) return readChunked(body);
+    int length = headers.indexOf("content-length: ");
+    if (length < 0) return true;
+    return readExact(body, headers.substring(length + 16).toInt());
+  }
+
+  bool sendResponse(int code, const std::string &body, const char *type = "application/json") {
+    return send(String("HTTP/1.1 ") + code + (code == 200 ? " OK" : " Error") + "\r\nContent-Type: " + type +
+                "\r\nContent-Length: " + (int)body.size() + "\r\n\r\n") &&
+           send(body.data(), body.size());
+  }
+
+  bool send(const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (n > 0) {
+      ssize_t sent = ::send(_fd, p, n, MSG_NOSIGNAL);
+      if (sent <= 0) return false;
+      p += sent;
+      n -= sent;
+    }
+    return true;
+  }
+
+  bool send(const String &text) { return send(text.c_str(), text.length()); }
+
+ private:
+  int _fd;
+};
+
+class MockServer {
+ public:
+  explicit MockServer(std::function<void(MockConnection &)> handler) {
+    _listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;                                   // Any free port
+    bind(_listenFd, (sockaddr *)&addr, sizeof(addr));
+    listen(_listenFd, 1);
+    socklen_t len = sizeof(addr);
+    getsockname(_listenFd, (sockaddr *)&addr, &len);
+    _port = ntohs(addr.sin_port);
+
+    _thread = std::thread([this, handler] {
+      pollfd p = {_listenFd, POLLIN, 0};
+      if (poll(&p, 1, 10000) <= 0) return;               // Nobody connected
+      int fd = accept(_listenFd, nullptr, nullptr);
+      if (fd < 0) return;
+      _accepted = true;
+      MockConnection connection(fd);
+      handler(connection);
+      close(fd);
+    });
+  }
+
+  ~MockServer() {
+    join();
+    close(_listenFd);
+  }
+
+  int port() const { return _port; }
+  bool accepted() const { return _accepted; }
+
+  void join() {
+    if (_thread.joinable()) _thread.join();
+  }
+
+ private:
+  int _listenFd;
+  int _port = 0;
+  volatile bool _accepted = false;
+  std::thread _thread;
+};
+
+#endif // MOCK_SERVER_H
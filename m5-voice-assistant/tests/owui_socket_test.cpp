@@ -0,0 +1,258 @@
+// OpenWebUI Socket.IO client (common/owui_socket.h) against a local WebSocket
+// stand-in: the server side of the upgrade, Engine.IO open, namespace connect
+// and a recorded-style sequence of chat events, frame by frame.
+
+#include "test_config.h"
+#include "../common/http_pool.h"
+#include "../common/owui_socket.h"
+
+#include "mock_server.h"
+#include "test.h"
+
+#include <atomic>
+
+volatile bool interactionCancelRequested = false;
+
+static const char *TEST_CHAT = "chat-1";
+static const char *TEST_MESSAGE = "msg-1";
+
+// ---- WebSocket stand-in (server side) ----
+
+static void wsSend(MockConnection &c, uint8_t opcode, const std::string &payload, bool fin = true) {
+  std::string frame;
+  frame += (char)((fin ? 0x80 : 0) | opcode);
+  size_t len = payload.size();
+  if (len < 126) {
+    frame += (char)len;
+  } else if (len < 65536) {
+    frame += (char)126;
+    frame += (char)(len >> 8);
+    frame += (char)(len & 0xFF);
+  } else {
+    frame += (char)127;
+    for (int i = 7; i >= 0; i--) frame += (char)((uint64_t)len >> (8 * i));
+  }
+  frame += payload;
+  c.send(frame.data(), frame.size());
+}
+
+static void wsText(MockConnection &c, const std::string &text) { wsSend(c, WS_OP_TEXT, text); }
+
+// One client frame; clients must mask, so an unmasked frame fails the test
+static bool wsRead(MockConnection &c, uint8_t &opcode, std::string &payload) {
+  std::string hdr;
+  if (!c.readExact(hdr, 2)) return false;
+  opcode = hdr[0] & 0x0F;
+  bool masked = hdr[1] & 0x80;
+  CHECK(masked);
+  CHECK(hdr[0] & 0x80);                  // The client never fragments
+  uint64_t len = hdr[1] & 0x7F;
+  std::string ext;
+  if (len == 126) {
+    if (!c.readExact(ext, 2)) return false;
+    len = (uint8_t)ext[0] << 8 | (uint8_t)ext[1];
+  }
+  std::string mask;
+  if (!masked || !c.readExact(mask, 4)) return false;
+  payload.clear();
+  if (!c.readExact(payload, len)) return false;
+  for (size_t i = 0; i < len; i++) payload[i] ^= mask[i & 3];
+  return true;
+}
+
+static std::string wsReadText(MockConnection &c) {
+  uint8_t opcode;
+  std::string payload;
+  if (!wsRead(c, opcode, payload)) return "(closed)";
+  CHECK_EQ((int)opcode, WS_OP_TEXT);
+  return payload;
+}
+
+// Upgrade and Socket.IO connect, as OpenWebUI answers them
+static void acceptSocket(MockConnection &c, String &request, String &headers) {
+  request = c.readLine();
+  headers = c.readHeaders();
+  c.send("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n\r\n");
+  wsText(c, "0{\"sid\":\"eio-1\",\"upgrades\":[],\"pingInterval\":25000,\"pingTimeout\":20000}");
+  CHECK_EQ(wsReadText(c), std::string("40{\"token\":\"test-llm-key\"}"));
+  wsText(c, "2");                        // Engine.IO ping before the connect reply
+  CHECK_EQ(wsReadText(c), std::string("3"));
+  wsText(c, "40{\"sid\":\"sock-1\"}");
+  CHECK_EQ(wsReadText(c), std::string("42[\"user-join\",{\"auth\":{\"token\":\"test-llm-key\"}}]"));
+}
+
+static std::string chatEvent(const char *messageId, const std::string &data) {
+  return std::string("42[\"chat-events\",{\"chat_id\":\"") + TEST_CHAT + "\",\"message_id\":\"" + messageId +
+         "\",\"data\":" + data + "}]";
+}
+
+static String deltas;
+static void onDelta(const String &delta) { deltas += delta + "|"; }
+
+static void useServer(MockServer &server) {
+  static String baseUrl;
+  baseUrl = String("http://127.0.0.1:") + server.port();
+  OWUI_BASE_URL = baseUrl.c_str();
+  interactionCancelRequested = false;
+  deltas = "";
+}
+
+TEST(connects_and_collects_a_completion) {
+  String request, headers;
+  std::vector<std::string> afterDone;
+  MockServer server([&](MockConnection &c) {
+    acceptSocket(c, request, headers);
+    wsText(c, chatEvent("other-msg", "{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"nope\"}}"));
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"Hel\"}}"));
+    wsSend(c, WS_OP_PING, "keepalive");
+    // A fragmented text message: "lo" arrives over two frames
+    std::string fragmented = chatEvent(TEST_MESSAGE, "{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"lo\"}}");
+    wsSend(c, WS_OP_TEXT, fragmented.substr(0, 20), false);
+    wsSend(c, WS_OP_CONTINUATION, fragmented.substr(20), true);
+    // Messages past OWUI_SOCKET_MAX_FRAME are skipped (16- and 64-bit lengths)
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"" +
+                                          std::string(20000, 'x') + "\"}}"));
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"" +
+                                          std::string(70000, 'y') + "\"}}"));
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"content\":\"Hello world\",\"done\":true}}"));
+
+    uint8_t opcode;
+    std::string payload;
+    CHECK(wsRead(c, opcode, payload));
+    CHECK_EQ((int)opcode, WS_OP_PONG);
+    CHECK_EQ(payload, std::string("keepalive"));
+    while (wsRead(c, opcode, payload)) afterDone.push_back(std::to_string(opcode) + ":" + payload);
+  });
+  useServer(server);
+
+  CHECK(owuiSocketConnect());
+  CHECK_EQ(owuiSocketSid, String("sock-1"));
+  owuiSocketWatch(TEST_CHAT, TEST_MESSAGE, onDelta);
+  String result;
+  CHECK_EQ(owuiSocketWait(result, 5000), 1);
+  owuiSocketClose();
+  server.join();
+
+  CHECK_EQ(result, String("Hello world"));
+  CHECK_EQ(deltas, String("Hel|lo| world|"));
+  CHECK_EQ(request, String("GET /ws/socket.io/?EIO=4&transport=websocket HTTP/1.1"));
+  CHECK(headers.indexOf("upgrade: websocket\n") >= 0);
+  CHECK(headers.indexOf("sec-websocket-version: 13\n") >= 0);
+  CHECK(headers.indexOf("sec-websocket-key: ") >= 0);
+  CHECK(headers.indexOf("authorization: Bearer test-llm-key\n") >= 0);
+  // Namespace disconnect, then a close frame
+  CHECK(afterDone.size() == 2 && afterDone[0] == "1:41" && afterDone[1] == "8:");
+  CHECK_EQ(owuiSocketSid, String(""));
+}
+
+TEST(streaming_choices_deltas_are_appended) {
+  MockServer server([&](MockConnection &c) {
+    String request, headers;
+    acceptSocket(c, request, headers);
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"choices\":[{\"delta\":{\"content\":\"It is \"}}]}}"));
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"choices\":[{\"delta\":{\"content\":\"noon.\"}}]}}"));
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"done\":true}}"));
+    uint8_t opcode;
+    std::string payload;
+    while (wsRead(c, opcode, payload)) {}
+  });
+  useServer(server);
+
+  CHECK(owuiSocketConnect());
+  owuiSocketWatch(TEST_CHAT, TEST_MESSAGE, onDelta);
+  String result;
+  CHECK_EQ(owuiSocketWait(result, 5000), 1);
+  owuiSocketClose();
+
+  CHECK_EQ(result, String("It is noon."));
+  CHECK_EQ(deltas, String("It is |noon.|"));
+}
+
+TEST(lost_connection_returns_partial_text) {
+  MockServer server([&](MockConnection &c) {
+    String request, headers;
+    acceptSocket(c, request, headers);
+    wsText(c, chatEvent(TEST_MESSAGE, "{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"Partial\"}}"));
+  });                                    // Returning closes the socket
+  useServer(server);
+
+  CHECK(owuiSocketConnect());
+  owuiSocketWatch(TEST_CHAT, TEST_MESSAGE, onDelta);
+  String result;
+  CHECK_EQ(owuiSocketWait(result, 5000), -1);
+  CHECK_EQ(result, String("Partial"));
+  owuiSocketClose();
+}
+
+TEST(quiet_socket_times_out_and_cancel_stops_the_wait) {
+  std::atomic<bool> finished{false};
+  MockServer server([&](MockConnection &c) {
+    String request, headers;
+    acceptSocket(c, request, headers);
+    while (!finished) delay(5);
+  });
+  useServer(server);
+
+  CHECK(owuiSocketConnect());
+  owuiSocketWatch(TEST_CHAT, TEST_MESSAGE, onDelta);
+  String result;
+  unsigned long start = millis();
+  CHECK_EQ(owuiSocketWait(result, 300), 0);
+  CHECK(millis() - start >= 300 && millis() - start < 2000);
+
+  interactionCancelRequested = true;
+  CHECK_EQ(owuiSocketWait(result, 5000), -1);
+  CHECK(millis() - start < 2000);
+  finished = true;
+  owuiSocketClose();
+}
+
+TEST(refused_upgrade_fails_the_connect) {
+  MockServer server([&](MockConnection &c) {
+    c.readLine();
+    c.readHeaders();
+    c.send("HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\n\r\n");
+  });
+  useServer(server);
+
+  CHECK(!owuiSocketConnect());
+  CHECK(owuiSocketClient == nullptr);
+}
+
+TEST(connect_error_packet_fails_the_connect) {
+  MockServer server([&](MockConnection &c) {
+    c.readLine();
+    c.readHeaders();
+    c.send("HTTP/1.1 101 Switching Protocols\r\n\r\n");
+    wsText(c, "0{\"sid\":\"eio-1\"}");
+    wsReadText(c);
+    wsText(c, "44{\"message\":\"Not authorized\"}");
+  });
+  useServer(server);
+
+  CHECK(!owuiSocketConnect());
+  CHECK_EQ(owuiSocketSid, String(""));
+}
+
+TEST(packets_are_handled_without_a_socket) {
+  owuiSocketWatch(TEST_CHAT, TEST_MESSAGE, onDelta);
+  deltas = "";
+  owuiSocketHandlePacket(String(chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"content\":\"Hi\"}}").c_str()));
+  owuiSocketHandlePacket(String(chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"content\":\"Hi there\",\"done\":true}}").c_str()));
+  CHECK_EQ(owuiSocketContent, String("Hi there"));
+  CHECK_EQ(deltas, String("Hi| there|"));
+  CHECK(owuiSocketDone);
+
+  // Events of another chat, and other Socket.IO events, are ignored
+  owuiSocketWatch(TEST_CHAT, TEST_MESSAGE, onDelta);
+  owuiSocketHandlePacket("42[\"chat-events\",{\"chat_id\":\"chat-2\",\"message_id\":\"msg-1\",\"data\":{\"type\":\"chat:message:delta\",\"data\":{\"content\":\"x\"}}}]");
+  owuiSocketHandlePacket("42[\"usage\",{\"models\":[]}]");
+  CHECK_EQ(owuiSocketContent, String(""));
+
+  owuiSocketHandlePacket(String(chatEvent(TEST_MESSAGE, "{\"type\":\"chat:completion\",\"data\":{\"error\":{\"content\":\"boom\"}}}").c_str()));
+  CHECK(owuiSocketDone);
+  owuiSocketHandlePacket("41");
+  CHECK(owuiSocketLost);
+}
+
+TEST_MAIN()
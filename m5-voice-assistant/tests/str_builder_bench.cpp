@@ -0,0 +1,258 @@
+// Benchmark: request bodies built the old way (chained String + and
+// .replace() escaping, as askGPT(), saveChatHistory() and speakText() did
+// before str_builder.h) against strBuild() into the body arena. Reports heap
+// allocations, bytes allocated and time per request for a TTS sentence, a
+// question, a chat save carrying the history and a question with a photo.
+//
+//   ./str_builder_bench [history bytes] [photo bytes]
+//
+// Host String is a std::string stand-in (host/Arduino.h), which grows by
+// doubling. The ESP32's String reallocates to the exact length on most
+// appends, so on the device the old path allocates at least as often.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+#include "../common/str_builder.h"
+
+#include <chrono>
+#include <malloc.h>
+#include <new>
+#include <vector>
+
+// ---- Heap accounting (every operator new in the process) ----
+
+static size_t heapAllocs = 0, heapBytes = 0;
+
+void *operator new(size_t size) {
+  void *p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  heapAllocs++;
+  heapBytes += size;
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+static volatile size_t sink;
+
+// What a request is built from
+struct Request {
+  String question;
+  String answer;
+  String history;              // chatTree.messages
+  String chatId, userMsgId, assistantMsgId;
+  std::vector<uint8_t> photo;
+};
+
+static const char *MODEL = "gpt-4o-mini";
+static const char *SYSTEM_PROMPT = " Answer in at most 40 words, plain text, no markdown.";
+
+// ---- Before: String + and .replace() ----
+
+static String oldEscape(const String &text) {
+  String escaped = text;
+  escaped.replace("\\", "\\\\");
+  escaped.replace("\"", "\\\"");
+  escaped.replace("\n", "\\n");
+  escaped.replace("\r", "\\r");
+  escaped.replace("\t", "\\t");
+  return escaped;
+}
+
+static String oldBase64(const uint8_t *data, size_t length) {
+  static const char chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  String encoded;
+  encoded.reserve(((length + 2) / 3) * 4);
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = (uint32_t)data[i] << 16;
+    if (i + 1 < length) n |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    encoded += chars[(n >> 18) & 0x3F];
+    encoded += chars[(n >> 12) & 0x3F];
+    encoded += (i + 1 < length) ? chars[(n >> 6) & 0x3F] : '=';
+    encoded += (i + 2 < length) ? chars[n & 0x3F] : '=';
+  }
+  return encoded;
+}
+
+static size_t oldTts(const Request &r) {
+  String escaped = r.answer;
+  escaped.replace("\\", "\\\\");
+  escaped.replace("\"", "\\\"");
+  escaped.replace("\n", " ");
+  String body = "{\"model\":\"" + String("tts-1") + "\","
+                "\"input\":\"" + escaped + "\","
+                "\"voice\":\"" + String("alloy") + "\"}";
+  return body.length();
+}
+
+static size_t oldAsk(const Request &r) {
+  String escaped = r.question;
+  escaped.replace("\\", "\\\\");
+  escaped.replace("\"", "\\\"");
+  escaped.replace("\n", " ");
+  String body = "{"
+                "\"model\":\"" + String(MODEL) + "\"," +
+                String("\"stream\":true,") +
+                "\"messages\":["
+                "{"
+                "\"role\":\"user\","
+                "\"content\":\"" +
+                escaped +
+                SYSTEM_PROMPT + "\""
+                "}"
+                "]"
+                "}";
+  return body.length();
+}
+
+static size_t oldSave(const Request &r) {
+  String escapedUser = oldEscape(r.question);
+  String escapedAssistant = oldEscape(r.answer);
+  String history = "{\"messages\":{" + r.history + "},\"currentId\":" + "\"" + r.assistantMsgId + "\"" + "}";
+  String body = "{"
+                "\"chat\":{"
+                "\"title\":\"M5 Voice Assistant\","
+                "\"history\":" + history + ","
+                "\"messages\":["
+                "{"
+                "\"id\":\"" + r.userMsgId + "\","
+                "\"role\":\"user\","
+                "\"content\":\"" + escapedUser + "\""
+                "},"
+                "{"
+                "\"id\":\"" + r.assistantMsgId + "\","
+                "\"role\":\"assistant\","
+                "\"content\":\"" + escapedAssistant + "\""
+                "}"
+                "]"
+                "}"
+                "}";
+  return body.length();
+}
+
+static size_t oldPhoto(const Request &r) {
+  String escaped = r.question;
+  escaped.replace("\\", "\\\\");
+  escaped.replace("\"", "\\\"");
+  escaped.replace("\n", " ");
+  String base64Image = oldBase64(r.photo.data(), r.photo.size());
+  String messagesArray = "{\"role\":\"user\",\"content\":["
+                         "{\"type\":\"text\",\"text\":\"" + escaped + SYSTEM_PROMPT + "\"},"
+                         "{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:image/jpeg;base64," + base64Image + "\"}}"
+                         "]}";
+  String body = "{"
+                "\"model\":\"" + String(MODEL) + "\","
+                "\"messages\":[" + messagesArray + "],"
+                "\"chat_id\":\"" + r.chatId + "\","
+                "\"stream\":true"
+                "}";
+  return body.length();
+}
+
+// ---- After: strBuild() into the body arena ----
+
+static size_t bodyHeapBlocks = 0;              // MEM_BODY blocks (arena full), not seen by operator new
+
+template <typename Fill>
+static size_t build(Fill fill) {
+  StrBuilder body;
+  int before = memUsage[MEM_BODY].blocks;
+  strBuild(body, fill);
+  bodyHeapBlocks += memUsage[MEM_BODY].blocks - before;
+  return body.length();
+}
+
+static size_t newTts(const Request &r) {
+  return build([&](StrBuilder &b) {
+    b.add("{\"model\":").quoted("tts-1").add(",\"input\":").quoted(r.answer).add(",\"voice\":").quoted("alloy").add('}');
+  });
+}
+
+static size_t newAsk(const Request &r) {
+  return build([&](StrBuilder &b) {
+    b.add("{\"model\":").quoted(MODEL).add(",\"stream\":true,\"messages\":[{\"role\":\"user\",\"content\":\"")
+     .json(r.question).add(SYSTEM_PROMPT).add("\"}]}");
+  });
+}
+
+static size_t newSave(const Request &r) {
+  return build([&](StrBuilder &b) {
+    b.add("{\"chat\":{\"title\":\"M5 Voice Assistant\",\"history\":");
+    b.add("{\"messages\":{").add(r.history).add("},\"currentId\":").quoted(r.assistantMsgId).add('}');
+    b.add(",\"messages\":[{\"id\":").quoted(r.userMsgId)
+     .add(",\"role\":\"user\",\"content\":").quoted(r.question)
+     .add("},{\"id\":").quoted(r.assistantMsgId)
+     .add(",\"role\":\"assistant\",\"content\":").quoted(r.answer)
+     .add("}]}}");
+  });
+}
+
+static size_t newPhoto(const Request &r) {
+  return build([&](StrBuilder &b) {
+    b.add("{\"model\":").quoted(MODEL).add(",\"messages\":[{\"role\":\"user\",\"content\":")
+     .add("[{\"type\":\"text\",\"text\":\"").json(r.question).add(SYSTEM_PROMPT)
+     .add("\"},{\"type\":\"image_url\",\"image_url\":{\"url\":\"data:image/jpeg;base64,")
+     .base64(r.photo.data(), r.photo.size())
+     .add("\"}}]}],\"chat_id\":").quoted(r.chatId).add(",\"stream\":true}");
+  });
+}
+
+struct BodyCase {
+  const char *name;
+  size_t (*before)(const Request &);
+  size_t (*after)(const Request &);
+};
+
+static const BodyCase CASES[] = {
+  {"tts sentence", oldTts, newTts},
+  {"question", oldAsk, newAsk},
+  {"chat save", oldSave, newSave},
+  {"photo question", oldPhoto, newPhoto},
+};
+
+static void run(const char *name, size_t (*build)(const Request &), const Request &r, int iterations) {
+  size_t allocs = heapAllocs, bytes = heapBytes;
+  bodyHeapBlocks = 0;
+  size_t length = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) length = build(r);
+  double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+  sink = length;
+  printf("  %-8s %7zu bytes %8.1f us %7.1f allocs %9.0f bytes allocated\n", name, length, us,
+         (double)(heapAllocs - allocs + bodyHeapBlocks) / iterations, (double)(heapBytes - bytes) / iterations);
+}
+
+int main(int argc, char **argv) {
+  size_t historyBytes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 16 * 1024;
+  size_t photoBytes = argc > 2 ? strtoul(argv[2], nullptr, 10) : 40 * 1024;
+  mediaArenaBegin(bodyArena, BODY_ARENA_BYTES, MEM_BODY);
+
+  Request r;
+  r.question = "What's the weather like in \"Reykjavik\" today?\nAnd tomorrow?";
+  r.answer = "Cloudy with light rain, around 7\xc2\xb0" "C and a south-west wind.\nTomorrow: brighter, 9\xc2\xb0" "C.";
+  r.chatId = "6f1c2d3e-4b5a-6978-8a9b-0c1d2e3f4a5b";
+  r.userMsgId = "a1b2c3d4-e5f6-4789-8abc-def012345678";
+  r.assistantMsgId = "b2c3d4e5-f6a7-489a-9bcd-ef0123456789";
+  while (r.history.length() < historyBytes) {
+    r.history += "\"" + r.userMsgId + "\":{\"id\":\"" + r.userMsgId + "\",\"role\":\"user\",\"content\":\"" +
+                 oldEscape(r.question) + "\",\"childrenIds\":[]},";
+  }
+  r.photo.resize(photoBytes);
+  for (size_t i = 0; i < photoBytes; i++) r.photo[i] = (uint8_t)(i * 131 + (i >> 7));
+
+  printf("History %zu bytes, photo %zu bytes, body arena %d bytes\n", historyBytes, photoBytes, BODY_ARENA_BYTES);
+  for (const BodyCase &c : CASES) {
+    printf("%s\n", c.name);
+    run("String", c.before, r, 200);
+    run("builder", c.after, r, 200);
+  }
+  return 0;
+}
@@ -0,0 +1,184 @@
+// Request body builder (common/str_builder.h): json() escaping of quotes,
+// backslashes and every control character, valid UTF-8 copied and invalid
+// bytes replaced, base64 against the RFC 4648 vectors, the counting pass
+// against the written one, and where strBuild() puts the body (arena lease,
+// heap when the arena is full).
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+
+// media_arena.h sizes the audio arena at compile time
+#undef STT_UPLOAD_CODEC
+#define STT_UPLOAD_CODEC UPLOAD_MULAW
+#include "../common/media_arena.h"
+#include "../common/str_builder.h"
+
+#include "test.h"
+
+#include <random>
+
+static std::string escaped(const std::string &s) {
+  return jsonEscape(s.c_str(), s.size()).c_str();
+}
+
+// Length of the UTF-8 sequence at s[i], 0 if it isn't valid (decoded, so
+// overlongs, surrogates and code points past U+10FFFF are caught by value)
+static size_t validUtf8At(const std::string &s, size_t i) {
+  uint8_t c = s[i];
+  size_t len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+  if (len == 0 || i + len > s.size()) return 0;
+  if (len == 1) return 1;
+  uint32_t cp = c & (0x7F >> len);
+  for (size_t k = 1; k < len; k++) {
+    if (((uint8_t)s[i + k] & 0xC0) != 0x80) return 0;
+    cp = cp << 6 | ((uint8_t)s[i + k] & 0x3F);
+  }
+  static const uint32_t MIN_CP[] = {0, 0, 0x80, 0x800, 0x10000};
+  if (cp < MIN_CP[len] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+  return len;
+}
+
+TEST(escapes_quotes_backslashes_and_controls) {
+  CHECK_EQ(escaped("plain text, 100% ASCII ~"), "plain text, 100% ASCII ~");
+  CHECK_EQ(escaped("say \"hi\" \\o/"), "say \\\"hi\\\" \\\\o/");
+  CHECK_EQ(escaped("a\nb\rc\td\be\ff"), "a\\nb\\rc\\td\\be\\ff");
+  CHECK_EQ(escaped(std::string("\0\x01\x1b\x1f", 4)), "\\u0000\\u0001\\u001b\\u001f");
+  CHECK_EQ(escaped("\x7f"), "\x7f");              // DEL is allowed in a JSON string
+  CHECK_EQ(escaped(""), "");
+
+  // Every control character comes out escaped, nothing else below 0x80 does
+  for (int c = 0; c < 0x80; c++) {
+    std::string out = escaped(std::string(1, (char)c));
+    bool escape = c < 0x20 || c == '"' || c == '\\';
+    if ((out[0] == '\\') != escape || (!escape && out.size() != 1)) TEST_FAIL("0x%02x -> %s", c, out.c_str());
+  }
+}
+
+TEST(valid_utf8_is_copied_as_it_is) {
+  const char *text = "caf\xc3\xa9 \xe2\x82\xac 5 \xe4\xb8\xad\xe6\x96\x87 \xf0\x9f\x8e\xa4 \xf4\x8f\xbf\xbf";
+  CHECK_EQ(escaped(text), text);
+  // Smallest and largest of each length
+  CHECK_EQ(escaped("\xc2\x80\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf\xf0\x90\x80\x80"),
+           "\xc2\x80\xdf\xbf\xe0\xa0\x80\xef\xbf\xbf\xf0\x90\x80\x80");
+  CHECK_EQ(escaped("\xe2\x80\x9cquoted\xe2\x80\x9d\n"), "\xe2\x80\x9cquoted\xe2\x80\x9d\\n");
+}
+
+TEST(invalid_utf8_becomes_replacement_characters) {
+  CHECK_EQ(escaped("a\xff" "b"), "a\\ufffdb");
+  CHECK_EQ(escaped("\x80"), "\\ufffd");                       // Lone continuation byte
+  CHECK_EQ(escaped("\xc0\xaf"), "\\ufffd\\ufffd");            // Overlong '/'
+  CHECK_EQ(escaped("\xc1\xbf"), "\\ufffd\\ufffd");
+  CHECK_EQ(escaped("\xe0\x80\xaf"), "\\ufffd\\ufffd\\ufffd"); // Overlong, 3 bytes
+  CHECK_EQ(escaped("\xf0\x80\x80\xaf"), "\\ufffd\\ufffd\\ufffd\\ufffd");
+  CHECK_EQ(escaped("\xed\xa0\x80"), "\\ufffd\\ufffd\\ufffd"); // UTF-16 surrogate
+  CHECK_EQ(escaped("\xf4\x90\x80\x80"), "\\ufffd\\ufffd\\ufffd\\ufffd");   // Past U+10FFFF
+  CHECK_EQ(escaped("\xf5\x80"), "\\ufffd\\ufffd");
+  CHECK_EQ(escaped("\xe2\x82" "a"), "\\ufffd\\ufffda");       // Cut short, then ASCII
+  CHECK_EQ(escaped("ok \xe2\x82"), "ok \\ufffd\\ufffd");      // Cut short at the end
+  CHECK_EQ(escaped("\xe2\x82\"\n"), "\\ufffd\\ufffd\\\"\\n");
+}
+
+TEST(random_bytes_always_give_valid_json) {
+  std::mt19937 rng(25);
+  int bad = 0;
+  for (int run = 0; run < 2000; run++) {
+    std::string in(rng() % 40, '\0');
+    for (char &c : in) c = (char)(rng() % 4 == 0 ? rng() % 0x20 : rng());
+    std::string out = escaped(in);
+    size_t i = 0;
+    while (i < out.size()) {
+      uint8_t c = out[i];
+      if (c < 0x20 || c == '"') break;            // Raw control or quote: broken JSON
+      if (c == '\\') {
+        if (i + 1 >= out.size() || !strchr("\"\\nrtbfu", out[i + 1])) break;
+        i += out[i + 1] == 'u' ? 6 : 2;
+        continue;
+      }
+      size_t len = validUtf8At(out, i);
+      if (len == 0) break;
+      i += len;
+    }
+    if (i != out.size()) bad++;
+  }
+  CHECK_EQ(bad, 0);
+}
+
+TEST(base64_matches_rfc4648) {
+  const char *plain[] = {"", "f", "fo", "foo", "foob", "fooba", "foobar"};
+  const char *encoded[] = {"", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy"};
+  for (int i = 0; i < 7; i++) {
+    char buf[16];
+    StrBuilder b(buf, sizeof(buf));
+    b.base64((const uint8_t *)plain[i], strlen(plain[i]));
+    CHECK_EQ(std::string(b.c_str()), encoded[i]);
+  }
+  uint8_t bytes[] = {0x00, 0xff, 0xfe, 0x3e, 0x3f};
+  String b64 = strBuildString([&](StrBuilder &b) { b.base64(bytes, sizeof(bytes)); });
+  CHECK_EQ(b64, String("AP/+Pj8="));
+}
+
+TEST(counting_pass_matches_the_written_body) {
+  std::string text = "line one\nsays \"caf\xc3\xa9\" \xff\x01 end";
+  uint8_t photo[100];
+  for (int i = 0; i < 100; i++) photo[i] = i * 7;
+  auto fill = [&](StrBuilder &b) {
+    b.add("{\"n\":").num(-42).add(",\"u\":").num(18446744073709551615ULL).add(",\"t\":").quoted(text.c_str());
+    b.add(",\"img\":\"").base64(photo, sizeof(photo)).add("\"}");
+  };
+  StrBuilder count;
+  fill(count);
+  CHECK(!count.ok());                             // No buffer: only counted
+  std::vector<char> buf(count.length() + 1);
+  StrBuilder body(buf.data(), buf.size());
+  fill(body);
+  CHECK(body.ok());
+  CHECK_EQ(body.length(), count.length());
+  CHECK_EQ(strlen(body.c_str()), body.length());
+  CHECK(strncmp(body.c_str(), "{\"n\":-42,\"u\":18446744073709551615,\"t\":\"line one\\nsays \\\"caf\xc3\xa9\\\" \\ufffd\\u0001",
+                61) == 0);
+
+  // One byte short: flagged, nothing half-written is handed out
+  StrBuilder tight(buf.data(), buf.size() - 1);
+  fill(tight);
+  CHECK(!tight.ok());
+  CHECK_EQ(tight.length(), count.length());
+  CHECK_EQ(std::string(tight.c_str()), "");
+}
+
+TEST(bodies_lease_the_arena_and_fall_back_to_the_heap) {
+  CHECK(mediaArenaBegin(bodyArena, BODY_ARENA_BYTES, MEM_BODY));
+  int heapBlocks = memUsage[MEM_BODY].blocks;
+  std::string text(1000, 'x');
+  {
+    StrBuilder a, b;
+    CHECK(strBuild(a, [&](StrBuilder &s) { s.add("{\"input\":").quoted(text.c_str()).add("}"); }));
+    CHECK(strBuild(b, [&](StrBuilder &s) { s.add("[").num(7).add("]"); }));
+    CHECK_EQ(std::string(b.c_str()), "[7]");
+    CHECK((uint8_t *)a.c_str() >= bodyArena.base && (uint8_t *)b.c_str() > (uint8_t *)a.c_str());
+    CHECK_EQ(bodyArena.holders, 2);
+    CHECK_EQ(memUsage[MEM_BODY].blocks, heapBlocks);
+
+    // Doesn't fit what is left: a heap block of its own
+    std::string big(BODY_ARENA_BYTES - 1000, 'y');
+    StrBuilder c;
+    CHECK(strBuild(c, [&](StrBuilder &s) { s.quoted(big.c_str()); }));
+    CHECK_EQ(c.length(), big.size() + 2);
+    CHECK_EQ(memUsage[MEM_BODY].blocks, heapBlocks + 1);
+    CHECK_EQ(bodyArena.holders, 2);
+  }
+  // Every builder gone: the heap block is freed and the arena rewinds
+  CHECK_EQ(memUsage[MEM_BODY].blocks, heapBlocks);
+  CHECK_EQ(bodyArena.holders, 0);
+  CHECK_EQ(bodyArena.used, (size_t)0);
+
+  // No arena: always the heap
+  StrBuilder d;
+  CHECK(strBuild(d, [&](StrBuilder &s) { s.add("kept"); }, nullptr));
+  CHECK_EQ(memUsage[MEM_BODY].blocks, heapBlocks + 1);
+  CHECK_EQ(bodyArena.used, (size_t)0);
+  d.release();
+  CHECK_EQ(memUsage[MEM_BODY].blocks, heapBlocks);
+}
+
+TEST_MAIN()
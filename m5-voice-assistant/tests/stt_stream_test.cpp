@@ -0,0 +1,188 @@
+// Streamed STT upload (common/stt_stream.h) against a mock transcription server:
+// the request is decoded chunk by chunk and compared with what the recorder
+// encoded, and the response is read back in both framings.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/audio_codec.h"
+#include "../common/stt_stream.h"
+
+#include "mock_server.h"
+#include "test.h"
+
+#include <atomic>
+
+#define TEST_BLOCK_SAMPLES 1600          // 100ms mic blocks, as recordAudio() pushes them
+#define TEST_BLOCKS 10
+
+static const char *TEST_TRANSCRIPT = "{\"text\":\"what time is it\"}";
+
+// What the mock server saw
+struct UploadCapture {
+  String requestLine;
+  String headers;
+  std::string body;
+  std::vector<size_t> chunkSizes;
+  bool decoded = false;
+  std::atomic<bool> audioBeforeEnd{false};   // Audio arrived while still "recording"
+};
+
+static void fillTone(int samples) {
+  static std::vector<int16_t> pcm;
+  pcm.resize(samples);
+  for (int i = 0; i < samples; i++) {
+    pcm[i] = (int16_t)(8000 * sin(2 * M_PI * 440 * i / SAMPLE_RATE));
+  }
+  audioBuffer = pcm.data();
+}
+
+// Record TEST_BLOCKS blocks the way recordAudio() does and wait for the transcript
+static String recordAndFinish() {
+  static std::vector<uint8_t> encoded(TEST_BLOCKS * TEST_BLOCK_SAMPLES);
+  audioCodecBuffer = encoded.data();
+  fillTone(TEST_BLOCKS * TEST_BLOCK_SAMPLES);
+  while (sttStreamTaskHandle != NULL) delay(1);   // Previous uploader sets done just before it exits
+
+  audioCodecBegin();
+  sttStreamBegin();
+  CHECK(sttStreamActive);
+  for (int b = 0; b < TEST_BLOCKS; b++) {
+    sttStreamPush(audioCodecAppend(b * TEST_BLOCK_SAMPLES, (b + 1) * TEST_BLOCK_SAMPLES));
+    delay(20);
+  }
+  sttStreamPush(audioCodecFinish(TEST_BLOCKS * TEST_BLOCK_SAMPLES));
+  sttStreamEndOfAudio();
+  return sttStreamFinish();
+}
+
+// Read the upload; the first data chunk after the WAV header is audio
+static void readUpload(MockConnection &c, UploadCapture &cap) {
+  cap.requestLine = c.readLine();
+  cap.headers = c.readHeaders();
+  for (;;) {
+    String sizeLine = c.readLine();
+    size_t size = strtoul(sizeLine.c_str(), nullptr, 16);
+    if (size == 0) {
+      cap.decoded = sizeLine == "0" && c.readLine().length() == 0;
+      return;
+    }
+    if (cap.chunkSizes.size() == 2 && !sttStreamAudioComplete) cap.audioBeforeEnd = true;
+    cap.chunkSizes.push_back(size);
+    if (!c.readExact(cap.body, size) || c.readLine().length() != 0) return;
+  }
+}
+
+static std::string expectedBody(bool withModel) {
+  std::string boundary = "----ESP32StreamBoundary";
+  uint8_t header[AUDIO_CODEC_HEADER_MAX];
+  int headerSize = audioCodecHeader(header, -1);
+  std::string body = "--" + boundary + "\r\n" +
+                     "Content-Disposition: form-data; name=\"file\"; filename=\"audio.wav\"\r\n" +
+                     "Content-Type: audio/wav\r\n\r\n";
+  body.append((const char *)header, headerSize);
+  body.append((const char *)audioCodecData(), audioCodecBytes);
+  body += "\r\n--" + boundary;
+  if (withModel) {
+    body += "\r\nContent-Disposition: form-data; name=\"model\"\r\n\r\nwhisper-1\r\n--" + boundary;
+  }
+  return body + "--\r\n";
+}
+
+TEST(whisper_upload_is_chunked_while_recording) {
+  UploadCapture cap;
+  MockServer server([&](MockConnection &c) {
+    readUpload(c, cap);
+    c.send(String("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: ") +
+           (int)strlen(TEST_TRANSCRIPT) + "\r\nConnection: close\r\n\r\n" + TEST_TRANSCRIPT);
+  });
+  USE_OWUI_STT = false;
+  STT_PORT = server.port();
+
+  String transcript = recordAndFinish();
+  server.join();
+
+  CHECK_EQ(transcript, String(TEST_TRANSCRIPT));
+  CHECK_EQ(cap.requestLine, String("POST /v1/audio/transcriptions HTTP/1.1"));
+  CHECK(cap.headers.indexOf("authorization: Bearer test-stt-key\n") >= 0);
+  CHECK(cap.headers.indexOf("transfer-encoding: chunked\n") >= 0);
+  CHECK(cap.headers.indexOf("content-type: multipart/form-data; boundary=----ESP32StreamBoundary\n") >= 0);
+  CHECK(cap.headers.indexOf("content-length") < 0);
+  CHECK(cap.decoded);
+  CHECK(cap.body == expectedBody(true));
+
+  // Form part, WAV header, the audio in several pushes, closing boundary
+  CHECK(cap.chunkSizes.size() >= 5);
+  CHECK(cap.audioBeforeEnd);
+  CHECK_EQ(audioCodecBytes, TEST_BLOCKS * TEST_BLOCK_SAMPLES);   // mu-law: one byte per sample
+  CHECK_EQ(cap.body.compare(cap.body.find("RIFF") + 4, 4, "\xFF\xFF\xFF\xFF"), 0);
+}
+
+TEST(owui_upload_reads_chunked_response) {
+  UploadCapture cap;
+  MockServer server([&](MockConnection &c) {
+    readUpload(c, cap);
+    String json = TEST_TRANSCRIPT;
+    char size[8];
+    c.send("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n");
+    snprintf(size, sizeof(size), "%X\r\n", 9);
+    c.send(String(size) + json.substring(0, 9) + "\r\n");
+    snprintf(size, sizeof(size), "%X\r\n", json.length() - 9);
+    c.send(String(size) + json.substring(9) + "\r\n0\r\n\r\n");
+  });
+  String baseUrl = String("http://127.0.0.1:") + server.port();
+  OWUI_BASE_URL = baseUrl.c_str();
+  USE_OWUI_STT = true;
+
+  String transcript = recordAndFinish();
+  server.join();
+  USE_OWUI_STT = false;
+
+  CHECK_EQ(transcript, String(TEST_TRANSCRIPT));
+  CHECK_EQ(cap.requestLine, String("POST /api/v1/audio/transcriptions HTTP/1.1"));
+  CHECK(cap.headers.indexOf("authorization: Bearer test-llm-key\n") >= 0);
+  CHECK(cap.body == expectedBody(false));
+}
+
+TEST(server_error_falls_back_to_buffered_upload) {
+  UploadCapture cap;
+  MockServer server([&](MockConnection &c) {
+    readUpload(c, cap);
+    c.send("HTTP/1.1 500 Internal Server Error\r\nContent-Length: 5\r\n\r\nerror");
+  });
+  STT_PORT = server.port();
+
+  CHECK_EQ(recordAndFinish(), String(""));
+  CHECK(sttStreamFailed);
+  CHECK(cap.decoded);
+}
+
+TEST(refused_connection_falls_back_to_buffered_upload) {
+  int port;
+  {
+    MockServer closed([](MockConnection &) {});
+    port = closed.port();
+    WiFiClient probe;                   // Let the one-shot server finish
+    probe.connect("127.0.0.1", port);
+  }
+  STT_PORT = port;
+
+  unsigned long start = millis();
+  CHECK_EQ(recordAndFinish(), String(""));
+  CHECK(sttStreamFailed);
+  CHECK(millis() - start < 5000);
+}
+
+TEST(server_closing_mid_upload_fails_the_stream) {
+  MockServer server([&](MockConnection &c) {
+    c.readLine();
+    c.readHeaders();
+    std::string part;
+    c.readExact(part, 16);              // Take a little of the body, then hang up
+  });
+  STT_PORT = server.port();
+
+  CHECK_EQ(recordAndFinish(), String(""));
+  CHECK(sttStreamFailed);
+}
+
+TEST_MAIN()
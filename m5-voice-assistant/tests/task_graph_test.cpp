@@ -0,0 +1,102 @@
+// Stage executor (common/task_graph.h): stages start once their dependencies
+// are done, background stages overlap the foreground ones, and a failed stage
+// skips everything downstream of it.
+
+#include "test_config.h"
+#include "../common/mem_alloc.h"
+#include "../common/task_graph.h"
+
+#include "test.h"
+
+#include <atomic>
+#include <mutex>
+
+struct GraphLog {
+  std::mutex lock;
+  std::string order;           // Stage letters in the order they finished
+  std::atomic<int> running{0};
+  std::atomic<int> overlap{0}; // Most stages seen running at once
+};
+
+static GraphLog graphLog;
+
+static bool logStage(char name, int ms, bool ok) {
+  int now = ++graphLog.running;
+  for (int seen = graphLog.overlap; now > seen && !graphLog.overlap.compare_exchange_weak(seen, now);) {
+  }
+  delay(ms);
+  graphLog.running--;
+  std::lock_guard<std::mutex> guard(graphLog.lock);
+  graphLog.order += name;
+  return ok;
+}
+
+static void resetLog() {
+  graphLog.order.clear();
+  graphLog.overlap = 0;
+}
+
+static bool stageA(void *) { return logStage('a', 100, true); }
+static bool stageB(void *) { return logStage('b', 100, true); }
+static bool stageC(void *) { return logStage('c', 10, true); }
+static bool stageFail(void *) { return logStage('x', 10, false); }
+
+static int stageState(TaskGraph &g, int i) { return (int)g.stages[i].state; }
+
+TEST(background_stage_overlaps_the_foreground_one) {
+  resetLog();
+  TaskGraph g;
+  taskGraphInit(g, "overlap", nullptr);
+  int a = taskGraphAdd(g, "a", stageA, 0, false);
+  int b = taskGraphAdd(g, "b", stageB, 0, true);
+  taskGraphAdd(g, "c", stageC, TASK_DEP(a) | TASK_DEP(b), false);
+
+  unsigned long start = millis();
+  CHECK(taskGraphRun(g));
+  unsigned long elapsed = millis() - start;
+  CHECK(elapsed < 180);
+  CHECK_EQ(graphLog.overlap.load(), 2);
+  CHECK_EQ(graphLog.order.back(), 'c');
+  CHECK(g.stages[2].startMs >= g.stages[0].endMs && g.stages[2].startMs >= g.stages[1].endMs);
+  taskGraphReport(g);
+}
+
+TEST(stages_wait_for_their_dependencies) {
+  resetLog();
+  TaskGraph g;
+  taskGraphInit(g, "chain", nullptr);
+  int a = taskGraphAdd(g, "a", stageA, 0, true);
+  int b = taskGraphAdd(g, "b", stageB, TASK_DEP(a), true);
+  taskGraphAdd(g, "c", stageC, TASK_DEP(b), false);
+
+  CHECK(taskGraphRun(g));
+  CHECK_EQ(graphLog.order, std::string("abc"));
+  CHECK_EQ(graphLog.overlap.load(), 1);
+}
+
+TEST(failed_stage_skips_its_dependents_only) {
+  resetLog();
+  TaskGraph g;
+  taskGraphInit(g, "fail", nullptr);
+  int x = taskGraphAdd(g, "x", stageFail, 0, true);
+  int b = taskGraphAdd(g, "b", stageB, TASK_DEP(x), false);
+  int c = taskGraphAdd(g, "c", stageC, TASK_DEP(b), false);
+  int a = taskGraphAdd(g, "a", stageA, 0, false);
+
+  CHECK(!taskGraphRun(g));
+  CHECK_EQ(stageState(g, x), (int)TASK_STAGE_FAILED);
+  CHECK_EQ(stageState(g, b), (int)TASK_STAGE_SKIPPED);
+  CHECK_EQ(stageState(g, c), (int)TASK_STAGE_SKIPPED);
+  CHECK_EQ(stageState(g, a), (int)TASK_STAGE_DONE);
+  CHECK_EQ(graphLog.order.find('b'), std::string::npos);
+  taskGraphReport(g);
+}
+
+TEST(full_graph_refuses_another_stage) {
+  TaskGraph g;
+  taskGraphInit(g, "full", nullptr);
+  for (int i = 0; i < TASK_GRAPH_MAX_STAGES; i++) CHECK_EQ(taskGraphAdd(g, "c", stageC, 0, false), i);
+  CHECK_EQ(taskGraphAdd(g, "c", stageC, 0, false), -1);
+}
+
+TEST_MAIN()
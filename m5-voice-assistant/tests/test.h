@@ -0,0 +1,100 @@
+#ifndef TEST_H
+#define TEST_H
+
+// Minimal test harness for the host tests: TEST() registers a case, CHECK*()
+// records a failure and carries on, main() runs every case and exits non-zero
+// if any check failed. Each test file is its own executable.
+//
+//   TEST(escapes_quotes) {
+//     CHECK_EQ(jsonEscape("a\"b"), String("a\\\"b"));
+//   }
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct TestCase {
+  const char *name;
+  void (*fn)();
+};
+
+inline std::vector<TestCase> &testCases() {
+  static std::vector<TestCase> cases;
+  return cases;
+}
+
+inline int &testFailures() {
+  static int failures = 0;
+  return failures;
+}
+
+struct TestRegistrar {
+  TestRegistrar(const char *name, void (*fn)()) { testCases().push_back({name, fn}); }
+};
+
+#define TEST(name)                                          \
+  static void test_##name();                                \
+  static TestRegistrar testRegistrar_##name(#name, test_##name); \
+  static void test_##name()
+
+#define TEST_FAIL(...)                                      \
+  do {                                                      \
+    printf("  FAILED %s:%d: ", __FILE__, __LINE__);         \
+    printf(__VA_ARGS__);                                    \
+    printf("\n");                                           \
+    testFailures()++;                                       \
+  } while (0)
+
+#define CHECK(cond)                                         \
+  do {                                                      \
+    if (!(cond)) TEST_FAIL("%s", #cond);                    \
+  } while (0)
+
+// Values are compared with == and printed as strings through testText()
+#define CHECK_EQ(actual, expected)                          \
+  do {                                                      \
+    auto testActual_ = (actual);                            \
+    auto testExpected_ = (expected);                        \
+    if (!(testActual_ == testExpected_)) {                  \
+      TEST_FAIL("%s == %s: got \"%s\", expected \"%s\"", #actual, #expected, \
+                testText(testActual_).c_str(), testText(testExpected_).c_str()); \
+    }                                                       \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)             \
+  do {                                                      \
+    double testActual_ = (actual), testExpected_ = (expected); \
+    if (!(fabs(testActual_ - testExpected_) <= (tolerance))) { \
+      TEST_FAIL("%s: got %g, expected %g +- %g", #actual, testActual_, testExpected_, (double)(tolerance)); \
+    }                                                       \
+  } while (0)
+
+inline std::string testText(const std::string &v) { return v; }
+inline std::string testText(const char *v) { return v ? v : "(null)"; }
+template <class T>
+std::string testText(const T &v) { return std::to_string(v); }
+
+#ifdef HOST_ARDUINO_H
+inline std::string testText(const String &v) { return v.c_str(); }
+#endif
+
+// Runs every TEST() in the file; pass a name to run only that case
+#define TEST_MAIN()                                         \
+  int main(int argc, char **argv) {                         \
+    int run = 0;                                            \
+    for (const TestCase &t : testCases()) {                 \
+      if (argc > 1 && strcmp(argv[1], t.name) != 0) continue; \
+      int before = testFailures();                          \
+      printf("[ RUN  ] %s\n", t.name);                      \
+      fflush(stdout);                                       \
+      t.fn();                                               \
+      printf("[ %s ] %s\n", testFailures() == before ? " OK " : "FAIL", t.name); \
+      run++;                                                \
+    }                                                       \
+    printf("%d tests, %d failed checks\n", run, testFailures()); \
+    return testFailures() == 0 && run > 0 ? 0 : 1;          \
+  }
+
+#endif // TEST_H
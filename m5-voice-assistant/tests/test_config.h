@@ -0,0 +1,86 @@
+#ifndef TEST_CONFIG_H
+#define TEST_CONFIG_H
+
+// Stands in for device_config.h, secrets.h and the globals of the main .ino
+// when common/ headers are built on the host. Endpoints point at 127.0.0.1 and
+// are plain variables, so a test can aim them at its mock server's port.
+
+#include <Arduino.h>
+
+// Feature flags (as on Core2, minus what needs the device)
+#define ENABLE_STT_STREAMING true
+#define ENABLE_SILENCE_TRIM true
+#define ENABLE_PAUSE_TRIM true
+#define STT_UPLOAD_CODEC ((UploadCodec)testUploadCodec)
+#define HTTP_POOL_SIZE 2
+#define ENABLE_TLS_RESUMPTION false   // No mbedTLS on the host, https:// is never used
+#define ENABLE_OWUI_SOCKET true
+#define ENABLE_MIC_PREPROCESS true
+#define CHAT_CONTEXT_BUDGET_BYTES 8192
+#define CHAT_CONTEXT_KEEP_TURNS 6
+#define ENABLE_CHAT_SUMMARY true
+#define ENABLE_CHAT_PERSIST true
+#define ENABLE_MIC_PREROLL true
+
+// Mic clean-up stages (AudioProfile.micPreprocess)
+#define MIC_DC 1
+#define MIC_HPF 2
+#define MIC_AGC 4
+
+// Memory (mem_alloc.h, media_arena.h): host heap only, Core2 arena budgets
+#define ENABLE_PSRAM_MEDIA true       // psramFound() is false on the host
+#define ENABLE_CAMERA false
+#define STICK_AUDIO_ARENA_BYTES 163840
+#define CORE_AUDIO_ARENA_BYTES 393216
+#define REPLAY_ARENA_BYTES 131072
+#define IMAGE_ARENA_BYTES 65536
+#define BODY_ARENA_BYTES 131072
+
+struct AudioProfile {
+  const char *name;
+  int sampleRate;
+  int recordSeconds;
+  const char *quality;
+  int preRollMs;
+  int micPreprocess;
+};
+
+static constexpr AudioProfile STICK_PROFILES[] = {
+  {"Standard", 8000, 5, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},
+  {"HQ Short", 16000, 3, "Excellent", 300, MIC_DC | MIC_HPF | MIC_AGC}
+};
+
+static constexpr AudioProfile CORE_PROFILES[] = {
+  {"HQ", 16000, 5, "Excellent", 500, MIC_DC | MIC_HPF | MIC_AGC},
+  {"Standard", 8000, 8, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC},
+  {"Long", 8000, 15, "Good", 500, MIC_DC | MIC_HPF | MIC_AGC}
+};
+
+// Secrets
+bool USE_OWUI_STT = false;
+const char *OWUI_BASE_URL = "http://127.0.0.1:8080";
+const char *LLM_API_KEY = "test-llm-key";
+const char *LLM_MODEL = "gpt-4o-mini";
+const char *STT_HOST = "127.0.0.1";
+int STT_PORT = 0;
+const char *STT_PATH = "/v1/audio/transcriptions";
+bool STT_USE_SSL = false;
+const char *STT_API_KEY = "test-stt-key";
+const char *STT_MODEL = "whisper-1";
+const bool USE_TTS = true;
+
+// Main .ino globals
+int SAMPLE_RATE = 16000;
+int RECORD_SECONDS = 5;
+int RECORD_SAMPLES = 16000 * 5;
+int PRE_ROLL_SAMPLES = 0;
+int MIC_PREPROCESS = 0;
+int16_t *audioBuffer = nullptr;
+bool isLargeDevice = true;
+int numProfiles = 3;
+const AudioProfile *deviceProfiles = CORE_PROFILES;
+uint8_t *lastTtsMp3 = nullptr;
+size_t lastTtsMp3Length = 0;
+int testUploadCodec = 1;              // UPLOAD_MULAW, as STT_UPLOAD_CODEC on Core2
+
+#endif // TEST_CONFIG_H
@@ -0,0 +1,31 @@
+#ifndef TEST_SIGNAL_H
+#define TEST_SIGNAL_H
+
+// Test audio for the codec and DSP tests and benchmarks: a sine, and a
+// speech-band signal (a gliding pitch with 20 harmonics under a syllable-rate
+// envelope) that exercises the whole level range like a voice does.
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+inline std::vector<int16_t> testTone(int sampleRate, float hz, float amplitude, int samples) {
+  std::vector<int16_t> pcm(samples);
+  for (int i = 0; i < samples; i++) pcm[i] = (int16_t)(amplitude * sin(2 * M_PI * hz * i / sampleRate));
+  return pcm;
+}
+
+inline std::vector<int16_t> testVoice(int sampleRate, int samples, float level) {
+  std::vector<int16_t> pcm(samples);
+  double phase = 0;
+  for (int i = 0; i < samples; i++) {
+    double t = (double)i / sampleRate;
+    phase += 2 * M_PI * (120 + 80 * sin(2 * M_PI * 0.7 * t)) / sampleRate;
+    double v = 0;
+    for (int k = 1; k <= 20; k++) v += sin(k * phase) / k;
+    pcm[i] = (int16_t)(level * (0.3 + 0.7 * fabs(sin(2 * M_PI * 2 * t))) * v / 2);
+  }
+  return pcm;
+}
+
+#endif // TEST_SIGNAL_H
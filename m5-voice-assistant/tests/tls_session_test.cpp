@@ -0,0 +1,113 @@
+// TLS session cache (common/tls_session.h) without a handshake: entries kept
+// across a reset, power-on garbage dropped by the checksum, the oldest entry
+// replaced by sequence, and sessions too big for an entry left out. The host
+// mbedTLS stub saves and loads sessions in its own format.
+
+#include "test_config.h"
+#include "../common/tls_session.h"
+
+#include "test.h"
+
+static mbedtls_ssl_session makeSession(uint8_t tag, size_t ticketLen = 200) {
+  mbedtls_ssl_session s;
+  mbedtls_ssl_session_init(&s);
+  s.id_len = 32;
+  memset(s.id, tag, sizeof(s.id));
+  memset(s.master, tag + 1, sizeof(s.master));
+  s.ticket_len = ticketLen;
+  return s;
+}
+
+static void store(uint8_t tag, const char *host, size_t ticketLen = 200) {
+  mbedtls_ssl_session s = makeSession(tag, ticketLen);
+  tlsSessionStore(s, host, 443);
+}
+
+// Master secret offered for host, 0 if nothing was offered
+static uint8_t offeredMaster(const char *host) {
+  mbedtls_ssl_context ssl = {};
+  uint8_t master[TLS_MASTER_LEN] = {0};
+  if (!tlsSessionOffer(&ssl, host, 443, master)) return 0;
+  CHECK(memcmp(ssl.session.master, master, TLS_MASTER_LEN) == 0);
+  return master[0];
+}
+
+static int validEntries() {
+  int n = 0;
+  for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++) n += tlsSessionValid(tlsSessionCache[i]) ? 1 : 0;
+  return n;
+}
+
+TEST(garbage_in_rtc_memory_is_dropped) {
+  // What RTC_NOINIT memory holds after power-on
+  uint8_t *raw = (uint8_t *)tlsSessionCache;
+  for (size_t i = 0; i < sizeof(tlsSessionCache); i++) raw[i] = (uint8_t)(i * 131 + 7);
+  tlsSessionCache[0].magic = TLS_SESSION_MAGIC; // Right magic, wrong checksum
+  tlsSessionSequence = 12345;
+
+  tlsSessionInit();
+  CHECK_EQ(validEntries(), 0);
+  CHECK_EQ(tlsSessionCache[0].magic, (uint32_t)0);
+  CHECK_EQ(tlsSessionSequence, (uint32_t)0);
+  CHECK_EQ(offeredMaster("owui.example"), 0);
+}
+
+TEST(cached_session_survives_a_reset) {
+  tlsSessionInit();
+  store(0x10, "owui.example");
+  CHECK_EQ(offeredMaster("owui.example"), 0x11);
+  CHECK_EQ(offeredMaster("stt.example"), 0);
+
+  tlsSessionInit(); // setup() after a software reset or deep sleep
+  CHECK_EQ(validEntries(), 1);
+  CHECK_EQ(offeredMaster("owui.example"), 0x11);
+  CHECK_EQ(tlsSessionSequence, (uint32_t)1);
+}
+
+TEST(changed_byte_fails_the_checksum) {
+  tlsSessionInit();
+  store(0x20, "owui.example");
+  TlsSessionEntry *e = tlsSessionFind("owui.example", 443);
+  CHECK(e != nullptr);
+  e->blob[40] ^= 0x01;
+
+  tlsSessionInit();
+  CHECK(tlsSessionFind("owui.example", 443) == nullptr);
+  CHECK_EQ(offeredMaster("owui.example"), 0);
+}
+
+TEST(oldest_entry_is_replaced_by_sequence) {
+  for (TlsSessionEntry &e : tlsSessionCache) e.magic = 0;
+  tlsSessionInit();
+  store(0x30, "a.example");
+  store(0x40, "b.example");
+  store(0x50, "a.example"); // Same host: rewritten in place, now the newest
+  CHECK_EQ(validEntries(), 2);
+  CHECK_EQ(offeredMaster("a.example"), 0x51);
+
+  store(0x60, "c.example"); // b is the oldest
+  CHECK_EQ(offeredMaster("b.example"), 0);
+  CHECK_EQ(offeredMaster("a.example"), 0x51);
+  CHECK_EQ(offeredMaster("c.example"), 0x61);
+  CHECK(tlsSessionFind("c.example", 443)->sequence > tlsSessionFind("a.example", 443)->sequence);
+}
+
+TEST(session_bigger_than_an_entry_is_not_cached) {
+  for (TlsSessionEntry &e : tlsSessionCache) e.magic = 0;
+  tlsSessionInit();
+  store(0x70, "a.example");
+  store(0x80, "a.example", TLS_SESSION_BLOB_MAX); // Plus the ID and master secret
+  CHECK_EQ(offeredMaster("a.example"), 0x71);     // Earlier session still offered
+
+  store(0x90, "b.example", TLS_SESSION_BLOB_MAX - HOST_SSL_SESSION_FIXED);
+  CHECK_EQ(offeredMaster("b.example"), 0x91);
+  CHECK_EQ(tlsSessionFind("b.example", 443)->length, (uint16_t)TLS_SESSION_BLOB_MAX);
+}
+
+TEST(long_host_name_is_not_cached) {
+  std::string host(TLS_SESSION_HOST_MAX, 'h');
+  store(0xA0, host.c_str());
+  CHECK(tlsSessionFind(host.c_str(), 443) == nullptr);
+}
+
+TEST_MAIN()
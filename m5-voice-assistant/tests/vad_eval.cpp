@@ -0,0 +1,184 @@
+// VAD evaluation: replays labelled WAV files through each VAD engine with the
+// recorder's stop-on-silence rule (vad_replay.h) and reports, per file and per
+// engine, onset, endpoint latency (stop minus the end of the last labelled
+// word) and false cutoffs (stopped before it).
+//
+//   ./vad_eval [--silence ms] [--limit s] [--rms n] file.wav...
+//   ./vad_eval [--write dir]
+//
+// Labels for file.wav are read from file.txt (Audacity: Export Labels), one
+// label per stretch of speech. Without files, a synthetic set is generated:
+// quiet room and office noise, normal and soft voices; --write saves it as
+// WAV and labels to listen to or to replay on their own.
+
+#include "test_config.h"
+#include "vad_replay.h"
+
+#include <string>
+#include <vector>
+
+struct EvalFile {
+  std::string name;
+  std::vector<int16_t> pcm;
+  int sampleRate;
+  std::vector<WavLabel> labels;
+};
+
+struct EvalTotals {
+  int files = 0;
+  int scored = 0;
+  int stopped = 0;
+  int cutoffs = 0;
+  int limits = 0;
+  long latencySum = 0;
+  int latencyMax = 0;
+  long recordedMs = 0;
+  long speechMs = 0;
+};
+
+// Room noise, voice level and pitch for the synthetic set
+struct Scene {
+  const char *name;
+  float noise;
+  float hum;
+  float level;
+  float f0;
+};
+
+static const Scene SCENES[] = {
+  {"quiet", 20, 0, 3000, 120},
+  {"quiet-soft", 20, 0, 450, 220},
+  {"office", 250, 150, 3000, 140},
+  {"office-soft", 250, 150, 1200, 200},
+  {"loud-office", 700, 300, 4000, 120},
+};
+
+#define EVAL_TAKES 3                     // Synthetic files per scene
+#define EVAL_SYNTH_MS 15000              // As long as the "Long" recording profile
+
+static std::vector<EvalFile> synthesize() {
+  std::vector<EvalFile> files;
+  uint32_t seed = 1;
+  for (const Scene &scene : SCENES) {
+    for (int take = 1; take <= EVAL_TAKES; take++) {
+      SpeechSynth s(SAMPLE_RATE, EVAL_SYNTH_MS, seed++);
+      s.noise(scene.noise);
+      if (scene.hum > 0) s.tone(100, scene.hum);
+      s.utterance(300 + s.rng() % 600, 3 + s.rng() % 6, scene.level, scene.f0);
+      files.push_back({std::string(scene.name) + "-" + std::to_string(take), s.pcm(), SAMPLE_RATE, s.labels});
+    }
+  }
+  return files;
+}
+
+static bool load(const char *path, EvalFile &file) {
+  file.name = path;
+  if (!wavRead(path, file.pcm, file.sampleRate)) {
+    fprintf(stderr, "%s: not a 16-bit PCM WAV file\n", path);
+    return false;
+  }
+  std::string labels = path;
+  size_t dot = labels.find_last_of('.');
+  labels = (dot == std::string::npos ? labels : labels.substr(0, dot)) + ".txt";
+  if (!wavReadLabels(labels.c_str(), file.labels)) fprintf(stderr, "%s: no labels, not scored\n", labels.c_str());
+  return true;
+}
+
+static void evaluate(const EvalFile &file, const VadEngine &engine, int limitMs, int silenceMs, int rmsThreshold,
+                     EvalTotals &totals) {
+  VadReplay r = vadReplay(engine, file.pcm, file.sampleRate, limitMs, silenceMs, rmsThreshold);
+  totals.files++;
+  totals.recordedMs += r.stopMs;
+  totals.stopped += r.silenceStop;
+  totals.limits += !r.silenceStop;
+
+  char onset[24] = "-";
+  if (r.firstSpeechMs >= 0) snprintf(onset, sizeof(onset), "%dms", r.firstSpeechMs);
+  printf("%-24s %-9s onset %7s  stop %6dms  ", file.name.c_str(), engine.name, onset, r.stopMs);
+  if (file.labels.empty()) {
+    printf("%s\n", r.silenceStop ? "silence" : "limit");
+    return;
+  }
+
+  int speechStart = file.labels.front().startMs;
+  int speechEnd = 0;
+  for (const WavLabel &l : file.labels) {
+    speechEnd = std::max(speechEnd, l.endMs);
+    totals.speechMs += l.endMs - l.startMs;
+  }
+  totals.scored++;
+  printf("speech %5d-%5dms  ", speechStart, speechEnd);
+  if (r.stopMs < speechEnd) {
+    totals.cutoffs++;
+    printf("CUTOFF, lost %dms\n", speechEnd - r.stopMs);
+  } else if (!r.silenceStop) {
+    printf("LIMIT, %dms past the speech\n", r.stopMs - speechEnd);
+  } else {
+    int latency = r.stopMs - speechEnd;
+    totals.latencySum += latency;
+    totals.latencyMax = std::max(totals.latencyMax, latency);
+    printf("latency %dms\n", latency);
+  }
+}
+
+static void summary(const VadEngine &engine, const EvalTotals &t) {
+  int ended = t.scored - t.cutoffs - t.limits;
+  printf("%-9s %d files: %d false cutoffs, %d ran to the limit, endpoint latency mean %ldms max %dms over %d, "
+         "recorded %.1fs for %.1fs of speech\n",
+         engine.name, t.files, t.cutoffs, t.limits, ended > 0 ? t.latencySum / ended : 0, t.latencyMax, ended,
+         t.recordedMs / 1000.0, t.speechMs / 1000.0);
+}
+
+int main(int argc, char **argv) {
+  int silenceMs = 1500;                  // VAD_SILENCE_DURATION
+  int limitMs = EVAL_SYNTH_MS;
+  int rmsThreshold = 500;                // VAD_SILENCE_THRESHOLD
+  const char *writeDir = nullptr;
+  std::vector<EvalFile> files;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--silence" && i + 1 < argc) {
+      silenceMs = atoi(argv[++i]);
+    } else if (arg == "--limit" && i + 1 < argc) {
+      limitMs = atoi(argv[++i]) * 1000;
+    } else if (arg == "--rms" && i + 1 < argc) {
+      rmsThreshold = atoi(argv[++i]);
+    } else if (arg == "--write" && i + 1 < argc) {
+      writeDir = argv[++i];
+    } else if (arg[0] == '-') {
+      fprintf(stderr, "usage: %s [--silence ms] [--limit s] [--rms n] [--write dir] [file.wav...]\n", argv[0]);
+      return 2;
+    } else {
+      EvalFile file;
+      if (!load(argv[i], file)) return 1;
+      files.push_back(file);
+    }
+  }
+
+  if (files.empty()) {
+    files = synthesize();
+    printf("Synthetic set: %d scenes x %d takes, %ds each\n", (int)(sizeof(SCENES) / sizeof(SCENES[0])), EVAL_TAKES,
+           EVAL_SYNTH_MS / 1000);
+    if (writeDir) {
+      for (const EvalFile &f : files) {
+        std::string base = std::string(writeDir) + "/" + f.name;
+        if (!wavWrite((base + ".wav").c_str(), f.pcm, f.sampleRate) ||
+            !wavWriteLabels((base + ".txt").c_str(), f.labels)) {
+          fprintf(stderr, "%s: can't write\n", base.c_str());
+          return 1;
+        }
+      }
+      printf("Written to %s\n", writeDir);
+    }
+  }
+  printf("Silence timeout %dms, limit %dms, RMS threshold %d\n\n", silenceMs, limitMs, rmsThreshold);
+
+  const VadEngine *engines[] = {&vadSpectral, &vadRms};
+  EvalTotals totals[2];
+  for (const EvalFile &f : files) {
+    for (int e = 0; e < 2; e++) evaluate(f, *engines[e], limitMs, silenceMs, rmsThreshold, totals[e]);
+  }
+  printf("\n");
+  for (int e = 0; e < 2; e++) summary(*engines[e], totals[e]);
+  return 0;
+}
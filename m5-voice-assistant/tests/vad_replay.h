@@ -0,0 +1,149 @@
+#ifndef VAD_REPLAY_H
+#define VAD_REPLAY_H
+
+// Runs common/vad.h over recorded audio the way recordAudio() (common/audio.h)
+// does on the device: mic blocks of MIC_CAPTURE_BLOCK_MS, the VAD fed after
+// each block, and the same rule for stopping on silence. Also a speech-like
+// test signal (voiced syllables and fricatives over room noise) with labels,
+// for when there are no recordings at hand.
+
+#include "../common/vad.h"
+
+#include "wav_file.h"
+
+#include <random>
+#include <vector>
+
+#define VAD_REPLAY_BLOCK_MS 32           // MIC_CAPTURE_BLOCK_MS
+#define VAD_REPLAY_CHECK_MS 1000         // No silence check in the first second
+
+struct VadReplay {
+  int stopMs;                 // Recording length when it stopped
+  bool silenceStop;           // Stopped on silence (not the limit or the end of the audio)
+  int firstSpeechMs;          // -1 if the VAD never heard speech
+  int lastSpeechMs;           // End of the last speech-like frame
+  int speechFrames;
+  int frames;
+};
+
+// Record pcm until the silence rule stops it, limitMs passes or the audio ends
+inline VadReplay vadReplay(const VadEngine &engine, const std::vector<int16_t> &pcm, int sampleRate, int limitMs,
+                           int silenceMs, int rmsThreshold) {
+  Vad vad;
+  vadBegin(vad, engine, sampleRate, rmsThreshold);
+  int blockSamples = sampleRate * VAD_REPLAY_BLOCK_MS / 1000;
+  int limitSamples = std::min((int)((int64_t)limitMs * sampleRate / 1000), (int)pcm.size());
+  int recorded = 0, vadPos = 0;
+  bool silenceStop = false;
+  while (recorded < limitSamples) {
+    recorded = std::min(recorded + blockSamples, (int)pcm.size());
+    vadPos = vadFeed(vad, pcm.data(), vadPos, recorded);
+    int recordedMs = (int)((int64_t)recorded * 1000 / sampleRate);
+    if (recordedMs >= VAD_REPLAY_CHECK_MS) {
+      int silentMs = vad.lastSpeechFrame >= 0 ? vadSilenceMs(vad) : recordedMs - VAD_REPLAY_CHECK_MS;
+      if (silentMs >= silenceMs) {
+        silenceStop = true;
+        break;
+      }
+    }
+  }
+  VadReplay r;
+  r.stopMs = (int)((int64_t)recorded * 1000 / sampleRate);
+  r.silenceStop = silenceStop;
+  r.firstSpeechMs = vad.firstSpeechFrame >= 0 ? vad.firstSpeechFrame * VAD_FRAME_MS : -1;
+  r.lastSpeechMs = vad.lastSpeechFrame >= 0 ? (vad.lastSpeechFrame + 1) * VAD_FRAME_MS : -1;
+  r.speechFrames = vad.speechFrames;
+  r.frames = vad.frames;
+  return r;
+}
+
+// ---- Speech-like test signal ----
+
+struct SpeechSynth {
+  int sampleRate;
+  std::vector<float> audio;
+  std::vector<WavLabel> labels;        // One per word
+  std::mt19937 rng;
+
+  SpeechSynth(int rate, int ms, uint32_t seed) : sampleRate(rate), audio((int64_t)rate * ms / 1000), rng(seed) {}
+
+  int at(int ms) const { return (int)((int64_t)ms * sampleRate / 1000); }
+
+  float uniform(float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); }
+
+  // White noise of the given RMS over [fromMs, toMs), the whole signal by default
+  void noise(float rms, int fromMs = 0, int toMs = -1) {
+    std::normal_distribution<float> gauss(0, rms);
+    int end = toMs < 0 ? (int)audio.size() : std::min(at(toMs), (int)audio.size());
+    for (int i = at(fromMs); i < end; i++) audio[i] += gauss(rng);
+  }
+
+  void tone(float hz, float amplitude, int fromMs = 0, int toMs = -1) {
+    int end = toMs < 0 ? (int)audio.size() : std::min(at(toMs), (int)audio.size());
+    for (int i = at(fromMs); i < end; i++) audio[i] += amplitude * sinf(2 * (float)M_PI * hz * i / sampleRate);
+  }
+
+  // A vowel: harmonics of f0 falling off at 6dB/octave, under a raised-sine envelope
+  void syllable(int fromMs, int ms, float level, float f0) {
+    int start = at(fromMs), n = at(ms);
+    int harmonics = (int)(3800 / f0);
+    float power = 0;
+    for (int k = 1; k <= harmonics; k++) power += 0.5f / (k * k);
+    float scale = level / sqrtf(power);
+    for (int i = 0; i < n && start + i < (int)audio.size(); i++) {
+      float t = (float)i / sampleRate;
+      float pitch = f0 * (1 + 0.05f * sinf(2 * (float)M_PI * 3 * t));   // A little intonation
+      float v = 0;
+      for (int k = 1; k <= harmonics; k++) v += sinf(2 * (float)M_PI * k * pitch * t) / k;
+      audio[start + i] += scale * v * sinf((float)M_PI * i / n);
+    }
+  }
+
+  // An "s": differentiated noise (mostly above 2kHz) with soft edges
+  void fricative(int fromMs, int ms, float level) {
+    std::normal_distribution<float> gauss(0, level / sqrtf(2));
+    int start = at(fromMs), n = at(ms);
+    float prev = 0;
+    for (int i = 0; i < n && start + i < (int)audio.size(); i++) {
+      float x = gauss(rng);
+      float edge = std::min(1.0f, std::min(i, n - i) / (0.02f * sampleRate));
+      audio[start + i] += (x - prev) * edge;
+      prev = x;
+    }
+  }
+
+  // A word of 1-3 syllables, sometimes starting with a fricative; returns its end
+  int word(int fromMs, float level, float f0) {
+    int t = fromMs;
+    if (rng() % 3 == 0) {
+      int ms = 60 + rng() % 60;
+      fricative(t, ms, level * 0.25f);
+      t += ms;
+    }
+    for (int s = 1 + rng() % 3; s > 0; s--) {
+      int ms = 110 + rng() % 110;
+      syllable(t, ms, level * uniform(0.6f, 1.0f), f0 * uniform(0.9f, 1.1f));
+      t += ms + 10 + rng() % 30;
+    }
+    labels.push_back({fromMs, t, "word"});
+    return t;
+  }
+
+  // Words with pauses between them (shorter than the silence timeout); returns the end
+  int utterance(int fromMs, int words, float level, float f0) {
+    int t = fromMs;
+    for (int w = 0; w < words; w++) {
+      if (w) t += 120 + rng() % 380;
+      t = word(t, level, f0);
+    }
+    return t;
+  }
+
+  std::vector<int16_t> pcm() const {
+    std::vector<int16_t> out(audio.size());
+    for (size_t i = 0; i < audio.size(); i++) out[i] = (int16_t)std::max(-32768.0f, std::min(32767.0f, audio[i]));
+    return out;
+  }
+};
+
+#endif // VAD_REPLAY_H
@@ -0,0 +1,236 @@
+// Voice activity detection (common/vad.h) on synthetic audio: onset and
+// hangover frame by frame, clicks, a changing noise floor, fricatives, the RMS
+// engine, and the recorder's stop-on-silence rule as vad_eval replays it.
+
+#include "test_config.h"
+#include "vad_replay.h"
+
+#include "test.h"
+
+#include <unistd.h>
+
+// Feed audio frame by frame: speech as 'S' or '.', and the engine's raw verdict
+struct VadTrace {
+  std::string speech;
+  std::string raw;
+};
+
+static VadTrace feed(Vad &v, const std::vector<int16_t> &pcm) {
+  VadTrace t;
+  for (int pos = 0; pos + v.frameSamples <= (int)pcm.size(); pos += v.frameSamples) {
+    vadFeed(v, pcm.data(), pos, pos + v.frameSamples);
+    t.speech += v.speech ? 'S' : '.';
+    t.raw += v.rawSpeech ? 'x' : '.';
+  }
+  return t;
+}
+
+static int frameMs(int frame) { return frame * VAD_FRAME_MS; }
+
+TEST(onset_needs_consecutive_speech_like_frames) {
+  SpeechSynth s(SAMPLE_RATE, 2000, 1);
+  s.noise(30);
+  s.tone(1000, 3000, frameMs(60), frameMs(61));     // One frame: a blip
+  s.tone(1000, 3000, frameMs(80), frameMs(82));     // Two frames: speech
+  Vad v;
+  vadBegin(v, vadSpectral, SAMPLE_RATE, 500);
+  VadTrace t = feed(v, s.pcm());
+
+  CHECK_EQ(t.raw.substr(60, 1), std::string("x"));
+  CHECK_EQ(t.speech.find('S'), (size_t)81);
+  CHECK_EQ(v.firstSpeechFrame, 80);                // The onset frame counts as speech
+  CHECK_EQ(v.segmentStartFrame, 80);
+  CHECK_EQ(v.lastSpeechFrame, 81);
+  CHECK_EQ(t.speech.find('.', 81), (size_t)(81 + VAD_HANGOVER_MS / VAD_FRAME_MS));
+}
+
+TEST(hangover_bridges_pauses_between_words) {
+  SpeechSynth s(SAMPLE_RATE, 3000, 2);
+  s.noise(30);
+  s.tone(500, 3000, frameMs(50), frameMs(70));
+  s.tone(500, 3000, frameMs(80), frameMs(100));     // 160ms pause: the same speech
+  s.tone(500, 3000, frameMs(140), frameMs(150));    // 640ms pause: a new stretch
+  Vad v;
+  vadBegin(v, vadSpectral, SAMPLE_RATE, 500);
+  std::vector<int16_t> pcm = s.pcm();
+  std::vector<int16_t> head(pcm.begin(), pcm.begin() + frameMs(120) * SAMPLE_RATE / 1000);
+  VadTrace t = feed(v, head);
+
+  CHECK_EQ(v.segmentStartFrame, 50);
+  CHECK_EQ(t.speech.substr(51, 114 - 51), std::string(114 - 51, 'S'));
+  CHECK_EQ(t.speech.substr(114), std::string(120 - 114, '.'));
+  CHECK_EQ(v.lastSpeechFrame, 99);
+  CHECK_EQ(vadSilenceMs(v), (119 - 99) * VAD_FRAME_MS);
+
+  vadFeed(v, pcm.data(), head.size(), pcm.size());
+  CHECK_EQ(v.firstSpeechFrame, 50);
+  CHECK_EQ(v.segmentStartFrame, 140);
+  CHECK_EQ(v.lastSpeechFrame, 149);
+}
+
+TEST(clicks_are_not_speech) {
+  SpeechSynth s(SAMPLE_RATE, 3000, 3);
+  s.noise(30);
+  for (int ms = 500; ms < 3000; ms += 300) s.audio[s.at(ms)] += 30000;
+  Vad v;
+  vadBegin(v, vadSpectral, SAMPLE_RATE, 500);
+  VadTrace t = feed(v, s.pcm());
+
+  CHECK_EQ(v.firstSpeechFrame, -1);
+  CHECK(t.raw.find("xx") == std::string::npos);
+}
+
+TEST(noise_floor_follows_the_room) {
+  SpeechSynth s(SAMPLE_RATE, 16000, 4);
+  s.noise(300, 0, 6000);
+  s.tone(100, 150);                                // Mains hum, mostly below the band
+  int spoken = s.utterance(2000, 4, 3000, 140);
+  s.noise(900, 6000, 12000);                       // Someone turns on a fan
+  s.noise(100, 12000);                             // ...and off again
+  s.utterance(14000, 2, 1500, 200);
+  Vad v;
+  vadBegin(v, vadSpectral, SAMPLE_RATE, 500);
+  std::vector<int16_t> pcm = s.pcm();
+  VadTrace t = feed(v, pcm);
+
+  // Steady noise isn't speech; the words over it are
+  CHECK_EQ(t.speech.substr(0, 2000 / VAD_FRAME_MS).find('S'), std::string::npos);
+  CHECK(v.firstSpeechFrame >= 0 && abs(frameMs(v.firstSpeechFrame) - 2000) < 100);
+  int after = spoken / VAD_FRAME_MS + VAD_HANGOVER_MS / VAD_FRAME_MS + 2;
+  CHECK_EQ(t.speech.substr(after, 6000 / VAD_FRAME_MS - after).find('S'), std::string::npos);
+
+  // A louder room is speech until the floor has crept up to it (10dB: a few seconds)
+  std::string fan = t.speech.substr(6000 / VAD_FRAME_MS, 6000 / VAD_FRAME_MS);
+  CHECK(fan.find_last_of('S') == std::string::npos || frameMs(fan.find_last_of('S')) < 5000);
+  CHECK(fan.substr(fan.size() - 1000 / VAD_FRAME_MS).find('S') == std::string::npos);
+
+  // A quieter one is learnt within a few frames, and quieter speech is heard
+  std::string quiet = t.speech.substr(12000 / VAD_FRAME_MS, 2000 / VAD_FRAME_MS);
+  CHECK_EQ(quiet.find('S'), std::string::npos);
+  CHECK(t.speech.substr(14000 / VAD_FRAME_MS).find('S') < (size_t)(100 / VAD_FRAME_MS));
+
+  Vad floor;
+  vadBegin(floor, vadSpectral, SAMPLE_RATE, 500);
+  vadFeed(floor, pcm.data(), 0, s.at(12300));
+  CHECK(floor.noiseFloor < 3 * floor.energy);
+}
+
+TEST(fricatives_count_where_low_tones_do_not) {
+  // After digital silence the floor is VAD_MIN_ENERGY; both sounds land between
+  // the two thresholds above it, and only the fricative's high ZCR makes it speech
+  const int from = 500, to = 700;
+  SpeechSynth hiss(SAMPLE_RATE, 800, 5), hum(SAMPLE_RATE, 800, 5);
+  hiss.fricative(from, to - from, 35);
+  hum.tone(300, 29, from, to);
+  Vad a, b;
+  vadBegin(a, vadSpectral, SAMPLE_RATE, 500);
+  vadBegin(b, vadSpectral, SAMPLE_RATE, 500);
+  std::vector<int16_t> pa = hiss.pcm(), pb = hum.pcm();
+  vadFeed(a, pa.data(), 0, hiss.at(from + 96));
+  vadFeed(b, pb.data(), 0, hum.at(from + 96));
+
+  CHECK_NEAR(a.noiseFloor, VAD_MIN_ENERGY, 5);           // Crept up a little during the sound
+  CHECK(a.energy > VAD_SNR_UNVOICED * VAD_MIN_ENERGY && a.energy < VAD_SNR_VOICED * VAD_MIN_ENERGY);
+  CHECK(b.energy > VAD_SNR_UNVOICED * VAD_MIN_ENERGY && b.energy < VAD_SNR_VOICED * VAD_MIN_ENERGY);
+  CHECK(a.zcr > VAD_ZCR_UNVOICED);
+  CHECK(b.zcr < VAD_ZCR_UNVOICED);
+  CHECK(a.speech);
+  CHECK(!b.speech && b.firstSpeechFrame < 0);
+}
+
+TEST(rms_engine_uses_the_threshold) {
+  SpeechSynth s(SAMPLE_RATE, 1000, 6);
+  s.tone(250, 650, 0, 480);                        // RMS 460
+  s.tone(250, 750, 480, 1000);                     // RMS 530
+  Vad v;
+  vadBegin(v, vadRms, SAMPLE_RATE, 500);
+  VadTrace t = feed(v, s.pcm());
+
+  CHECK_EQ(t.raw.substr(0, 30), std::string(30, '.'));
+  CHECK_EQ(t.raw.substr(30, 31), std::string(31, 'x'));
+  CHECK_EQ(v.firstSpeechFrame, 30);
+  CHECK_NEAR(sqrtf(v.energy), 750 / sqrtf(2), 1);
+}
+
+TEST(replay_stops_after_the_silence_timeout) {
+  SpeechSynth s(SAMPLE_RATE, 15000, 7);
+  s.noise(30);
+  int end = s.utterance(500, 5, 3000, 120);
+  VadReplay r = vadReplay(vadSpectral, s.pcm(), SAMPLE_RATE, 15000, 1500, 500);
+
+  CHECK(r.silenceStop);
+  CHECK(r.firstSpeechMs >= 500 - VAD_FRAME_MS && r.firstSpeechMs < 600);
+  CHECK(r.lastSpeechMs > end - 100 && r.lastSpeechMs <= end + VAD_FRAME_MS);
+  // The check runs once per mic block
+  CHECK(r.stopMs >= r.lastSpeechMs + 1500 && r.stopMs < r.lastSpeechMs + 1500 + VAD_REPLAY_BLOCK_MS + VAD_FRAME_MS);
+
+  // Nobody speaks: one second, then the silence timeout
+  SpeechSynth quiet(SAMPLE_RATE, 15000, 8);
+  quiet.noise(30);
+  r = vadReplay(vadSpectral, quiet.pcm(), SAMPLE_RATE, 15000, 1500, 500);
+  CHECK(r.silenceStop);
+  CHECK_EQ(r.firstSpeechMs, -1);
+  CHECK(r.stopMs >= 2500 && r.stopMs < 2500 + VAD_REPLAY_BLOCK_MS);
+}
+
+TEST(rms_engine_fails_where_spectral_does_not) {
+  // A noisy office keeps the RMS engine recording to the limit
+  SpeechSynth office(SAMPLE_RATE, 15000, 9);
+  office.noise(700);
+  int end = office.utterance(500, 4, 3000, 120);
+  VadReplay rms = vadReplay(vadRms, office.pcm(), SAMPLE_RATE, 15000, 1500, 500);
+  VadReplay spectral = vadReplay(vadSpectral, office.pcm(), SAMPLE_RATE, 15000, 1500, 500);
+  CHECK(!rms.silenceStop);
+  CHECK_EQ(rms.stopMs, 15000);
+  CHECK(spectral.silenceStop && spectral.stopMs > end && spectral.stopMs < end + 2000);
+
+  // A soft voice in a quiet room never reaches the threshold: cut off
+  SpeechSynth soft(SAMPLE_RATE, 15000, 10);
+  soft.noise(20);
+  end = soft.utterance(1500, 5, 400, 220);
+  rms = vadReplay(vadRms, soft.pcm(), SAMPLE_RATE, 15000, 1500, 500);
+  spectral = vadReplay(vadSpectral, soft.pcm(), SAMPLE_RATE, 15000, 1500, 500);
+  CHECK(rms.silenceStop && rms.stopMs < end);
+  CHECK(spectral.silenceStop && spectral.stopMs > end && spectral.stopMs < end + 2000);
+}
+
+TEST(wav_files_and_labels_round_trip) {
+  std::string base = std::string(P_tmpdir) + "/vad_test_" + std::to_string(getpid());
+  SpeechSynth s(SAMPLE_RATE, 1500, 11);
+  s.noise(100);
+  s.utterance(200, 2, 2000, 150);
+  std::vector<int16_t> pcm = s.pcm(), back;
+  int rate = 0;
+  CHECK(wavWrite((base + ".wav").c_str(), pcm, SAMPLE_RATE));
+  CHECK(wavWriteLabels((base + ".txt").c_str(), s.labels));
+  CHECK(wavRead((base + ".wav").c_str(), back, rate));
+  CHECK_EQ(rate, SAMPLE_RATE);
+  CHECK(back == pcm);
+  std::vector<WavLabel> labels;
+  CHECK(wavReadLabels((base + ".txt").c_str(), labels));
+  CHECK_EQ(labels.size(), s.labels.size());
+  for (size_t i = 0; i < labels.size() && i < s.labels.size(); i++) {
+    CHECK_EQ(labels[i].startMs, s.labels[i].startMs);
+    CHECK_EQ(labels[i].endMs, s.labels[i].endMs);
+  }
+
+  // Stereo, with a LIST chunk before the data, is mixed down
+  const uint8_t stereo[] = {
+    'R', 'I', 'F', 'F', 54, 0, 0, 0, 'W', 'A', 'V', 'E',
+    'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 2, 0, 0x80, 0x3E, 0, 0, 0, 0xFA, 0, 0, 4, 0, 16, 0,
+    'L', 'I', 'S', 'T', 3, 0, 0, 0, 'a', 'b', 'c', 0,
+    'd', 'a', 't', 'a', 8, 0, 0, 0, 100, 0, 200, 0, 0x9C, 0xFF, 0x38, 0xFF,
+  };
+  FILE *f = fopen((base + ".wav").c_str(), "wb");
+  fwrite(stereo, 1, sizeof(stereo), f);
+  fclose(f);
+  CHECK(wavRead((base + ".wav").c_str(), back, rate));
+  CHECK_EQ(rate, 16000);
+  CHECK(back == std::vector<int16_t>({150, -150}));
+  CHECK(!wavReadLabels((base + ".missing").c_str(), labels));
+
+  unlink((base + ".wav").c_str());
+  unlink((base + ".txt").c_str());
+}
+
+TEST_MAIN()
@@ -0,0 +1,112 @@
+#ifndef WAV_FILE_H
+#define WAV_FILE_H
+
+// 16-bit PCM WAV files and Audacity label tracks for the audio tests and
+// harnesses. Reading mixes any number of channels down to mono; writing is
+// mono. Labels are Audacity's "Export Labels" text: start<TAB>end<TAB>name per
+// line, in seconds.
+
+#include <algorithm>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+struct WavLabel {
+  int startMs;
+  int endMs;
+  std::string name;
+};
+
+static uint32_t wavLe32(const uint8_t *p) { return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24; }
+static uint16_t wavLe16(const uint8_t *p) { return p[0] | p[1] << 8; }
+
+inline bool wavRead(const char *path, std::vector<int16_t> &samples, int &sampleRate) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  std::vector<uint8_t> data;
+  uint8_t buf[4096];
+  for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) data.insert(data.end(), buf, buf + n);
+  fclose(f);
+  if (data.size() < 12 || memcmp(data.data(), "RIFF", 4) || memcmp(data.data() + 8, "WAVE", 4)) return false;
+
+  int channels = 0, bits = 0;
+  sampleRate = 0;
+  for (size_t pos = 12; pos + 8 <= data.size();) {
+    const uint8_t *chunk = data.data() + pos;
+    size_t size = wavLe32(chunk + 4);
+    size_t avail = std::min(size, data.size() - pos - 8);   // Streamed files may claim 0xFFFFFFFF
+    if (!memcmp(chunk, "fmt ", 4) && avail >= 16) {
+      uint16_t format = wavLe16(chunk + 8);
+      channels = wavLe16(chunk + 10);
+      sampleRate = wavLe32(chunk + 12);
+      bits = wavLe16(chunk + 22);
+      if (format != 1 && format != 0xFFFE) return false;   // PCM or WAVE_FORMAT_EXTENSIBLE
+    } else if (!memcmp(chunk, "data", 4)) {
+      if (channels <= 0 || bits != 16) return false;
+      size_t frames = avail / (2 * channels);
+      samples.resize(frames);
+      for (size_t i = 0; i < frames; i++) {
+        int sum = 0;
+        for (int c = 0; c < channels; c++) sum += (int16_t)wavLe16(chunk + 8 + (i * channels + c) * 2);
+        samples[i] = (int16_t)(sum / channels);
+      }
+      return true;
+    }
+    pos += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+inline bool wavWrite(const char *path, const std::vector<int16_t> &samples, int sampleRate) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  uint32_t dataBytes = samples.size() * 2;
+  uint8_t header[44];
+  auto le32 = [&](int at, uint32_t v) { for (int i = 0; i < 4; i++) header[at + i] = v >> (8 * i); };
+  auto le16 = [&](int at, uint16_t v) { header[at] = v; header[at + 1] = v >> 8; };
+  memcpy(header, "RIFF", 4);
+  le32(4, 36 + dataBytes);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  le32(16, 16);
+  le16(20, 1);                           // PCM
+  le16(22, 1);                           // Mono
+  le32(24, sampleRate);
+  le32(28, sampleRate * 2);
+  le16(32, 2);
+  le16(34, 16);
+  memcpy(header + 36, "data", 4);
+  le32(40, dataBytes);
+  bool ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+  for (int16_t s : samples) {
+    uint8_t le[2] = {(uint8_t)s, (uint8_t)((uint16_t)s >> 8)};
+    ok = ok && fwrite(le, 1, 2, f) == 2;
+  }
+  return fclose(f) == 0 && ok;
+}
+
+// Labels sorted as in the file; false if the file can't be opened
+inline bool wavReadLabels(const char *path, std::vector<WavLabel> &labels) {
+  FILE *f = fopen(path, "r");
+  if (!f) return false;
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    double start, end;
+    char name[256] = "";
+    int fields = sscanf(line, "%lf %lf %255[^\r\n]", &start, &end, name);
+    if (fields < 2) continue;            // Blank lines and Audacity's "\" spectral rows
+    labels.push_back({(int)(start * 1000 + 0.5), (int)(end * 1000 + 0.5), name});
+  }
+  fclose(f);
+  return true;
+}
+
+inline bool wavWriteLabels(const char *path, const std::vector<WavLabel> &labels) {
+  FILE *f = fopen(path, "w");
+  if (!f) return false;
+  for (const WavLabel &l : labels) fprintf(f, "%.6f\t%.6f\t%s\n", l.startMs / 1000.0, l.endMs / 1000.0, l.name.c_str());
+  return fclose(f) == 0;
+}
+
+#endif // WAV_FILE_H